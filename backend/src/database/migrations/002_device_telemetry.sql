@@ -0,0 +1,3 @@
+-- Latest health snapshot reported by each device (scheduler task timing,
+-- cache counters, ...). Overwritten on every upload that carries one.
+ALTER TABLE devices ADD COLUMN IF NOT EXISTS telemetry JSONB;
@@ -0,0 +1,3 @@
+-- Devices that evaluate their own alert rules report when a condition
+-- clears; the open alert is closed rather than left to expire.
+ALTER TABLE alerts ADD COLUMN IF NOT EXISTS resolved_at TIMESTAMP WITH TIME ZONE;
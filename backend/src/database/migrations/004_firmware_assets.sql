@@ -0,0 +1,14 @@
+-- Files shipped alongside a firmware release (alert audio clips). Devices
+-- fetch them into LittleFS before flashing the image.
+CREATE TABLE IF NOT EXISTS firmware_assets (
+    id UUID PRIMARY KEY DEFAULT uuid_generate_v4(),
+    firmware_id UUID REFERENCES firmware_binaries(id) ON DELETE CASCADE,
+    name VARCHAR(64) NOT NULL, -- File name on the device, e.g. 'tank_low.wav'
+    file_path TEXT NOT NULL,
+    file_size BIGINT,
+    checksum VARCHAR(255),
+    created_at TIMESTAMP WITH TIME ZONE DEFAULT CURRENT_TIMESTAMP,
+    UNIQUE(firmware_id, name)
+);
+
+CREATE INDEX IF NOT EXISTS idx_firmware_assets_firmware ON firmware_assets(firmware_id);
@@ -0,0 +1,18 @@
+-- Draws, refills and suspected leaks detected on the device, and the
+-- device's own daily counters. Days the device reported are not rebuilt
+-- from raw measurements by the nightly job.
+CREATE TABLE IF NOT EXISTS usage_events (
+    id UUID PRIMARY KEY DEFAULT uuid_generate_v4(),
+    device_id UUID REFERENCES devices(id) ON DELETE CASCADE,
+    type VARCHAR(20) NOT NULL, -- 'draw', 'refill', 'leak'
+    started_at TIMESTAMP WITH TIME ZONE NOT NULL,
+    duration_minutes INTEGER NOT NULL,
+    amount_l DECIMAL(10, 2) NOT NULL,
+    created_at TIMESTAMP WITH TIME ZONE DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE INDEX IF NOT EXISTS idx_usage_events_device_started ON usage_events(device_id, started_at DESC);
+
+ALTER TABLE daily_summaries ADD COLUMN IF NOT EXISTS refilled_l DECIMAL(10, 2) DEFAULT 0;
+ALTER TABLE daily_summaries ADD COLUMN IF NOT EXISTS draw_events INTEGER DEFAULT 0;
+ALTER TABLE daily_summaries ADD COLUMN IF NOT EXISTS device_reported BOOLEAN DEFAULT FALSE;
@@ -0,0 +1,6 @@
+-- Rollup records: one row stands for every reading of a report window.
+-- level_cm, volume_l, temperature_c and battery_v hold the window means;
+-- stats has min/max/first/last per quantity. NULL for raw readings.
+ALTER TABLE measurements ADD COLUMN IF NOT EXISTS sample_count INTEGER;
+ALTER TABLE measurements ADD COLUMN IF NOT EXISTS span_s INTEGER;
+ALTER TABLE measurements ADD COLUMN IF NOT EXISTS stats JSONB;
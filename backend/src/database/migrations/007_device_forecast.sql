@@ -0,0 +1,3 @@
+-- Latest flow and time-to-empty/full estimate from the device's own fit,
+-- replaced by every measurement upload (NULL while the device has none).
+ALTER TABLE devices ADD COLUMN IF NOT EXISTS forecast JSONB;
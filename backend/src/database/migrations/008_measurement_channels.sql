@@ -0,0 +1,4 @@
+-- Multi-tank devices (firmware SENSOR_CHANNELS > 1): every tank's reading,
+-- channel 0 first. level_cm and volume_l repeat channel 0. NULL for
+-- single-tank devices.
+ALTER TABLE measurements ADD COLUMN IF NOT EXISTS channels JSONB;
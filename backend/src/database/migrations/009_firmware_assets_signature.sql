@@ -0,0 +1,4 @@
+-- RSA signature (hex) of a release's asset list, from the firmware's
+-- `make sign-assets`. Devices built with a signing key only fetch assets
+-- when it verifies. NULL for unsigned releases.
+ALTER TABLE firmware_binaries ADD COLUMN IF NOT EXISTS assets_signature TEXT;
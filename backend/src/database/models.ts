@@ -27,10 +27,20 @@ export interface Device {
   firmware_version?: string;
   last_seen?: Date;
   status: 'online' | 'offline';
+  telemetry?: Record<string, unknown>; // Latest health snapshot from firmware
+  forecast?: DeviceForecast; // Latest flow/time-to-empty estimate from firmware
   created_at: Date;
   updated_at: Date;
 }
 
+export interface DeviceForecast {
+  flow_lpm: number; // Negative while draining
+  time_to_empty_min?: number;
+  time_to_full_min?: number;
+  basis?: 'flow' | 'daily'; // Time to empty from the current draw, or yesterday's usage
+  reported_at: string;
+}
+
 export interface Measurement {
   id: string;
   device_id: string;
@@ -40,9 +50,29 @@ export interface Measurement {
   temperature_c?: number;
   battery_v?: number;
   rssi?: number;
+  // Rollup records only: readings summarized, their time span, and
+  // min/max/first/last per quantity
+  sample_count?: number;
+  span_s?: number;
+  stats?: Record<string, RollupStat>;
+  // Multi-tank devices only: every tank, channel 0 first
+  channels?: TankChannelReading[];
   created_at: Date;
 }
 
+export interface TankChannelReading {
+  level_cm: number;
+  volume_l: number;
+  percent?: number;
+}
+
+export interface RollupStat {
+  min: number;
+  max: number;
+  first: number;
+  last: number;
+}
+
 export interface DailySummary {
   id: string;
   device_id: string;
@@ -53,10 +83,23 @@ export interface DailySummary {
   avg_volume_l?: number;
   refill_events: number;
   leak_suspected: boolean;
+  refilled_l?: number;
+  draw_events?: number;
+  device_reported: boolean;
   created_at: Date;
   updated_at: Date;
 }
 
+export interface UsageEvent {
+  id: string;
+  device_id: string;
+  type: 'draw' | 'refill' | 'leak';
+  started_at: Date;
+  duration_minutes: number;
+  amount_l: number;
+  created_at: Date;
+}
+
 export interface Alert {
   id: string;
   device_id: string;
@@ -69,6 +112,7 @@ export interface Alert {
   acknowledged_by?: string;
   acknowledged_at?: Date;
   delivered_to_firebase: boolean;
+  resolved_at?: Date;
   created_at: Date;
 }
 
@@ -94,11 +138,22 @@ export interface FirmwareBinary {
   file_size?: number;
   checksum?: string;
   description?: string;
+  assets_signature?: string;
   is_active: boolean;
   rollout_percentage: number;
   created_at: Date;
 }
 
+export interface FirmwareAsset {
+  id: string;
+  firmware_id: string;
+  name: string;
+  file_path: string;
+  file_size?: number;
+  checksum?: string;
+  created_at: Date;
+}
+
 export interface UserDeviceMapping {
   id: string;
   user_id: string;
@@ -9,6 +9,7 @@ import { createDeviceToken } from '../middleware/deviceAuth.middleware';
 import { z } from 'zod';
 import { Device, FirmwareBinary } from '../database/models';
 import { getAuth } from '../config/firebase';
+import { requestPatch } from '../services/delta.service';
 
 const router = express.Router();
 
@@ -27,7 +28,8 @@ const storage = multer.diskStorage({
   },
   filename: (req, file, cb) => {
     const uniqueSuffix = Date.now() + '-' + Math.round(Math.random() * 1E9);
-    cb(null, `firmware-${uniqueSuffix}.bin`);
+    const extension = file.fieldname === 'assets' ? path.extname(file.originalname) : '.bin';
+    cb(null, `${file.fieldname}-${uniqueSuffix}${extension}`);
   },
 });
 
@@ -307,40 +309,103 @@ router.post('/devices/:deviceId/config', async (req: AuthRequest, res) => {
   }
 });
 
-// POST /api/v1/admin/firmware/upload - Upload firmware
-router.post('/firmware/upload', upload.single('firmware'), async (req: AuthRequest, res) => {
+// Release assets land in the device's audio directory (dashboard files,
+// named *.gz, in its web directory) under their original name, so keep
+// names to a single safe path component
+const ASSET_NAME = /^[A-Za-z0-9_.-]{1,31}$/;
+const MAX_ASSETS = 8;
+
+// RSA-2048 signature of the asset list, hex (firmware `make sign-assets`)
+const ASSETS_SIGNATURE = /^[0-9a-f]{512}$/;
+
+function sha256File(filePath: string): string {
+  return crypto.createHash('sha256').update(fs.readFileSync(filePath)).digest('hex');
+}
+
+// POST /api/v1/admin/firmware/upload - Upload firmware (plus optional assets)
+router.post('/firmware/upload', upload.fields([
+  { name: 'firmware', maxCount: 1 },
+  { name: 'assets', maxCount: MAX_ASSETS },
+]), async (req: AuthRequest, res) => {
+  const files = (req.files || {}) as { [field: string]: Express.Multer.File[] };
+  const assetFiles = files.assets || [];
+  const uploaded = [...(files.firmware || []), ...assetFiles];
+  const discardUploads = () => {
+    for (const file of uploaded) {
+      if (fs.existsSync(file.path)) {
+        fs.unlinkSync(file.path);
+      }
+    }
+  };
+
   try {
-    if (!req.file) {
+    const firmwareFile = files.firmware?.[0];
+    if (!firmwareFile) {
+      discardUploads();
       return res.status(400).json({ error: 'No file uploaded' });
     }
 
     const { version, description } = req.body;
+    const assetsSignature = req.body.assets_signature?.trim().toLowerCase() || null;
 
     if (!version) {
-      // Delete uploaded file
-      fs.unlinkSync(req.file.path);
+      discardUploads();
       return res.status(400).json({ error: 'Version is required' });
     }
 
+    const badAsset = assetFiles.find((file) => !ASSET_NAME.test(file.originalname));
+    if (badAsset) {
+      discardUploads();
+      return res.status(400).json({ error: `Invalid asset name: ${badAsset.originalname}` });
+    }
+
+    if (assetsSignature && (assetFiles.length === 0 || !ASSETS_SIGNATURE.test(assetsSignature))) {
+      discardUploads();
+      return res.status(400).json({ error: 'Invalid assets_signature' });
+    }
+
     // Calculate file checksum
-    const fileBuffer = fs.readFileSync(req.file.path);
-    const checksum = crypto.createHash('sha256').update(fileBuffer).digest('hex');
+    const checksum = sha256File(firmwareFile.path);
 
     // Insert firmware record
     const result = await query(
       `INSERT INTO firmware_binaries 
-       (version, file_path, file_size, checksum, description, is_active)
-       VALUES ($1, $2, $3, $4, $5, false)
+       (version, file_path, file_size, checksum, description, assets_signature, is_active)
+       VALUES ($1, $2, $3, $4, $5, $6, false)
        RETURNING *`,
       [
         version,
-        req.file.path,
-        req.file.size,
+        firmwareFile.path,
+        firmwareFile.size,
         checksum,
         description || null,
+        assetsSignature,
       ]
     );
 
+    const assets = [];
+    for (const file of assetFiles) {
+      const assetResult = await query(
+        `INSERT INTO firmware_assets (firmware_id, name, file_path, file_size, checksum)
+         VALUES ($1, $2, $3, $4, $5)
+         RETURNING id, name, file_size, checksum`,
+        [result.rows[0].id, file.originalname, file.path, file.size, sha256File(file.path)]
+      );
+      assets.push(assetResult.rows[0]);
+    }
+
+    // Patches from the versions devices run now, so most are ready by the
+    // time the release is assigned
+    const baseResult = await query(
+      `SELECT DISTINCT fb.id, fb.file_path FROM firmware_binaries fb
+       INNER JOIN devices d ON d.firmware_version = fb.version
+       WHERE fb.id <> $1`,
+      [result.rows[0].id]
+    );
+    for (const base of baseResult.rows) {
+      requestPatch(base, result.rows[0]);
+    }
+
     res.json({
       success: true,
       firmware: {
@@ -349,13 +414,12 @@ router.post('/firmware/upload', upload.single('firmware'), async (req: AuthReque
         file_size: result.rows[0].file_size,
         checksum: result.rows[0].checksum,
         description: result.rows[0].description,
+        assets,
       },
     });
   } catch (error: any) {
     console.error('Error uploading firmware:', error);
-    if (req.file && fs.existsSync(req.file.path)) {
-      fs.unlinkSync(req.file.path);
-    }
+    discardUploads();
     res.status(500).json({ error: 'Failed to upload firmware' });
   }
 });
@@ -2,23 +2,290 @@ import express from 'express';
 import { authenticateDevice, DeviceAuthRequest } from '../middleware/deviceAuth.middleware';
 import { query } from '../config/database';
 import { z } from 'zod';
-import { processAlertsForMeasurement } from '../services/alert.service';
+import { processAlertsForMeasurement, processDeviceAlertEvent } from '../services/alert.service';
+import { getPatch } from '../services/delta.service';
+import { recordDeviceUsage } from '../services/aggregation.service';
+import { Device } from '../database/models';
 import * as fs from 'fs';
 
 const router = express.Router();
 
+// Device health (scheduler task stats, cache counters, ...) sent with
+// uploads; the latest copy is kept on the device row
+const telemetrySchema = z.record(z.unknown());
+
+// Window statistics of a rollup record (firmware ROLLUP_ENABLED); the
+// record's own values are the window means
+const rollupStatSchema = z.object({
+  min: z.number(),
+  max: z.number(),
+  first: z.number(),
+  last: z.number(),
+});
+
+const rollupSchema = z.object({
+  samples: z.number().int().positive(),
+  span_s: z.number().int().nonnegative(),
+  level_cm: rollupStatSchema,
+  temperature_c: rollupStatSchema.optional(),
+  battery_v: rollupStatSchema.optional(),
+});
+
+// Every tank of a multi-tank device, by sensor channel (channel 0 is the
+// record's own level_cm/volume_l)
+const channelsSchema = z.array(z.object({
+  level_cm: z.number(),
+  volume_l: z.number(),
+  percent: z.number().optional(),
+})).min(1).max(8);
+
+// Flow and time to empty/full from the device's fit of recent levels.
+// basis tells whether time to empty follows the current draw or
+// yesterday's usage.
+const forecastSchema = z.object({
+  flow_lpm: z.number(),
+  time_to_empty_min: z.number().nonnegative().optional(),
+  time_to_full_min: z.number().nonnegative().optional(),
+  basis: z.enum(['flow', 'daily']).optional(),
+});
+
+// Draws, refills and suspected leaks found by the device, plus its daily
+// totals (today so far, and yesterday's final ones until acknowledged)
+const usageSchema = z.object({
+  events: z.array(z.object({
+    type: z.enum(['draw', 'refill', 'leak']),
+    age_ms: z.number().int().nonnegative(),
+    timestamp: z.number().optional(),
+    minutes: z.number().int().nonnegative(),
+    amount_l: z.number(),
+  })).max(10).optional(),
+  days: z.array(z.object({
+    date: z.string().regex(/^\d{4}-\d{2}-\d{2}$/),
+    used_l: z.number().nonnegative(),
+    refilled_l: z.number().nonnegative(),
+    refills: z.number().int().nonnegative(),
+    draws: z.number().int().nonnegative(),
+    leak: z.boolean(),
+  })).max(2).optional(),
+});
+
 // Validation schema for measurement data
 const measurementSchema = z.object({
   device_id: z.string(),
   firmware_version: z.string().optional(),
+  // Unix seconds from the device clock, once it has synced over SNTP
   timestamp: z.number().optional(),
   level_cm: z.number(),
   volume_l: z.number(),
   temperature_c: z.number().optional(),
   battery_v: z.number().optional(),
   rssi: z.number().optional(),
+  rollup: rollupSchema.optional(),
+  channels: channelsSchema.optional(),
+  telemetry: telemetrySchema.optional(),
+  usage: usageSchema.optional(),
+  forecast: forecastSchema.optional(),
+  // Set by firmware that evaluates alert rules itself and posts transitions
+  // to /alerts; the server then skips its own threshold checks
+  device_alerts: z.boolean().optional(),
+});
+
+// Batched upload: samples collected while the device radio was off.
+// age_ms is how long before the upload each sample was taken; timestamp
+// (Unix seconds) is added once the device clock is synced and wins.
+const MAX_BATCH_SIZE = 100;
+
+const batchMeasurementSchema = z.object({
+  age_ms: z.number().int().nonnegative(),
+  timestamp: z.number().optional(),
+  level_cm: z.number(),
+  volume_l: z.number(),
+  temperature_c: z.number().optional(),
+  battery_v: z.number().optional(),
+  rssi: z.number().optional(),
+  rollup: rollupSchema.optional(),
+  channels: channelsSchema.optional(),
+});
+
+const batchSchema = z.object({
+  device_id: z.string(),
+  firmware_version: z.string().optional(),
+  measurements: z.array(batchMeasurementSchema).min(1).max(MAX_BATCH_SIZE),
+  telemetry: telemetrySchema.optional(),
+  usage: usageSchema.optional(),
+  forecast: forecastSchema.optional(),
+  device_alerts: z.boolean().optional(),
 });
 
+// Readings a gateway collected from leaf devices over ESP-NOW, grouped
+// by leaf. Leaves never talk to the server themselves; age_ms is how long
+// before the upload each reading was taken.
+const MAX_RELAY_NODES = 16;
+
+const relaySchema = z.object({
+  device_id: z.string(),
+  firmware_version: z.string().optional(),
+  nodes: z.array(z.object({
+    device_id: z.string(),
+    measurements: z.array(batchMeasurementSchema).min(1).max(MAX_BATCH_SIZE),
+  })).min(1).max(MAX_RELAY_NODES),
+});
+
+// Alert transitions from the device rule engine. age_ms is how long
+// before the upload the transition happened.
+const alertEventsSchema = z.object({
+  device_id: z.string(),
+  events: z.array(z.object({
+    type: z.enum(['tank_full', 'tank_low', 'battery_low']),
+    state: z.enum(['raised', 'cleared']),
+    value: z.number(),
+    age_ms: z.number().int().nonnegative(),
+  })).min(1).max(10),
+});
+
+// Update device last_seen, status, reported firmware version and telemetry
+// forecast: undefined keeps the stored one, null clears it (the device
+// had no settled estimate)
+async function markDeviceSeen(
+  deviceId: string,
+  firmwareVersion?: string,
+  telemetry?: Record<string, unknown>,
+  forecast?: z.infer<typeof forecastSchema> | null
+): Promise<void> {
+  await query(
+    `UPDATE devices 
+     SET last_seen = NOW(), 
+         status = 'online',
+         firmware_version = COALESCE($1, firmware_version),
+         telemetry = COALESCE($3, telemetry),
+         forecast = CASE WHEN $4 THEN $5::jsonb ELSE forecast END,
+         updated_at = NOW()
+     WHERE id = $2`,
+    [
+      firmwareVersion,
+      deviceId,
+      telemetry ? JSON.stringify(telemetry) : null,
+      forecast !== undefined,
+      forecast ? JSON.stringify({ ...forecast, reported_at: new Date().toISOString() }) : null,
+    ]
+  );
+}
+
+// Device config as sent to firmware. DECIMAL columns come back from pg as
+// strings; the firmware only accepts numbers.
+function deviceConfigPayload(config: any): any {
+  const toNumber = (value: any) => (value === null || value === undefined ? undefined : Number(value));
+  return {
+    measurement_interval_ms: toNumber(config.measurement_interval_ms),
+    report_interval_ms: toNumber(config.report_interval_ms),
+    tank_full_threshold_l: toNumber(config.tank_full_threshold_l),
+    tank_low_threshold_l: toNumber(config.tank_low_threshold_l),
+    battery_low_threshold_v: toNumber(config.battery_low_threshold_v),
+    level_empty_cm: toNumber(config.level_empty_cm),
+    level_full_cm: toNumber(config.level_full_cm),
+    ...(config.config_json || {}),
+  };
+}
+
+// Config and pending firmware piggybacked on measurement responses
+async function buildDeviceUpdates(deviceId: string, firmwareVersion?: string): Promise<any> {
+  const updates: any = {};
+
+  // Get device config to return (if any updates)
+  const configResult = await query(
+    'SELECT * FROM device_configs WHERE device_id = $1',
+    [deviceId]
+  );
+
+  // Include config if available
+  if (configResult.rows.length > 0) {
+    updates.config = deviceConfigPayload(configResult.rows[0]);
+  }
+
+  // Advertise pending firmware so devices only open an OTA connection
+  // when there is something to download
+  const otaResult = await query(
+    `SELECT fb.version FROM firmware_binaries fb
+     INNER JOIN device_firmware_assignments dfa ON dfa.firmware_id = fb.id
+     WHERE dfa.device_id = $1 
+     AND dfa.status = 'pending'
+     AND fb.is_active = true
+     ORDER BY fb.created_at DESC
+     LIMIT 1`,
+    [deviceId]
+  );
+
+  if (otaResult.rows.length > 0 && otaResult.rows[0].version !== firmwareVersion) {
+    updates.ota = otaResult.rows[0].version;
+  }
+
+  return updates;
+}
+
+// Device clock readings are used when plausible: after 2020 (older
+// firmware sent uptime in ms here) and not ahead of the server
+const MIN_DEVICE_EPOCH = 1577836800;
+const MAX_CLOCK_AHEAD_S = 300;
+
+function deviceTimestamp(timestamp?: number): number | null {
+  if (timestamp === undefined || timestamp < MIN_DEVICE_EPOCH) {
+    return null;
+  }
+  return timestamp <= Date.now() / 1000 + MAX_CLOCK_AHEAD_S ? timestamp : null;
+}
+
+// sample_count, span_s and stats columns of a rollup record (all null for
+// a raw reading)
+function rollupColumns(rollup?: z.infer<typeof rollupSchema>): any[] {
+  if (!rollup) {
+    return [null, null, null];
+  }
+  const { samples, span_s, ...stats } = rollup;
+  return [samples, span_s, JSON.stringify(stats)];
+}
+
+// One multi-row insert; timestamps come from the device clock, or are
+// reconstructed from sample age
+async function insertMeasurements(
+  deviceId: string,
+  measurements: z.infer<typeof batchMeasurementSchema>[]
+): Promise<any[]> {
+  const values: any[] = [deviceId];
+  const rows = measurements.map((m) => {
+    const base = values.length;
+    values.push(m.age_ms, m.level_cm, m.volume_l, m.temperature_c ?? null, m.battery_v ?? null, m.rssi ?? null,
+      deviceTimestamp(m.timestamp), ...rollupColumns(m.rollup), m.channels ? JSON.stringify(m.channels) : null);
+    return `($1, COALESCE(to_timestamp($${base + 7}), NOW() - ($${base + 1} * INTERVAL '1 millisecond')), $${base + 2}, $${base + 3}, $${base + 4}, $${base + 5}, $${base + 6}, $${base + 8}, $${base + 9}, $${base + 10}, $${base + 11})`;
+  });
+
+  const result = await query(
+    `INSERT INTO measurements 
+     (device_id, timestamp, level_cm, volume_l, temperature_c, battery_v, rssi, sample_count, span_s, stats, channels)
+     VALUES ${rows.join(', ')}
+     RETURNING *`,
+    values
+  );
+  return result.rows;
+}
+
+// Alerts reflect the current tank state: evaluate the newest row only
+function processLatestAlerts(deviceId: string, rows: any[]) {
+  const latest = rows.reduce((a: any, b: any) => (a.timestamp > b.timestamp ? a : b));
+  processAlertsForMeasurement(deviceId, latest).catch(err => {
+    console.error('Error processing alerts:', err);
+  });
+}
+
+async function saveDeviceUsage(device: Device, usage?: z.infer<typeof usageSchema>) {
+  if (!usage) {
+    return;
+  }
+  await recordDeviceUsage(device.id, device.tenant_id, {
+    events: usage.events?.map((e) => ({ ...e, timestamp: deviceTimestamp(e.timestamp) })),
+    days: usage.days,
+  });
+}
+
 // POST /api/v1/measurements - Device sends sensor data
 router.post('/measurements', authenticateDevice, async (req: DeviceAuthRequest, res) => {
   try {
@@ -32,8 +299,8 @@ router.post('/measurements', authenticateDevice, async (req: DeviceAuthRequest,
     // Insert measurement
     const result = await query(
       `INSERT INTO measurements 
-       (device_id, timestamp, level_cm, volume_l, temperature_c, battery_v, rssi)
-       VALUES ($1, NOW(), $2, $3, $4, $5, $6)
+       (device_id, timestamp, level_cm, volume_l, temperature_c, battery_v, rssi, sample_count, span_s, stats, channels)
+       VALUES ($1, COALESCE(to_timestamp($7), NOW()), $2, $3, $4, $5, $6, $8, $9, $10, $11)
        RETURNING *`,
       [
         req.device.id,
@@ -42,50 +309,31 @@ router.post('/measurements', authenticateDevice, async (req: DeviceAuthRequest,
         validated.temperature_c || null,
         validated.battery_v || null,
         validated.rssi || null,
+        deviceTimestamp(validated.timestamp),
+        ...rollupColumns(validated.rollup),
+        validated.channels ? JSON.stringify(validated.channels) : null,
       ]
     );
 
-    // Update device last_seen and status
-    await query(
-      `UPDATE devices 
-       SET last_seen = NOW(), 
-           status = 'online',
-           firmware_version = COALESCE($1, firmware_version),
-           updated_at = NOW()
-       WHERE id = $2`,
-      [validated.firmware_version, req.device.id]
-    );
-
-    // Get device config to return (if any updates)
-    const configResult = await query(
-      'SELECT * FROM device_configs WHERE device_id = $1',
-      [req.device.id]
-    );
+    // Records replayed from the device's flash buffer are old; they leave
+    // the stored forecast alone
+    const buffered = req.get('X-Buffered') === 'true';
+    await markDeviceSeen(req.device.id, validated.firmware_version, validated.telemetry,
+      validated.forecast ?? (buffered ? undefined : null));
+    await saveDeviceUsage(req.device, validated.usage);
 
     const response: any = {
       success: true,
       measurement_id: result.rows[0].id,
+      ...(await buildDeviceUpdates(req.device.id, validated.firmware_version)),
     };
 
-    // Include config if available
-    if (configResult.rows.length > 0) {
-      const config = configResult.rows[0];
-      response.config = {
-        measurement_interval_ms: config.measurement_interval_ms,
-        report_interval_ms: config.report_interval_ms,
-        tank_full_threshold_l: config.tank_full_threshold_l,
-        tank_low_threshold_l: config.tank_low_threshold_l,
-        battery_low_threshold_v: config.battery_low_threshold_v,
-        level_empty_cm: config.level_empty_cm,
-        level_full_cm: config.level_full_cm,
-        ...(config.config_json || {}),
-      };
-    }
-
     // Process alerts asynchronously (don't wait for it)
-    processAlertsForMeasurement(req.device.id, result.rows[0]).catch(err => {
-      console.error('Error processing alerts:', err);
-    });
+    if (!validated.device_alerts) {
+      processAlertsForMeasurement(req.device.id, result.rows[0]).catch(err => {
+        console.error('Error processing alerts:', err);
+      });
+    }
 
     res.status(201).json(response);
   } catch (error: any) {
@@ -97,6 +345,119 @@ router.post('/measurements', authenticateDevice, async (req: DeviceAuthRequest,
   }
 });
 
+// POST /api/v1/measurements/batch - Device sends several samples in one session
+router.post('/measurements/batch', authenticateDevice, async (req: DeviceAuthRequest, res) => {
+  try {
+    const validated = batchSchema.parse(req.body);
+
+    if (!req.device) {
+      return res.status(401).json({ error: 'Device not authenticated' });
+    }
+
+    const rows = await insertMeasurements(req.device.id, validated.measurements);
+
+    await markDeviceSeen(req.device.id, validated.firmware_version, validated.telemetry, validated.forecast ?? null);
+    await saveDeviceUsage(req.device, validated.usage);
+
+    const response: any = {
+      success: true,
+      count: rows.length,
+      ...(await buildDeviceUpdates(req.device.id, validated.firmware_version)),
+    };
+
+    if (!validated.device_alerts) {
+      processLatestAlerts(req.device.id, rows);
+    }
+
+    res.status(201).json(response);
+  } catch (error: any) {
+    if (error instanceof z.ZodError) {
+      return res.status(400).json({ error: 'Invalid request data', details: error.errors });
+    }
+    console.error('Error processing measurement batch:', error);
+    res.status(500).json({ error: 'Failed to process measurement batch' });
+  }
+});
+
+// POST /api/v1/measurements/relay - Gateway forwards readings from its leaf devices
+router.post('/measurements/relay', authenticateDevice, async (req: DeviceAuthRequest, res) => {
+  try {
+    const validated = relaySchema.parse(req.body);
+
+    if (!req.device) {
+      return res.status(401).json({ error: 'Device not authenticated' });
+    }
+
+    // A gateway may only speak for devices of its own tenant
+    const leafResult = await query(
+      `SELECT * FROM devices WHERE device_id = ANY($1) AND tenant_id = $2`,
+      [validated.nodes.map((n) => n.device_id), req.device.tenant_id]
+    );
+    const leaves = new Map<string, Device>(leafResult.rows.map((d: Device) => [d.device_id, d]));
+
+    // Unknown leaves are reported back rather than failing the upload, so
+    // the gateway can drop their frames with the rest
+    let count = 0;
+    const rejected: string[] = [];
+    for (const node of validated.nodes) {
+      const leaf = leaves.get(node.device_id);
+      if (!leaf) {
+        rejected.push(node.device_id);
+        continue;
+      }
+
+      const rows = await insertMeasurements(leaf.id, node.measurements);
+      count += rows.length;
+      await markDeviceSeen(leaf.id);
+      processLatestAlerts(leaf.id, rows);
+    }
+
+    await markDeviceSeen(req.device.id, validated.firmware_version);
+
+    const response: any = {
+      success: true,
+      count,
+      rejected,
+      ...(await buildDeviceUpdates(req.device.id, validated.firmware_version)),
+    };
+
+    res.status(201).json(response);
+  } catch (error: any) {
+    if (error instanceof z.ZodError) {
+      return res.status(400).json({ error: 'Invalid request data', details: error.errors });
+    }
+    console.error('Error processing relay upload:', error);
+    res.status(500).json({ error: 'Failed to process relay upload' });
+  }
+});
+
+// POST /api/v1/alerts - Device reports alert transitions as they happen
+router.post('/alerts', authenticateDevice, async (req: DeviceAuthRequest, res) => {
+  try {
+    const validated = alertEventsSchema.parse(req.body);
+
+    if (!req.device) {
+      return res.status(401).json({ error: 'Device not authenticated' });
+    }
+
+    // Oldest first, so a raise and its clear resolve in order
+    const events = [...validated.events].sort((a, b) => b.age_ms - a.age_ms);
+    for (const event of events) {
+      await processDeviceAlertEvent(req.device.id, req.device.tenant_id, event);
+    }
+
+    await markDeviceSeen(req.device.id);
+
+    res.status(201).json({ success: true, count: events.length });
+  } catch (error: any) {
+    if (error instanceof z.ZodError) {
+      return res.status(400).json({ error: 'Invalid request data', details: error.errors });
+    }
+    console.error('Error processing alert events:', error);
+    res.status(500).json({ error: 'Failed to process alert events' });
+  }
+});
+
 // GET /api/v1/devices/:deviceId/config - Device pulls configuration
 router.get('/devices/:deviceId/config', authenticateDevice, async (req: DeviceAuthRequest, res) => {
   try {
@@ -120,17 +481,7 @@ router.get('/devices/:deviceId/config', authenticateDevice, async (req: DeviceAu
       });
     }
 
-    const config = configResult.rows[0];
-    res.json({
-      measurement_interval_ms: config.measurement_interval_ms,
-      report_interval_ms: config.report_interval_ms,
-      tank_full_threshold_l: config.tank_full_threshold_l,
-      tank_low_threshold_l: config.tank_low_threshold_l,
-      battery_low_threshold_v: config.battery_low_threshold_v,
-      level_empty_cm: config.level_empty_cm,
-      level_full_cm: config.level_full_cm,
-      ...(config.config_json || {}),
-    });
+    res.json(deviceConfigPayload(configResult.rows[0]));
   } catch (error: any) {
     console.error('Error fetching device config:', error);
     res.status(500).json({ error: 'Failed to fetch configuration' });
@@ -158,6 +509,14 @@ router.get('/devices/:deviceId/ota/latest', authenticateDevice, async (req: Devi
       [req.device.id]
     );
 
+    // Conditional check: the answer only changes with the assignment or the
+    // device's own version, so a matching ETag gets a bodyless 304
+    const etag = `"${assignmentResult.rows.length > 0 ? assignmentResult.rows[0].id : 'none'}-${currentVersion}"`;
+    res.setHeader('ETag', etag);
+    if (req.headers['if-none-match'] === etag) {
+      return res.status(304).end();
+    }
+
     if (assignmentResult.rows.length === 0) {
       return res.json({
         update_available: false,
@@ -173,14 +532,55 @@ router.get('/devices/:deviceId/ota/latest', authenticateDevice, async (req: Devi
       const baseUrl = process.env.API_BASE_URL || `http://localhost:${process.env.PORT || 3000}`;
       const downloadUrl = `${baseUrl}/api/v1/devices/${req.device.device_id}/ota/download/${firmware.id}`;
 
-      return res.json({
+      const response: any = {
         update_available: true,
         current_version: currentVersion,
         latest_version: firmware.version,
         download_url: downloadUrl,
         file_size: firmware.file_size,
         checksum: firmware.checksum,
-      });
+      };
+
+      // Files the device stores alongside the image (alert clips); it skips
+      // any whose checksum matches what it already has
+      const assetResult = await query(
+        'SELECT id, name, file_size, checksum FROM firmware_assets WHERE firmware_id = $1 ORDER BY name',
+        [firmware.id]
+      );
+      if (assetResult.rows.length > 0) {
+        const assetUrl = `${baseUrl}/api/v1/devices/${req.device.device_id}/ota/asset`;
+        response.assets = assetResult.rows.map((asset: any) => ({
+          name: asset.name,
+          url: `${assetUrl}/${asset.id}`,
+          size: Number(asset.file_size),
+          checksum: asset.checksum,
+        }));
+        if (firmware.assets_signature) {
+          response.assets_signature = firmware.assets_signature;
+        }
+      }
+
+      // Offer a delta patch when we still have the binary the device is running
+      // and the patch has been generated
+      const baseResult = await query(
+        'SELECT id, file_path FROM firmware_binaries WHERE version = $1',
+        [currentVersion]
+      );
+
+      if (baseResult.rows.length > 0) {
+        try {
+          const patchPath = getPatch(baseResult.rows[0], firmware);
+          if (patchPath) {
+            response.patch_url = `${baseUrl}/api/v1/devices/${req.device.device_id}/ota/patch/${firmware.id}/${baseResult.rows[0].id}`;
+            response.patch_size = fs.statSync(patchPath).size;
+          }
+        } catch (err) {
+          // Devices fall back to the full image
+          console.error('Error looking up delta patch:', err);
+        }
+      }
+
+      return res.json(response);
     }
 
     res.json({
@@ -252,5 +652,106 @@ router.get('/devices/:deviceId/ota/download/:firmwareId', authenticateDevice, as
   }
 });
 
+// GET /api/v1/devices/:deviceId/ota/asset/:assetId - Download release asset (device-authenticated)
+router.get('/devices/:deviceId/ota/asset/:assetId', authenticateDevice, async (req: DeviceAuthRequest, res) => {
+  try {
+    if (!req.device) {
+      return res.status(401).json({ error: 'Device not authenticated' });
+    }
+
+    // Assets are fetched before the image, but a device retrying after a
+    // failed flash may already have started the download
+    const assetResult = await query(
+      `SELECT fa.* FROM firmware_assets fa
+       INNER JOIN firmware_binaries fb ON fb.id = fa.firmware_id
+       INNER JOIN device_firmware_assignments dfa ON dfa.firmware_id = fb.id
+       WHERE dfa.device_id = $1
+       AND fa.id = $2
+       AND dfa.status IN ('pending', 'downloading')
+       AND fb.is_active = true`,
+      [req.device.id, req.params.assetId]
+    );
+
+    if (assetResult.rows.length === 0) {
+      return res.status(404).json({ error: 'Asset not found or not assigned to this device' });
+    }
+
+    const asset = assetResult.rows[0];
+
+    if (!fs.existsSync(asset.file_path)) {
+      return res.status(404).json({ error: 'Asset file not found on server' });
+    }
+
+    res.setHeader('Content-Type', 'application/octet-stream');
+    res.setHeader('Content-Disposition', `attachment; filename="${asset.name}"`);
+    res.setHeader('Content-Length', asset.file_size);
+    if (asset.checksum) {
+      res.setHeader('X-Asset-Checksum', asset.checksum);
+    }
+
+    fs.createReadStream(asset.file_path).pipe(res);
+  } catch (error: any) {
+    console.error('Error downloading asset:', error);
+    res.status(500).json({ error: 'Failed to download asset' });
+  }
+});
+
+// GET /api/v1/devices/:deviceId/ota/patch/:firmwareId/:baseId - Download delta patch (device-authenticated)
+router.get('/devices/:deviceId/ota/patch/:firmwareId/:baseId', authenticateDevice, async (req: DeviceAuthRequest, res) => {
+  try {
+    if (!req.device) {
+      return res.status(401).json({ error: 'Device not authenticated' });
+    }
+
+    const { firmwareId, baseId } = req.params;
+
+    // Verify the target firmware is assigned to this device
+    const assignmentResult = await query(
+      `SELECT fb.* FROM firmware_binaries fb
+       INNER JOIN device_firmware_assignments dfa ON dfa.firmware_id = fb.id
+       WHERE dfa.device_id = $1 
+       AND fb.id = $2
+       AND dfa.status = 'pending'
+       AND fb.is_active = true`,
+      [req.device.id, firmwareId]
+    );
+
+    if (assignmentResult.rows.length === 0) {
+      return res.status(404).json({ error: 'Firmware not found or not assigned to this device' });
+    }
+
+    const baseResult = await query(
+      'SELECT id, file_path FROM firmware_binaries WHERE id = $1',
+      [baseId]
+    );
+
+    if (baseResult.rows.length === 0) {
+      return res.status(404).json({ error: 'Base firmware not found' });
+    }
+
+    const patchPath = getPatch(baseResult.rows[0], assignmentResult.rows[0]);
+    if (!patchPath) {
+      return res.status(404).json({ error: 'No patch available for this base firmware' });
+    }
+
+    res.setHeader('Content-Type', 'application/octet-stream');
+    res.setHeader('Content-Length', fs.statSync(patchPath).size);
+
+    fs.createReadStream(patchPath).pipe(res);
+
+    await query(
+      `UPDATE device_firmware_assignments 
+       SET status = 'downloading', updated_at = NOW()
+       WHERE device_id = $1 AND firmware_id = $2`,
+      [req.device.id, firmwareId]
+    ).catch(err => {
+      console.error('Error updating assignment status:', err);
+    });
+  } catch (error: any) {
+    console.error('Error downloading delta patch:', error);
+    res.status(500).json({ error: 'Failed to download patch' });
+  }
+});
+
 export default router;
 
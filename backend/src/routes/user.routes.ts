@@ -233,7 +233,7 @@ router.get('/devices/:deviceId/current', validateDeviceAccess, async (req: AuthR
 
     // Get device UUID
     const deviceResult = await query(
-      'SELECT id FROM devices WHERE device_id = $1',
+      'SELECT id, forecast FROM devices WHERE device_id = $1',
       [deviceId]
     );
 
@@ -265,6 +265,9 @@ router.get('/devices/:deviceId/current', validateDeviceAccess, async (req: AuthR
       temperature_c: measurement.temperature_c ? parseFloat(measurement.temperature_c.toString()) : null,
       battery_v: measurement.battery_v ? parseFloat(measurement.battery_v.toString()) : null,
       rssi: measurement.rssi,
+      ...(measurement.channels ? { channels: measurement.channels } : {}),
+      // Flow and time to empty/full as last estimated by the device
+      forecast: deviceResult.rows[0].forecast || null,
     });
   } catch (error: any) {
     console.error('Error fetching current measurement:', error);
@@ -297,7 +300,7 @@ router.get('/devices/:deviceId/history', validateDeviceAccess, async (req: AuthR
 
     // Get measurements
     const measurementsResult = await query(
-      `SELECT timestamp, level_cm, volume_l, temperature_c, battery_v, rssi
+      `SELECT timestamp, level_cm, volume_l, temperature_c, battery_v, rssi, sample_count, span_s, stats, channels
        FROM measurements 
        WHERE device_id = $1 
        AND timestamp >= $2
@@ -315,6 +318,10 @@ router.get('/devices/:deviceId/history', validateDeviceAccess, async (req: AuthR
         temperature_c: m.temperature_c ? parseFloat(m.temperature_c.toString()) : null,
         battery_v: m.battery_v ? parseFloat(m.battery_v.toString()) : null,
         rssi: m.rssi,
+        // Rollup records: the values above are window means
+        ...(m.sample_count ? { sample_count: m.sample_count, span_s: m.span_s, stats: m.stats } : {}),
+        // Multi-tank devices: every tank, channel 0 first
+        ...(m.channels ? { channels: m.channels } : {}),
       })),
     });
   } catch (error: any) {
@@ -1,10 +1,72 @@
 import { query } from '../config/database';
+import { createLeakAlert } from './alert.service';
 
 interface MeasurementRow {
   volume_l: number;
   timestamp: Date;
 }
 
+// Usage found by the device's own tracker, sent with measurement uploads.
+// timestamp is already checked for plausibility (else null).
+export interface DeviceUsageReport {
+  events?: {
+    type: 'draw' | 'refill' | 'leak';
+    age_ms: number;
+    timestamp: number | null;
+    minutes: number;
+    amount_l: number;
+  }[];
+  days?: {
+    date: string;
+    used_l: number;
+    refilled_l: number;
+    refills: number;
+    draws: number;
+    leak: boolean;
+  }[];
+}
+
+export async function recordDeviceUsage(
+  deviceId: string,
+  tenantId: string,
+  usage: DeviceUsageReport
+): Promise<void> {
+  for (const event of usage.events || []) {
+    await query(
+      `INSERT INTO usage_events (device_id, type, started_at, duration_minutes, amount_l)
+       VALUES ($1, $2, COALESCE(to_timestamp($3), NOW() - ($4 * INTERVAL '1 millisecond')), $5, $6)`,
+      [deviceId, event.type, event.timestamp, event.age_ms, event.minutes, event.amount_l]
+    );
+
+    if (event.type === 'leak') {
+      await createLeakAlert(deviceId, tenantId, {
+        lost_l: event.amount_l,
+        minutes: event.minutes,
+        source: 'device',
+      });
+    }
+  }
+
+  // Running totals for today, final ones for yesterday; the latest wins
+  for (const day of usage.days || []) {
+    await query(
+      `INSERT INTO daily_summaries 
+       (device_id, date, total_usage_l, refilled_l, refill_events, draw_events, leak_suspected, device_reported)
+       VALUES ($1, $2, $3, $4, $5, $6, $7, true)
+       ON CONFLICT (device_id, date) 
+       DO UPDATE SET
+         total_usage_l = EXCLUDED.total_usage_l,
+         refilled_l = EXCLUDED.refilled_l,
+         refill_events = EXCLUDED.refill_events,
+         draw_events = EXCLUDED.draw_events,
+         leak_suspected = EXCLUDED.leak_suspected,
+         device_reported = true,
+         updated_at = NOW()`,
+      [deviceId, day.date, day.used_l, day.refilled_l, day.refills, day.draws, day.leak]
+    );
+  }
+}
+
 export async function aggregateDailySummaries(): Promise<void> {
   console.log('Starting daily aggregation...');
 
@@ -26,8 +88,36 @@ async function aggregateDeviceDailySummary(deviceId: string, deviceIdString: str
   yesterday.setHours(0, 0, 0, 0);
   const yesterdayEnd = new Date(yesterday);
   yesterdayEnd.setHours(23, 59, 59, 999);
+  const dateStr = yesterday.toISOString().split('T')[0];
+
+  // Devices that track usage themselves have already reported usage,
+  // refills and leaks; only the level statistics are filled in, in SQL
+  const reportedResult = await query(
+    `UPDATE daily_summaries ds
+     SET min_volume_l = s.min_volume,
+         max_volume_l = s.max_volume,
+         avg_volume_l = s.avg_volume,
+         updated_at = NOW()
+     FROM (
+       SELECT MIN(volume_l) AS min_volume, MAX(volume_l) AS max_volume, AVG(volume_l) AS avg_volume
+       FROM measurements
+       WHERE device_id = $1
+       AND timestamp >= $2
+       AND timestamp <= $3
+     ) s
+     WHERE ds.device_id = $1
+     AND ds.date = $4
+     AND ds.device_reported = true
+     RETURNING ds.total_usage_l`,
+    [deviceId, yesterday, yesterdayEnd, dateStr]
+  );
+
+  if (reportedResult.rows.length > 0) {
+    console.log(`Device ${deviceIdString} reported its own usage for ${dateStr}: ${reportedResult.rows[0].total_usage_l}L`);
+    return;
+  }
 
-  // Get all measurements for yesterday
+  // Older firmware: reconstruct usage from all of yesterday's measurements
   const measurementsResult = await query(
     `SELECT volume_l, timestamp 
      FROM measurements 
@@ -106,8 +196,6 @@ async function aggregateDeviceDailySummary(deviceId: string, deviceIdString: str
   }
 
   // Insert or update daily summary
-  const dateStr = yesterday.toISOString().split('T')[0];
-  
   await query(
     `INSERT INTO daily_summaries 
      (device_id, date, total_usage_l, min_volume_l, max_volume_l, avg_volume_l, refill_events, leak_suspected)
@@ -60,6 +60,48 @@ export async function processAlertsForMeasurement(deviceId: string, measurement:
   }
 }
 
+// Transition reported by a device that evaluates its own alert rules
+export interface DeviceAlertEvent {
+  type: 'tank_full' | 'tank_low' | 'battery_low';
+  state: 'raised' | 'cleared';
+  value: number;
+  age_ms: number;
+}
+
+const DEVICE_ALERTS: Record<DeviceAlertEvent['type'], { severity: Alert['severity']; message: (value: number) => string }> = {
+  tank_full: { severity: 'high', message: (v) => `Tank is full (${v.toFixed(1)}L)` },
+  tank_low: { severity: 'critical', message: (v) => `Tank is low (${v.toFixed(1)}L)` },
+  battery_low: { severity: 'medium', message: (v) => `Battery is low (${v.toFixed(2)}V)` },
+};
+
+export async function processDeviceAlertEvent(
+  deviceId: string,
+  tenantId: string,
+  event: DeviceAlertEvent
+): Promise<void> {
+  if (event.state === 'cleared') {
+    await query(
+      `UPDATE alerts 
+       SET resolved_at = NOW() - ($3 * INTERVAL '1 millisecond')
+       WHERE device_id = $1 
+       AND type = $2 
+       AND resolved_at IS NULL`,
+      [deviceId, event.type, event.age_ms]
+    );
+    return;
+  }
+
+  const alert = DEVICE_ALERTS[event.type];
+  await createAndSendAlert(
+    deviceId,
+    tenantId,
+    event.type,
+    alert.severity,
+    alert.message(event.value),
+    { value: event.value, age_ms: event.age_ms, source: 'device' }
+  );
+}
+
 export async function checkDeviceOfflineAlerts(): Promise<void> {
   console.log('Checking for offline devices...');
 
@@ -116,12 +158,13 @@ async function createAndSendAlert(
   message: string,
   payload: any
 ): Promise<void> {
-  // Check if similar alert already exists and is not acknowledged
+  // Check if similar alert already exists and is not acknowledged or resolved
   const existingAlertResult = await query(
     `SELECT id FROM alerts 
      WHERE device_id = $1 
      AND type = $2 
      AND acknowledged = false
+     AND resolved_at IS NULL
      AND created_at > NOW() - INTERVAL '1 hour'`,
     [deviceId, type]
   );
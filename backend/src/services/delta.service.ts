@@ -0,0 +1,384 @@
+import * as fs from 'fs';
+import * as path from 'path';
+import * as crypto from 'crypto';
+import * as zlib from 'zlib';
+import { Worker, isMainThread, workerData } from 'worker_threads';
+
+// WTD1 delta patch format - see firmware/src/modules/delta_patch.h.
+// Kept in step with firmware/scripts/delta_patch.py, which is the host-side
+// reference for generating and verifying patches.
+
+const MAGIC = Buffer.from('WTD1');
+const OP_END = 0x00;
+const OP_COPY = 0x01;
+const OP_INSERT = 0x02;
+
+const SEED_LEN = 8;
+const HASH_BITS = 20;
+const MAX_CANDIDATES = 16;
+const MIN_MATCH = 16;
+const FIX_COST = 3;
+const GIVE_UP = 32;
+
+// Only offer a patch when it saves a meaningful share of the download
+const MAX_PATCH_RATIO = parseFloat(process.env.OTA_MAX_PATCH_RATIO || '0.5');
+
+function seedHash(data: Buffer, pos: number): number {
+  let h = 0;
+  for (let i = pos; i < pos + SEED_LEN; i++) {
+    h = (Math.imul(h, 31) + data[i]) >>> 0;
+  }
+  return (h ^ (h >>> 15)) & ((1 << HASH_BITS) - 1);
+}
+
+function extend(oldBuf: Buffer, newBuf: Buffer, o: number, n: number): { length: number; score: number } {
+  const limit = Math.min(oldBuf.length - o, newBuf.length - n);
+  let score = 0;
+  let bestScore = 0;
+  let bestLen = 0;
+  for (let k = 0; k < limit; k++) {
+    if (oldBuf[o + k] === newBuf[n + k]) {
+      score++;
+      if (score > bestScore) {
+        bestScore = score;
+        bestLen = k + 1;
+      }
+    } else {
+      score -= FIX_COST;
+      if (score < bestScore - GIVE_UP) {
+        break;
+      }
+    }
+  }
+  return { length: bestLen, score: bestScore };
+}
+
+function writeVarint(out: number[], value: number): void {
+  while (value > 0x7f) {
+    out.push((value & 0x7f) | 0x80);
+    value = Math.floor(value / 128);
+  }
+  out.push(value);
+}
+
+function zigzag(value: number): number {
+  return value >= 0 ? value * 2 : -value * 2 - 1;
+}
+
+export function generatePatch(oldBuf: Buffer, newBuf: Buffer): Buffer {
+  const header = Buffer.alloc(44);
+  MAGIC.copy(header, 0);
+  header.writeUInt32LE(oldBuf.length, 4);
+  crypto.createHash('md5').update(oldBuf).digest().copy(header, 8);
+  header.writeUInt32LE(newBuf.length, 24);
+  crypto.createHash('md5').update(newBuf).digest().copy(header, 28);
+
+  const head = new Int32Array(1 << HASH_BITS).fill(-1);
+  const chain = new Int32Array(Math.max(oldBuf.length, 1)).fill(-1);
+  for (let pos = 0; pos + SEED_LEN <= oldBuf.length; pos++) {
+    const h = seedHash(oldBuf, pos);
+    chain[pos] = head[h];
+    head[h] = pos;
+  }
+
+  const ops: number[] = [];
+  const chunks: Buffer[] = [header];
+  const flushOps = () => {
+    if (ops.length > 0) {
+      chunks.push(Buffer.from(ops));
+      ops.length = 0;
+    }
+  };
+
+  let oldCursor = 0;
+  let literalStart = 0;
+  let i = 0;
+
+  const flushLiteral = (end: number) => {
+    if (end > literalStart) {
+      ops.push(OP_INSERT);
+      writeVarint(ops, end - literalStart);
+      flushOps();
+      chunks.push(newBuf.subarray(literalStart, end));
+    }
+  };
+
+  while (i < newBuf.length) {
+    let bestLen = 0;
+    let bestScore = 0;
+    let bestOff = 0;
+
+    // Continuing where the last copy ended wins most often in firmware
+    const candidates: number[] = oldCursor < oldBuf.length ? [oldCursor] : [];
+    if (i + SEED_LEN <= newBuf.length) {
+      let c = head[seedHash(newBuf, i)];
+      for (let tries = 0; c >= 0 && tries < MAX_CANDIDATES; tries++) {
+        candidates.push(c);
+        c = chain[c];
+      }
+    }
+
+    for (const o of candidates) {
+      const { length, score } = extend(oldBuf, newBuf, o, i);
+      if (score > bestScore) {
+        bestLen = length;
+        bestScore = score;
+        bestOff = o;
+      }
+    }
+
+    if (bestLen >= MIN_MATCH) {
+      flushLiteral(i);
+      const fixes: number[] = [];
+      for (let k = 0; k < bestLen; k++) {
+        if (oldBuf[bestOff + k] !== newBuf[i + k]) {
+          fixes.push(k);
+        }
+      }
+      ops.push(OP_COPY);
+      writeVarint(ops, zigzag(bestOff - oldCursor));
+      writeVarint(ops, bestLen);
+      writeVarint(ops, fixes.length);
+      let prev = 0;
+      for (const k of fixes) {
+        writeVarint(ops, k - prev);
+        ops.push(newBuf[i + k]);
+        prev = k;
+      }
+      oldCursor = bestOff + bestLen;
+      i += bestLen;
+      literalStart = i;
+    } else {
+      i++;
+    }
+  }
+
+  flushLiteral(newBuf.length);
+  ops.push(OP_END);
+  flushOps();
+
+  return Buffer.concat(chunks);
+}
+
+export function applyPatch(oldBuf: Buffer, patch: Buffer): Buffer {
+  let pos = 0;
+  const byte = (): number => {
+    if (pos >= patch.length) throw new Error('Truncated patch');
+    return patch[pos++];
+  };
+  const varint = (): number => {
+    let value = 0;
+    let mul = 1;
+    for (;;) {
+      const b = byte();
+      value += (b & 0x7f) * mul;
+      if (!(b & 0x80)) return value;
+      mul *= 128;
+    }
+  };
+
+  if (patch.length < 44 || !patch.subarray(0, 4).equals(MAGIC)) {
+    throw new Error('Bad patch header');
+  }
+  const oldSize = patch.readUInt32LE(4);
+  const oldMd5 = patch.subarray(8, 24);
+  const newSize = patch.readUInt32LE(24);
+  const newMd5 = patch.subarray(28, 44);
+  pos = 44;
+
+  if (oldSize !== oldBuf.length || !crypto.createHash('md5').update(oldBuf).digest().equals(oldMd5)) {
+    throw new Error('Patch does not match base image');
+  }
+
+  const out = Buffer.alloc(newSize);
+  let outPos = 0;
+  let oldCursor = 0;
+  for (;;) {
+    const op = byte();
+    if (op === OP_END) break;
+    if (op === OP_COPY) {
+      const z = varint();
+      const delta = z % 2 === 0 ? z / 2 : -(z + 1) / 2;
+      const length = varint();
+      const start = oldCursor + delta;
+      if (start < 0 || start + length > oldBuf.length || outPos + length > newSize) {
+        throw new Error('Copy outside image bounds');
+      }
+      oldBuf.copy(out, outPos, start, start + length);
+      let fixPos = 0;
+      for (let f = varint(); f > 0; f--) {
+        fixPos += varint();
+        if (fixPos >= length) throw new Error('Fixup outside copy range');
+        out[outPos + fixPos] = byte();
+      }
+      outPos += length;
+      oldCursor = start + length;
+    } else if (op === OP_INSERT) {
+      const length = varint();
+      if (pos + length > patch.length || outPos + length > newSize) {
+        throw new Error('Insert outside image bounds');
+      }
+      patch.copy(out, outPos, pos, pos + length);
+      pos += length;
+      outPos += length;
+    } else {
+      throw new Error(`Unknown patch op 0x${op.toString(16)}`);
+    }
+  }
+
+  if (outPos !== newSize || !crypto.createHash('md5').update(out).digest().equals(newMd5)) {
+    throw new Error('Reconstructed image does not match');
+  }
+  return out;
+}
+
+// Signed images end with [raw image sig][written image sig][u32 block length]
+// (see firmware/Makefile 'sign'). Patches reconstruct the raw image, so they
+// carry the raw signature as [patch][raw image sig][u32 block length].
+const SIGNATURE_SIZE = 256;
+const SIGNATURE_BLOCK_SIZE = 2 * SIGNATURE_SIZE;
+
+interface FirmwareImage {
+  image: Buffer;
+  rawSignature: Buffer | null;
+}
+
+// Firmware is stored as uploaded, usually gzip-compressed and signed. Patches
+// are always computed over the raw image the device actually runs.
+function loadImage(filePath: string): FirmwareImage {
+  let data = fs.readFileSync(filePath);
+  let rawSignature: Buffer | null = null;
+
+  const trailerSize = SIGNATURE_BLOCK_SIZE + 4;
+  if (data.length > trailerSize && data.readUInt32LE(data.length - 4) === SIGNATURE_BLOCK_SIZE) {
+    rawSignature = data.subarray(data.length - trailerSize, data.length - trailerSize + SIGNATURE_SIZE);
+    data = data.subarray(0, data.length - trailerSize);
+  }
+
+  if (data.length >= 2 && data[0] === 0x1f && data[1] === 0x8b) {
+    data = zlib.gunzipSync(data);
+  }
+  return { image: data, rawSignature };
+}
+
+interface FirmwareFile {
+  id: string;
+  file_path: string;
+}
+
+interface PatchJob {
+  fromPath: string;
+  toPath: string;
+  patchPath: string;
+  skipPath: string;
+  label: string;
+}
+
+function patchJob(from: FirmwareFile, to: FirmwareFile): PatchJob {
+  const patchDir = path.join(process.env.FIRMWARE_STORAGE_PATH || './storage/firmware', 'patches');
+  const patchPath = path.join(patchDir, `${from.id}-${to.id}.wtd`);
+  return {
+    fromPath: from.file_path,
+    toPath: to.file_path,
+    patchPath,
+    skipPath: `${patchPath}.skip`,
+    label: `${from.id} -> ${to.id}`,
+  };
+}
+
+// Runs in a worker thread: a patch takes seconds of CPU, which would stall
+// every request if done on the event loop
+function buildPatch(job: PatchJob): void {
+  const oldBuf = loadImage(job.fromPath).image;
+  const target = loadImage(job.toPath);
+  const newBuf = target.image;
+  const fullSize = fs.statSync(job.toPath).size;
+  let patch = generatePatch(oldBuf, newBuf);
+
+  fs.mkdirSync(path.dirname(job.patchPath), { recursive: true });
+
+  // Self-check before any device sees it, and remember unhelpful pairs
+  if (!applyPatch(oldBuf, patch).equals(newBuf) || patch.length > fullSize * MAX_PATCH_RATIO) {
+    fs.writeFileSync(job.skipPath, '');
+    return;
+  }
+
+  if (target.rawSignature) {
+    const blockLength = Buffer.alloc(4);
+    blockLength.writeUInt32LE(SIGNATURE_SIZE);
+    patch = Buffer.concat([patch, target.rawSignature, blockLength]);
+  }
+
+  // Renamed into place, so a request never sees a partial file
+  const tmpPath = `${job.patchPath}.tmp`;
+  fs.writeFileSync(tmpPath, patch);
+  fs.renameSync(tmpPath, job.patchPath);
+  console.log(`Generated delta patch ${job.label}: ${patch.length} bytes (full download ${fullSize} bytes)`);
+}
+
+// One worker at a time; a release rolling out asks for the same few pairs
+const patchQueue: PatchJob[] = [];
+const queuedPatches = new Set<string>();
+let patchWorkerBusy = false;
+
+function runNextPatch(): void {
+  const job = patchQueue.shift();
+  if (!job) {
+    patchWorkerBusy = false;
+    return;
+  }
+  patchWorkerBusy = true;
+
+  // Under ts-node (npm run dev) the worker needs the same TypeScript hook
+  const worker = new Worker(__filename, {
+    workerData: job,
+    execArgv: __filename.endsWith('.ts') ? ['--require', 'ts-node/register/transpile-only'] : [],
+  });
+  worker.on('error', (err) => {
+    // Not retried; devices keep getting the full image
+    console.error(`Error generating delta patch ${job.label}:`, err);
+    fs.mkdirSync(path.dirname(job.skipPath), { recursive: true });
+    fs.writeFileSync(job.skipPath, '');
+  });
+  worker.on('exit', () => {
+    queuedPatches.delete(job.patchPath);
+    runNextPatch();
+  });
+}
+
+/**
+ * Queue generation of the patch from one firmware binary to another,
+ * unless it exists, is known not to be worthwhile, or is already queued.
+ */
+export function requestPatch(from: FirmwareFile, to: FirmwareFile): void {
+  const job = patchJob(from, to);
+  if (queuedPatches.has(job.patchPath) || fs.existsSync(job.patchPath) || fs.existsSync(job.skipPath) ||
+      !fs.existsSync(job.fromPath) || !fs.existsSync(job.toPath)) {
+    return;
+  }
+
+  queuedPatches.add(job.patchPath);
+  patchQueue.push(job);
+  if (!patchWorkerBusy) {
+    runNextPatch();
+  }
+}
+
+/**
+ * Get the patch from one firmware binary to another. Returns the patch
+ * path, or null when there is none yet (generation is queued in the
+ * background; the device gets the full image meanwhile) or no worthwhile
+ * patch can be produced.
+ */
+export function getPatch(from: FirmwareFile, to: FirmwareFile): string | null {
+  const { patchPath } = patchJob(from, to);
+  if (fs.existsSync(patchPath)) {
+    return patchPath;
+  }
+  requestPatch(from, to);
+  return null;
+}
+
+if (!isMainThread && workerData?.patchPath) {
+  buildPatch(workerData as PatchJob);
+}
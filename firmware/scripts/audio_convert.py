@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""
+Audio Clip Converter for Water Tank Firmware
+
+Converts a PCM WAV (any rate, mono or stereo, 8/16/24/32-bit) into a clip
+the firmware streams from LittleFS (see src/modules/audio.h): mono, at a
+speaker-friendly rate, as 4-bit IMA-ADPCM (default, ~4 kB per second at
+8 kHz) or 8-bit PCM.
+
+Usage:
+    python3 audio_convert.py <in.wav> <out.wav> [--rate HZ] [--pcm8] [--seconds S]
+"""
+
+import argparse
+import os
+import struct
+import sys
+import wave
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+    796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+    7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500,
+    20350, 22385, 24623, 27086, 29794, 32767,
+]
+ADPCM_INDEX = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+# 256-byte blocks: 4-byte header (first sample, step index) + 252 bytes of
+# nibbles = 505 samples
+BLOCK_ALIGN = 256
+SAMPLES_PER_BLOCK = (BLOCK_ALIGN - 4) * 2 + 1
+
+
+def clamp(value, low, high):
+    return max(low, min(high, value))
+
+
+def read_mono(path):
+    """Samples as floats in [-1, 1), channels averaged."""
+    with wave.open(path, "rb") as w:
+        channels = w.getnchannels()
+        width = w.getsampwidth()
+        rate = w.getframerate()
+        frames = w.readframes(w.getnframes())
+
+    count = len(frames) // width
+    if width == 1:
+        values = [(b - 128) / 128.0 for b in frames]
+    else:
+        scale = float(1 << (8 * width - 1))
+        values = [int.from_bytes(frames[i * width:(i + 1) * width], "little", signed=True) / scale
+                  for i in range(count)]
+
+    mono = [sum(values[i:i + channels]) / channels for i in range(0, len(values), channels)]
+    return mono, rate
+
+
+def resample(samples, src_rate, dst_rate):
+    """Box-filter to the new rate, then linear interpolation."""
+    if src_rate == dst_rate:
+        return samples
+
+    ratio = src_rate / dst_rate
+    if ratio > 1:
+        # Average over one output period so content above the new Nyquist
+        # rate does not fold back as noise
+        width = int(ratio)
+        acc = 0.0
+        smoothed = []
+        for i, s in enumerate(samples):
+            acc += s
+            if i >= width:
+                acc -= samples[i - width]
+            smoothed.append(acc / min(i + 1, width))
+        samples = smoothed
+
+    out = []
+    pos = 0.0
+    while pos < len(samples) - 1:
+        i = int(pos)
+        frac = pos - i
+        out.append(samples[i] * (1 - frac) + samples[i + 1] * frac)
+        pos += ratio
+    return out
+
+
+def encode_adpcm(samples):
+    """IMA-ADPCM in WAV block layout, low nibble first."""
+    pcm = [clamp(int(round(s * 32767)), -32768, 32767) for s in samples]
+    count = len(pcm)
+    # Pad the last block with silence
+    pcm += [0] * ((-count) % SAMPLES_PER_BLOCK)
+
+    out = bytearray()
+    index = 0
+    for start in range(0, len(pcm), SAMPLES_PER_BLOCK):
+        block = pcm[start:start + SAMPLES_PER_BLOCK]
+        predictor = block[0]
+        out += struct.pack("<hBB", predictor, index, 0)
+
+        nibbles = []
+        for s in block[1:]:
+            step = ADPCM_STEPS[index]
+            diff = s - predictor
+            nibble = 0
+            if diff < 0:
+                nibble = 8
+                diff = -diff
+            delta = step >> 3
+            if diff >= step:
+                nibble |= 4
+                diff -= step
+                delta += step
+            if diff >= step >> 1:
+                nibble |= 2
+                diff -= step >> 1
+                delta += step >> 1
+            if diff >= step >> 2:
+                nibble |= 1
+                delta += step >> 2
+
+            predictor = clamp(predictor - delta if nibble & 8 else predictor + delta, -32768, 32767)
+            index = clamp(index + ADPCM_INDEX[nibble & 7], 0, 88)
+            nibbles.append(nibble)
+
+        for i in range(0, len(nibbles), 2):
+            out.append(nibbles[i] | (nibbles[i + 1] << 4))
+
+    return bytes(out), count
+
+
+def write_wav(path, fmt_chunk, data, fact_samples=None):
+    chunks = b"fmt " + struct.pack("<I", len(fmt_chunk)) + fmt_chunk
+    if fact_samples is not None:
+        chunks += b"fact" + struct.pack("<II", 4, fact_samples)
+    chunks += b"data" + struct.pack("<I", len(data)) + data
+    if len(data) & 1:
+        chunks += b"\0"
+
+    with open(path, "wb") as f:
+        f.write(b"RIFF" + struct.pack("<I", 4 + len(chunks)) + b"WAVE" + chunks)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Convert a WAV into a firmware audio clip")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    parser.add_argument("--rate", type=int, default=8000, help="output sample rate (default 8000)")
+    parser.add_argument("--pcm8", action="store_true", help="8-bit PCM instead of IMA-ADPCM")
+    parser.add_argument("--seconds", type=float, help="keep only the first S seconds")
+    args = parser.parse_args(argv[1:])
+
+    samples, rate = read_mono(args.input)
+    if args.seconds:
+        samples = samples[:int(args.seconds * rate)]
+    samples = resample(samples, rate, args.rate)
+
+    if args.pcm8:
+        data = bytes(clamp(int(round(s * 127)) + 128, 0, 255) for s in samples)
+        fmt_chunk = struct.pack("<HHIIHH", 1, 1, args.rate, args.rate, 1, 8)
+        write_wav(args.output, fmt_chunk, data)
+    else:
+        data, count = encode_adpcm(samples)
+        byte_rate = args.rate * BLOCK_ALIGN // SAMPLES_PER_BLOCK
+        fmt_chunk = struct.pack("<HHIIHHHH", 0x11, 1, args.rate, byte_rate, BLOCK_ALIGN, 4, 2,
+                                SAMPLES_PER_BLOCK)
+        write_wav(args.output, fmt_chunk, data, count)
+
+    seconds = len(samples) / args.rate
+    print("%s: %.2f s at %d Hz, %s, %d bytes" % (
+        args.output, seconds, args.rate, "PCM8" if args.pcm8 else "IMA-ADPCM", os.path.getsize(args.output)))
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except (OSError, ValueError, wave.Error) as e:
+        print("Error: %s" % e)
+        sys.exit(1)
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+"""
+Delta Patch Tool for Water Tank Firmware OTA
+
+Generates, applies and verifies WTD1 delta patches between two firmware
+images. The device applies these in streaming fashion (see
+src/modules/delta_patch.h for the format); the backend generates the
+same format on demand in src/services/delta.service.ts.
+
+Images may be raw, gzip-compressed (.bin.gz) or signed (.ota.bin);
+patches are always computed over the raw image.
+
+Usage:
+    python3 delta_patch.py diff   <old.bin> <new.bin> <out.patch>
+    python3 delta_patch.py apply  <old.bin> <in.patch> <out.bin>
+    python3 delta_patch.py verify <old.bin> <new.bin> <in.patch>
+"""
+
+import gzip
+import hashlib
+import struct
+import sys
+
+MAGIC = b"WTD1"
+HEADER_SIZE = 44
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+# Signed OTA images (make sign) end with two RSA-2048 signatures + length
+SIGNATURE_BLOCK_SIZE = 512
+
+# Matching parameters - these only affect patch size, any valid op stream
+# applies on the device
+SEED_LEN = 8            # Bytes hashed to find candidate matches
+HASH_BITS = 20
+MAX_CANDIDATES = 16     # Hash chain entries tried per position
+MIN_MATCH = 16          # Shortest copy worth emitting
+FIX_COST = 3            # Score penalty for a mismatched byte inside a copy
+GIVE_UP = 32            # Stop extending once score drops this far below best
+
+
+def seed_hash(data, pos):
+    """Hash SEED_LEN bytes starting at pos into HASH_BITS bits."""
+    h = 0
+    for b in data[pos:pos + SEED_LEN]:
+        h = ((h * 31) + b) & 0xFFFFFFFF
+    return (h ^ (h >> 15)) & ((1 << HASH_BITS) - 1)
+
+
+def build_index(old):
+    """Hash chains over every seed position of the base image."""
+    head = [-1] * (1 << HASH_BITS)
+    chain = [-1] * max(len(old), 1)
+    for pos in range(len(old) - SEED_LEN + 1):
+        h = seed_hash(old, pos)
+        chain[pos] = head[h]
+        head[h] = pos
+    return head, chain
+
+
+def extend(old, new, o, n):
+    """
+    Extend an approximate match of old[o:] against new[n:].
+    Returns (length, score) of the best-scoring prefix.
+    """
+    limit = min(len(old) - o, len(new) - n)
+    score = best_score = 0
+    best_len = 0
+    k = 0
+    while k < limit:
+        if old[o + k] == new[n + k]:
+            score += 1
+            if score > best_score:
+                best_score = score
+                best_len = k + 1
+        else:
+            score -= FIX_COST
+            if score < best_score - GIVE_UP:
+                break
+        k += 1
+    return best_len, best_score
+
+
+def write_varint(out, value):
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def generate(old, new):
+    """Generate a WTD1 patch turning old into new."""
+    out = bytearray()
+    out += MAGIC
+    out += struct.pack("<I", len(old)) + hashlib.md5(old).digest()
+    out += struct.pack("<I", len(new)) + hashlib.md5(new).digest()
+
+    head, chain = build_index(old)
+
+    old_cursor = 0
+    literal_start = 0
+    i = 0
+    n = len(new)
+
+    def flush_literal(end):
+        if end > literal_start:
+            out.append(OP_INSERT)
+            write_varint(out, end - literal_start)
+            out.extend(new[literal_start:end])
+
+    while i < n:
+        best_len, best_score, best_off = 0, 0, 0
+
+        # Continuing where the last copy ended wins most often in firmware,
+        # where code is shifted rather than rearranged
+        candidates = [old_cursor] if old_cursor < len(old) else []
+        if i + SEED_LEN <= n:
+            c = head[seed_hash(new, i)]
+            tries = 0
+            while c >= 0 and tries < MAX_CANDIDATES:
+                candidates.append(c)
+                c = chain[c]
+                tries += 1
+
+        for o in candidates:
+            length, score = extend(old, new, o, i)
+            if score > best_score:
+                best_len, best_score, best_off = length, score, o
+
+        if best_len >= MIN_MATCH:
+            flush_literal(i)
+            fixes = [k for k in range(best_len) if old[best_off + k] != new[i + k]]
+            out.append(OP_COPY)
+            write_varint(out, zigzag(best_off - old_cursor))
+            write_varint(out, best_len)
+            write_varint(out, len(fixes))
+            prev = 0
+            for k in fixes:
+                write_varint(out, k - prev)
+                out.append(new[i + k])
+                prev = k
+            old_cursor = best_off + best_len
+            i += best_len
+            literal_start = i
+        else:
+            i += 1
+
+    flush_literal(n)
+    out.append(OP_END)
+    return bytes(out)
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise ValueError("truncated patch")
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def bytes(self, count):
+        if self.pos + count > len(self.data):
+            raise ValueError("truncated patch")
+        chunk = self.data[self.pos:self.pos + count]
+        self.pos += count
+        return chunk
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            if not b & 0x80:
+                return value
+            shift += 7
+
+
+def apply(old, patch):
+    """Apply a WTD1 patch, mirroring the firmware implementation."""
+    r = Reader(patch)
+    if r.bytes(4) != MAGIC:
+        raise ValueError("bad magic")
+    old_size, = struct.unpack("<I", r.bytes(4))
+    old_md5 = r.bytes(16)
+    new_size, = struct.unpack("<I", r.bytes(4))
+    new_md5 = r.bytes(16)
+
+    if old_size != len(old) or old_md5 != hashlib.md5(old).digest():
+        raise ValueError("patch does not match base image")
+
+    out = bytearray()
+    old_cursor = 0
+    while True:
+        op = r.byte()
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            z = r.varint()
+            delta = (z >> 1) ^ -(z & 1)
+            length = r.varint()
+            start = old_cursor + delta
+            if start < 0 or start + length > len(old):
+                raise ValueError("copy outside base image")
+            block = bytearray(old[start:start + length])
+            pos = 0
+            for _ in range(r.varint()):
+                pos += r.varint()
+                if pos >= length:
+                    raise ValueError("fixup outside copy range")
+                block[pos] = r.byte()
+            out += block
+            old_cursor = start + length
+        elif op == OP_INSERT:
+            out += r.bytes(r.varint())
+        else:
+            raise ValueError("unknown op 0x%02x" % op)
+
+    if len(out) != new_size or hashlib.md5(out).digest() != new_md5:
+        raise ValueError("reconstructed image does not match")
+    return bytes(out)
+
+
+def read_file(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def read_image(path):
+    """Read a firmware image, dropping any signature block and inflating
+    gzip-compressed OTA images."""
+    data = read_file(path)
+    trailer = SIGNATURE_BLOCK_SIZE + 4
+    if len(data) > trailer and struct.unpack("<I", data[-4:])[0] == SIGNATURE_BLOCK_SIZE:
+        data = data[:-trailer]
+    if data[:2] == b"\x1f\x8b":
+        data = gzip.decompress(data)
+    return data
+
+
+def main(argv):
+    if len(argv) != 5 or argv[1] not in ("diff", "apply", "verify"):
+        print(__doc__.strip())
+        return 1
+
+    cmd = argv[1]
+    old = read_image(argv[2])
+
+    if cmd == "diff":
+        new = read_image(argv[3])
+        patch = generate(old, new)
+        apply(old, patch)
+        with open(argv[4], "wb") as f:
+            f.write(patch)
+        print("Patch: %d bytes (%.1f%% of %d byte image)"
+              % (len(patch), 100.0 * len(patch) / max(len(new), 1), len(new)))
+    elif cmd == "apply":
+        new = apply(old, read_file(argv[3]))
+        with open(argv[4], "wb") as f:
+            f.write(new)
+        print("Reconstructed %d byte image" % len(new))
+    else:
+        new = read_image(argv[3])
+        if apply(old, read_file(argv[4])) != new:
+            print("Patch verification FAILED")
+            return 1
+        print("Patch verified")
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except ValueError as e:
+        print("Error: %s" % e)
+        sys.exit(1)
@@ -0,0 +1,758 @@
+/**
+ * Heap Budget Check
+ *
+ * Runs the firmware's own JSON code (src/modules/payload.cpp, config.cpp
+ * and the modules they call) on the host, with every table it reads filled
+ * to the firmware's limits, and counts the heap used by each report-cycle
+ * HEAP_SITE: report, batch, relay, flush, storage and config. Exits
+ * non-zero if a site's peak exceeds its HEAP_BUDGET_*_BYTES budget.
+ *
+ * Upload sites run in two steps, as on the device: the payload is built
+ * and its document freed, then the body is held while the request goes out
+ * and the response is parsed and applied. The second step also holds the
+ * TLS session and HTTPClient, which are not built here; --tls-bytes stands
+ * in for them.
+ *
+ * Settings come from config.h and the other firmware headers; build
+ * variants are picked with BUDGET_DEFINES. Task and heap site names are
+ * read from the sources (--src), so telemetry carries the names the
+ * firmware registers. Every ArduinoJson slot holds pointers, so documents
+ * take more room on a 64-bit host than on the ESP8266: passing here is
+ * conservative. Allocations are counted by wrapping malloc() at link time
+ * (GNU ld).
+ *
+ * Needs ArduinoJson from 'make install-libs'.
+ *
+ * Usage:
+ *     make heap-budget [BUDGET_DEFINES="-DSENSOR_CHANNELS=3 -DROLLUP_ENABLED=true"]
+ *     heap_budget --src DIR [--tls-bytes N] [-v]
+ */
+
+#include "config.h"
+#include "payload.h"
+#include "alert_engine.h"
+#include "alerts.h"
+#include "dns_cache.h"
+#include "forecast.h"
+#include "heap_monitor.h"
+#include "logger.h"
+#include "profiler.h"
+#include "relay_protocol.h"
+#include "rtc_store.h"
+#include "scheduler.h"
+#include "sensor.h"
+#include "time_sync.h"
+#include "usage_tracker.h"
+#include <dirent.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Samples in one batch upload, as water_tank.ino sends them
+#if RADIO_BATCHING_ENABLED
+#define BUDGET_BATCH_SAMPLES    BATCH_MAX_SAMPLES
+#else
+#define BUDGET_BATCH_SAMPLES    RTC_PENDING_SAMPLES
+#endif
+
+struct Options {
+    std::string src;
+    size_t tlsBytes = 22000;        // BearSSL buffers (16709 in, 837 out), context, HTTPClient
+    bool verbose = false;
+};
+
+static Options opts;
+
+// ============================================================================
+// Allocation counting
+// ============================================================================
+
+struct HeapCount {
+    size_t live = 0;
+    size_t peak = 0;
+    size_t allocations = 0;
+};
+
+static HeapCount heap;
+
+// Each block's size is kept in front of it for the free
+static const size_t HEADER = alignof(std::max_align_t);
+
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+    void __real_free(void* ptr);
+}
+
+static void track(size_t added, size_t removed) {
+    heap.live += added;
+    if (heap.live > heap.peak) {
+        heap.peak = heap.live;
+    }
+    heap.live -= removed;
+}
+
+static void* countedAlloc(size_t size) {
+    char* block = (char*)__real_malloc(size + HEADER);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    memcpy(block, &size, sizeof(size));
+    heap.allocations++;
+    track(size, 0);
+    return block + HEADER;
+}
+
+static void countedFree(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    char* block = (char*)ptr - HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    track(0, size);
+    __real_free(block);
+}
+
+// Counted as a move: both blocks are live for a moment
+static void* countedRealloc(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return countedAlloc(size);
+    }
+    char* block = (char*)ptr - HEADER;
+    size_t oldSize;
+    memcpy(&oldSize, block, sizeof(oldSize));
+    block = (char*)__real_realloc(block, size + HEADER);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    memcpy(block, &size, sizeof(size));
+    heap.allocations++;
+    track(size, oldSize);
+    return block + HEADER;
+}
+
+// String and ArduinoJson's default allocator call these
+extern "C" {
+    void* __wrap_malloc(size_t size) {
+        return countedAlloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size) {
+        void* ptr = countedAlloc(count * size);
+        if (ptr != nullptr) {
+            memset(ptr, 0, count * size);
+        }
+        return ptr;
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size) {
+        return countedRealloc(ptr, size);
+    }
+
+    void __wrap_free(void* ptr) {
+        countedFree(ptr);
+    }
+}
+
+void* operator new(size_t size) {
+    void* ptr = countedAlloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    countedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    countedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    countedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    countedFree(ptr);
+}
+
+// Heap in use above the level at its start
+struct Measure {
+    size_t start = heap.live;
+    size_t allocations = heap.allocations;
+
+    Measure() {
+        heap.peak = heap.live;
+    }
+
+    size_t peak() const {
+        return heap.peak - start;
+    }
+};
+
+// ============================================================================
+// Firmware state, filled to the limits
+// ============================================================================
+
+// Large enough that every counter prints at full width
+static const uint32_t WIDE = 4000000000UL;
+
+static bool clockSynced = true;
+static std::vector<std::string> taskNames;
+static std::vector<std::string> siteNames;
+static TaskStats tasks[SCHEDULER_MAX_TASKS];
+static HeapSiteStats sites[HEAP_MAX_SITES];
+static HeapStats heapStats = { WIDE, WIDE, WIDE, WIDE, 100, 100 };
+static RtcData rtc;
+static float levels[SENSOR_CHANNELS];
+
+unsigned long millis() {
+    return WIDE;
+}
+
+namespace TimeSync {
+    bool isValid() {
+        return clockSynced;
+    }
+
+    uint32_t epoch() {
+        return WIDE;
+    }
+
+    uint32_t epochAt(unsigned long) {
+        return clockSynced ? WIDE : 0;
+    }
+
+    uint32_t getClockId() {
+        return WIDE;
+    }
+
+    const struct tm* localTime() {
+        static struct tm now = { 59, 59, 23, 31, 11, 126 };
+        return &now;
+    }
+}
+
+namespace RtcStore {
+    RtcData& data() {
+        return rtc;
+    }
+}
+
+namespace Scheduler {
+    int getTaskCount() {
+        return SCHEDULER_MAX_TASKS;
+    }
+
+    const TaskStats& getStats(int id) {
+        return tasks[id];
+    }
+}
+
+namespace HeapMonitor {
+    void sample() {
+    }
+
+    const HeapStats& getStats() {
+        return heapStats;
+    }
+
+    int getSiteCount() {
+        return HEAP_MAX_SITES;
+    }
+
+    const HeapSiteStats& getSite(int index) {
+        return sites[index];
+    }
+}
+
+namespace DnsCache {
+    float getHitRatio() {
+        return 0.987654f;
+    }
+
+    unsigned long getTimeSavedMs() {
+        return WIDE;
+    }
+}
+
+namespace Log {
+    uint32_t getCount(uint8_t) {
+        return WIDE;
+    }
+
+    uint32_t getDropped() {
+        return WIDE;
+    }
+
+    namespace detail {
+        void put(Args&, const void*, size_t) {
+        }
+
+        void putString(Args&, const char*) {
+        }
+
+        void commit(uint8_t, PGM_P, const Args&) {
+        }
+    }
+}
+
+namespace Sensor {
+    const float* getLastLevels() {
+        return levels;
+    }
+
+    float calculateVolume(float, uint8_t) {
+        return 12345.678f;
+    }
+
+    float getPercentage(float, uint8_t) {
+        return 98.7654f;
+    }
+}
+
+// Every field set, which the real fit never does at once
+namespace Forecast {
+    bool getEstimate(ForecastEstimate& estimate) {
+        estimate.flowLpm = -12.3456f;
+        estimate.minutesToEmpty = WIDE;
+        estimate.minutesToFull = WIDE;
+        estimate.fromDailyUsage = true;
+        return true;
+    }
+}
+
+namespace Alerts {
+    void triggerTankFull() {
+    }
+
+    void triggerTankLow() {
+    }
+
+    void triggerBatteryLow() {
+    }
+}
+
+// A string of n characters, the longest a setting can hold
+static String longest(size_t n) {
+    return String(std::string(n, 'x').c_str());
+}
+
+// First quoted argument of every call to the function
+static void findNames(const std::string& text, const char* call, std::vector<std::string>& names) {
+    std::string prefix = std::string(call) + "(\"";
+    for (size_t at = text.find(prefix); at != std::string::npos; at = text.find(prefix, at + 1)) {
+        size_t begin = at + prefix.size();
+        size_t end = text.find('"', begin);
+        std::string name = text.substr(begin, end - begin);
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(name);
+        }
+    }
+}
+
+// The sketch and every module
+static bool readSources(const std::string& dir, std::string& text) {
+    const std::string paths[] = { dir, dir + "/modules" };
+    for (const std::string& path : paths) {
+        DIR* d = opendir(path.c_str());
+        if (d == nullptr) {
+            return false;
+        }
+        while (dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            size_t dot = name.rfind('.');
+            std::string ext = dot == std::string::npos ? "" : name.substr(dot);
+            if (ext == ".ino" || ext == ".cpp") {
+                std::ifstream file(path + "/" + name);
+                std::stringstream content;
+                content << file.rdbuf();
+                text += content.str();
+            }
+        }
+        closedir(d);
+    }
+    return true;
+}
+
+// Up to the table's size; slots the firmware does not use yet get the
+// longest name, in case they are taken later
+static void padNames(std::vector<std::string>& names, size_t count) {
+    std::string widest;
+    for (const std::string& name : names) {
+        if (name.size() > widest.size()) {
+            widest = name;
+        }
+    }
+    names.resize(std::max(names.size(), count), widest);
+}
+
+static bool fillState() {
+    std::string sources;
+    if (!readSources(opts.src, sources)) {
+        fprintf(stderr, "Cannot read sources in %s\n", opts.src.c_str());
+        return false;
+    }
+    findNames(sources, "Scheduler::addPeriodic", taskNames);
+    findNames(sources, "Scheduler::addOneShot", taskNames);
+    findNames(sources, "HEAP_SITE", siteNames);
+    if (taskNames.empty() || siteNames.empty()) {
+        fprintf(stderr, "No tasks or heap sites found in %s\n", opts.src.c_str());
+        return false;
+    }
+    padNames(taskNames, SCHEDULER_MAX_TASKS);
+    padNames(siteNames, HEAP_MAX_SITES);
+
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        tasks[i] = { taskNames[i].c_str(), WIDE, WIDE, (uint64_t)WIDE * WIDE, WIDE };
+    }
+    for (int i = 0; i < HEAP_MAX_SITES; i++) {
+        sites[i] = { siteNames[i].c_str(), WIDE, WIDE, WIDE, WIDE, -2000000000, WIDE };
+    }
+
+#if PROFILING_ENABLED
+    // One reading per bucket, the last one as long as a reading can be
+    for (int probe = 0; probe < PROBE_COUNT; probe++) {
+        uint32_t us = PROFILE_FIRST_BUCKET_US;
+        for (int b = 0; b < PROFILE_BUCKETS; b++, us <<= 2) {
+            Profiler::record((ProfileProbe)probe, b < PROFILE_BUCKETS - 1 ? us - 1 : WIDE);
+        }
+    }
+#endif
+
+    RtcUsageState& usage = rtc.usage;
+    usage.eventCount = RTC_USAGE_EVENTS;
+    for (int i = 0; i < RTC_USAGE_EVENTS; i++) {
+        usage.events[i] = { 0, -12345.678f, 65535, USAGE_EVENT_REFILL, 0 };
+    }
+    for (int i = 0; i < 2; i++) {
+        usage.days[i] = { 20261018, 12345.678f, 12345.678f, 255, 255, 1, 0 };
+    }
+
+    for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        levels[ch] = 123.4567f;
+    }
+
+    Config::deviceId = longest(DEVICE_ID_MAX_LEN - 1);
+    Config::deviceToken = longest(DEVICE_TOKEN_MAX_LEN - 1);
+    Config::wifiSsid = longest(32);             // 802.11 limit
+    Config::wifiPassword = longest(63);         // WPA2 passphrase limit
+    return true;
+}
+
+static SystemState reading() {
+    SystemState state = {};
+    state.lastMeasurement = 1;
+    state.waterLevelCm = 123.4567f;
+    state.volumeLiters = 12345.678f;
+    state.temperatureC = -12.3456f;
+    state.batteryVoltage = 3.45678f;
+    state.wifiRssi = -100;
+    for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        state.channelLevelCm[ch] = 123.4567f;
+    }
+    return state;
+}
+
+#if ROLLUP_ENABLED
+static RtcRollup rollupWindow() {
+    RtcRollupStat stat = { -32768, 32767, -32768, 32767, -2000000000 };
+    return { 1, 65535, 65535, stat, stat, stat };
+}
+#endif
+
+// Measurement response as the backend sends it: the whole config with
+// every value changed, so it is written to flash, and a pending update
+static std::string response(int variant) {
+    std::string v = std::to_string(variant);
+    std::string config = "{\"measurement_interval_ms\":60000" + v +
+        ",\"report_interval_ms\":360000" + v +
+        ",\"tank_full_threshold_l\":12345.6" + v +
+        ",\"tank_low_threshold_l\":1234.56" + v +
+        ",\"battery_low_threshold_v\":3.4567" + v +
+        ",\"channels\":[";
+    for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        config += std::string(ch > 0 ? "," : "") + "{\"level_empty_cm\":123.45" + v +
+            ",\"level_full_cm\":12.345" + v + ",\"area_cm2\":12345.6" + v + "}";
+    }
+    config += "],\"alert_rules\":{";
+    for (int type = 0; type < ALERT_TYPE_COUNT; type++) {
+        config += std::string(type > 0 ? "," : "") + "\"" + AlertEngine::getName((AlertType)type) +
+            "\":{\"enabled\":" + (variant % 2 ? "true" : "false") + ",\"hysteresis\":12.34" + v +
+            ",\"debounce_s\":360" + v + ",\"cooldown_s\":8640" + v + "}";
+    }
+    config += "}}";
+    return "{\"success\":true,\"measurement_id\":\"9b2f6c1e-3c4a-4e7b-8f0d-2a6b5c4d3e2f\","
+        "\"config\":" + config + ",\"ota\":\"12.34.56-rc.7+g1a2b3c4\"}";
+}
+
+// The HTTP response body, read as HTTPClient::getStream() is
+class ResponseStream : public Stream {
+public:
+    explicit ResponseStream(const std::string& text) : text(text) {}
+
+    size_t write(uint8_t) override {
+        return 0;
+    }
+
+    size_t readBytes(char* buffer, size_t length) override {
+        size_t n = std::min(length, text.size() - at);
+        memcpy(buffer, text.data() + at, n);
+        at += n;
+        return n;
+    }
+
+private:
+    const std::string& text;
+    size_t at = 0;
+};
+
+// ============================================================================
+// Sites
+// ============================================================================
+
+struct Result {
+    size_t buildPeak = 0;           // Building the body
+    size_t sendPeak = 0;            // Body held, response handled; without TLS
+    size_t bodyBytes = 0;
+    bool upload = false;
+    bool ok = true;
+};
+
+// handleResponse() in data_reporter.cpp
+static bool handleResponse(const std::string& text) {
+    ResponseStream stream(text);
+
+    JsonDocument respDoc;
+    if (Payload::parseResponse(stream, respDoc)) {
+        printf("response did not parse\n");
+        return false;
+    }
+    return Config::applyFromJson(respDoc["config"].as<JsonVariantConst>());
+}
+
+// Build the body, then hold it through the request and, if given, the
+// response
+template <typename Build>
+static Result upload(Build build, const std::string* responseText) {
+    Result result;
+    result.upload = true;
+
+    Measure measure;
+    String body;
+    build(body);
+    result.buildPeak = measure.peak();
+    result.bodyBytes = body.length();
+
+    // The document is gone; the body stays until the request is done
+    heap.peak = heap.live;
+    if (responseText != nullptr) {
+        result.ok = handleResponse(*responseText);
+    }
+    result.sendPeak = measure.peak();
+    return result;
+}
+
+// DataReporter::send
+static Result reportSite() {
+    SystemState state = reading();
+    std::string text = response(1);
+    return upload([&](String& body) {
+        Payload::report(body, state.waterLevelCm, state.volumeLiters, state.temperatureC,
+            state.batteryVoltage, state.wifiRssi, state.channelLevelCm, WIDE);
+    }, &text);
+}
+
+// DataReporter::sendBatch, with the rollup window if there is one
+static Result batchSite() {
+    static SystemState samples[BUDGET_BATCH_SAMPLES];
+    for (SystemState& s : samples) {
+        s = reading();
+    }
+#if ROLLUP_ENABLED
+    RtcRollup window = rollupWindow();
+    const RtcRollup* rollup = &window;
+#else
+    const RtcRollup* rollup = nullptr;
+#endif
+    std::string text = response(2);
+    return upload([&](String& body) {
+        Payload::batch(body, samples, BUDGET_BATCH_SAMPLES, WIDE, rollup);
+    }, &text);
+}
+
+// DataReporter::sendRelay with a full inbox, each frame from another leaf
+static Result relaySite() {
+    static RelayInbox inbox;
+    for (int i = 0; i < RELAY_INBOX_FRAMES; i++) {
+        char deviceId[RELAY_DEVICE_ID_LEN];
+        snprintf(deviceId, sizeof(deviceId), "%0*d", RELAY_DEVICE_ID_LEN - 1, i);
+
+        RelayFrame frame;
+        RelayProtocol::begin(frame, deviceId, 1, RELAY_MAX_SAMPLES);
+        for (int j = 0; j < RELAY_MAX_SAMPLES; j++) {
+            frame.samples[frame.count++] = { (uint32_t)j, 12345.678f, -32768, -32768, 65535 };
+        }
+        RelayProtocol::seal(frame, inbox.key);
+
+        RelayAck reply;
+        RelayProtocol::accept(inbox, (const uint8_t*)&frame, RelayProtocol::frameSize(frame.count),
+            WIDE - i, reply);
+    }
+
+    Result result;
+    if (inbox.count != RELAY_INBOX_FRAMES) {
+        printf("relay inbox took %d of %d frames\n", inbox.count, RELAY_INBOX_FRAMES);
+        result.ok = false;
+        return result;
+    }
+    std::string text = response(3);
+    return upload([&](String& body) {
+        Payload::relay(body, inbox, inbox.count, WIDE);
+    }, &text);
+}
+
+// Storage::flushBuffer for one record taken before the clock was set:
+// read from flash, dateRecord(), sendBuffered()
+static Result flushSite() {
+    clockSynced = false;
+    std::string record = Payload::bufferedMeasurement(reading()).c_str();
+    clockSynced = true;
+
+    return upload([&](String& body) {
+        body = record.c_str();
+        Payload::dateRecord(body);
+    }, nullptr);
+}
+
+// Storage::bufferMeasurement and bufferRollup, before the clock is set
+static Result storageSite() {
+    Result result;
+    clockSynced = false;
+    {
+        Measure measure;
+        String record = Payload::bufferedMeasurement(reading());
+        result.bodyBytes = record.length();
+        result.buildPeak = measure.peak();
+    }
+#if ROLLUP_ENABLED
+    {
+        Measure measure;
+        String record = Payload::bufferedRollup(rollupWindow());
+        result.bodyBytes = std::max(result.bodyBytes, record.length());
+        result.buildPeak = std::max(result.buildPeak, measure.peak());
+    }
+#endif
+    clockSynced = true;
+    return result;
+}
+
+// Config::applyFromJson with every value changed, so Config::save() runs.
+// The site opens inside it, once the response is parsed.
+static Result configSite() {
+    std::string text = response(4);
+    JsonDocument respDoc;
+    deserializeJson(respDoc, text);
+
+    Result result;
+    Measure measure;
+    result.ok = Config::applyFromJson(respDoc["config"].as<JsonVariantConst>());
+    result.buildPeak = measure.peak();
+    return result;
+}
+
+// ============================================================================
+
+struct Site {
+    const char* name;
+    Result (*run)();
+    size_t budget;
+};
+
+static bool parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--src") == 0 && hasValue) {
+            opts.src = argv[++i];
+        } else if (strcmp(arg, "--tls-bytes") == 0 && hasValue) {
+            opts.tlsBytes = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(arg, "-v") == 0) {
+            opts.verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s --src DIR [--tls-bytes N] [-v]\n", argv[0]);
+            return false;
+        }
+    }
+    if (opts.src.empty() || opts.tlsBytes >= HEAP_BUDGET_UPLOAD_BYTES) {
+        fprintf(stderr, "Needs --src DIR, and --tls-bytes < %d\n", HEAP_BUDGET_UPLOAD_BYTES);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv) || !fillState()) {
+        return 2;
+    }
+
+    const Site siteList[] = {
+        { "report", reportSite, HEAP_BUDGET_UPLOAD_BYTES },
+        { "batch", batchSite, HEAP_BUDGET_UPLOAD_BYTES },
+        { "relay", relaySite, HEAP_BUDGET_UPLOAD_BYTES },
+        { "flush", flushSite, HEAP_BUDGET_UPLOAD_BYTES },
+        { "storage", storageSite, HEAP_BUDGET_STORAGE_BYTES },
+        { "config", configSite, HEAP_BUDGET_CONFIG_BYTES },
+    };
+
+    printf("Heap per site: %d channel(s), batch of %d%s, TLS %zu bytes\n",
+        SENSOR_CHANNELS, BUDGET_BATCH_SAMPLES, ROLLUP_ENABLED ? " + rollup" : "", opts.tlsBytes);
+    if (opts.verbose) {
+        printf("  tasks:");
+        for (const std::string& name : taskNames) {
+            printf(" %s", name.c_str());
+        }
+        printf("\n  sites:");
+        for (const std::string& name : siteNames) {
+            printf(" %s", name.c_str());
+        }
+        printf("\n");
+    }
+
+    int over = 0;
+    for (const Site& site : siteList) {
+        Measure measure;
+        Result result = site.run();
+        long retained = (long)heap.live - (long)measure.start;
+
+        // The body is built before the TLS session opens
+        size_t sendPeak = result.upload ? result.sendPeak + opts.tlsBytes : 0;
+        size_t peak = std::max(result.buildPeak, sendPeak);
+        bool ok = result.ok && peak <= site.budget;
+        if (!ok) {
+            over++;
+        }
+        printf("  %-8s peak %6zu of %5zu, %4zu allocations, JSON %5zu bytes, retained %ld  %s\n",
+            site.name, peak, site.budget, heap.allocations - measure.allocations,
+            result.bodyBytes, retained, ok ? "ok" : "OVER");
+        if (opts.verbose && result.upload) {
+            printf("           building %zu, sending %zu + TLS\n", result.buildPeak, result.sendPeak);
+        }
+    }
+
+    if (over > 0) {
+        printf("FAIL: %d site(s) over budget\n", over);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * Host Arduino Shim
+ *
+ * Just enough of the ESP8266 Arduino core for the firmware modules that
+ * build JSON (payload, config, alert engine, rollup, ...) to build on the
+ * host for scripts/heap_budget.cpp. String allocates like the core's: up
+ * to 11 characters inline, longer ones on the heap rounded up to 16 bytes,
+ * grown with realloc(). Serial discards its output. The host program
+ * defines millis().
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) (s)
+
+#define PI 3.1415926535897932384626433832795
+
+using std::max;
+using std::min;
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+unsigned long millis();
+
+// Cycle counter for Profiler spans; always zero here
+struct EspClass {
+    uint32_t getCycleCount() { return 0; }
+    uint8_t getCpuFreqMHz() { return 80; }
+};
+
+inline EspClass ESP;
+
+class String {
+public:
+    String(const char* str = "") { assign(str, str ? strlen(str) : 0); }
+    String(const String& other) { assign(other.c_str(), other.length()); }
+    ~String() { release(); }
+
+    String& operator=(const String& other) {
+        if (this != &other) {
+            assign(other.c_str(), other.length());
+        }
+        return *this;
+    }
+
+    // nullptr empties the string and frees its buffer
+    String& operator=(const char* str) {
+        if (str == nullptr) {
+            release();
+            return *this;
+        }
+        assign(str, strlen(str));
+        return *this;
+    }
+
+    bool reserve(size_t size) {
+        if (size <= capacity()) {
+            return true;
+        }
+        size_t newSize = (size + 16) & ~(size_t)0xf;
+        char* buffer = (char*)realloc(heap_, newSize);
+        if (buffer == nullptr) {
+            return false;
+        }
+        if (heap_ == nullptr) {
+            memcpy(buffer, sso_, len_ + 1);
+        }
+        heap_ = buffer;
+        heapCapacity_ = newSize - 1;
+        return true;
+    }
+
+    bool concat(const char* str, size_t n) {
+        if (str == nullptr || !reserve(len_ + n)) {
+            return false;
+        }
+        memcpy(buffer() + len_, str, n);
+        len_ += n;
+        buffer()[len_] = 0;
+        return true;
+    }
+
+    bool concat(const char* str) { return str != nullptr && concat(str, strlen(str)); }
+    bool concat(char c) { return concat(&c, 1); }
+    String& operator+=(const char* str) { concat(str); return *this; }
+    String& operator+=(const String& str) { concat(str.c_str(), str.length()); return *this; }
+
+    const char* c_str() const { return heap_ ? heap_ : sso_; }
+    size_t length() const { return len_; }
+    char operator[](size_t i) const { return c_str()[i]; }
+    bool operator==(const char* str) const { return strcmp(c_str(), str ? str : "") == 0; }
+
+    int indexOf(const char* str) const {
+        const char* found = strstr(c_str(), str);
+        return found ? (int)(found - c_str()) : -1;
+    }
+
+private:
+    static const size_t SSO_CAPACITY = 11;
+
+    char sso_[SSO_CAPACITY + 1] = {};
+    char* heap_ = nullptr;
+    size_t heapCapacity_ = 0;
+    size_t len_ = 0;
+
+    size_t capacity() const { return heap_ ? heapCapacity_ : SSO_CAPACITY; }
+    char* buffer() { return heap_ ? heap_ : sso_; }
+
+    void assign(const char* str, size_t n) {
+        len_ = 0;
+        buffer()[0] = 0;
+        concat(str, n);
+    }
+
+    void release() {
+        free(heap_);
+        heap_ = nullptr;
+        heapCapacity_ = 0;
+        len_ = 0;
+        sso_[0] = 0;
+    }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            write(buffer[i]);
+        }
+        return size;
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual size_t readBytes(char* buffer, size_t length) = 0;
+};
+
+struct HardwareSerial {
+    void println(const char*) {}
+    int printf(const char*, ...) { return 0; }
+};
+
+inline HardwareSerial Serial;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,22 @@
+/**
+ * Host ESP8266WiFi Shim
+ *
+ * IPAddress only, for the DnsCache declarations in dns_cache.h.
+ */
+
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{ a, b, c, d } {}
+    uint8_t operator[](int i) const { return bytes_[i]; }
+
+private:
+    uint8_t bytes_[4] = {};
+};
+
+#endif // HOST_ESP8266WIFI_H
@@ -0,0 +1,32 @@
+/**
+ * Host LittleFS Shim
+ *
+ * A filesystem that is always mounted and empty: files open, writes are
+ * discarded and reads return nothing. Enough for Config::save() and
+ * Config::load() to run their JSON.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+
+class File : public Stream {
+public:
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+    size_t readBytes(char*, size_t) override { return 0; }
+    void close() {}
+    explicit operator bool() const { return true; }
+};
+
+struct LittleFSClass {
+    bool begin() { return true; }
+    bool exists(const char*) { return false; }
+    bool remove(const char*) { return true; }
+    File open(const char*, const char*) { return File(); }
+};
+
+inline LittleFSClass LittleFS;
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Log Decoder for Water Tank Firmware
+
+Decodes binary log records (see src/modules/logger.h for the frame
+format) written by the firmware to Serial with LOG_SERIAL_BINARY, or to
+/log.bin in LittleFS. Records hold the flash address of their format
+string, which is looked up in the ELF of the exact build that wrote them.
+
+Text between records (boot messages, modules still printing directly) is
+passed through.
+
+Usage:
+    python3 log_decode.py <firmware.elf> [capture.bin | -]
+"""
+
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+HEADER = struct.Struct("<BBBII")    # sync, level, argBytes, millis, format
+MAX_ARG_BYTES = 96
+
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+SHT_PROGBITS = 1
+
+SPEC = re.compile(rb"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|L|z|j|t)?([diouxXcsfFeEgGp%])")
+
+
+class Elf:
+    """Just enough ELF32 to read strings by load address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("not an ELF32 file")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, _, addr, offset, size) = struct.unpack_from(
+                "<IIIIII", self.data, shoff + i * shentsize)
+            if sh_type == SHT_PROGBITS and addr and size:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end]
+        return None
+
+
+def format_record(fmt, args):
+    """printf over the stored arguments, mirroring formatRecord() on the device."""
+    out = []
+    pos = 0
+    arg = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()].decode("utf-8", "replace"))
+        pos = m.end()
+        flags, conv = m.group(1).decode(), m.group(2).decode()
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "s":
+            end = args.find(b"\0", arg)
+            if end < 0:
+                out.append("?")
+                arg = len(args)
+                continue
+            out.append(("%" + flags + "s") % args[arg:end].decode("utf-8", "replace"))
+            arg = end + 1
+            continue
+        if arg + 4 > len(args):
+            out.append("?")
+            continue
+        word = args[arg:arg + 4]
+        arg += 4
+        if conv in "fFeEgG":
+            out.append(("%" + flags + conv) % struct.unpack("<f", word)[0])
+        elif conv in "di":
+            out.append(("%" + flags + "d") % struct.unpack("<i", word)[0])
+        elif conv == "c":
+            out.append(chr(struct.unpack("<I", word)[0] & 0xFF))
+        else:
+            value, = struct.unpack("<I", word)
+            out.append(("%" + flags + ("x" if conv == "p" else conv)) % value)
+    out.append(fmt[pos:].decode("utf-8", "replace"))
+    return "".join(out)
+
+
+def decode(elf, data, emit):
+    """Decode records from data; returns the unconsumed tail."""
+    text = bytearray()
+    i = 0
+    while i < len(data):
+        if data[i] != FRAME_SYNC:
+            text.append(data[i])
+            i += 1
+            continue
+        if i + HEADER.size > len(data):
+            break
+        _, level, arg_bytes, millis, address = HEADER.unpack_from(data, i)
+        fmt = elf.string(address) if level in LEVELS and arg_bytes <= MAX_ARG_BYTES else None
+        if fmt is None:
+            text.append(data[i])
+            i += 1
+            continue
+        end = i + HEADER.size + arg_bytes
+        if end > len(data):
+            break
+        if text:
+            emit(text.decode("utf-8", "replace"))
+            text.clear()
+        line = format_record(fmt, data[i + HEADER.size:end])
+        emit("[%10.3f] %s %s\n" % (millis / 1000.0, LEVELS[level], line))
+        i = end
+    if text:
+        emit(text.decode("utf-8", "replace"))
+    return data[i:]
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        print(__doc__.strip())
+        return 1
+
+    elf = Elf(argv[1])
+    source = sys.stdin.buffer if len(argv) == 2 or argv[2] == "-" else open(argv[2], "rb")
+
+    def emit(s):
+        sys.stdout.write(s)
+        sys.stdout.flush()
+
+    pending = b""
+    while True:
+        chunk = source.read1(4096) if hasattr(source, "read1") else source.read(4096)
+        if not chunk:
+            break
+        pending = decode(elf, pending + chunk, emit)
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except (OSError, ValueError) as e:
+        print("Error: %s" % e)
+        sys.exit(1)
@@ -0,0 +1,429 @@
+/**
+ * Relay Protocol Simulation
+ *
+ * Runs the ESP-NOW relay protocol between simulated leaves and a gateway
+ * over a lossy link, using the firmware's own src/modules/relay_protocol.cpp.
+ * Leaves keep unsent readings like the firmware does (RTC backlog, oldest
+ * dropped when full). The gateway uploads on a timer and when its inbox
+ * is half full, backing off after a failed early upload. Halfway through, the gateway's access point moves to
+ * another channel, so the leaves have to find it again.
+ *
+ * Checks that every reading reaches the server at most once, is dated
+ * exactly, and that each one taken is accounted for (delivered, still
+ * held, or dropped from a leaf's full backlog). None may be lost to a
+ * full gateway inbox, and none altered by an attacker without the key
+ * (--forge). Exits non-zero if not.
+ *
+ * Usage:
+ *     make relay-sim [SIM_ARGS="--leaves 12 --loss 0.3"]
+ *     relay_sim [--leaves N] [--hours H] [--interval-s S] [--upload-s S]
+ *               [--loss P] [--ack-loss P] [--upload-failure P] [--forge P]
+ *               [--seed N] [-v]
+ */
+
+#include "relay_protocol.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Mirrors of firmware settings the simulation depends on
+static const size_t PENDING_SAMPLES = 4;            // RTC_PENDING_SAMPLES
+static const double ACK_TIMEOUT_MS = 30;            // RELAY_ACK_TIMEOUT_MS
+static const double UPLOAD_CHECK_MS = 1000;         // Gateway relayTask period
+static const uint64_t UPLOAD_BACKOFF_MS = 30000;    // RELAY_UPLOAD_BACKOFF_MS
+
+struct Options {
+    int leaves = 6;
+    double hours = 24;
+    double intervalS = 300;
+    double uploadS = 300;
+    double loss = 0.1;              // Frame lost before the gateway
+    double ackLoss = 0.05;          // Gateway got it, leaf missed the answer
+    double uploadFailure = 0.1;
+    double forge = 0.02;            // Frame replayed, and altered, by an attacker
+    unsigned seed = 1;
+    bool verbose = false;
+};
+
+struct Reading {
+    uint32_t id;
+    uint64_t takenAt;
+};
+
+struct Leaf {
+    std::string deviceId;
+    uint8_t boot;
+    uint16_t seq = 0;
+    uint8_t channel = 0;
+    std::vector<Reading> pending;
+    uint64_t nextWake;
+    uint32_t nextId = 1;
+};
+
+struct Totals {
+    uint64_t taken = 0;
+    uint64_t delivered = 0;
+    uint64_t held = 0;              // Still in a leaf's backlog at the end
+    uint64_t droppedByLeaf = 0;     // RTC backlog full
+    uint64_t lostToOverflow = 0;    // Turned away by a full inbox, yet not kept
+    uint64_t unexplained = 0;
+    uint64_t frames = 0;
+    uint64_t transmissions = 0;
+    uint64_t undelivered = 0;       // Frames no channel answered
+    uint64_t busy = 0;              // Frames the gateway had no room for
+    uint64_t searches = 0;          // Deliveries that changed channel
+    double radioMs = 0;
+    double worstRadioMs = 0;
+    uint64_t uploads = 0;
+    uint64_t failedUploads = 0;
+    uint64_t uploadedFrames = 0;
+    uint64_t duplicatesAtServer = 0;
+    uint64_t misdated = 0;
+    uint64_t forged = 0;            // Altered frames sent
+    uint64_t forgedAtServer = 0;
+};
+
+static const uint8_t KEY[RELAY_KEY_LEN] = {
+    0x3a, 0x91, 0x5e, 0x07, 0xc4, 0x28, 0xbd, 0x66, 0x10, 0xf3, 0x8e, 0x52, 0xa9, 0x4d, 0x2b, 0x75
+};
+
+static Options opt;
+static std::mt19937 rng;
+static RelayInbox inbox;
+static Totals totals;
+static uint8_t gatewayChannel = 6;
+static uint64_t simNow = 0;
+static const Leaf* sender = nullptr;
+static double sendRadioMs = 0;
+
+// Server side: what each leaf's readings were taken at, and what arrived
+static std::map<std::string, std::map<uint32_t, uint64_t>> takenAt;
+static std::map<std::string, std::set<uint32_t>> received;
+
+// Why a reading may be missing: it was in a frame the gateway turned away
+// for lack of room, or the leaf dropped it from a full backlog
+static std::map<std::string, std::set<uint32_t>> overflowed;
+static std::map<std::string, std::set<uint32_t>> dropped;
+
+static bool chance(double p) {
+    return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+// 1 Mbps with long preamble, plus the link-layer ack
+static double airtimeMs(size_t len) {
+    return (192 + len * 8) / 1000.0 + 0.3;
+}
+
+// The radio: RelayTransmit for the leaf in `sender`
+static RelayStatus transmit(uint8_t channel, const uint8_t* data, size_t len) {
+    totals.transmissions++;
+    sendRadioMs += airtimeMs(len);
+
+    if (channel != gatewayChannel || chance(opt.loss)) {
+        sendRadioMs += ACK_TIMEOUT_MS;
+        return RELAY_NO_REPLY;
+    }
+
+    RelayAck reply;
+    RelayStatus status = RelayProtocol::accept(inbox, data, len, (uint32_t)simNow, reply);
+    if (status == RELAY_BUSY) {
+        const RelayFrame& frame = *(const RelayFrame*)data;
+        for (uint8_t i = 0; i < frame.count; i++) {
+            overflowed[sender->deviceId].insert((uint32_t)frame.samples[i].volumeL);
+        }
+    }
+    if (status == RELAY_NO_REPLY || chance(opt.ackLoss)) {
+        sendRadioMs += ACK_TIMEOUT_MS;
+        return RELAY_NO_REPLY;
+    }
+
+    sendRadioMs += airtimeMs(sizeof(reply));
+    return RelayProtocol::parseAck((const uint8_t*)&reply, sizeof(reply), KEY, *(const RelayFrame*)data);
+}
+
+// An attacker without the key records a frame the gateway took and sends
+// it again from its own radio, as it was and with the newest reading
+// changed and numbered past what the gateway has
+static void forge(const RelayFrame& frame, size_t len) {
+    RelayFrame altered = frame;
+    altered.seq += 100;
+    altered.samples[altered.count - 1].volumeL = 1e6f;
+
+    RelayAck reply;
+    totals.forged++;
+    if (gatewayChannel == sender->channel) {
+        RelayProtocol::accept(inbox, (const uint8_t*)&frame, len, (uint32_t)simNow + 1, reply);
+        RelayProtocol::accept(inbox, (const uint8_t*)&altered, len, (uint32_t)simNow + 1, reply);
+    }
+}
+
+// Relay::upload(): false if the request failed
+static bool upload() {
+    size_t count = inbox.count;
+    if (count == 0) {
+        return true;
+    }
+
+    totals.uploads++;
+    if (chance(opt.uploadFailure)) {
+        totals.failedUploads++;
+        return false;
+    }
+
+    // What DataReporter::sendRelay() sends and the backend stores: the
+    // reading's time is arrival on the gateway minus its age
+    for (size_t i = 0; i < count; i++) {
+        const RelayEntry& entry = RelayProtocol::peek(inbox, i);
+        std::string id = entry.frame.deviceId;
+        for (uint8_t j = 0; j < entry.frame.count; j++) {
+            const RelaySample& sample = entry.frame.samples[j];
+            uint32_t readingId = (uint32_t)sample.volumeL;
+            uint64_t at = (uint32_t)(entry.receivedAt - sample.ageMs);
+            if (!takenAt[id].count(readingId)) {
+                totals.forgedAtServer++;
+                continue;
+            }
+
+            if (!received[id].insert(readingId).second) {
+                totals.duplicatesAtServer++;
+                continue;
+            }
+            totals.delivered++;
+            if (at != takenAt[id][readingId]) {
+                totals.misdated++;
+            }
+        }
+    }
+    totals.uploadedFrames += count;
+    RelayProtocol::drop(inbox, count);
+    return true;
+}
+
+// One report wake of a leaf, as relayMeasurement() in water_tank.ino
+static void wake(Leaf& leaf) {
+    leaf.seq++;
+    Reading reading = { leaf.nextId++, simNow };
+    takenAt[leaf.deviceId][reading.id] = reading.takenAt;
+    totals.taken++;
+
+    std::vector<Reading> samples = leaf.pending;
+    samples.push_back(reading);
+
+    RelayFrame frame;
+    RelayProtocol::begin(frame, leaf.deviceId.c_str(), leaf.boot, leaf.seq);
+    size_t first = samples.size() > RELAY_MAX_SAMPLES ? samples.size() - RELAY_MAX_SAMPLES : 0;
+    for (size_t i = first; i < samples.size(); i++) {
+        RelaySample& s = frame.samples[frame.count++];
+        s.ageMs = (uint32_t)(simNow - samples[i].takenAt);
+        s.volumeL = (float)samples[i].id;       // Carries the reading's id
+        s.levelMm = 1000;
+        s.temperatureCenti = 2500;
+        s.batteryMv = 3900;
+    }
+    RelayProtocol::seal(frame, KEY);
+
+    sender = &leaf;
+    sendRadioMs = 0;
+    totals.frames++;
+    uint8_t channel = leaf.channel;
+    RelayStatus status = RelayProtocol::deliver(frame, channel, transmit);
+    totals.radioMs += sendRadioMs;
+    if (sendRadioMs > totals.worstRadioMs) {
+        totals.worstRadioMs = sendRadioMs;
+    }
+
+    if (channel != leaf.channel) {
+        totals.searches++;
+        if (opt.verbose) {
+            printf("%8.2f h  %s found the gateway on channel %u\n", simNow / 3.6e6, leaf.deviceId.c_str(), channel);
+        }
+        leaf.channel = channel;
+    }
+
+    if (status == RELAY_ACCEPTED || status == RELAY_DUPLICATE) {
+        if (chance(opt.forge)) {
+            forge(frame, RelayProtocol::frameSize(frame.count));
+        }
+        leaf.pending.clear();
+        return;
+    }
+
+    if (status == RELAY_BUSY) {
+        totals.busy++;
+    } else {
+        totals.undelivered++;
+    }
+    if (leaf.pending.size() >= PENDING_SAMPLES) {
+        dropped[leaf.deviceId].insert(leaf.pending.front().id);
+        leaf.pending.erase(leaf.pending.begin());
+    }
+    leaf.pending.push_back(reading);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [--leaves N] [--hours H] [--interval-s S] [--upload-s S]\n"
+                    "       [--loss P] [--ack-loss P] [--upload-failure P] [--forge P] [--seed N] [-v]\n", name);
+    exit(2);
+}
+
+static void parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-v") {
+            opt.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        double value = atof(argv[++i]);
+        if (arg == "--leaves") opt.leaves = (int)value;
+        else if (arg == "--hours") opt.hours = value;
+        else if (arg == "--interval-s") opt.intervalS = value;
+        else if (arg == "--upload-s") opt.uploadS = value;
+        else if (arg == "--loss") opt.loss = value;
+        else if (arg == "--ack-loss") opt.ackLoss = value;
+        else if (arg == "--upload-failure") opt.uploadFailure = value;
+        else if (arg == "--forge") opt.forge = value;
+        else if (arg == "--seed") opt.seed = (unsigned)value;
+        else usage(argv[0]);
+    }
+    if (opt.leaves < 1 || opt.leaves > RELAY_MAX_LEAVES || opt.intervalS <= 0 || opt.uploadS <= 0) {
+        usage(argv[0]);
+    }
+}
+
+int main(int argc, char** argv) {
+    parseArgs(argc, argv);
+    rng.seed(opt.seed);
+    memcpy(inbox.key, KEY, RELAY_KEY_LEN);
+
+    std::vector<Leaf> leaves(opt.leaves);
+    for (int i = 0; i < opt.leaves; i++) {
+        Leaf& leaf = leaves[i];
+        leaf.deviceId = "leaf-" + std::to_string(i + 1);
+        leaf.boot = (uint8_t)(rng() % 255 + 1);
+        leaf.nextWake = (uint64_t)(std::uniform_real_distribution<double>(0, opt.intervalS)(rng) * 1000);
+    }
+
+    uint64_t endAt = (uint64_t)(opt.hours * 3.6e6);
+    uint64_t intervalMs = (uint64_t)(opt.intervalS * 1000);
+    uint64_t uploadMs = (uint64_t)(opt.uploadS * 1000);
+    uint64_t nextUpload = uploadMs;
+    uint64_t nextCheck = (uint64_t)UPLOAD_CHECK_MS;
+    uint64_t backoffMs = 0;
+    uint64_t failedAt = 0;
+    bool moved = false;
+
+    while (true) {
+        Leaf* next = &leaves[0];
+        for (Leaf& leaf : leaves) {
+            if (leaf.nextWake < next->nextWake) {
+                next = &leaf;
+            }
+        }
+        uint64_t at = std::min(next->nextWake, std::min(nextUpload, nextCheck));
+        if (at >= endAt) {
+            break;
+        }
+        simNow = at;
+
+        if (!moved && simNow >= endAt / 2) {
+            // The access point changed channel; the gateway follows it
+            gatewayChannel = 11;
+            moved = true;
+            if (opt.verbose) {
+                printf("%8.2f h  gateway moved to channel %u\n", simNow / 3.6e6, gatewayChannel);
+            }
+        }
+
+        if (simNow == nextUpload) {
+            upload();
+            nextUpload += uploadMs;
+        } else if (simNow == nextCheck) {
+            // relayTask() in water_tank.ino
+            if (inbox.count >= RELAY_INBOX_FRAMES / 2 && (backoffMs == 0 || simNow - failedAt >= backoffMs)) {
+                if (upload()) {
+                    backoffMs = 0;
+                } else {
+                    failedAt = simNow;
+                    backoffMs = backoffMs == 0 ? UPLOAD_BACKOFF_MS : std::min(backoffMs * 2, uploadMs);
+                }
+            }
+            nextCheck += (uint64_t)UPLOAD_CHECK_MS;
+        } else {
+            wake(*next);
+            next->nextWake += intervalMs;
+        }
+    }
+
+    // Drain the gateway so what is left is only what leaves still hold
+    double uploadFailure = opt.uploadFailure;
+    opt.uploadFailure = 0;
+    upload();
+    opt.uploadFailure = uploadFailure;
+
+    // A reading can be both delivered and held or dropped (the leaf missed
+    // the ack); the first reason that applies counts
+    for (const Leaf& leaf : leaves) {
+        std::set<uint32_t> held;
+        for (const Reading& reading : leaf.pending) {
+            held.insert(reading.id);
+        }
+        for (const auto& taken : takenAt[leaf.deviceId]) {
+            uint32_t id = taken.first;
+            if (received[leaf.deviceId].count(id)) {
+                continue;
+            } else if (held.count(id)) {
+                totals.held++;
+            } else if (dropped[leaf.deviceId].count(id)) {
+                totals.droppedByLeaf++;
+            } else if (overflowed[leaf.deviceId].count(id)) {
+                totals.lostToOverflow++;
+            } else {
+                totals.unexplained++;
+            }
+        }
+    }
+
+    printf("Leaves %d for %.1f h, report every %.0f s, upload every %.0f s\n",
+        opt.leaves, opt.hours, opt.intervalS, opt.uploadS);
+    printf("Link loss %.0f%%, ack loss %.0f%%, upload failure %.0f%%, seed %u\n\n",
+        opt.loss * 100, opt.ackLoss * 100, opt.uploadFailure * 100, opt.seed);
+    printf("Readings   %llu taken, %llu delivered, %llu held by leaves, %llu dropped by leaves, %llu lost to a full inbox\n",
+        (unsigned long long)totals.taken, (unsigned long long)totals.delivered, (unsigned long long)totals.held,
+        (unsigned long long)totals.droppedByLeaf, (unsigned long long)totals.lostToOverflow);
+    printf("Frames     %llu sent, %llu transmissions (%.2f per frame), %llu never answered, %llu busy, %llu channel changes\n",
+        (unsigned long long)totals.frames, (unsigned long long)totals.transmissions,
+        totals.frames ? (double)totals.transmissions / totals.frames : 0.0,
+        (unsigned long long)totals.undelivered, (unsigned long long)totals.busy,
+        (unsigned long long)totals.searches);
+    printf("Gateway    %u frames accepted, %u repeated frames and %u repeated readings dropped, %u invalid, %u overflows\n",
+        inbox.stats.accepted, inbox.stats.duplicates, inbox.stats.resent, inbox.stats.invalid, inbox.stats.overflows);
+    printf("Leaf radio %.1f ms per report on average, worst %.1f ms\n",
+        totals.frames ? totals.radioMs / totals.frames : 0.0, totals.worstRadioMs);
+    printf("Uploads    %llu requests, %llu failed, %.1f frames each\n",
+        (unsigned long long)totals.uploads, (unsigned long long)totals.failedUploads,
+        totals.uploads > totals.failedUploads ? (double)totals.uploadedFrames / (totals.uploads - totals.failedUploads) : 0.0);
+    printf("Server     %llu duplicates, %llu misdated, %llu forged of %llu sent\n\n",
+        (unsigned long long)totals.duplicatesAtServer, (unsigned long long)totals.misdated,
+        (unsigned long long)totals.forgedAtServer, (unsigned long long)totals.forged);
+
+    bool ok = totals.duplicatesAtServer == 0 && totals.misdated == 0 && totals.forgedAtServer == 0 &&
+        totals.unexplained == 0 && totals.lostToOverflow == 0;
+    if (totals.unexplained != 0) {
+        printf("%llu readings unaccounted for\n", (unsigned long long)totals.unexplained);
+    }
+    if (totals.lostToOverflow != 0) {
+        printf("%llu readings lost to a full inbox\n", (unsigned long long)totals.lostToOverflow);
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
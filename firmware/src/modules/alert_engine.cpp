@@ -0,0 +1,266 @@
+/**
+ * Alert Engine Module Implementation
+ */
+
+#include "alert_engine.h"
+#include "config.h"
+#include "alerts.h"
+#include "rtc_store.h"
+#include "logger.h"
+
+// ============================================================================
+// Rule Table
+// ============================================================================
+
+enum AlertMetric {
+    METRIC_VOLUME,
+    METRIC_BATTERY
+};
+
+/**
+ * What a condition watches; fixed at build time
+ */
+struct AlertCondition {
+    const char* name;           // Server alert type
+    AlertMetric metric;
+    bool above;                 // Raised at or above the threshold (else at or below)
+    float* threshold;           // Config value, so server thresholds apply directly
+    void (*sound)();
+};
+
+/**
+ * How a condition behaves; configurable from the server
+ */
+struct AlertRule {
+    bool enabled;
+    float hysteresis;           // Metric units
+    uint32_t debounceMs;
+    uint32_t cooldownMs;
+};
+
+static const AlertCondition conditions[ALERT_TYPE_COUNT] = {
+    { "tank_full",   METRIC_VOLUME,  true,  &Config::tankFullThreshold,   Alerts::triggerTankFull },
+    { "tank_low",    METRIC_VOLUME,  false, &Config::tankLowThreshold,    Alerts::triggerTankLow },
+    { "battery_low", METRIC_BATTERY, false, &Config::batteryLowThreshold, Alerts::triggerBatteryLow },
+};
+
+static const AlertRule defaultRules[ALERT_TYPE_COUNT] = {
+    { true, ALERT_HYSTERESIS_L, ALERT_DEBOUNCE_MS,         ALERT_COOLDOWN_MS },
+    { true, ALERT_HYSTERESIS_L, ALERT_DEBOUNCE_MS,         ALERT_COOLDOWN_MS },
+    { true, ALERT_HYSTERESIS_V, ALERT_BATTERY_DEBOUNCE_MS, ALERT_BATTERY_COOLDOWN_MS },
+};
+
+static AlertRule rules[ALERT_TYPE_COUNT] = {
+    defaultRules[0], defaultRules[1], defaultRules[2]
+};
+
+// ============================================================================
+// Transitions
+// ============================================================================
+
+static float readMetric(AlertMetric metric, const SystemState& state) {
+    return metric == METRIC_VOLUME ? state.volumeLiters : state.batteryVoltage;
+}
+
+static void queueEvent(RtcAlertState& s, AlertEventKind kind, float value, unsigned long now) {
+    s.event = kind;
+    s.eventValue = value;
+    s.eventAt = now;
+}
+
+static bool raise(int i, float value, unsigned long now) {
+    const AlertCondition& cond = conditions[i];
+    RtcAlertState& s = RtcStore::data().alerts[i];
+
+    s.active = 1;
+
+    // Flapping around the threshold: stay raised, but don't repeat the
+    // sound or the server notification
+    if (s.notifiedAt != 0 && now - s.notifiedAt < rules[i].cooldownMs) {
+        LOG_INFO("[Alert] %s raised again within cooldown (%.2f)", cond.name, value);
+        s.notified = 0;
+        return false;
+    }
+
+    LOG_WARN("[Alert] %s raised (%.2f, threshold %.2f)", cond.name, value, *cond.threshold);
+    cond.sound();
+    s.notified = 1;
+    s.notifiedAt = now;
+    queueEvent(s, ALERT_EVENT_RAISED, value, now);
+    return true;
+}
+
+static bool clear(int i, float value, unsigned long now) {
+    const AlertCondition& cond = conditions[i];
+    RtcAlertState& s = RtcStore::data().alerts[i];
+
+    s.active = 0;
+    LOG_INFO("[Alert] %s cleared (%.2f)", cond.name, value);
+
+    // The server only hears about clears of raises it was told about
+    if (!s.notified) {
+        return false;
+    }
+    s.notified = 0;
+
+    if (s.event == ALERT_EVENT_RAISED) {
+        // Raised and cleared before it could be sent: nothing to report
+        s.event = ALERT_EVENT_NONE;
+        return false;
+    }
+    queueEvent(s, ALERT_EVENT_CLEARED, value, now);
+    return true;
+}
+
+// ============================================================================
+// Rule Settings
+// ============================================================================
+
+static bool updateFlag(bool& target, JsonVariantConst value) {
+    if (!value.is<bool>() || value.as<bool>() == target) {
+        return false;
+    }
+    target = value.as<bool>();
+    return true;
+}
+
+static bool updateNumber(float& target, JsonVariantConst value) {
+    if (!value.is<float>() || value.as<float>() < 0 || value.as<float>() == target) {
+        return false;
+    }
+    target = value.as<float>();
+    return true;
+}
+
+static bool updateSeconds(uint32_t& targetMs, JsonVariantConst value) {
+    if (!value.is<float>() || value.as<float>() < 0) {
+        return false;
+    }
+    uint32_t ms = (uint32_t)(value.as<float>() * 1000.0f);
+    if (ms == targetMs) {
+        return false;
+    }
+    targetMs = ms;
+    return true;
+}
+
+namespace AlertEngine {
+    bool evaluate(const SystemState& state, unsigned long now) {
+        bool queued = false;
+
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            const AlertCondition& cond = conditions[i];
+            const AlertRule& rule = rules[i];
+            RtcAlertState& s = RtcStore::data().alerts[i];
+
+            float value = readMetric(cond.metric, state);
+            float threshold = *cond.threshold;
+
+            if (s.active) {
+                bool cleared = cond.above ? value < threshold - rule.hysteresis :
+                                            value > threshold + rule.hysteresis;
+                if (cleared || !rule.enabled) {
+                    queued |= clear(i, value, now);
+                }
+                continue;
+            }
+
+            bool triggered = cond.above ? value >= threshold : value <= threshold;
+            if (!triggered || !rule.enabled) {
+                s.pending = 0;
+                continue;
+            }
+
+            if (!s.pending) {
+                s.pending = 1;
+                s.pendingSince = now;
+            }
+            if (now - s.pendingSince >= rule.debounceMs) {
+                s.pending = 0;
+                queued |= raise(i, value, now);
+            }
+        }
+
+        return queued;
+    }
+
+    bool isActive(AlertType type) {
+        return RtcStore::data().alerts[type].active != 0;
+    }
+
+    bool anyActive() {
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            if (RtcStore::data().alerts[i].active) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool hasPendingEvents() {
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            if (RtcStore::data().alerts[i].event != ALERT_EVENT_NONE) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t getPendingEvents(AlertEvent* events) {
+        size_t count = 0;
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            const RtcAlertState& s = RtcStore::data().alerts[i];
+            if (s.event != ALERT_EVENT_NONE) {
+                events[count].type = (AlertType)i;
+                events[count].kind = (AlertEventKind)s.event;
+                events[count].value = s.eventValue;
+                events[count].at = s.eventAt;
+                count++;
+            }
+        }
+        return count;
+    }
+
+    void clearPendingEvents() {
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            RtcStore::data().alerts[i].event = ALERT_EVENT_NONE;
+        }
+    }
+
+    const char* getName(AlertType type) {
+        return conditions[type].name;
+    }
+
+    bool applyRules(JsonVariantConst settings) {
+        if (!settings.is<JsonObjectConst>()) {
+            return false;
+        }
+
+        bool changed = false;
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            JsonVariantConst rule = settings[conditions[i].name];
+            if (!rule.is<JsonObjectConst>()) {
+                continue;
+            }
+            changed |= updateFlag(rules[i].enabled, rule["enabled"]);
+            changed |= updateNumber(rules[i].hysteresis, rule["hysteresis"]);
+            changed |= updateSeconds(rules[i].debounceMs, rule["debounce_s"]);
+            changed |= updateSeconds(rules[i].cooldownMs, rule["cooldown_s"]);
+        }
+        return changed;
+    }
+
+    void saveRules(JsonObject settings) {
+        for (int i = 0; i < ALERT_TYPE_COUNT; i++) {
+            JsonObject rule = settings[conditions[i].name].to<JsonObject>();
+            rule["enabled"] = rules[i].enabled;
+            rule["hysteresis"] = rules[i].hysteresis;
+            rule["debounce_s"] = rules[i].debounceMs / 1000.0f;
+            rule["cooldown_s"] = rules[i].cooldownMs / 1000.0f;
+        }
+    }
+
+    void resetRules() {
+        memcpy(rules, defaultRules, sizeof(rules));
+    }
+}
@@ -0,0 +1,110 @@
+/**
+ * ============================================================================
+ * Alert Engine Module
+ * ============================================================================
+ * Evaluates the alert conditions (tank full, tank low, battery low) from a
+ * rule table. Each condition keeps its own state in RTC memory, so several
+ * can be active at once and timing survives deep sleep:
+ *   - hysteresis: clears only once the value is back past the threshold
+ *     by this much
+ *   - debounce: the condition must hold this long before it is raised
+ *   - cooldown: a condition raised again within this time of its last
+ *     notification is raised silently (no sound, no server event)
+ * Raised/cleared transitions are queued as events for DataReporter to
+ * push to the server. Thresholds come from Config; the other rule
+ * settings from the "alert_rules" config object.
+ */
+
+#ifndef ALERT_ENGINE_H
+#define ALERT_ENGINE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "types.h"
+
+enum AlertType {
+    ALERT_TANK_FULL,
+    ALERT_TANK_LOW,
+    ALERT_BATTERY_LOW,
+    ALERT_TYPE_COUNT
+};
+
+enum AlertEventKind {
+    ALERT_EVENT_NONE,
+    ALERT_EVENT_RAISED,
+    ALERT_EVENT_CLEARED
+};
+
+/**
+ * A transition waiting to be sent to the server
+ */
+struct AlertEvent {
+    AlertType type;
+    AlertEventKind kind;
+    float value;                // Reading that caused the transition
+    unsigned long at;           // PowerManager::now() when it happened
+};
+
+namespace AlertEngine {
+    /**
+     * Evaluate every rule against a measurement, playing the alert sound
+     * for newly raised conditions
+     * @param state Latest measurement
+     * @param now PowerManager::now()
+     * @return true if a transition was queued for the server
+     */
+    bool evaluate(const SystemState& state, unsigned long now);
+
+    /**
+     * Check whether a condition is currently raised
+     */
+    bool isActive(AlertType type);
+
+    /**
+     * Check whether any condition is currently raised
+     */
+    bool anyActive();
+
+    /**
+     * Check for transitions not yet acknowledged by the server
+     */
+    bool hasPendingEvents();
+
+    /**
+     * Copy the pending transitions
+     * @param events Array of at least ALERT_TYPE_COUNT entries
+     * @return Number of events copied
+     */
+    size_t getPendingEvents(AlertEvent* events);
+
+    /**
+     * Drop the pending transitions once the server has them
+     */
+    void clearPendingEvents();
+
+    /**
+     * Server name of a condition ("tank_full", "tank_low", "battery_low")
+     */
+    const char* getName(AlertType type);
+
+    /**
+     * Apply rule settings, keyed by condition name:
+     *   {"tank_low": {"enabled": true, "hysteresis": 20,
+     *                 "debounce_s": 30, "cooldown_s": 3600}}
+     * Missing keys keep their current value.
+     * @return true if anything changed
+     */
+    bool applyRules(JsonVariantConst rules);
+
+    /**
+     * Write the rule settings in the format applyRules() reads
+     */
+    void saveRules(JsonObject rules);
+
+    /**
+     * Restore the default rule settings
+     */
+    void resetRules();
+}
+
+#endif // ALERT_ENGINE_H
@@ -4,7 +4,9 @@
 
 #include "alerts.h"
 #include "config.h"
-#include <time.h>
+#include "audio.h"
+#include "time_sync.h"
+#include <Ticker.h>
 
 // Tone frequencies
 #define TONE_LOW        440     // A4
@@ -12,6 +14,182 @@
 #define TONE_HIGH       1760    // A6
 #define TONE_ALERT      2000
 
+// ============================================================================
+// Pattern Tables
+// ============================================================================
+
+/**
+ * One sequencer step: tone (0 = silent) and LED state for a duration
+ */
+struct SeqStep {
+    uint16_t frequency;
+    uint16_t durationMs;
+    uint8_t led;
+};
+
+/**
+ * Steps played `repeat` times, then the `next` pattern (if any)
+ */
+struct Pattern {
+    const SeqStep* steps;       // PROGMEM
+    uint8_t count;
+    uint8_t repeat;
+    uint8_t priority;
+    const Pattern* next;
+};
+
+enum AlertPriority {
+    PRIORITY_STARTUP = 0,
+    PRIORITY_NOTICE = 1,
+    PRIORITY_BATTERY = 2,
+    PRIORITY_TANK = 3
+};
+
+#define STEPS(table) table, sizeof(table) / sizeof(table[0])
+
+// LED blinks: on, then off
+static const SeqStep BLINK_50_50[] PROGMEM   = { {0, 50, 1},  {0, 50, 0} };
+static const SeqStep BLINK_100_100[] PROGMEM = { {0, 100, 1}, {0, 100, 0} };
+static const SeqStep BLINK_200_100[] PROGMEM = { {0, 200, 1}, {0, 100, 0} };
+static const SeqStep BLINK_300_200[] PROGMEM = { {0, 300, 1}, {0, 200, 0} };
+static const SeqStep BLINK_500_300[] PROGMEM = { {0, 500, 1}, {0, 300, 0} };
+
+// Pleasant ascending startup melody (C5 E5 G5)
+static const SeqStep STARTUP_MELODY[] PROGMEM = {
+    {523, 100, 0}, {0, 50, 0}, {659, 100, 0}, {0, 50, 0}, {784, 150, 0}
+};
+
+// Happy melody for tank full (G5 B5 D6)
+static const SeqStep FULL_MELODY[] PROGMEM = {
+    {784, 200, 0}, {0, 100, 0}, {988, 200, 0}, {0, 100, 0}, {1175, 300, 0}, {0, 300, 0}
+};
+
+// Warning descending tone (A5 A4)
+static const SeqStep LOW_MELODY[] PROGMEM = {
+    {880, 300, 0}, {0, 100, 0}, {440, 500, 0}, {0, 200, 0}
+};
+
+// Short warning beeps
+static const SeqStep BATTERY_BEEP[] PROGMEM = { {TONE_ALERT, 100, 0}, {0, 100, 0} };
+
+// Generic trigger() patterns
+static const SeqStep SHORT_BEEP[] PROGMEM  = { {TONE_MID, 100, 0} };
+static const SeqStep LONG_BEEP[] PROGMEM   = { {TONE_MID, 500, 0} };
+static const SeqStep URGENT_BEEP[] PROGMEM = { {TONE_ALERT, 100, 0}, {0, 50, 0} };
+static const SeqStep DEFAULT_BEEP[] PROGMEM = { {TONE_LOW, 200, 0} };
+
+static const Pattern STARTUP_BLINK   = { STEPS(BLINK_200_100), 2, PRIORITY_STARTUP, nullptr };
+static const Pattern STARTUP         = { STEPS(STARTUP_MELODY), 1, PRIORITY_STARTUP, &STARTUP_BLINK };
+
+static const Pattern TANK_FULL_BLINK = { STEPS(BLINK_300_200), 3, PRIORITY_TANK, nullptr };
+static const Pattern TANK_FULL       = { STEPS(FULL_MELODY), 3, PRIORITY_TANK, &TANK_FULL_BLINK };
+static const Pattern TANK_FULL_QUIET = { STEPS(BLINK_100_100), 5, PRIORITY_TANK, nullptr };
+
+static const Pattern TANK_LOW_BLINK  = { STEPS(BLINK_500_300), 5, PRIORITY_TANK, nullptr };
+static const Pattern TANK_LOW        = { STEPS(LOW_MELODY), 4, PRIORITY_TANK, &TANK_LOW_BLINK };
+static const Pattern TANK_LOW_QUIET  = { STEPS(BLINK_100_100), 10, PRIORITY_TANK, nullptr };
+
+static const Pattern BATTERY         = { STEPS(BATTERY_BEEP), 2, PRIORITY_BATTERY, nullptr };
+static const Pattern BATTERY_QUIET   = { STEPS(BLINK_50_50), 3, PRIORITY_BATTERY, nullptr };
+
+static const Pattern NOTICE_SHORT    = { STEPS(SHORT_BEEP), 1, PRIORITY_NOTICE, nullptr };
+static const Pattern NOTICE_LONG     = { STEPS(LONG_BEEP), 1, PRIORITY_NOTICE, nullptr };
+static const Pattern NOTICE_URGENT   = { STEPS(URGENT_BEEP), 5, PRIORITY_NOTICE, nullptr };
+static const Pattern NOTICE_DEFAULT  = { STEPS(DEFAULT_BEEP), 1, PRIORITY_NOTICE, nullptr };
+
+// ============================================================================
+// Sequencer
+// ============================================================================
+
+// Each step arms a one-shot timer for its duration. Timer callbacks run
+// whenever loop() yields (delay(), network waits), so patterns keep time
+// without any polling from the main loop.
+static Ticker stepTimer;
+static const Pattern* volatile current = nullptr;
+static uint8_t stepIndex = 0;
+static uint8_t repeatsLeft = 0;
+
+static void advance();
+
+static void silence() {
+    noTone(PIN_SPEAKER);
+    digitalWrite(PIN_SPEAKER, LOW);
+    digitalWrite(PIN_STATUS_LED, HIGH);  // LED off (active low)
+}
+
+static void startStep() {
+    SeqStep step;
+    memcpy_P(&step, &current->steps[stepIndex], sizeof(step));
+    
+    if (step.frequency > 0) {
+        tone(PIN_SPEAKER, step.frequency);
+    } else {
+        noTone(PIN_SPEAKER);
+    }
+    digitalWrite(PIN_STATUS_LED, step.led ? LOW : HIGH);
+    
+    stepTimer.once_ms(step.durationMs, advance);
+}
+
+static void advance() {
+    if (!current) {
+        return;
+    }
+    
+    if (++stepIndex >= current->count) {
+        stepIndex = 0;
+        if (--repeatsLeft == 0) {
+            current = current->next;
+            if (!current) {
+                silence();
+                return;
+            }
+            repeatsLeft = current->repeat;
+        }
+    }
+    startStep();
+}
+
+static bool accepts(const Pattern& pattern) {
+    return !current || current->priority <= pattern.priority;
+}
+
+static void play(const Pattern& pattern) {
+    if (!accepts(pattern)) {
+        return;
+    }
+    
+#if AUDIO_ENABLED
+    Audio::stop();
+#endif
+    stepTimer.detach();
+    current = &pattern;
+    stepIndex = 0;
+    repeatsLeft = pattern.repeat;
+    startStep();
+}
+
+// Alert sound: the recorded clip if there is one, otherwise the melody.
+// During quiet hours, and alongside a clip, the LED pattern alone.
+static void playAlert(const Pattern& melody, const Pattern& quiet, const char* clip) {
+    if (Alerts::isQuietHours()) {
+        play(quiet);
+        return;
+    }
+    
+#if AUDIO_ENABLED
+    if (accepts(melody)) {
+        play(quiet);
+        if (Audio::play(clip)) {
+            return;
+        }
+    }
+#else
+    (void)clip;
+#endif
+    play(melody);
+}
+
 namespace Alerts {
     void init() {
         Serial.println(F("[Alerts] Initializing..."));
@@ -26,93 +204,57 @@ namespace Alerts {
     }
 
     void playStartupSound() {
-        // Pleasant ascending startup melody
-        playTone(523, 100);  // C5
-        delay(50);
-        playTone(659, 100);  // E5
-        delay(50);
-        playTone(784, 150);  // G5
-        
-        blinkLed(2, 200, 100);
+        play(STARTUP);
     }
 
     void triggerTankFull() {
-        if (isQuietHours()) {
-            // During quiet hours, just blink LED
-            blinkLed(5, 100, 100);
-            return;
-        }
-        
-        // Happy melody for tank full
-        for (int i = 0; i < 3; i++) {
-            playTone(784, 200);   // G5
-            delay(100);
-            playTone(988, 200);   // B5
-            delay(100);
-            playTone(1175, 300);  // D6
-            delay(300);
-        }
-        
-        blinkLed(3, 300, 200);
+        playAlert(TANK_FULL, TANK_FULL_QUIET, AUDIO_DIR "/tank_full.wav");
     }
 
     void triggerTankLow() {
-        if (isQuietHours()) {
-            blinkLed(10, 100, 100);
-            return;
-        }
-        
-        // Warning descending tone
-        for (int i = 0; i < 4; i++) {
-            playTone(880, 300);   // A5
-            delay(100);
-            playTone(440, 500);   // A4
-            delay(200);
-        }
-        
-        blinkLed(5, 500, 300);
+        playAlert(TANK_LOW, TANK_LOW_QUIET, AUDIO_DIR "/tank_low.wav");
     }
 
     void triggerBatteryLow() {
-        if (isQuietHours()) {
-            blinkLed(3, 50, 50);
-            return;
-        }
-        
-        // Short warning beeps
-        for (int i = 0; i < 2; i++) {
-            playTone(TONE_ALERT, 100);
-            delay(100);
-        }
+        playAlert(BATTERY, BATTERY_QUIET, AUDIO_DIR "/battery_low.wav");
     }
 
     void trigger(int pattern) {
         switch (pattern) {
             case 1:  // Short beep
-                playTone(TONE_MID, 100);
+                play(NOTICE_SHORT);
                 break;
             case 2:  // Long beep
-                playTone(TONE_MID, 500);
+                play(NOTICE_LONG);
                 break;
             case 3:  // Urgent (rapid beeps)
-                for (int i = 0; i < 5; i++) {
-                    playTone(TONE_ALERT, 100);
-                    delay(50);
-                }
+                play(NOTICE_URGENT);
                 break;
             default:
-                playTone(TONE_LOW, 200);
+                play(NOTICE_DEFAULT);
         }
     }
 
     void stop() {
-        noTone(PIN_SPEAKER);
-        digitalWrite(PIN_SPEAKER, LOW);
+        stepTimer.detach();
+        current = nullptr;
+        silence();
+#if AUDIO_ENABLED
+        Audio::stop();
+#endif
+    }
+
+    bool isPlaying() {
+#if AUDIO_ENABLED
+        if (Audio::isPlaying()) {
+            return true;
+        }
+#endif
+        return current != nullptr;
     }
 
     bool isQuietHours() {
-        time_t now = time(nullptr);
-        struct tm* timeInfo = localtime(&now);
+        const struct tm* timeInfo = TimeSync::localTime();
         
         if (timeInfo == nullptr) {
             // If time not set, assume not quiet hours
@@ -130,22 +272,4 @@ namespace Alerts {
             return (hour >= QUIET_HOURS_START && hour < QUIET_HOURS_END);
         }
     }
-
-    void playTone(int frequency, int duration) {
-        // Use tone() for ESP8266
-        tone(PIN_SPEAKER, frequency, duration);
-        delay(duration);
-        noTone(PIN_SPEAKER);
-    }
-
-    void blinkLed(int count, int onTime, int offTime) {
-        for (int i = 0; i < count; i++) {
-            digitalWrite(PIN_STATUS_LED, LOW);   // LED on (active low)
-            delay(onTime);
-            digitalWrite(PIN_STATUS_LED, HIGH);  // LED off
-            delay(offTime);
-        }
-    }
 }
-
-
@@ -2,7 +2,11 @@
  * ============================================================================
  * Alerts Module
  * ============================================================================
- * Handles local audio alerts and LED indicators
+ * Handles local audio alerts and LED indicators. Alerts are tone/LED
+ * patterns from data tables, played by a timer-driven sequencer: every
+ * call returns immediately. A pattern interrupts one of equal or lower
+ * priority and is ignored while a higher-priority one plays. With
+ * AUDIO_ENABLED, alerts play a recorded clip from LittleFS when present.
  */
 
 #ifndef ALERTS_H
@@ -43,7 +47,7 @@ namespace Alerts {
     void trigger(int pattern);
     
     /**
-     * Stop any active alert
+     * Stop any active alert (silences the speaker, LED off)
      */
     void stop();
     
@@ -53,19 +57,9 @@ namespace Alerts {
     bool isQuietHours();
     
     /**
-     * Play a tone
-     * @param frequency Frequency in Hz
-     * @param duration Duration in ms
+     * Check if a pattern is playing
      */
-    void playTone(int frequency, int duration);
-    
-    /**
-     * Blink status LED
-     * @param count Number of blinks
-     * @param onTime On duration in ms
-     * @param offTime Off duration in ms
-     */
-    void blinkLed(int count, int onTime = 100, int offTime = 100);
+    bool isPlaying();
 }
 
 #endif // ALERTS_H
@@ -0,0 +1,355 @@
+/**
+ * Audio Module Implementation
+ */
+
+#include "audio.h"
+#include "config.h"
+#include "logger.h"
+#include <LittleFS.h>
+#include <i2s.h>
+#include <Schedule.h>
+
+// WAV format tags
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_IMA_ADPCM    0x0011
+
+// Core I2S driver DMA ring: 8 buffers of 64 frames
+#define I2S_DMA_FRAMES          (8 * 64)
+
+enum ClipFormat {
+    CLIP_PCM8,
+    CLIP_PCM16,
+    CLIP_ADPCM
+};
+
+/**
+ * Clip being streamed and its decoder state
+ */
+struct Clip {
+    File file;
+    ClipFormat format;
+    uint32_t sampleRate;
+    uint32_t dataLeft;          // Bytes of the data chunk not yet read
+    uint16_t blockAlign;        // ADPCM block size (header + nibbles)
+    uint16_t blockLeft;         // Nibble bytes left in the current block
+    int32_t predictor;          // ADPCM: last decoded sample
+    int stepIndex;              // ADPCM: position in the step table
+};
+
+// IMA-ADPCM step sizes and index adjustments
+static const uint16_t ADPCM_STEPS[89] PROGMEM = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+    796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+    7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500,
+    20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t ADPCM_INDEX[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static Clip clip;
+static int16_t samples[AUDIO_BUFFER_SAMPLES];
+static size_t sampleCount = 0;
+static size_t samplePos = 0;
+static uint8_t raw[64];
+
+static bool playing = false;
+static bool pumpScheduled = false;
+static bool primed = false;             // DMA ring has been filled once
+static unsigned long drainUntil = 0;    // Set once the data chunk is exhausted
+static uint32_t sigmaAcc = 0;           // Delta-sigma modulator state
+static uint32_t underruns = 0;
+static uint32_t clipUnderruns = 0;
+
+// ============================================================================
+// WAV Parsing
+// ============================================================================
+
+static uint16_t read16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool readExact(void* buf, size_t len) {
+    return clip.file.read((uint8_t*)buf, len) == len;
+}
+
+// Walk the RIFF chunks to the data chunk, accepting only formats the
+// decoder handles
+static bool openClip(const char* path) {
+    clip.file = LittleFS.open(path, "r");
+    if (!clip.file) {
+        return false;
+    }
+    
+    uint8_t header[12];
+    if (!readExact(header, sizeof(header)) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    
+    bool haveFormat = false;
+    while (true) {
+        uint8_t chunk[8];
+        if (!readExact(chunk, sizeof(chunk))) {
+            return false;
+        }
+        uint32_t size = read32(chunk + 4);
+        
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (size < sizeof(fmt) || !readExact(fmt, sizeof(fmt))) {
+                return false;
+            }
+            uint16_t tag = read16(fmt);
+            uint16_t channels = read16(fmt + 2);
+            uint16_t bits = read16(fmt + 14);
+            clip.sampleRate = read32(fmt + 4);
+            clip.blockAlign = read16(fmt + 12);
+            
+            if (channels != 1 || clip.sampleRate == 0) {
+                return false;
+            } else if (tag == WAV_FORMAT_PCM && bits == 8) {
+                clip.format = CLIP_PCM8;
+            } else if (tag == WAV_FORMAT_PCM && bits == 16) {
+                clip.format = CLIP_PCM16;
+            } else if (tag == WAV_FORMAT_IMA_ADPCM && bits == 4 && clip.blockAlign > 4) {
+                clip.format = CLIP_ADPCM;
+            } else {
+                return false;
+            }
+            haveFormat = true;
+            size -= sizeof(fmt);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            clip.dataLeft = size;
+            clip.blockLeft = 0;
+            return haveFormat;
+        }
+        
+        // Skip the rest of the chunk (padded to an even size)
+        clip.file.seek(size + (size & 1), SeekCur);
+    }
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+static int16_t decodeNibble(uint8_t nibble) {
+    int32_t step = pgm_read_word(&ADPCM_STEPS[clip.stepIndex]);
+    int32_t diff = step >> 3;
+    if (nibble & 1) diff += step >> 2;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 4) diff += step;
+    
+    clip.predictor += (nibble & 8) ? -diff : diff;
+    clip.predictor = constrain(clip.predictor, -32768, 32767);
+    clip.stepIndex = constrain(clip.stepIndex + ADPCM_INDEX[nibble & 7], 0, 88);
+    return (int16_t)clip.predictor;
+}
+
+// Decode up to `max` samples from the file; 0 at the end of the clip
+static size_t decode(int16_t* out, size_t max) {
+    size_t n = 0;
+    
+    while (n < max && clip.dataLeft > 0) {
+        if (clip.format == CLIP_ADPCM && clip.blockLeft == 0) {
+            // Block header: first sample and step index
+            uint8_t header[4];
+            if (clip.dataLeft < sizeof(header) || !readExact(header, sizeof(header))) {
+                clip.dataLeft = 0;
+                break;
+            }
+            clip.dataLeft -= sizeof(header);
+            clip.predictor = (int16_t)read16(header);
+            clip.stepIndex = min((int)header[2], 88);
+            clip.blockLeft = clip.blockAlign - sizeof(header);
+            out[n++] = (int16_t)clip.predictor;
+            continue;
+        }
+        
+        size_t bytes;
+        switch (clip.format) {
+            case CLIP_PCM8:  bytes = max - n; break;
+            case CLIP_PCM16: bytes = (max - n) * 2; break;
+            default:         bytes = min((max - n) / 2, (size_t)clip.blockLeft); break;
+        }
+        bytes = min(bytes, min(sizeof(raw), (size_t)clip.dataLeft));
+        if (bytes == 0) {
+            break;
+        }
+        
+        size_t got = clip.file.read(raw, bytes);
+        if (got == 0) {
+            // Truncated file
+            clip.dataLeft = 0;
+            break;
+        }
+        clip.dataLeft -= got;
+        
+        switch (clip.format) {
+            case CLIP_PCM8:
+                for (size_t i = 0; i < got; i++) {
+                    out[n++] = (int16_t)((raw[i] - 128) << 8);
+                }
+                break;
+            case CLIP_PCM16:
+                for (size_t i = 0; i + 1 < got; i += 2) {
+                    out[n++] = (int16_t)read16(raw + i);
+                }
+                break;
+            default:
+                clip.blockLeft -= got;
+                for (size_t i = 0; i < got; i++) {
+                    out[n++] = decodeNibble(raw[i] & 0x0F);
+                    out[n++] = decodeNibble(raw[i] >> 4);
+                }
+                break;
+        }
+    }
+    
+    return n;
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+
+// One I2S frame (32 bits) per sample
+static uint32_t toFrame(int16_t sample) {
+    int32_t s = (int32_t)sample * AUDIO_VOLUME / 100;
+
+#if AUDIO_I2S_DAC
+    // Same sample on both channels
+    uint16_t u = (uint16_t)s;
+    return ((uint32_t)u << 16) | u;
+#else
+    // First-order delta-sigma, 32x oversampled: the density of ones follows
+    // the sample; the speaker and transistor filter it back to audio
+    uint32_t level = (uint32_t)(s + 32768);
+    uint32_t bits = 0;
+    for (int i = 0; i < 32; i++) {
+        bits <<= 1;
+        sigmaAcc += level;
+        if (sigmaAcc >= 65536) {
+            sigmaAcc -= 65536;
+            bits |= 1;
+        }
+    }
+    return bits;
+#endif
+}
+
+static void finish() {
+    i2s_end();
+    clip.file.close();
+    playing = false;
+    
+    // i2s_end() leaves its pins as inputs; GPIO2 is also the status LED
+    // on most modules, and GPIO3 is serial RX. GPIO15 keeps its external
+    // pull-down as an input.
+    pinMode(PIN_STATUS_LED, OUTPUT);
+    digitalWrite(PIN_STATUS_LED, HIGH);
+    pinMode(3, FUNCTION_0);
+    
+    if (clipUnderruns > 0) {
+        LOG_WARN("[Audio] Clip finished with %lu underrun(s)", clipUnderruns);
+    }
+}
+
+// Top up the DMA ring. Runs every AUDIO_PUMP_INTERVAL_US from loop(),
+// yield() and delay(); returning false unregisters it.
+static bool pump() {
+    if (!playing) {
+        pumpScheduled = false;
+        return false;
+    }
+    
+    if (primed && drainUntil == 0 && i2s_is_empty()) {
+        underruns++;
+        clipUnderruns++;
+    }
+    
+    while (i2s_available() > 0) {
+        int16_t sample = 0;  // Silence once the clip is exhausted
+        if (samplePos >= sampleCount) {
+            sampleCount = decode(samples, AUDIO_BUFFER_SAMPLES);
+            samplePos = 0;
+        }
+        if (samplePos < sampleCount) {
+            sample = samples[samplePos++];
+        }
+        if (!i2s_write_sample_nb(toFrame(sample))) {
+            break;
+        }
+    }
+    primed = true;
+    
+    if (clip.dataLeft == 0 && samplePos >= sampleCount) {
+        // Let the queued frames play out before releasing the pins
+        if (drainUntil == 0) {
+            drainUntil = millis() + I2S_DMA_FRAMES * 1000UL / clip.sampleRate + 1;
+        } else if ((long)(millis() - drainUntil) >= 0) {
+            finish();
+            pumpScheduled = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace Audio {
+    bool play(const char* path) {
+        stop();
+        
+        if (!LittleFS.exists(path)) {
+            return false;
+        }
+        if (!openClip(path)) {
+            LOG_WARN("[Audio] %s: not a mono PCM or IMA-ADPCM WAV", path);
+            clip.file.close();
+            return false;
+        }
+        
+        sampleCount = 0;
+        samplePos = 0;
+        drainUntil = 0;
+        primed = false;
+        sigmaAcc = 0;
+        clipUnderruns = 0;
+        
+        i2s_begin();
+        i2s_set_rate(clip.sampleRate);
+        playing = true;
+        
+        if (!pumpScheduled) {
+            pumpScheduled = schedule_recurrent_function_us(pump, AUDIO_PUMP_INTERVAL_US);
+            if (!pumpScheduled) {
+                finish();
+                return false;
+            }
+        }
+        pump();
+        
+        LOG_INFO("[Audio] Playing %s (%lu Hz)", path, clip.sampleRate);
+        return true;
+    }
+    
+    void stop() {
+        if (playing) {
+            finish();
+        }
+    }
+    
+    bool isPlaying() {
+        return playing;
+    }
+    
+    uint32_t getUnderruns() {
+        return underruns;
+    }
+}
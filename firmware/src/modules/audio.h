@@ -0,0 +1,46 @@
+/**
+ * ============================================================================
+ * Audio Module
+ * ============================================================================
+ * Streams WAV clips from LittleFS to the I2S output: mono 8/16-bit PCM or
+ * 4-bit IMA-ADPCM, any sample rate the I2S clock can make (8-22 kHz is
+ * plenty for a speaker). Clips are decoded a small block at a time into the
+ * core I2S driver's DMA ring, so only a few hundred samples are ever in
+ * RAM. The refill runs as a recurrent scheduled function, which the core
+ * also calls from inside yield() and delay(): playback keeps its rate while
+ * a task blocks on the network.
+ *
+ * Output is either an I2S DAC/amplifier, or (AUDIO_I2S_DAC false) a 1-bit
+ * delta-sigma stream on the I2S data pin driving a transistor and speaker.
+ */
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <Arduino.h>
+
+namespace Audio {
+    /**
+     * Start playing a clip, replacing any clip already playing
+     * @param path File in LittleFS, e.g. "/audio/tank_low.wav"
+     * @return false if the file is missing or not a supported format
+     */
+    bool play(const char* path);
+    
+    /**
+     * Stop playback and release the I2S pins
+     */
+    void stop();
+    
+    /**
+     * Check if a clip is playing
+     */
+    bool isPlaying();
+    
+    /**
+     * Times the DMA ring ran dry since boot (audible as a dropout)
+     */
+    uint32_t getUnderruns();
+}
+
+#endif // AUDIO_H
@@ -3,12 +3,58 @@
  */
 
 #include "config.h"
+#include "heap_monitor.h"
+#include "alert_engine.h"
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 
 #define CONFIG_FILE "/config.json"
 
+// Set a numeric setting from the device key or the server's unit-suffixed
+// one (e.g. "tank_low_threshold" / "tank_low_threshold_l")
+template <typename T>
+static bool applyNumber(JsonVariantConst doc, const char* key, const char* serverKey, T& target) {
+    JsonVariantConst value = doc[key];
+    if (!value.is<float>() && serverKey != nullptr) {
+        value = doc[serverKey];
+    }
+    if (!value.is<float>() || value.as<T>() == target) {
+        return false;
+    }
+    target = value.as<T>();
+    return true;
+}
+
+static bool applyString(JsonVariantConst doc, const char* key, String& target) {
+    JsonVariantConst value = doc[key];
+    if (!value.is<const char*>() || target == value.as<const char*>()) {
+        return false;
+    }
+    target = value.as<const char*>();
+    return true;
+}
+
+// Per-channel settings, by position: [{ "level_empty_cm", "level_full_cm",
+// "area_cm2" }, ...]. Extra entries are ignored.
+static bool applyChannels(JsonVariantConst list) {
+    JsonArrayConst array = list.as<JsonArrayConst>();
+    bool changed = false;
+    for (size_t i = 0; i < array.size() && i < SENSOR_CHANNELS; i++) {
+        ChannelConfig& channel = Config::channels[i];
+        changed |= applyNumber(array[i], "level_empty_cm", nullptr, channel.levelEmptyCm);
+        changed |= applyNumber(array[i], "level_full_cm", nullptr, channel.levelFullCm);
+        changed |= applyNumber(array[i], "area_cm2", nullptr, channel.areaCm2);
+    }
+    return changed;
+}
+
+static void resetChannels() {
+    for (int i = 0; i < SENSOR_CHANNELS; i++) {
+        Config::channels[i] = { LEVEL_EMPTY_CM, LEVEL_FULL_CM, (float)TANK_AREA_CM2 };
+    }
+}
+
 namespace Config {
     // Runtime configuration with defaults
     unsigned long measurementIntervalMs = MEASUREMENT_INTERVAL_MS;
@@ -16,8 +62,7 @@ namespace Config {
     float tankFullThreshold = TANK_FULL_THRESHOLD_L;
     float tankLowThreshold = TANK_LOW_THRESHOLD_L;
     float batteryLowThreshold = BATTERY_LOW_THRESHOLD_V;
-    float levelEmptyCm = LEVEL_EMPTY_CM;
-    float levelFullCm = LEVEL_FULL_CM;
+    ChannelConfig channels[SENSOR_CHANNELS];    // Set by load()
     
     // WiFi credentials (defaults from config.h)
     String wifiSsid = WIFI_SSID_DEFAULT;
@@ -30,6 +75,8 @@ namespace Config {
     void load() {
         Serial.println(F("[Config] Loading from flash..."));
         
+        resetChannels();
+        
         if (!LittleFS.begin()) {
             Serial.println(F("[Config] Failed to mount filesystem, using defaults"));
             return;
@@ -61,8 +108,10 @@ namespace Config {
         tankFullThreshold = doc["tank_full_threshold"] | TANK_FULL_THRESHOLD_L;
         tankLowThreshold = doc["tank_low_threshold"] | TANK_LOW_THRESHOLD_L;
         batteryLowThreshold = doc["battery_low_threshold"] | BATTERY_LOW_THRESHOLD_V;
-        levelEmptyCm = doc["level_empty_cm"] | LEVEL_EMPTY_CM;
-        levelFullCm = doc["level_full_cm"] | LEVEL_FULL_CM;
+        channels[0].levelEmptyCm = doc["level_empty_cm"] | LEVEL_EMPTY_CM;
+        channels[0].levelFullCm = doc["level_full_cm"] | LEVEL_FULL_CM;
+        applyChannels(doc["channels"]);
+        AlertEngine::applyRules(doc["alert_rules"]);
         
         // Load WiFi credentials
         if (doc.containsKey("wifi_ssid")) {
@@ -84,6 +133,8 @@ namespace Config {
     }
 
     void save() {
+        HEAP_SITE("config", HEAP_BUDGET_CONFIG_BYTES);
+        
         Serial.println(F("[Config] Saving to flash..."));
         
         if (!LittleFS.begin()) {
@@ -103,8 +154,16 @@ namespace Config {
         doc["tank_full_threshold"] = tankFullThreshold;
         doc["tank_low_threshold"] = tankLowThreshold;
         doc["battery_low_threshold"] = batteryLowThreshold;
-        doc["level_empty_cm"] = levelEmptyCm;
-        doc["level_full_cm"] = levelFullCm;
+        doc["level_empty_cm"] = channels[0].levelEmptyCm;
+        doc["level_full_cm"] = channels[0].levelFullCm;
+        JsonArray channelList = doc["channels"].to<JsonArray>();
+        for (int i = 0; i < SENSOR_CHANNELS; i++) {
+            JsonObject channel = channelList.add<JsonObject>();
+            channel["level_empty_cm"] = channels[i].levelEmptyCm;
+            channel["level_full_cm"] = channels[i].levelFullCm;
+            channel["area_cm2"] = channels[i].areaCm2;
+        }
+        AlertEngine::saveRules(doc["alert_rules"].to<JsonObject>());
         doc["wifi_ssid"] = wifiSsid;
         doc["wifi_password"] = wifiPassword;
         doc["device_id"] = deviceId;
@@ -124,12 +183,12 @@ namespace Config {
         tankFullThreshold = TANK_FULL_THRESHOLD_L;
         tankLowThreshold = TANK_LOW_THRESHOLD_L;
         batteryLowThreshold = BATTERY_LOW_THRESHOLD_V;
-        levelEmptyCm = LEVEL_EMPTY_CM;
-        levelFullCm = LEVEL_FULL_CM;
+        resetChannels();
         wifiSsid = WIFI_SSID_DEFAULT;
         wifiPassword = WIFI_PASSWORD_DEFAULT;
         deviceId = DEVICE_ID_DEFAULT;
         deviceToken = DEVICE_TOKEN_DEFAULT;
+        AlertEngine::resetRules();
         
         // Delete config file
         if (LittleFS.begin()) {
@@ -148,42 +207,43 @@ namespace Config {
             return false;
         }
         
-        // Apply values (only if present in JSON)
-        if (doc.containsKey("measurement_interval")) {
-            measurementIntervalMs = doc["measurement_interval"];
-        }
-        if (doc.containsKey("report_interval")) {
-            reportIntervalMs = doc["report_interval"];
-        }
-        if (doc.containsKey("tank_full_threshold")) {
-            tankFullThreshold = doc["tank_full_threshold"];
-        }
-        if (doc.containsKey("tank_low_threshold")) {
-            tankLowThreshold = doc["tank_low_threshold"];
-        }
-        if (doc.containsKey("battery_low_threshold")) {
-            batteryLowThreshold = doc["battery_low_threshold"];
-        }
-        if (doc.containsKey("level_empty_cm")) {
-            levelEmptyCm = doc["level_empty_cm"];
-        }
-        if (doc.containsKey("level_full_cm")) {
-            levelFullCm = doc["level_full_cm"];
-        }
-        if (doc.containsKey("wifi_ssid")) {
-            wifiSsid = doc["wifi_ssid"].as<String>();
-        }
-        if (doc.containsKey("wifi_password")) {
-            wifiPassword = doc["wifi_password"].as<String>();
-        }
-        if (doc.containsKey("device_id")) {
-            deviceId = doc["device_id"].as<String>();
-        }
-        if (doc.containsKey("device_token")) {
-            deviceToken = doc["device_token"].as<String>();
+        return applyFromJson(doc.as<JsonVariantConst>());
+    }
+
+    bool applyFromJson(JsonVariantConst doc) {
+        HEAP_SITE("config", HEAP_BUDGET_CONFIG_BYTES);
+        
+        if (!doc.is<JsonObjectConst>()) {
+            return false;
         }
         
-        save();
+        // Apply values (only if present in JSON). The server sends
+        // unit-suffixed names; both are accepted.
+        bool changed = false;
+        changed |= applyNumber(doc, "measurement_interval", "measurement_interval_ms", measurementIntervalMs);
+        changed |= applyNumber(doc, "report_interval", "report_interval_ms", reportIntervalMs);
+        changed |= applyNumber(doc, "tank_full_threshold", "tank_full_threshold_l", tankFullThreshold);
+        changed |= applyNumber(doc, "tank_low_threshold", "tank_low_threshold_l", tankLowThreshold);
+        changed |= applyNumber(doc, "battery_low_threshold", "battery_low_threshold_v", batteryLowThreshold);
+
+        // With a channel list, channel 0 comes from it alone: the top-level
+        // keys may disagree, and applying both would rewrite flash each time
+        if (doc["channels"].as<JsonArrayConst>().size() > 0) {
+            changed |= applyChannels(doc["channels"]);
+        } else {
+            changed |= applyNumber(doc, "level_empty_cm", nullptr, channels[0].levelEmptyCm);
+            changed |= applyNumber(doc, "level_full_cm", nullptr, channels[0].levelFullCm);
+        }
+        changed |= applyString(doc, "wifi_ssid", wifiSsid);
+        changed |= applyString(doc, "wifi_password", wifiPassword);
+        changed |= applyString(doc, "device_id", deviceId);
+        changed |= applyString(doc, "device_token", deviceToken);
+        changed |= AlertEngine::applyRules(doc["alert_rules"]);
+        
+        // Every response carries the config; only write flash when it differs
+        if (changed) {
+            save();
+        }
         return true;
     }
     
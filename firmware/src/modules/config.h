@@ -10,6 +10,7 @@
 #define CONFIG_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 
 // ============================================================================
 // Firmware Version
@@ -35,6 +36,15 @@
 #define WIFI_CONNECT_TIMEOUT_MS     15000
 #define WIFI_RECONNECT_INTERVAL_MS  30000
 
+// Restarting this many times, each within the window of the previous
+// boot, opens the config portal
+#define RESTART_PORTAL_COUNT        3
+#define RESTART_WINDOW_MS           5000
+
+// Reconnect with the BSSID, channel and lease cached in RTC memory;
+// fall back to a full scan + DHCP if it takes longer than this
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 1500
+
 // ============================================================================
 // Server Configuration
 // ============================================================================
@@ -42,11 +52,16 @@
 #define SERVER_HOST         "aquamind-api.utkarshjoshi.com"
 #define SERVER_PORT         443
 #define SERVER_ENDPOINT     "/api/v1/measurements"
+#define SERVER_ALERTS_ENDPOINT "/api/v1/alerts"
 
 // Default device ID and token (can be overridden via config portal)
 #define DEVICE_ID_DEFAULT   "watertank"
 #define DEVICE_TOKEN_DEFAULT "688bb1924d4a0f43d1ace8eaf9d4475d86841761c280fc4bf3650b51a32b8043"
 
+// Longest device ID and token the config portal takes, with the NUL
+#define DEVICE_ID_MAX_LEN   64
+#define DEVICE_TOKEN_MAX_LEN 128
+
 // Use HTTPS (recommended)
 #define USE_HTTPS           true
 
@@ -58,6 +73,32 @@
 #define MQTT_PASSWORD       ""
 #define MQTT_TOPIC          "watertank/device1"
 
+// Resolve SERVER_HOST through the RTC-backed DNS cache and connect by
+// address. Skips TLS SNI, so the server must not depend on it (the nginx
+// deployment routes by Host header). Disable if it sits behind an
+// SNI-routed proxy.
+#define DNS_CACHE_ENABLED   true
+
+// How long a resolved address is used without asking DNS again. The
+// ESP8266 resolver does not expose record TTLs, so this is fixed.
+#define DNS_CACHE_TTL_MS    3600000  // 1 hour
+
+// Give up on a DNS query after this long and use the last good address
+#define DNS_LOOKUP_TIMEOUT_MS 3000
+
+// Wall clock (quiet hours, measurement timestamps). POSIX TZ string, e.g.
+// "UTC0" or "CET-1CEST,M3.5.0,M10.5.0/3"
+#define TIME_ZONE           "IST-5:30"
+#define NTP_SERVER_1        "pool.ntp.org"
+#define NTP_SERVER_2        "time.google.com"
+
+// Re-sync this often; the clock kept across deep sleep drifts by up to a
+// few percent
+#define TIME_RESYNC_MS      21600000  // 6 hours
+
+// Longest a deep-sleep wake stays up waiting for SNTP after reporting
+#define TIME_SYNC_WAIT_MS   2000
+
 // ============================================================================
 // Hardware Pin Configuration
 // ============================================================================
@@ -66,6 +107,11 @@
 #define PIN_ULTRASONIC_TRIG     D1      // GPIO5
 #define PIN_ULTRASONIC_ECHO     D2      // GPIO4
 
+// Per-channel pins (SENSOR_CHANNELS > 1), channel 0 first. Only one sensor
+// pings at a time, so the echoes can share one input through a diode each.
+#define SENSOR_TRIG_PINS        { PIN_ULTRASONIC_TRIG, D6, D7 }
+#define SENSOR_ECHO_PINS        { PIN_ULTRASONIC_ECHO, PIN_ULTRASONIC_ECHO, PIN_ULTRASONIC_ECHO }
+
 // Temperature Sensor (DS18B20)
 #define PIN_TEMPERATURE         D3      // GPIO0
 
@@ -99,6 +145,22 @@
 #define LEVEL_EMPTY_CM          140.0   // Distance when tank is empty
 #define LEVEL_FULL_CM           20.0    // Distance when tank is full
 
+// Cross-section for volume (the tank is a prism either way)
+#ifdef TANK_IS_CYLINDRICAL
+#define TANK_AREA_CM2           (PI * TANK_DIAMETER_CM * TANK_DIAMETER_CM / 4.0)
+#else
+#define TANK_AREA_CM2           (TANK_LENGTH_CM * TANK_WIDTH_CM)
+#endif
+
+// Multi-tank: one device reads up to SENSOR_CHANNELS tanks, one ultrasonic
+// sensor each (pins above), and reports them all in one upload. Channel 0
+// is the primary tank that alerts, usage tracking and forecasts follow.
+// Every channel starts with the geometry and calibration above; the
+// "channels" config sets them per tank.
+#ifndef SENSOR_CHANNELS
+#define SENSOR_CHANNELS         1
+#endif
+
 // ============================================================================
 // Alert Thresholds
 // ============================================================================
@@ -107,13 +169,86 @@
 #define TANK_LOW_THRESHOLD_L        100.0   // Alert when volume <= this
 #define BATTERY_LOW_THRESHOLD_V     3.3     // Battery voltage warning
 
-// Hysteresis to prevent alert flapping
+// Hysteresis to prevent alert flapping: a raised alert clears once the
+// reading is this far back past its threshold
 #define ALERT_HYSTERESIS_L          20.0
+#define ALERT_HYSTERESIS_V          0.1
+
+// A condition must hold this long before it is raised; battery voltage
+// sags under radio load, so it gets longer
+#define ALERT_DEBOUNCE_MS           30000
+#define ALERT_BATTERY_DEBOUNCE_MS   300000    // 5 minutes
+
+// Raising the same alert again within this time of the last notification
+// is silent (no sound, no server event)
+#define ALERT_COOLDOWN_MS           3600000   // 1 hour
+#define ALERT_BATTERY_COOLDOWN_MS   43200000  // 12 hours
 
 // Quiet hours (no audible alerts)
 #define QUIET_HOURS_START           22      // 10 PM
 #define QUIET_HOURS_END             7       // 7 AM
 
+// ============================================================================
+// Usage Tracking
+// ============================================================================
+
+// A draw or refill is the level moving at least this fast between two
+// filtered readings, by at least USAGE_NOISE_L (about 1 cm on the default
+// tank)
+#define USAGE_FLOW_LPM              2.0
+#define USAGE_NOISE_L               6.0
+
+// A draw or refill ends after this many readings without flow
+#define USAGE_SETTLE_SAMPLES        2
+
+// Smaller draws count towards daily usage but are not reported as events;
+// smaller rises are ignored
+#define USAGE_MIN_EVENT_L           10.0
+
+// Leak: no draw or refill for this long, yet the level fell at least
+// USAGE_LEAK_RATE_LPH on average
+#define USAGE_LEAK_WINDOW_MS        14400000  // 4 hours
+#define USAGE_LEAK_RATE_LPH         2.0
+
+// ============================================================================
+// Forecasting
+// ============================================================================
+
+// Weight kept by older readings at each new one; 0.9 follows roughly the
+// last 10 readings
+#define FORECAST_FORGETTING         0.9
+
+// A reading this far off the fitted line starts a new fit (a draw or
+// refill began or ended). Fitted flow slower than USAGE_FLOW_LPM counts
+// as idle, and time to empty then comes from yesterday's usage.
+#define FORECAST_RESET_L            8.0
+
+// ============================================================================
+// Audio Configuration
+// ============================================================================
+
+// Recorded alert clips: WAV files in LittleFS (AUDIO_DIR/tank_full.wav,
+// tank_low.wav, battery_low.wav) played through I2S in place of the tone()
+// melodies; alerts without a clip keep the melody. Takes GPIO3 (RX, data),
+// GPIO15 (D8, bit clock) and GPIO2 (D4, word clock - the status LED on most
+// modules) while a clip plays, so serial input is unavailable until the
+// clip ends.
+#ifndef AUDIO_ENABLED
+#define AUDIO_ENABLED           false
+#endif
+
+// true: I2S DAC/amplifier (e.g. MAX98357A). false: 1-bit delta-sigma stream
+// on GPIO3 into a transistor and speaker.
+#define AUDIO_I2S_DAC           false
+
+#define AUDIO_DIR               "/audio"
+#define AUDIO_VOLUME            100     // Percent
+
+// Decoded samples held in RAM, and how often the DMA ring (512 frames,
+// 64 ms at 8 kHz) is topped up
+#define AUDIO_BUFFER_SAMPLES    128
+#define AUDIO_PUMP_INTERVAL_US  5000
+
 // ============================================================================
 // Timing Configuration
 // ============================================================================
@@ -124,12 +259,177 @@
 // How often to report to server (milliseconds)
 #define REPORT_INTERVAL_MS          300000  // 5 minutes
 
-// How often to check for OTA updates (milliseconds)
-#define OTA_CHECK_INTERVAL_MS       3600000  // 1 hour
+// Fallback OTA poll (milliseconds). Available updates normally arrive
+// with the measurement response, so this is a conditional safety net
+#define OTA_CHECK_INTERVAL_MS       86400000  // 24 hours
 
 // Sensor stabilization delay
 #define SENSOR_WARMUP_MS            100
 
+// Scheduler: WiFi/portal/ArduinoOTA upkeep period, longest idle delay per
+// loop() pass, and how often the task statistics are printed
+#define SCHEDULER_FAST_TASK_MS      20
+#define SCHEDULER_IDLE_MAX_MS       50
+#define SCHEDULER_STATS_INTERVAL_MS 600000  // 10 minutes
+
+// Task deadlines (milliseconds from due to finished); misses are counted
+// in the scheduler statistics
+#define ALERT_DEADLINE_MS           100
+#define OTA_CHECK_DEADLINE_MS       10000
+
+// Let the SDK light-sleep while the scheduler idles (keeps the association,
+// adds up to a beacon interval of latency to incoming requests)
+#ifndef IDLE_LIGHT_SLEEP_ENABLED
+#define IDLE_LIGHT_SLEEP_ENABLED    false
+#endif
+
+// Latency histograms for hot paths (sensor, upload, connect, flash writes,
+// loop passes), printed with the task statistics and sent with uploads.
+// false compiles the instrumentation out.
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED           true
+#endif
+
+// Heap sampling period for the free-heap / largest-block low-water marks
+#define HEAP_SAMPLE_INTERVAL_MS     1000
+
+// Attribute heap use to call sites (HEAP_SITE); on in debug builds
+#ifndef HEAP_SITE_TRACKING
+#ifdef DEBUG
+#define HEAP_SITE_TRACKING          true
+#else
+#define HEAP_SITE_TRACKING          false
+#endif
+#endif
+
+// Peak heap use allowed per call site before a warning is logged (bytes)
+#define HEAP_BUDGET_UPLOAD_BYTES    28000   // TLS session + request/response
+#define HEAP_BUDGET_STORAGE_BYTES   4096
+#define HEAP_BUDGET_CONFIG_BYTES    4096
+
+// ============================================================================
+// Logging Configuration
+// ============================================================================
+
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERROR         1
+#define LOG_LEVEL_WARN          2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_DEBUG         4
+
+// Highest level compiled in; LOG_* calls above it generate no code.
+// Debug builds include payloads and response bodies.
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL               LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL               LOG_LEVEL_INFO
+#endif
+#endif
+
+// RAM ring holding records until the idle hook writes them out
+#define LOG_RING_BYTES          2048
+
+// Write raw records to Serial instead of text (decode with make log-decode)
+#ifndef LOG_SERIAL_BINARY
+#define LOG_SERIAL_BINARY       false
+#endif
+
+// Records at or below this level are also appended to /log.bin in LittleFS
+// (LOG_LEVEL_NONE disables); the file rotates to /log.old at the size limit
+#define LOG_FILE_LEVEL          LOG_LEVEL_WARN
+#define LOG_FILE_MAX_BYTES      16384
+
+// ============================================================================
+// Power Configuration
+// ============================================================================
+
+// Duty-cycle mode: wake, measure, report when due, then deep sleep until
+// the next measurement. Requires D0 (GPIO16) wired to RST.
+#ifndef DEEP_SLEEP_ENABLED
+#define DEEP_SLEEP_ENABLED      false
+#endif
+
+// Radio-off batching (mains power): WiFi sleeps between uploads and
+// measurements queue in RAM. The radio comes up once per report interval,
+// when the queue fills, or when an alert is raised.
+#ifndef RADIO_BATCHING_ENABLED
+#define RADIO_BATCHING_ENABLED  false
+#endif
+
+// Measurements queued between batched uploads
+#define BATCH_MAX_SAMPLES       32
+
+// Rollups: each report carries min/max/mean/first/last of every reading
+// since the previous one (the report interval is the window) instead of
+// the latest reading or all of them. Readings that jump by ROLLUP_STEP_CM
+// or more from the one before are also sent raw.
+#ifndef ROLLUP_ENABLED
+#define ROLLUP_ENABLED          false
+#endif
+
+#define ROLLUP_STEP_CM          5.0
+
+// ESP-NOW relay for clusters of tanks. Leaves never associate: each report
+// is one frame to the gateway, a mains-powered unit on the access point
+// that uploads all its leaves' readings in one request with its own
+// reports. Leaves run the deep-sleep cycle with one tank and no rollups.
+#define RELAY_ROLE_NONE         0
+#define RELAY_ROLE_LEAF         1
+#define RELAY_ROLE_GATEWAY      2
+
+#ifndef RELAY_ROLE
+#define RELAY_ROLE              RELAY_ROLE_NONE
+#endif
+
+// Gateway's station MAC (it logs it at boot)
+#define RELAY_GATEWAY_MAC       { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
+
+// Key shared by the gateway and its leaves; frames and answers without a
+// valid tag are dropped. 16 random bytes, e.g. `openssl rand -hex 16`.
+#ifndef RELAY_KEY
+#define RELAY_KEY               { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, \
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
+#endif
+
+// Longest a leaf waits for the gateway's answer to a frame
+#define RELAY_ACK_TIMEOUT_MS    30
+
+// Gateway: first wait after a failed early upload (half-full queue)
+#define RELAY_UPLOAD_BACKOFF_MS 30000
+
+#if RELAY_ROLE == RELAY_ROLE_LEAF && (!DEEP_SLEEP_ENABLED || ROLLUP_ENABLED || SENSOR_CHANNELS > 1)
+#error "Relay leaves need DEEP_SLEEP_ENABLED, one sensor channel and no rollups"
+#endif
+#if RELAY_ROLE == RELAY_ROLE_GATEWAY && (DEEP_SLEEP_ENABLED || RADIO_BATCHING_ENABLED || IDLE_LIGHT_SLEEP_ENABLED)
+#error "A relay gateway keeps its radio on to hear its leaves"
+#endif
+
+// ============================================================================
+// Local API Configuration
+// ============================================================================
+
+// HTTP server for the LAN: current state as JSON (/api/state), recent
+// readings in a compact binary form (/api/history) and a dashboard served
+// from LittleFS. Needs the radio on, so it defaults to off in the
+// deep-sleep and batching modes.
+#ifndef LOCAL_API_ENABLED
+#define LOCAL_API_ENABLED       (!DEEP_SLEEP_ENABLED && !RADIO_BATCHING_ENABLED)
+#endif
+
+#define LOCAL_API_PORT          80
+
+// Dashboard files, gzipped by `make web` and shipped as release assets
+#define LOCAL_API_WEB_DIR       "/www"
+
+// Readings kept in RAM for /api/history, 14 bytes each (4 hours at the
+// default measurement interval)
+#define LOCAL_HISTORY_SAMPLES   240
+
+#if LOCAL_API_ENABLED && (DEEP_SLEEP_ENABLED || RADIO_BATCHING_ENABLED)
+#error "The local API needs the radio on"
+#endif
+
 // ============================================================================
 // OTA Configuration
 // ============================================================================
@@ -141,10 +441,23 @@
 // Final URL format: {OTA_UPDATE_URL_BASE}/{deviceId}/ota/latest
 #define OTA_UPDATE_URL_BASE     "https://aquamind-api.utkarshjoshi.com/api/v1/devices"
 
+// Image signing (RSA-2048 / SHA-256). Verification is compiled in when
+// `make keys` has created keys/public.key; see firmware/README.md
+#define OTA_SIGNATURE_SIZE      256
+
 // ============================================================================
 // Runtime Config Class
 // ============================================================================
 
+/**
+ * Geometry and calibration of one sensor channel (tank)
+ */
+struct ChannelConfig {
+    float levelEmptyCm;         // Distance when the tank is empty
+    float levelFullCm;          // Distance when the tank is full
+    float areaCm2;              // Cross-section
+};
+
 namespace Config {
     // These can be modified at runtime and saved to flash
     extern unsigned long measurementIntervalMs;
@@ -152,8 +465,7 @@ namespace Config {
     extern float tankFullThreshold;
     extern float tankLowThreshold;
     extern float batteryLowThreshold;
-    extern float levelEmptyCm;
-    extern float levelFullCm;
+    extern ChannelConfig channels[SENSOR_CHANNELS];
     
     // WiFi credentials (configurable via portal)
     extern String wifiSsid;
@@ -175,6 +487,9 @@ namespace Config {
     // Apply config from JSON (for remote updates)
     bool applyFromJson(const char* json);
     
+    // Apply config from an already parsed object
+    bool applyFromJson(JsonVariantConst json);
+    
     // Get OTA hostname (uses deviceId)
     String getOtaHostname();
 }
@@ -3,7 +3,15 @@
  */
 
 #include "data_reporter.h"
+#include "payload.h"
 #include "config.h"
+#include "ota_handler.h"
+#include "dns_cache.h"
+#include "profiler.h"
+#include "heap_monitor.h"
+#include "logger.h"
+#include "usage_tracker.h"
+#include "power_manager.h"
 #include <ESP8266HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
@@ -12,13 +20,49 @@ static String serverHost = SERVER_HOST;
 static int serverPort = SERVER_PORT;
 static String serverEndpoint = SERVER_ENDPOINT;
 
-// WiFi clients
-static WiFiClient wifiClient;
-static WiFiClientSecure wifiClientSecure;
+// WiFi clients (server address comes from the DNS cache)
+static DnsCachedClient<WiFiClient> wifiClient;
+static DnsCachedClient<WiFiClientSecure> wifiClientSecure;
+
+// Open a request to the server with the device's credentials. HTTP/1.0:
+// no chunked encoding, so responses parse from the socket.
+static void beginRequest(HTTPClient& http, const String& path) {
+    String url = String(USE_HTTPS ? "https://" : "http://") +
+                 serverHost + ":" + String(serverPort) + path;
+    
+    http.useHTTP10(true);
+    #if USE_HTTPS
+    http.begin(wifiClientSecure, url);
+    #else
+    http.begin(wifiClient, url);
+    #endif
+    http.addHeader("Authorization", "Bearer " + Config::deviceToken);
+}
+
+// Apply config and OTA hints returned with a measurement upload
+static void handleResponse(Stream& body) {
+    JsonDocument respDoc;
+    DeserializationError error = Payload::parseResponse(body, respDoc);
+    HeapMonitor::sample();
+    if (error) {
+        LOG_WARN("[Reporter] Bad response: %s", error.c_str());
+        return;
+    }
+    
+    // Check for config updates in response
+    if (respDoc.containsKey("config")) {
+        Config::applyFromJson(respDoc["config"].as<JsonVariantConst>());
+    }
+    
+    // Pending firmware is advertised here instead of polling /ota/latest
+    if (respDoc.containsKey("ota")) {
+        OTAHandler::notifyAvailable(respDoc["ota"]);
+    }
+}
 
 namespace DataReporter {
     void init() {
-        Serial.println(F("[Reporter] Initializing..."));
+        LOG_INFO("[Reporter] Initializing...");
         
         #if USE_HTTPS
         // For testing, accept any certificate
@@ -26,7 +70,7 @@ namespace DataReporter {
         wifiClientSecure.setInsecure();
         #endif
         
-        Serial.printf("[Reporter] Endpoint: %s://%s:%d%s\n",
+        LOG_INFO("[Reporter] Endpoint: %s://%s:%d%s",
             USE_HTTPS ? "https" : "http",
             serverHost.c_str(),
             serverPort,
@@ -34,85 +78,156 @@ namespace DataReporter {
         );
     }
 
-    bool send(float levelCm, float volumeL, float tempC, float batteryV, int rssi) {
-        HTTPClient http;
+    bool send(float levelCm, float volumeL, float tempC, float batteryV, int rssi,
+              const float* channelLevelsCm) {
+        PROFILE_SCOPE(PROBE_REPORT_SEND);
+        HEAP_SITE("report", HEAP_BUDGET_UPLOAD_BYTES);
         
-        String url = String(USE_HTTPS ? "https://" : "http://") +
-                     serverHost + ":" + String(serverPort) + serverEndpoint;
-        
-        // Build JSON payload
-        JsonDocument doc;
-        doc["device_id"] = Config::deviceId;
-        doc["firmware_version"] = FIRMWARE_VERSION;
-        doc["timestamp"] = millis();  // Server should use its own timestamp
-        doc["level_cm"] = levelCm;
-        doc["volume_l"] = volumeL;
-        doc["temperature_c"] = tempC;
-        doc["battery_v"] = batteryV;
-        doc["rssi"] = rssi;
+        HTTPClient http;
         
         String payload;
-        serializeJson(doc, payload);
+        bool usageSent = Payload::report(payload, levelCm, volumeL, tempC, batteryV, rssi,
+                                         channelLevelsCm, PowerManager::now());
         
-        Serial.printf("[Reporter] Sending to %s\n", url.c_str());
-        Serial.printf("[Reporter] Payload: %s\n", payload.c_str());
-        
-        #if USE_HTTPS
-        http.begin(wifiClientSecure, url);
-        #else
-        http.begin(wifiClient, url);
-        #endif
+        LOG_INFO("[Reporter] Sending to %s%s", serverHost.c_str(), serverEndpoint.c_str());
+        LOG_DEBUG("[Reporter] Payload: %s", payload.c_str());
         
+        beginRequest(http, serverEndpoint);
         http.addHeader("Content-Type", "application/json");
-        http.addHeader("Authorization", "Bearer " + Config::deviceToken);
         
         int httpCode = http.POST(payload);
+        HeapMonitor::sample();
         
         if (httpCode > 0) {
-            Serial.printf("[Reporter] Response: %d\n", httpCode);
+            LOG_INFO("[Reporter] Response: %d", httpCode);
             
             if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED) {
-                String response = http.getString();
-                Serial.printf("[Reporter] Body: %s\n", response.c_str());
-                
-                // Check for config updates in response
-                JsonDocument respDoc;
-                if (deserializeJson(respDoc, response) == DeserializationError::Ok) {
-                    if (respDoc.containsKey("config")) {
-                        String configJson;
-                        serializeJson(respDoc["config"], configJson);
-                        Config::applyFromJson(configJson.c_str());
-                    }
+                if (usageSent) {
+                    UsageTracker::acknowledge();
                 }
+                handleResponse(http.getStream());
                 
                 http.end();
                 return true;
             }
         } else {
-            Serial.printf("[Reporter] Error: %s\n", http.errorToString(httpCode).c_str());
+            LOG_WARN("[Reporter] Error: %s", http.errorToString(httpCode).c_str());
         }
         
         http.end();
         return false;
     }
 
-    bool sendBuffered(const char* jsonData) {
+    bool sendBatch(const SystemState* samples, size_t count, unsigned long now, const RtcRollup* rollup) {
+        if (count == 0 && rollup == nullptr) {
+            return true;
+        }
+        
+        HEAP_SITE("batch", HEAP_BUDGET_UPLOAD_BYTES);
+        
         HTTPClient http;
         
-        String url = String(USE_HTTPS ? "https://" : "http://") +
-                     serverHost + ":" + String(serverPort) + serverEndpoint;
+        String payload;
+        bool usageSent = Payload::batch(payload, samples, count, now, rollup);
         
-        #if USE_HTTPS
-        http.begin(wifiClientSecure, url);
-        #else
-        http.begin(wifiClient, url);
-        #endif
+        LOG_INFO("[Reporter] Sending batch of %d%s (%d bytes)", count, rollup ? " + rollup" : "", payload.length());
+        
+        beginRequest(http, serverEndpoint + "/batch");
+        http.addHeader("Content-Type", "application/json");
+        
+        int httpCode = http.POST(payload);
+        HeapMonitor::sample();
+        bool success = (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED);
+        
+        if (success) {
+            if (usageSent) {
+                UsageTracker::acknowledge();
+            }
+            handleResponse(http.getStream());
+        } else if (httpCode > 0) {
+            LOG_WARN("[Reporter] Batch rejected: %d", httpCode);
+        } else {
+            LOG_WARN("[Reporter] Error: %s", http.errorToString(httpCode).c_str());
+        }
+        
+        http.end();
+        return success;
+    }
+
+    bool sendRelay(const RelayInbox& inbox, size_t count, unsigned long now) {
+        if (count == 0) {
+            return true;
+        }
+        
+        HEAP_SITE("relay", HEAP_BUDGET_UPLOAD_BYTES);
+        
+        HTTPClient http;
         
+        String payload;
+        size_t leaves = Payload::relay(payload, inbox, count, now);
+        
+        LOG_INFO("[Reporter] Sending %d relay frames from %d leaves (%d bytes)", count, leaves, payload.length());
+        
+        beginRequest(http, serverEndpoint + "/relay");
+        http.addHeader("Content-Type", "application/json");
+        
+        int httpCode = http.POST(payload);
+        HeapMonitor::sample();
+        bool success = (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED);
+        
+        if (success) {
+            handleResponse(http.getStream());
+        } else if (httpCode > 0) {
+            LOG_WARN("[Reporter] Relay upload rejected: %d", httpCode);
+        } else {
+            LOG_WARN("[Reporter] Error: %s", http.errorToString(httpCode).c_str());
+        }
+        
+        http.end();
+        return success;
+    }
+
+    bool sendAlertEvents(const AlertEvent* events, size_t count, unsigned long now) {
+        if (count == 0) {
+            return true;
+        }
+        
+        HTTPClient http;
+        
+        String payload;
+        Payload::alertEvents(payload, events, count, now);
+        
+        LOG_INFO("[Reporter] Sending %d alert event(s)", count);
+        LOG_DEBUG("[Reporter] Payload: %s", payload.c_str());
+        
+        beginRequest(http, SERVER_ALERTS_ENDPOINT);
+        http.addHeader("Content-Type", "application/json");
+        
+        int httpCode = http.POST(payload);
+        HeapMonitor::sample();
+        bool success = (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED);
+        
+        if (!success) {
+            if (httpCode > 0) {
+                LOG_WARN("[Reporter] Alert events rejected: %d", httpCode);
+            } else {
+                LOG_WARN("[Reporter] Error: %s", http.errorToString(httpCode).c_str());
+            }
+        }
+        
+        http.end();
+        return success;
+    }
+
+    bool sendBuffered(const char* jsonData) {
+        HTTPClient http;
+        
+        beginRequest(http, serverEndpoint);
         http.addHeader("Content-Type", "application/json");
-        http.addHeader("Authorization", "Bearer " + Config::deviceToken);
         http.addHeader("X-Buffered", "true");
         
         int httpCode = http.POST(jsonData);
+        HeapMonitor::sample();
         http.end();
         
         return (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED);
@@ -121,23 +236,14 @@ namespace DataReporter {
     bool checkConfigUpdate() {
         HTTPClient http;
         
-        String url = String(USE_HTTPS ? "https://" : "http://") +
-                     serverHost + ":" + String(serverPort) + 
-                     "/api/v1/devices/" + Config::deviceId + "/config";
-        
-        #if USE_HTTPS
-        http.begin(wifiClientSecure, url);
-        #else
-        http.begin(wifiClient, url);
-        #endif
-        
-        http.addHeader("Authorization", "Bearer " + Config::deviceToken);
+        beginRequest(http, "/api/v1/devices/" + Config::deviceId + "/config");
         
         int httpCode = http.GET();
         
         if (httpCode == HTTP_CODE_OK) {
-            String response = http.getString();
-            bool result = Config::applyFromJson(response.c_str());
+            JsonDocument doc;
+            bool result = deserializeJson(doc, http.getStream()) == DeserializationError::Ok &&
+                          Config::applyFromJson(doc.as<JsonVariantConst>());
             http.end();
             return result;
         }
@@ -9,6 +9,10 @@
 #define DATA_REPORTER_H
 
 #include <Arduino.h>
+#include "types.h"
+#include "alert_engine.h"
+#include "rtc_store.h"
+#include "relay_protocol.h"
 
 namespace DataReporter {
     /**
@@ -23,9 +27,41 @@ namespace DataReporter {
      * @param tempC Temperature in Celsius
      * @param batteryV Battery voltage
      * @param rssi WiFi signal strength
+     * @param channelLevelsCm Every channel's level (SENSOR_CHANNELS > 1)
      * @return true if sent successfully
      */
-    bool send(float levelCm, float volumeL, float tempC, float batteryV, int rssi);
+    bool send(float levelCm, float volumeL, float tempC, float batteryV, int rssi,
+              const float* channelLevelsCm = nullptr);
+    
+    /**
+     * Send several measurements in one request
+     * @param samples Measurements, oldest first
+     * @param count Number of measurements
+     * @param now Current time on the same clock as lastMeasurement,
+     *            used to send each sample's age
+     * @param rollup Closed rollup window to send after the samples, if any
+     * @return true if sent successfully
+     */
+    bool sendBatch(const SystemState* samples, size_t count, unsigned long now,
+                   const RtcRollup* rollup = nullptr);
+    
+    /**
+     * Send the relay leaves' readings in one request (gateway)
+     * @param inbox Frames received from leaves
+     * @param count Number of frames to send, oldest first
+     * @param now Current time on the same clock as receivedAt
+     * @return true if sent successfully
+     */
+    bool sendRelay(const RelayInbox& inbox, size_t count, unsigned long now);
+    
+    /**
+     * Send alert transitions as soon as they happen
+     * @param events Transitions from AlertEngine::getPendingEvents()
+     * @param count Number of events
+     * @param now Current PowerManager::now(), used to send each event's age
+     * @return true if the server accepted them
+     */
+    bool sendAlertEvents(const AlertEvent* events, size_t count, unsigned long now);
     
     /**
      * Send buffered measurement (from storage)
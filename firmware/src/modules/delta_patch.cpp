@@ -0,0 +1,224 @@
+/**
+ * Delta Patch Module Implementation
+ */
+
+#include "delta_patch.h"
+
+#define DELTA_OP_END        0x00
+#define DELTA_OP_COPY       0x01
+#define DELTA_OP_INSERT     0x02
+
+// Chunk size for flash reads and Update writes
+#define DELTA_CHUNK_SIZE    256
+
+static Stream* source = nullptr;
+static size_t remaining = 0;
+static UpdaterHashClass* outputHash = nullptr;
+
+static uint8_t chunk[DELTA_CHUNK_SIZE];
+
+static bool readExact(uint8_t* buf, size_t len) {
+    if (len > remaining) {
+        return false;
+    }
+    if (source->readBytes(buf, len) != len) {
+        return false;
+    }
+    remaining -= len;
+    return true;
+}
+
+static bool readByte(uint8_t& value) {
+    return readExact(&value, 1);
+}
+
+static bool readVarint(uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b;
+        if (!readByte(b)) {
+            return false;
+        }
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t readU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static String toHex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    String hex;
+    hex.reserve(len * 2);
+    for (size_t i = 0; i < len; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0x0F];
+    }
+    return hex;
+}
+
+static bool writeChunk(const uint8_t* data, size_t len) {
+    if (outputHash) {
+        outputHash->add(data, len);
+    }
+    return Update.write(const_cast<uint8_t*>(data), len) == len;
+}
+
+static bool applyCopy(uint32_t& oldCursor, uint32_t oldSize) {
+    uint32_t zigzag, len, fixCount;
+    if (!readVarint(zigzag) || !readVarint(len) || !readVarint(fixCount)) {
+        return false;
+    }
+
+    int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    int64_t start = (int64_t)oldCursor + delta;
+    if (start < 0 || start + len > oldSize) {
+        Serial.println(F("[Delta] Copy outside base image"));
+        return false;
+    }
+
+    // Fixups are read lazily as the copy reaches them
+    uint32_t fixPos = UINT32_MAX;
+    uint8_t fixByte = 0;
+    auto nextFix = [&](uint32_t base) -> bool {
+        if (fixCount == 0) {
+            fixPos = UINT32_MAX;
+            return true;
+        }
+        uint32_t gap;
+        if (!readVarint(gap) || !readByte(fixByte)) {
+            return false;
+        }
+        fixPos = base + gap;
+        fixCount--;
+        return true;
+    };
+    if (!nextFix(0)) {
+        return false;
+    }
+
+    uint32_t done = 0;
+    while (done < len) {
+        size_t n = min((uint32_t)DELTA_CHUNK_SIZE, len - done);
+        if (!ESP.flashRead((uint32_t)start + done, chunk, n)) {
+            Serial.println(F("[Delta] Flash read failed"));
+            return false;
+        }
+        while (fixPos < done + n) {
+            chunk[fixPos - done] = fixByte;
+            if (!nextFix(fixPos)) {
+                return false;
+            }
+        }
+        if (!writeChunk(chunk, n)) {
+            return false;
+        }
+        done += n;
+    }
+
+    if (fixPos != UINT32_MAX) {
+        Serial.println(F("[Delta] Fixup outside copy range"));
+        return false;
+    }
+
+    oldCursor = (uint32_t)start + len;
+    return true;
+}
+
+static bool applyInsert() {
+    uint32_t len;
+    if (!readVarint(len)) {
+        return false;
+    }
+    while (len > 0) {
+        size_t n = min((uint32_t)DELTA_CHUNK_SIZE, len);
+        if (!readExact(chunk, n) || !writeChunk(chunk, n)) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+namespace DeltaPatch {
+    bool apply(Stream& patch, size_t patchSize, UpdaterHashClass* hash) {
+        source = &patch;
+        remaining = patchSize;
+        outputHash = hash;
+
+        uint8_t header[DELTA_PATCH_HEADER_SIZE];
+        if (!readExact(header, sizeof(header)) || memcmp(header, DELTA_PATCH_MAGIC, 4) != 0) {
+            Serial.println(F("[Delta] Invalid patch header"));
+            return false;
+        }
+
+        uint32_t oldSize = readU32(header + 4);
+        String oldMd5 = toHex(header + 8, 16);
+        uint32_t newSize = readU32(header + 24);
+        String newMd5 = toHex(header + 28, 16);
+
+        // The patch is only valid against the exact image it was generated from
+        if (oldSize != ESP.getSketchSize() || !oldMd5.equalsIgnoreCase(ESP.getSketchMD5())) {
+            Serial.println(F("[Delta] Patch does not match running firmware"));
+            return false;
+        }
+
+        if (newSize + 1 > (ESP.getFreeSketchSpace() - 0x1000)) {
+            Serial.printf("[Delta] Not enough space. Available: %d, Required: %d\n",
+                ESP.getFreeSketchSpace() - 0x1000, newSize);
+            return false;
+        }
+
+        if (!Update.begin(newSize + 1)) {
+            Serial.printf("[Delta] Update begin failed: %s\n", Update.getErrorString().c_str());
+            return false;
+        }
+
+        // Updater hashes every chunk as it is written and checks this in end()
+        Update.setMD5(newMd5.c_str());
+
+        Serial.printf("[Delta] Applying %d byte patch -> %d byte image\n", patchSize, newSize);
+
+        uint32_t oldCursor = 0;
+        bool ok = true;
+        while (ok) {
+            uint8_t op;
+            if (!readByte(op)) {
+                ok = false;
+                break;
+            }
+            if (op == DELTA_OP_END) {
+                break;
+            } else if (op == DELTA_OP_COPY) {
+                ok = applyCopy(oldCursor, oldSize);
+            } else if (op == DELTA_OP_INSERT) {
+                ok = applyInsert();
+            } else {
+                Serial.printf("[Delta] Unknown op: 0x%02x\n", op);
+                ok = false;
+            }
+            yield();
+        }
+
+        if (!ok || Update.progress() != newSize) {
+            Serial.printf("[Delta] Patch failed at %d/%d bytes\n", Update.progress(), newSize);
+            return false;
+        }
+
+        // Leave the stream positioned after the patch body
+        while (remaining > 0) {
+            size_t n = min(remaining, (size_t)DELTA_CHUNK_SIZE);
+            if (!readExact(chunk, n)) {
+                return false;
+            }
+        }
+
+        Serial.println(F("[Delta] Patch applied"));
+        return true;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * ============================================================================
+ * Delta Patch Module
+ * ============================================================================
+ * Applies differential (delta) firmware patches in streaming fashion.
+ *
+ * The patch is read from a stream, the running image is read back from
+ * flash, and the reconstructed image is written to the OTA partition
+ * through Update. Nothing larger than a small chunk is held in RAM.
+ *
+ * Patch format (little-endian), produced by scripts/delta_patch.py
+ * and the backend delta service:
+ *
+ *   "WTD1"            magic
+ *   u32  oldSize      size of the base image the patch applies to
+ *   u8[16] oldMd5     MD5 of the base image
+ *   u32  newSize      size of the reconstructed image
+ *   u8[16] newMd5     MD5 of the reconstructed image
+ *   ops...            until END
+ *
+ *   0x01 COPY   varint zigzag(oldOffset - oldCursor), varint len,
+ *               varint nfix, nfix * (varint gap, u8 byte)
+ *   0x02 INSERT varint len, len literal bytes
+ *   0x00 END
+ */
+
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <Arduino.h>
+#include <Updater.h>
+
+#define DELTA_PATCH_MAGIC       "WTD1"
+#define DELTA_PATCH_HEADER_SIZE 44
+
+namespace DeltaPatch {
+    /**
+     * Apply a patch against the running firmware image.
+     * Begins an Update sized newSize + 1 and leaves it open: the caller
+     * commits with Update.end(true) (which checks the MD5) or discards
+     * with Update.end(false).
+     * @param patch Stream positioned at the start of the patch
+     * @param patchSize Patch size in bytes, excluding any signature trailer
+     * @param hash Optional hash fed with every byte of the new image
+     * @return true if the whole new image was written
+     */
+    bool apply(Stream& patch, size_t patchSize, UpdaterHashClass* hash = nullptr);
+}
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,100 @@
+/**
+ * DNS Cache Module Implementation
+ */
+
+#include "dns_cache.h"
+#include "rtc_store.h"
+#include "power_manager.h"
+#include "logger.h"
+#include <coredecls.h>
+
+static RtcDnsEntry* findEntry(RtcDnsCache& cache, uint32_t hash) {
+    for (int i = 0; i < RTC_DNS_ENTRIES; i++) {
+        if (cache.entries[i].ip != 0 && cache.entries[i].hostHash == hash) {
+            return &cache.entries[i];
+        }
+    }
+    return nullptr;
+}
+
+// Slot for a new hostname: an empty one, else the oldest
+static RtcDnsEntry* allocEntry(RtcDnsCache& cache) {
+    RtcDnsEntry* oldest = &cache.entries[0];
+    for (int i = 0; i < RTC_DNS_ENTRIES; i++) {
+        if (cache.entries[i].ip == 0) {
+            return &cache.entries[i];
+        }
+        if (cache.entries[i].resolvedAt < oldest->resolvedAt) {
+            oldest = &cache.entries[i];
+        }
+    }
+    return oldest;
+}
+
+namespace DnsCache {
+    bool resolve(const char* host, IPAddress& ip) {
+        if (ip.fromString(host)) {
+            return true;
+        }
+        
+        RtcDnsCache& cache = RtcStore::data().dns;
+        uint32_t hash = crc32(host, strlen(host));
+        RtcDnsEntry* entry = findEntry(cache, hash);
+        unsigned long now = PowerManager::now();
+        
+        // The clock restarts on a reset, so an entry from "the future" is
+        // of unknown age: query again but keep it as the fallback
+        if (entry && now >= entry->resolvedAt && now - entry->resolvedAt < DNS_CACHE_TTL_MS) {
+            ip = IPAddress(entry->ip);
+            cache.hits++;
+            RtcStore::save();
+            return true;
+        }
+        
+        unsigned long start = millis();
+        bool ok = WiFi.hostByName(host, ip, DNS_LOOKUP_TIMEOUT_MS) && ip.isSet();
+        cache.lookups++;
+        cache.lookupMs += millis() - start;
+        
+        if (ok) {
+            if (!entry) {
+                entry = allocEntry(cache);
+                entry->hostHash = hash;
+            }
+            entry->ip = (uint32_t)ip;
+            entry->resolvedAt = now;
+        } else if (entry) {
+            LOG_WARN("[DNS] Lookup of %s failed, using last good address", host);
+            ip = IPAddress(entry->ip);
+            cache.fallbacks++;
+            ok = true;
+        } else {
+            LOG_WARN("[DNS] Lookup of %s failed", host);
+            cache.failures++;
+        }
+        
+        RtcStore::save();
+        return ok;
+    }
+
+    float getHitRatio() {
+        const RtcDnsCache& cache = RtcStore::data().dns;
+        uint32_t total = cache.hits + cache.lookups;
+        return total > 0 ? (float)cache.hits / total : 0.0f;
+    }
+
+    unsigned long getTimeSavedMs() {
+        const RtcDnsCache& cache = RtcStore::data().dns;
+        if (cache.lookups == 0) {
+            return 0;
+        }
+        return (unsigned long)((uint64_t)cache.hits * cache.lookupMs / cache.lookups);
+    }
+
+    void printStats() {
+        const RtcDnsCache& cache = RtcStore::data().dns;
+        LOG_INFO("[DNS] Hit ratio %.0f%% (%u hits, %u queries, %u fallbacks, %u failures), ~%lu ms saved",
+            getHitRatio() * 100.0f, cache.hits, cache.lookups, cache.fallbacks, cache.failures,
+            getTimeSavedMs());
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * ============================================================================
+ * DNS Cache Module
+ * ============================================================================
+ * Small resolver cache for outbound connections. Answers are kept in RTC
+ * memory, so they survive deep sleep and resets, and are reused for
+ * DNS_CACHE_TTL_MS. When a query fails, the last good address is used.
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "config.h"
+#include "profiler.h"
+#include "heap_monitor.h"
+
+namespace DnsCache {
+    /**
+     * Resolve a hostname, from the cache when fresh
+     * @param host Hostname or dotted IP address
+     * @param ip Resolved address
+     * @return true if an address is available (fresh, queried or fallback)
+     */
+    bool resolve(const char* host, IPAddress& ip);
+    
+    /**
+     * Share of resolutions answered from the cache (0..1)
+     */
+    float getHitRatio();
+    
+    /**
+     * Estimated query time avoided by cache hits (ms)
+     */
+    unsigned long getTimeSavedMs();
+    
+    /**
+     * Print cache statistics
+     */
+    void printStats();
+}
+
+/**
+ * Client wrapper that resolves hostnames through DnsCache before
+ * connecting. Drop-in for WiFiClient / WiFiClientSecure with HTTPClient.
+ */
+template <typename Base>
+class DnsCachedClient : public Base {
+public:
+    using Base::connect;
+    
+    int connect(const char* host, uint16_t port) override {
+        #if DNS_CACHE_ENABLED
+        IPAddress ip;
+        if (!DnsCache::resolve(host, ip)) {
+            return 0;
+        }
+        return timedConnect(ip, port);
+        #else
+        return timedConnect(host, port);
+        #endif
+    }
+
+private:
+    // Times the connect and samples the heap while the TLS buffers are held
+    template <typename Address>
+    int timedConnect(Address address, uint16_t port) {
+        int result;
+        {
+            PROFILE_SCOPE(PROBE_CONNECT);
+            result = Base::connect(address, port);
+        }
+        HeapMonitor::sample();
+        return result;
+    }
+};
+
+#endif // DNS_CACHE_H
@@ -0,0 +1,93 @@
+/**
+ * Forecast Module Implementation
+ */
+
+#include "forecast.h"
+#include "config.h"
+#include "rtc_store.h"
+#include "sensor.h"
+#include "usage_tracker.h"
+#include "logger.h"
+
+// Covariance of a new fit: nothing is known about the line yet
+#define FORECAST_INITIAL_P      10000.0f
+
+// Flow variance (relative to a reading's) below which the fit is used;
+// reached after four readings at a steady interval
+#define FORECAST_SETTLED_P      0.3f
+
+static void restart(RtcForecastState& f, float volumeL, unsigned long now) {
+    f.volumeL = volumeL;
+    f.flowLpm = 0;
+    f.p[0] = FORECAST_INITIAL_P;
+    f.p[1] = 0;
+    f.p[2] = FORECAST_INITIAL_P;
+    f.lastAt = now;
+}
+
+namespace Forecast {
+    void update(float volumeL, unsigned long now) {
+        RtcForecastState& f = RtcStore::data().forecast;
+        if (f.lastAt == 0) {
+            restart(f, volumeL, now);
+            return;
+        }
+        if (now == f.lastAt) {
+            return;
+        }
+        
+        // Carry the line forward to this reading (in minutes), and let the
+        // older readings lose weight
+        float dt = (now - f.lastAt) / 60000.0f;
+        float predicted = f.volumeL + f.flowLpm * dt;
+        float p0 = (f.p[0] + 2 * dt * f.p[1] + dt * dt * f.p[2]) / FORECAST_FORGETTING;
+        float p1 = (f.p[1] + dt * f.p[2]) / FORECAST_FORGETTING;
+        float p2 = f.p[2] / FORECAST_FORGETTING;
+        
+        // Readings have unit weight, so s is the spread expected around a
+        // settled line; a young fit (large p0) is never restarted
+        float error = volumeL - predicted;
+        float s = p0 + 1.0f;
+        if (fabsf(error) > FORECAST_RESET_L && error * error > 9.0f * s) {
+            LOG_DEBUG("[Forecast] Reading %.1f L off the fitted %.2f L/min, new fit", error, f.flowLpm);
+            restart(f, volumeL, now);
+            return;
+        }
+        
+        float k0 = p0 / s;
+        float k1 = p1 / s;
+        f.volumeL = predicted + k0 * error;
+        f.flowLpm += k1 * error;
+        f.p[0] = (1 - k0) * p0;
+        f.p[1] = (1 - k0) * p1;
+        f.p[2] = p2 - k1 * p1;
+        f.lastAt = now;
+    }
+    
+    bool getEstimate(ForecastEstimate& estimate) {
+        const RtcForecastState& f = RtcStore::data().forecast;
+        if (f.lastAt == 0 || f.p[2] > FORECAST_SETTLED_P) {
+            return false;
+        }
+        
+        float volumeL = max(f.volumeL, 0.0f);
+        estimate.flowLpm = f.flowLpm;
+        estimate.minutesToEmpty = -1;
+        estimate.minutesToFull = -1;
+        estimate.fromDailyUsage = false;
+        
+        if (f.flowLpm <= -USAGE_FLOW_LPM) {
+            estimate.minutesToEmpty = volumeL / -f.flowLpm;
+        } else if (f.flowLpm >= USAGE_FLOW_LPM) {
+            float capacityL = Sensor::calculateVolume(Config::channels[0].levelFullCm);
+            estimate.minutesToFull = max(capacityL - volumeL, 0.0f) / f.flowLpm;
+        } else {
+            float dailyL = UsageTracker::getYesterdayUsage();
+            if (dailyL > 0) {
+                estimate.minutesToEmpty = volumeL / dailyL * 1440.0f;
+                estimate.fromDailyUsage = true;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * ============================================================================
+ * Forecast Module
+ * ============================================================================
+ * Current flow rate and time to empty or full. A straight line through the
+ * filtered volume readings is fitted by recursive least squares with
+ * exponential forgetting (FORECAST_FORGETTING), so recent readings count
+ * most and no history has to be kept: the fit is two numbers and their
+ * covariance in RTC memory. A reading far off the line (a draw or refill
+ * starting or stopping) restarts the fit. While nothing flows, time to
+ * empty is projected from yesterday's usage instead.
+ */
+
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#include <Arduino.h>
+
+struct ForecastEstimate {
+    float flowLpm;              // Fitted flow, negative while draining
+    float minutesToEmpty;       // < 0 if unknown
+    float minutesToFull;        // < 0 unless filling
+    bool fromDailyUsage;        // minutesToEmpty is based on yesterday's usage
+};
+
+namespace Forecast {
+    /**
+     * Feed one filtered reading
+     * @param volumeL Filtered volume (UsageTracker::getFiltered())
+     * @param now PowerManager::now()
+     */
+    void update(float volumeL, unsigned long now);
+    
+    /**
+     * Estimate from the current fit
+     * @return false until a fit has settled (a few readings after a
+     *         restart)
+     */
+    bool getEstimate(ForecastEstimate& estimate);
+}
+
+#endif // FORECAST_H
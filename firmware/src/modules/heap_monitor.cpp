@@ -0,0 +1,130 @@
+/**
+ * Heap Monitor Module Implementation
+ */
+
+#include "heap_monitor.h"
+#include "logger.h"
+
+static HeapStats stats = {
+    0, UINT32_MAX, 0, UINT32_MAX, 0, 0
+};
+
+#if HEAP_SITE_TRACKING
+static HeapSiteStats sites[HEAP_MAX_SITES];
+static int siteCount = 0;
+
+// Lowest free heap seen since the innermost open site started
+static uint32_t siteMinFree = UINT32_MAX;
+
+static HeapSiteStats* findSite(const char* name, uint32_t budget) {
+    for (int i = 0; i < siteCount; i++) {
+        if (strcmp(sites[i].name, name) == 0) {
+            return &sites[i];
+        }
+    }
+    if (siteCount >= HEAP_MAX_SITES) {
+        return nullptr;
+    }
+    HeapSiteStats* site = &sites[siteCount++];
+    memset(site, 0, sizeof(*site));
+    site->name = name;
+    site->budget = budget;
+    return site;
+}
+#endif
+
+namespace HeapMonitor {
+    void sample() {
+        uint32_t freeHeap;
+        uint32_t maxBlock;
+        uint8_t fragmentation;
+        ESP.getHeapStats(&freeHeap, &maxBlock, &fragmentation);
+        
+        stats.freeHeap = freeHeap;
+        stats.maxBlock = maxBlock;
+        stats.fragmentation = fragmentation;
+        if (freeHeap < stats.minFreeHeap) {
+            stats.minFreeHeap = freeHeap;
+        }
+        if (maxBlock < stats.minMaxBlock) {
+            stats.minMaxBlock = maxBlock;
+        }
+        if (fragmentation > stats.maxFragmentation) {
+            stats.maxFragmentation = fragmentation;
+        }
+        
+#if HEAP_SITE_TRACKING
+        if (freeHeap < siteMinFree) {
+            siteMinFree = freeHeap;
+        }
+#endif
+    }
+
+    const HeapStats& getStats() {
+        return stats;
+    }
+
+    int getSiteCount() {
+#if HEAP_SITE_TRACKING
+        return siteCount;
+#else
+        return 0;
+#endif
+    }
+
+    const HeapSiteStats& getSite(int index) {
+#if HEAP_SITE_TRACKING
+        return sites[index];
+#else
+        static HeapSiteStats none = {};
+        (void)index;
+        return none;
+#endif
+    }
+
+    void printStats() {
+        sample();
+        LOG_INFO("[Heap] Free %u (min %u), max block %u (min %u), frag %u%% (max %u%%)",
+            stats.freeHeap, stats.minFreeHeap, stats.maxBlock, stats.minMaxBlock,
+            stats.fragmentation, stats.maxFragmentation);
+        
+        for (int i = 0; i < getSiteCount(); i++) {
+            const HeapSiteStats& site = getSite(i);
+            LOG_INFO("[Heap]   %-10s calls %u, peak %u (worst %u, budget %u, over %u), retained %d",
+                site.name, site.calls, site.lastPeak, site.worstPeak,
+                site.budget, site.overBudget, site.lastRetained);
+        }
+    }
+
+#if HEAP_SITE_TRACKING
+    SiteScope::SiteScope(const char* name, uint32_t budget)
+        : site(findSite(name, budget)), startFree(ESP.getFreeHeap()), outerMinFree(siteMinFree) {
+        siteMinFree = startFree;
+    }
+
+    SiteScope::~SiteScope() {
+        sample();
+        uint32_t endFree = stats.freeHeap;
+        uint32_t lowFree = siteMinFree;
+        
+        // Hand the low point on to an enclosing site
+        siteMinFree = lowFree < outerMinFree ? lowFree : outerMinFree;
+        
+        if (!site) {
+            return;
+        }
+        
+        site->calls++;
+        site->lastPeak = startFree > lowFree ? startFree - lowFree : 0;
+        site->lastRetained = (int32_t)startFree - (int32_t)endFree;
+        if (site->lastPeak > site->worstPeak) {
+            site->worstPeak = site->lastPeak;
+        }
+        if (site->budget > 0 && site->lastPeak > site->budget) {
+            site->overBudget++;
+            LOG_WARN("[Heap] %s used %u bytes (budget %u)",
+                site->name, site->lastPeak, site->budget);
+        }
+    }
+#endif
+}
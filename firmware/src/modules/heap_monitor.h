@@ -0,0 +1,99 @@
+/**
+ * ============================================================================
+ * Heap Monitor Module
+ * ============================================================================
+ * Samples free heap, largest free block and fragmentation, and keeps their
+ * low-water marks since boot. TLS needs one large contiguous block, so the
+ * largest-block low-water mark is the number to watch.
+ *
+ * With HEAP_SITE_TRACKING (debug builds), HEAP_SITE(name, budget) marks a
+ * call site: each pass records its peak heap use (lowest free heap seen
+ * by samples inside it) and the bytes still held when it returns, and
+ * warns when the peak exceeds the budget.
+ */
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#define HEAP_MAX_SITES  8
+
+/**
+ * Heap figures, current and worst since boot
+ */
+struct HeapStats {
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t maxBlock;
+    uint32_t minMaxBlock;
+    uint8_t fragmentation;
+    uint8_t maxFragmentation;
+};
+
+/**
+ * Per call-site allocation figures
+ */
+struct HeapSiteStats {
+    const char* name;
+    uint32_t calls;
+    uint32_t budget;
+    uint32_t lastPeak;      // Bytes in use at the low point of the last pass
+    uint32_t worstPeak;
+    int32_t lastRetained;   // Bytes not released by the end of the last pass
+    uint32_t overBudget;    // Passes whose peak exceeded the budget
+};
+
+namespace HeapMonitor {
+    /**
+     * Read the heap counters and update the low-water marks
+     */
+    void sample();
+    
+    /**
+     * Current and worst-case figures
+     */
+    const HeapStats& getStats();
+    
+    /**
+     * Number of tracked call sites (0 without HEAP_SITE_TRACKING)
+     */
+    int getSiteCount();
+    
+    /**
+     * Figures for a tracked call site
+     */
+    const HeapSiteStats& getSite(int index);
+    
+    /**
+     * Print heap figures and call sites
+     */
+    void printStats();
+    
+#if HEAP_SITE_TRACKING
+    /**
+     * Tracks its own lifetime; use through HEAP_SITE
+     */
+    class SiteScope {
+    public:
+        SiteScope(const char* name, uint32_t budget);
+        ~SiteScope();
+        
+    private:
+        HeapSiteStats* site;
+        uint32_t startFree;
+        uint32_t outerMinFree;
+    };
+#endif
+}
+
+#if HEAP_SITE_TRACKING
+#define HEAP_SITE_CONCAT_(a, b) a##b
+#define HEAP_SITE_CONCAT(a, b) HEAP_SITE_CONCAT_(a, b)
+#define HEAP_SITE(name, budget) HeapMonitor::SiteScope HEAP_SITE_CONCAT(heapSite_, __LINE__)(name, budget)
+#else
+#define HEAP_SITE(name, budget) do {} while (0)
+#endif
+
+#endif // HEAP_MONITOR_H
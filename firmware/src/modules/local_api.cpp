@@ -0,0 +1,278 @@
+/**
+ * Local API Module Implementation
+ */
+
+#include "local_api.h"
+#include "config.h"
+#include "sensor.h"
+#include "alert_engine.h"
+#include "storage.h"
+#include "payload.h"
+#include "time_sync.h"
+#include "logger.h"
+#include <ESP8266WebServer.h>
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+
+#if LOCAL_API_ENABLED
+
+#define HISTORY_VERSION         1
+
+// Records converted per write to the socket
+#define HISTORY_CHUNK_RECORDS   32
+
+// Dashboard files whose ETag is remembered
+#define ETAG_CACHE_SIZE         8
+
+struct __attribute__((packed)) HistoryHeader {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t recordSize;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t now;               // Unix seconds, 0 until synced
+};
+
+struct __attribute__((packed)) HistoryRecord {
+    uint32_t ageMs;
+    float volumeL;
+    int16_t levelMm;
+    int16_t temperatureCenti;
+    uint16_t batteryMv;
+};
+
+// A record as kept: the clock reading instead of the age, which is only
+// known once the request comes in
+struct __attribute__((packed)) HistoryEntry {
+    uint32_t takenAt;           // millis()
+    float volumeL;
+    int16_t levelMm;
+    int16_t temperatureCenti;
+    uint16_t batteryMv;
+};
+
+struct EtagEntry {
+    String path;
+    size_t size;
+    uint32_t hash;
+};
+
+// Answer for / until the dashboard has been installed
+static const char FALLBACK_PAGE[] PROGMEM =
+    "<!DOCTYPE html><html><head><meta name=\"viewport\" content=\"width=device-width\">"
+    "<title>Water Tank</title></head><body><h1>Water Tank</h1>"
+    "<p>The dashboard is not installed. It ships with firmware releases as assets.</p>"
+    "<p><a href=\"/api/state\">/api/state</a></p></body></html>";
+
+static ESP8266WebServer server(LOCAL_API_PORT);
+static const SystemState* state = nullptr;
+static bool started = false;
+
+static HistoryEntry history[LOCAL_HISTORY_SAMPLES];
+static size_t historyHead = 0;
+static size_t historyCount = 0;
+
+static EtagEntry etags[ETAG_CACHE_SIZE];
+static size_t nextEtag = 0;
+
+// FNV-1a over the file: cheap, and only run once per file and size
+static uint32_t hashFile(File& file) {
+    uint32_t hash = 2166136261u;
+    uint8_t buff[128];
+    size_t n;
+    while ((n = file.read(buff, sizeof(buff))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            hash = (hash ^ buff[i]) * 16777619u;
+        }
+    }
+    file.seek(0);
+    return hash;
+}
+
+static String fileEtag(const String& path, File& file) {
+    EtagEntry* entry = nullptr;
+    for (size_t i = 0; i < ETAG_CACHE_SIZE; i++) {
+        if (etags[i].path == path) {
+            entry = &etags[i];
+            break;
+        }
+    }
+    
+    // A release replaces files in place; a new size is a new file
+    if (entry == nullptr || entry->size != file.size()) {
+        if (entry == nullptr) {
+            entry = &etags[nextEtag];
+            nextEtag = (nextEtag + 1) % ETAG_CACHE_SIZE;
+        }
+        entry->path = path;
+        entry->size = file.size();
+        entry->hash = hashFile(file);
+    }
+    
+    char etag[12];
+    snprintf(etag, sizeof(etag), "\"%08x\"", entry->hash);
+    return String(etag);
+}
+
+static const char* contentType(const String& path) {
+    if (path.endsWith(".html")) return "text/html";
+    if (path.endsWith(".js")) return "application/javascript";
+    if (path.endsWith(".css")) return "text/css";
+    if (path.endsWith(".svg")) return "image/svg+xml";
+    if (path.endsWith(".json")) return "application/json";
+    if (path.endsWith(".ico")) return "image/x-icon";
+    return "application/octet-stream";
+}
+
+static void sendState() {
+    JsonDocument doc;
+    doc["device_id"] = Config::deviceId;
+    doc["firmware_version"] = FIRMWARE_VERSION;
+    if (TimeSync::isValid()) {
+        doc["timestamp"] = TimeSync::epoch();
+    }
+    doc["uptime_ms"] = millis();
+    
+    if (state->lastMeasurement != 0) {
+        doc["age_ms"] = millis() - state->lastMeasurement;
+        doc["level_cm"] = state->waterLevelCm;
+        doc["volume_l"] = state->volumeLiters;
+        doc["percent"] = Sensor::getPercentage(state->waterLevelCm);
+        doc["temperature_c"] = state->temperatureC;
+        doc["battery_v"] = state->batteryVoltage;
+        Payload::addChannels(state->channelLevelCm, doc.as<JsonObject>());
+    }
+    doc["rssi"] = WiFi.RSSI();
+    doc["buffered"] = Storage::getBufferCount();
+    
+    JsonArray alerts = doc["alerts"].to<JsonArray>();
+    for (int type = 0; type < ALERT_TYPE_COUNT; type++) {
+        if (AlertEngine::isActive((AlertType)type)) {
+            alerts.add(AlertEngine::getName((AlertType)type));
+        }
+    }
+    Payload::addForecast(doc.as<JsonObject>());
+    
+    String body;
+    serializeJson(doc, body);
+    server.sendHeader("Access-Control-Allow-Origin", "*");
+    server.sendHeader("Cache-Control", "no-store");
+    server.send(200, "application/json", body);
+}
+
+// Written straight from the ring in small chunks; no copy of the whole
+// body is made
+static void sendHistory() {
+    HistoryHeader header = { { 'W', 'H' }, HISTORY_VERSION, sizeof(HistoryRecord),
+        (uint16_t)historyCount, 0, TimeSync::isValid() ? TimeSync::epoch() : 0 };
+    unsigned long now = millis();
+    
+    server.sendHeader("Access-Control-Allow-Origin", "*");
+    server.sendHeader("Cache-Control", "no-store");
+    server.setContentLength(sizeof(header) + historyCount * sizeof(HistoryRecord));
+    server.send(200, "application/octet-stream", "");
+    server.sendContent((const char*)&header, sizeof(header));
+    
+    HistoryRecord chunk[HISTORY_CHUNK_RECORDS];
+    size_t n = 0;
+    for (size_t i = 0; i < historyCount; i++) {
+        const HistoryEntry& entry = history[(historyHead + i) % LOCAL_HISTORY_SAMPLES];
+        HistoryRecord& record = chunk[n++];
+        record.ageMs = now - entry.takenAt;
+        record.volumeL = entry.volumeL;
+        record.levelMm = entry.levelMm;
+        record.temperatureCenti = entry.temperatureCenti;
+        record.batteryMv = entry.batteryMv;
+        
+        if (n == HISTORY_CHUNK_RECORDS || i + 1 == historyCount) {
+            server.sendContent((const char*)chunk, n * sizeof(HistoryRecord));
+            n = 0;
+        }
+    }
+}
+
+// Dashboard files: /app.js is served from LOCAL_API_WEB_DIR/app.js.gz.
+// streamFile() copies from the filesystem to the socket and adds
+// Content-Encoding: gzip for .gz names.
+static void sendStatic() {
+    if (server.method() != HTTP_GET) {
+        server.send(405, "text/plain", "Method not allowed");
+        return;
+    }
+    
+    String uri = server.uri();
+    if (uri.endsWith("/")) {
+        uri += "index.html";
+    }
+    String path = String(LOCAL_API_WEB_DIR) + uri + ".gz";
+    
+    if (uri.indexOf("..") >= 0 || !LittleFS.exists(path)) {
+        if (uri == "/index.html") {
+            server.send_P(200, "text/html", FALLBACK_PAGE);
+        } else {
+            server.send(404, "text/plain", "Not found");
+        }
+        return;
+    }
+    
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        server.send(500, "text/plain", "Read failed");
+        return;
+    }
+    
+    // Browsers revalidate every time; an unchanged file costs a 304
+    String etag = fileEtag(path, file);
+    server.sendHeader("ETag", etag);
+    server.sendHeader("Cache-Control", "no-cache");
+    if (server.header("If-None-Match") == etag) {
+        server.send(304);
+    } else {
+        server.streamFile(file, contentType(uri));
+    }
+    file.close();
+}
+
+namespace LocalApi {
+    void begin(const SystemState& systemState) {
+        if (started) {
+            return;
+        }
+        state = &systemState;
+        
+        static const char* headers[] = { "If-None-Match" };
+        server.collectHeaders(headers, 1);
+        server.on("/api/state", HTTP_GET, sendState);
+        server.on("/api/history", HTTP_GET, sendHistory);
+        server.onNotFound(sendStatic);
+        server.begin();
+        started = true;
+        
+        LOG_INFO("[LocalApi] Serving on port %d", LOCAL_API_PORT);
+    }
+
+    void handle() {
+        if (started) {
+            server.handleClient();
+        }
+    }
+
+    void record(const SystemState& reading) {
+        HistoryEntry& entry = history[(historyHead + historyCount) % LOCAL_HISTORY_SAMPLES];
+        entry.takenAt = reading.lastMeasurement;
+        entry.volumeL = reading.volumeLiters;
+        entry.levelMm = (int16_t)constrain(lroundf(reading.waterLevelCm * 10.0f), -32768L, 32767L);
+        entry.temperatureCenti = (int16_t)constrain(lroundf(reading.temperatureC * 100.0f), -32768L, 32767L);
+        entry.batteryMv = (uint16_t)(reading.batteryVoltage * 1000.0f + 0.5f);
+        
+        // Full: the slot just written was the oldest
+        if (historyCount < LOCAL_HISTORY_SAMPLES) {
+            historyCount++;
+        } else {
+            historyHead = (historyHead + 1) % LOCAL_HISTORY_SAMPLES;
+        }
+    }
+}
+
+#endif // LOCAL_API_ENABLED
@@ -0,0 +1,49 @@
+/**
+ * ============================================================================
+ * Local API Module
+ * ============================================================================
+ * HTTP server for readers on the LAN (LOCAL_API_ENABLED), answered from
+ * memory without a round trip through the backend:
+ *   - GET /api/state    latest reading, alerts and forecast as JSON
+ *   - GET /api/history  recent readings from a RAM ring, binary (below)
+ *   - GET /...          dashboard files from LOCAL_API_WEB_DIR
+ *
+ * Dashboard files are stored gzipped (index.html.gz) and streamed from
+ * flash as they are, with Content-Encoding: gzip. A file's ETag is a hash
+ * of its contents, worked out on its first request; a matching
+ * If-None-Match is answered 304 without sending the file.
+ *
+ * /api/history body, little-endian, records oldest first:
+ *   header  u8 'W', u8 'H', u8 version (1), u8 record size (14),
+ *           u16 count, u16 reserved, u32 Unix time now (0 until synced)
+ *   record  u32 age (ms), f32 volume (L), i16 level (mm),
+ *           i16 temperature (0.01 °C), u16 battery (mV)
+ */
+
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <Arduino.h>
+#include "types.h"
+
+namespace LocalApi {
+    /**
+     * Start the server. Call once the network is up: before the first
+     * connection the WiFi config portal may hold the port.
+     * @param state The sketch's state, read on each request
+     */
+    void begin(const SystemState& state);
+    
+    /**
+     * Serve waiting requests (scheduler task)
+     */
+    void handle();
+    
+    /**
+     * Add a measurement to the history ring
+     * @param reading State after takeMeasurement()
+     */
+    void record(const SystemState& reading);
+}
+
+#endif // LOCAL_API_H
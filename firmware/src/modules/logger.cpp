@@ -0,0 +1,290 @@
+/**
+ * Logger Module Implementation
+ */
+
+#include "logger.h"
+#include <LittleFS.h>
+
+#define LOG_FILE_PATH       "/log.bin"
+#define LOG_FILE_OLD_PATH   "/log.old"
+#define LOG_LINE_BYTES      192
+#define LOG_FILE_BUFFER     256
+
+// Ring of complete record frames, oldest at ringTail
+static uint8_t ring[LOG_RING_BYTES];
+static size_t ringHead = 0;
+static size_t ringTail = 0;
+static size_t ringUsed = 0;
+
+static uint32_t dropped = 0;
+static uint32_t counts[LOG_LEVEL_DEBUG + 1];
+
+// Text line partly written to Serial
+static char line[LOG_LINE_BYTES];
+static size_t lineLen = 0;
+static size_t lineSent = 0;
+
+// Frames waiting to be appended to the log file
+static bool fileAttached = false;
+static uint8_t fileBuffer[LOG_FILE_BUFFER];
+static size_t fileBufferLen = 0;
+
+static void ringWrite(const void* data, size_t len) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t first = min(len, (size_t)LOG_RING_BYTES - ringHead);
+    memcpy(ring + ringHead, bytes, first);
+    memcpy(ring, bytes + first, len - first);
+    ringHead = (ringHead + len) % LOG_RING_BYTES;
+    ringUsed += len;
+}
+
+static void ringRead(size_t pos, void* out, size_t len) {
+    uint8_t* bytes = (uint8_t*)out;
+    size_t first = min(len, (size_t)LOG_RING_BYTES - pos);
+    memcpy(bytes, ring + pos, first);
+    memcpy(bytes + first, ring, len - first);
+}
+
+static size_t frameLength(size_t pos) {
+    uint8_t header[3];
+    ringRead(pos, header, sizeof(header));
+    return LOG_HEADER_BYTES + header[2];
+}
+
+static bool ringPop(uint8_t* frame, size_t* len) {
+    if (ringUsed == 0) {
+        return false;
+    }
+    *len = frameLength(ringTail);
+    ringRead(ringTail, frame, *len);
+    ringTail = (ringTail + *len) % LOG_RING_BYTES;
+    ringUsed -= *len;
+    return true;
+}
+
+static void flushFileBuffer() {
+    if (fileBufferLen == 0) {
+        return;
+    }
+    
+    File file = LittleFS.open(LOG_FILE_PATH, "a");
+    if (file) {
+        file.write(fileBuffer, fileBufferLen);
+        bool full = file.size() >= LOG_FILE_MAX_BYTES;
+        file.close();
+        
+        // Keep one previous file
+        if (full) {
+            LittleFS.remove(LOG_FILE_OLD_PATH);
+            LittleFS.rename(LOG_FILE_PATH, LOG_FILE_OLD_PATH);
+        }
+    }
+    fileBufferLen = 0;
+}
+
+static void toFile(const uint8_t* frame, size_t len) {
+    if (!fileAttached || frame[1] > LOG_FILE_LEVEL) {
+        return;
+    }
+    if (fileBufferLen + len > sizeof(fileBuffer)) {
+        flushFileBuffer();
+    }
+    memcpy(fileBuffer + fileBufferLen, frame, len);
+    fileBufferLen += len;
+}
+
+// printf over stored arguments; length modifiers are ignored since every
+// argument was stored at 32 bits
+static size_t formatRecord(const uint8_t* frame, char* out, size_t size) {
+    uint32_t address;
+    memcpy(&address, frame + 7, sizeof(address));
+    PGM_P format = (PGM_P)(uintptr_t)address;
+    
+    const uint8_t* arg = frame + LOG_HEADER_BYTES;
+    const uint8_t* argEnd = arg + frame[2];
+    size_t n = 0;
+    char c;
+    
+    while ((c = pgm_read_byte(format++)) && n < size - 1) {
+        if (c != '%') {
+            out[n++] = c;
+            continue;
+        }
+        
+        char spec[16];
+        size_t specLen = 0;
+        spec[specLen++] = '%';
+        char conv;
+        while ((conv = pgm_read_byte(format++))) {
+            if (conv == '%' && specLen == 1) {
+                break;
+            }
+            if (strchr("hlLzjt", conv)) {
+                continue;
+            }
+            if (specLen < sizeof(spec) - 1) {
+                spec[specLen++] = conv;
+            }
+            if (strchr("diouxXcsfFeEgGp", conv)) {
+                break;
+            }
+        }
+        if (!conv) {
+            break;
+        }
+        if (conv == '%') {
+            out[n++] = '%';
+            continue;
+        }
+        spec[specLen] = '\0';
+        
+        int written;
+        if (conv == 's') {
+            const char* str = (const char*)arg;
+            size_t len = strnlen(str, argEnd - arg);
+            if (arg + len >= argEnd) {
+                written = snprintf(out + n, size - n, "?");
+                arg = argEnd;
+            } else {
+                written = snprintf(out + n, size - n, spec, str);
+                arg += len + 1;
+            }
+        } else if (argEnd - arg < 4) {
+            written = snprintf(out + n, size - n, "?");
+        } else {
+            uint32_t word;
+            memcpy(&word, arg, sizeof(word));
+            arg += sizeof(word);
+            
+            if (strchr("fFeEgG", conv)) {
+                float f;
+                memcpy(&f, &word, sizeof(f));
+                written = snprintf(out + n, size - n, spec, (double)f);
+            } else if (conv == 'd' || conv == 'i') {
+                written = snprintf(out + n, size - n, spec, (int)(int32_t)word);
+            } else {
+                if (conv == 'p') {
+                    spec[specLen - 1] = 'x';
+                }
+                written = snprintf(out + n, size - n, spec, (unsigned)word);
+            }
+        }
+        if (written > 0) {
+            n = min(n + written, size - 1);
+        }
+    }
+    
+    out[n] = '\0';
+    return n;
+}
+
+namespace Log {
+    void attachFile() {
+        fileAttached = LOG_FILE_LEVEL > LOG_LEVEL_NONE;
+    }
+
+    void drain() {
+        uint8_t frame[LOG_HEADER_BYTES + LOG_MAX_ARG_BYTES];
+        size_t len;
+        
+#if LOG_SERIAL_BINARY
+        while (ringUsed > 0 && (size_t)Serial.availableForWrite() >= frameLength(ringTail)) {
+            ringPop(frame, &len);
+            Serial.write(frame, len);
+            toFile(frame, len);
+        }
+#else
+        for (;;) {
+            // Only write what the UART FIFO takes without blocking
+            if (lineSent < lineLen) {
+                size_t room = Serial.availableForWrite();
+                size_t chunk = min(room, lineLen - lineSent);
+                Serial.write((const uint8_t*)line + lineSent, chunk);
+                lineSent += chunk;
+                if (lineSent < lineLen) {
+                    break;
+                }
+            }
+            
+            if (!ringPop(frame, &len)) {
+                break;
+            }
+            toFile(frame, len);
+            
+            lineLen = formatRecord(frame, line, sizeof(line) - 1);
+            line[lineLen++] = '\n';
+            lineSent = 0;
+        }
+#endif
+        
+        flushFileBuffer();
+    }
+
+    void flush() {
+        while (ringUsed > 0 || lineSent < lineLen) {
+            drain();
+            yield();
+        }
+        Serial.flush();
+    }
+
+    uint32_t getDropped() {
+        return dropped;
+    }
+
+    uint32_t getCount(uint8_t level) {
+        return level <= LOG_LEVEL_DEBUG ? counts[level] : 0;
+    }
+
+    namespace detail {
+        void put(Args& args, const void* data, size_t len) {
+            if (args.len + len > sizeof(args.data)) {
+                return;
+            }
+            memcpy(args.data + args.len, data, len);
+            args.len += len;
+        }
+
+        void putString(Args& args, const char* str) {
+            if (!str) {
+                str = "(null)";
+            }
+            size_t room = sizeof(args.data) - args.len;
+            if (room == 0) {
+                return;
+            }
+            size_t len = min(strlen(str), min((size_t)LOG_MAX_STRING, room - 1));
+            memcpy(args.data + args.len, str, len);
+            args.data[args.len + len] = '\0';
+            args.len += len + 1;
+        }
+
+        void commit(uint8_t level, PGM_P format, const Args& args) {
+            size_t len = LOG_HEADER_BYTES + args.len;
+            
+            // Never block the caller: overwrite the oldest records
+            while (LOG_RING_BYTES - ringUsed < len) {
+                size_t oldest = frameLength(ringTail);
+                ringTail = (ringTail + oldest) % LOG_RING_BYTES;
+                ringUsed -= oldest;
+                dropped++;
+            }
+            
+            uint8_t header[LOG_HEADER_BYTES];
+            uint32_t timestamp = millis();
+            uint32_t address = (uint32_t)(uintptr_t)format;
+            header[0] = LOG_FRAME_SYNC;
+            header[1] = level;
+            header[2] = args.len;
+            memcpy(header + 3, &timestamp, sizeof(timestamp));
+            memcpy(header + 7, &address, sizeof(address));
+            
+            ringWrite(header, sizeof(header));
+            ringWrite(args.data, args.len);
+            
+            if (level <= LOG_LEVEL_DEBUG) {
+                counts[level]++;
+            }
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * ============================================================================
+ * Logger Module
+ * ============================================================================
+ * Deferred-formatting log. LOG_INFO(fmt, ...) stores a binary record (the
+ * flash address of the format string, a timestamp and the raw arguments)
+ * in a RAM ring and returns; Log::drain() formats and writes records to
+ * Serial from the scheduler's idle hook, and appends warnings and errors
+ * to a file in LittleFS. Levels above LOG_LEVEL compile to dead code.
+ *
+ * Record frame (little-endian, also used on Serial with LOG_SERIAL_BINARY
+ * and in the log file; decode with scripts/log_decode.py):
+ *   0xA5 | level:u8 | argBytes:u8 | millis:u32 | format address:u32 | args
+ * Arguments: integers and chars as u32, floats as f32, strings inline and
+ * NUL-terminated.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include "config.h"
+
+#define LOG_FRAME_SYNC          0xA5
+#define LOG_HEADER_BYTES        11
+#define LOG_MAX_ARG_BYTES       96
+#define LOG_MAX_STRING          48
+
+namespace Log {
+    /**
+     * Send warnings and errors to the log file from now on (LittleFS mounted)
+     */
+    void attachFile();
+    
+    /**
+     * Write out buffered records without blocking on Serial. Call when idle.
+     */
+    void drain();
+    
+    /**
+     * Write out all buffered records, blocking. Call before sleep or restart.
+     */
+    void flush();
+    
+    /**
+     * Records overwritten before they were drained
+     */
+    uint32_t getDropped();
+    
+    /**
+     * Records logged per level (index LOG_LEVEL_ERROR .. LOG_LEVEL_DEBUG)
+     */
+    uint32_t getCount(uint8_t level);
+    
+    namespace detail {
+        struct Args {
+            uint8_t data[LOG_MAX_ARG_BYTES];
+            uint8_t len;
+        };
+        
+        void put(Args& args, const void* data, size_t len);
+        void putString(Args& args, const char* str);
+        void commit(uint8_t level, PGM_P format, const Args& args);
+        
+        // Every integer type on the target is at most 32 bits wide
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+        pack(Args& args, T value) {
+            uint32_t word = (uint32_t)value;
+            put(args, &word, sizeof(word));
+        }
+        
+        template <typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type
+        pack(Args& args, T value) {
+            float f = (float)value;
+            put(args, &f, sizeof(f));
+        }
+        
+        inline void pack(Args& args, const char* str) { putString(args, str); }
+        inline void pack(Args& args, char* str) { putString(args, str); }
+        inline void pack(Args& args, const String& str) { putString(args, str.c_str()); }
+    }
+    
+    template <typename... T>
+    void write(uint8_t level, PGM_P format, const T&... values) {
+        detail::Args args;
+        args.len = 0;
+        (detail::pack(args, values), ...);
+        detail::commit(level, format, args);
+    }
+}
+
+// Disabled levels still type-check their arguments (and keep variables
+// used only for logging referenced), but the call is dead code
+#define LOG_DISABLED(fmt, ...) do { if (false) Log::write(0, fmt, ##__VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) Log::write(LOG_LEVEL_ERROR, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) Log::write(LOG_LEVEL_WARN, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) Log::write(LOG_LEVEL_INFO, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) Log::write(LOG_LEVEL_DEBUG, PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#endif // LOGGER_H
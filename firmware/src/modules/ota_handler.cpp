@@ -4,17 +4,284 @@
 
 #include "ota_handler.h"
 #include "config.h"
+#include "delta_patch.h"
+#include "dns_cache.h"
+#include "logger.h"
 #include <ArduinoOTA.h>
 #include <ESP8266httpUpdate.h>
 #include <ArduinoJson.h>
 #include <WiFiClientSecure.h>
 #include <ESP8266HTTPClient.h>
 #include <Updater.h>
+#include <LittleFS.h>
+#include <BearSSLHelpers.h>
+
+#if __has_include("ota_signing_key.h")
+#include "ota_signing_key.h"
+#endif
+
+// Signed images end with [raw image sig][written image sig][u32 block length].
+// The raw signature is what the backend appends to delta patches, whose
+// output is the raw image: [patch][raw image sig][u32 block length].
+#define OTA_IMAGE_TRAILER_SIZE  (2 * OTA_SIGNATURE_SIZE + 4)
+#define OTA_PATCH_TRAILER_SIZE  (OTA_SIGNATURE_SIZE + 4)
+
+#ifdef OTA_SIGNING_ENABLED
+// RSA check of a finished hash against the release key
+static bool verifyHash(BearSSL::HashSHA256& hash, const uint8_t* signature) {
+    // Key lives in flash; only copy it to RAM for the duration of the check
+    String pem = FPSTR(OTA_SIGNING_PUBKEY);
+    BearSSL::PublicKey key(pem.c_str());
+    BearSSL::SigningVerifier verifier(&key);
+    return verifier.verify(&hash, signature, OTA_SIGNATURE_SIZE);
+}
+
+static bool verifySignature(BearSSL::HashSHA256& hash, const uint8_t* trailer, size_t trailerSize) {
+    uint32_t blockLen = trailer[trailerSize - 4] | (trailer[trailerSize - 3] << 8) |
+        (trailer[trailerSize - 2] << 16) | ((uint32_t)trailer[trailerSize - 1] << 24);
+    if (blockLen != trailerSize - 4) {
+        Serial.println(F("[OTA] Malformed signature block"));
+        return false;
+    }
+    
+    hash.end();
+    
+    // The signature covering the bytes we wrote is always last in the block
+    return verifyHash(hash, trailer + trailerSize - 4 - OTA_SIGNATURE_SIZE);
+}
+#endif
+
+// Updates are begun with one spare byte so they stay unfinished until
+// verified: end(true) commits what was written, end(false) discards it.
+static bool commitUpdate(bool verified) {
+    if (!verified) {
+        Serial.println(F("[OTA] Signature verification failed, discarding image"));
+        Update.end(false);
+        return false;
+    }
+    
+    if (!Update.end(true)) {
+        Serial.printf("[OTA] Update end failed: %s\n", Update.getErrorString().c_str());
+        return false;
+    }
+    
+    if (!Update.isFinished()) {
+        Serial.println(F("[OTA] Update not finished"));
+        return false;
+    }
+    
+    return true;
+}
+
+// Advertised update waiting to be fetched
+static bool updatePending = false;
+
+// Version whose install failed; not retried until a different one is advertised
+static String failedVersion = "";
+
+// ETag of the last /ota/latest answer, for conditional checks
+static String otaEtag = "";
+
+// ============================================================================
+// Release Assets
+// ============================================================================
+
+// Files shipped with a release (audio clips, dashboard files), fetched
+// into LittleFS before the image is flashed
+#define OTA_MAX_ASSETS          8
+
+struct OtaAsset {
+    String name;
+    String url;
+    String checksum;            // SHA-256, hex
+    size_t size;
+};
+
+static OtaAsset assets[OTA_MAX_ASSETS];
+static int assetCount = 0;
+
+// Signature of the asset list (hex), empty if the release has none
+static String assetsSignature = "";
+
+static String hashHex(BearSSL::HashSHA256& hash) {
+    const uint8_t* digest = (const uint8_t*)hash.hash();
+    String hex;
+    for (int i = 0; i < hash.len(); i++) {
+        char byte[3];
+        sprintf(byte, "%02x", digest[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+static String fileSha256(const String& path) {
+    if (!LittleFS.exists(path)) {
+        return "";
+    }
+    
+    File file = LittleFS.open(path, "r");
+    BearSSL::HashSHA256 hash;
+    hash.begin();
+    
+    uint8_t buff[128];
+    size_t n;
+    while ((n = file.read(buff, sizeof(buff))) > 0) {
+        hash.add(buff, n);
+    }
+    file.close();
+    
+    hash.end();
+    return hashHex(hash);
+}
+
+// Download to a temporary file and only replace the old copy once the
+// size and checksum match
+static bool downloadAsset(const OtaAsset& asset, const String& path) {
+    FSInfo info;
+    if (!LittleFS.info(info) || info.totalBytes - info.usedBytes < asset.size + 8192) {
+        Serial.println(F("[OTA] Not enough filesystem space"));
+        return false;
+    }
+    
+    DnsCachedClient<WiFiClientSecure> clientSecure;
+    clientSecure.setInsecure();  // Accept any certificate (for now)
+    HTTPClient http;
+    
+    http.begin(clientSecure, asset.url);
+    http.addHeader("Authorization", "Bearer " + Config::deviceToken);
+    
+    int httpCode = http.GET();
+    if (httpCode != HTTP_CODE_OK || http.getSize() != (int)asset.size) {
+        Serial.printf("[OTA] HTTP error: %d, size %d\n", httpCode, http.getSize());
+        http.end();
+        return false;
+    }
+    
+    String tmpPath = path + ".tmp";
+    File file = LittleFS.open(tmpPath, "w");
+    if (!file) {
+        http.end();
+        return false;
+    }
+    
+    BearSSL::HashSHA256 hash;
+    hash.begin();
+    
+    WiFiClient* stream = http.getStreamPtr();
+    size_t written = 0;
+    
+    uint8_t buff[128];
+    while (http.connected() && written < asset.size) {
+        size_t available = stream->available();
+        if (available) {
+            int c = stream->readBytes(buff, ((available > sizeof(buff)) ? sizeof(buff) : available));
+            hash.add(buff, c);
+            if (file.write(buff, c) != (size_t)c) {
+                break;
+            }
+            written += c;
+        }
+        delay(1);
+    }
+    
+    file.close();
+    http.end();
+    hash.end();
+    
+    if (written != asset.size || hashHex(hash) != asset.checksum) {
+        Serial.printf("[OTA] Asset incomplete or corrupt (%d/%d bytes)\n", written, asset.size);
+        LittleFS.remove(tmpPath);
+        return false;
+    }
+    
+    LittleFS.remove(path);
+    return LittleFS.rename(tmpPath.c_str(), path.c_str());
+}
+
+#ifdef OTA_SIGNING_ENABLED
+// The list and its checksums come over a connection that is not
+// authenticated, so signed builds only trust it with a signature from
+// `make sign-assets`: over "<name> <sha256>\n" per asset, sorted by name
+static bool assetsSigned() {
+    if (assetsSignature.length() != 2 * OTA_SIGNATURE_SIZE) {
+        return false;
+    }
+    uint8_t signature[OTA_SIGNATURE_SIZE];
+    for (size_t i = 0; i < OTA_SIGNATURE_SIZE; i++) {
+        char byte[3] = { assetsSignature[2 * i], assetsSignature[2 * i + 1], '\0' };
+        char* end;
+        signature[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    
+    int order[OTA_MAX_ASSETS];
+    for (int i = 0; i < assetCount; i++) {
+        order[i] = i;
+        for (int j = i; j > 0 && strcmp(assets[order[j]].name.c_str(), assets[order[j - 1]].name.c_str()) < 0; j--) {
+            int swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+    
+    BearSSL::HashSHA256 hash;
+    hash.begin();
+    for (int i = 0; i < assetCount; i++) {
+        const OtaAsset& asset = assets[order[i]];
+        hash.add(asset.name.c_str(), asset.name.length());
+        hash.add(" ", 1);
+        hash.add(asset.checksum.c_str(), asset.checksum.length());
+        hash.add("\n", 1);
+    }
+    hash.end();
+    return verifyHash(hash, signature);
+}
+#endif
+
+// Gzipped dashboard files belong to the local API; the rest are clips
+static String assetPath(const String& name) {
+    return String(name.endsWith(".gz") ? LOCAL_API_WEB_DIR : AUDIO_DIR) + "/" + name;
+}
+
+static void syncAssets() {
+    #ifdef OTA_SIGNING_ENABLED
+    if (assetCount > 0 && !assetsSigned()) {
+        Serial.println(F("[OTA] Release assets are not signed, skipping them"));
+        assetCount = 0;
+        return;
+    }
+    #endif
+    
+    for (int i = 0; i < assetCount; i++) {
+#if !LOCAL_API_ENABLED
+        if (assets[i].name.endsWith(".gz")) {
+            continue;
+        }
+#endif
+        String path = assetPath(assets[i].name);
+        if (fileSha256(path) == assets[i].checksum) {
+            continue;
+        }
+        
+        Serial.printf("[OTA] Fetching %s (%d bytes)\n", path.c_str(), assets[i].size);
+        if (!downloadAsset(assets[i], path)) {
+            Serial.printf("[OTA] Could not fetch %s, keeping the old copy\n", path.c_str());
+        }
+    }
+    assetCount = 0;
+}
 
 namespace OTAHandler {
     void init() {
         Serial.println(F("[OTA] Initializing..."));
         
+        #ifdef OTA_SIGNING_ENABLED
+        // ArduinoOTA flashes whatever it is sent, with no signature check;
+        // signed builds only take images through checkForUpdate()
+        Serial.println(F("[OTA] Signed build: network upload (ArduinoOTA) disabled"));
+        #else
         // Set hostname
         ArduinoOTA.setHostname(Config::getOtaHostname().c_str());
         
@@ -65,16 +332,22 @@ namespace OTAHandler {
         
         ArduinoOTA.begin();
         Serial.printf("[OTA] Ready at %s.local:%d\n", Config::getOtaHostname().c_str(), OTA_PORT);
+        #endif
     }
 
     void handle() {
+        #ifndef OTA_SIGNING_ENABLED
         ArduinoOTA.handle();
+        #endif
     }
 
     bool checkForUpdate() {
         Serial.println(F("[OTA] Checking for updates..."));
         
+        updatePending = false;
+        
         String downloadUrl = "";
+        String patchUrl = "";
         String latestVersion = "";
         bool updateFound = false;
         
@@ -82,26 +355,52 @@ namespace OTAHandler {
         // This ensures they are destroyed and memory freed before we try to download
         {
             // Use secure client for HTTPS
-            WiFiClientSecure clientSecure;
+            DnsCachedClient<WiFiClientSecure> clientSecure;
             clientSecure.setInsecure();  // Accept any certificate (for now)
             HTTPClient http;
             
             // Construct URL: /api/v1/devices/{deviceId}/ota/latest
             String url = String(OTA_UPDATE_URL_BASE) + "/" + Config::deviceId + "/ota/latest";
             
+            // HTTP/1.0: no chunked encoding, so the body can be parsed
+            // straight from the socket
+            http.useHTTP10(true);
             http.begin(clientSecure, url);
             http.addHeader("Authorization", "Bearer " + Config::deviceToken);
             http.addHeader("X-Firmware-Version", FIRMWARE_VERSION);
+            if (otaEtag.length() > 0) {
+                http.addHeader("If-None-Match", otaEtag);
+            }
+            
+            const char* headerKeys[] = { "ETag" };
+            http.collectHeaders(headerKeys, 1);
             
             int httpCode = http.GET();
             
-            if (httpCode == HTTP_CODE_OK) {
-                String response = http.getString();
+            if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+                Serial.println(F("[OTA] Not modified"));
+            } else if (httpCode == HTTP_CODE_OK) {
+                otaEtag = http.header("ETag");
                 
                 // Parse response for update info
-                // Expected: {"update_available": true, "download_url": "...", "latest_version": "..."}
+                // Expected: {"update_available": true, "download_url": "...", "latest_version": "...",
+                //            "patch_url": "..." (optional, when a delta from our version exists),
+                //            "assets": [{"name", "url", "size", "checksum"}] (optional),
+                //            "assets_signature": "..." (optional, hex)}
+                JsonDocument filter;
+                filter["update_available"] = true;
+                filter["download_url"] = true;
+                filter["latest_version"] = true;
+                filter["patch_url"] = true;
+                filter["assets"][0]["name"] = true;
+                filter["assets"][0]["url"] = true;
+                filter["assets"][0]["size"] = true;
+                filter["assets"][0]["checksum"] = true;
+                filter["assets_signature"] = true;
+                
                 JsonDocument doc;
-                if (deserializeJson(doc, response) == DeserializationError::Ok) {
+                if (deserializeJson(doc, http.getStream(),
+                        DeserializationOption::Filter(filter)) == DeserializationError::Ok) {
                     if (doc["update_available"] == true) {
                         const char* url = doc["download_url"];
                         const char* ver = doc["latest_version"];
@@ -110,6 +409,24 @@ namespace OTAHandler {
                             downloadUrl = String(url);
                             latestVersion = String(ver);
                             updateFound = true;
+                            
+                            const char* patch = doc["patch_url"];
+                            if (patch) {
+                                patchUrl = String(patch);
+                            }
+                            
+                            assetCount = 0;
+                            for (JsonVariantConst asset : doc["assets"].as<JsonArrayConst>()) {
+                                const char* name = asset["name"];
+                                const char* assetUrl = asset["url"];
+                                const char* checksum = asset["checksum"];
+                                if (assetCount >= OTA_MAX_ASSETS || !name || !assetUrl || !checksum ||
+                                    strchr(name, '/') != nullptr) {
+                                    continue;
+                                }
+                                assets[assetCount++] = { name, assetUrl, checksum, asset["size"] | 0u };
+                            }
+                            assetsSignature = doc["assets_signature"] | "";
                         } else {
                             Serial.println(F("[OTA] Update available but missing URL or version"));
                         }
@@ -129,19 +446,52 @@ namespace OTAHandler {
             Serial.printf("[OTA] Update available: v%s\n", latestVersion.c_str());
             Serial.printf("[OTA] URL: %s\n", downloadUrl.c_str());
             
+            // Clips first: the image reboots the device once flashed
+            syncAssets();
+            
+            // Prefer the delta patch, fall back to the full image if it fails
+            if (patchUrl.length() > 0) {
+                if (updateFromPatch(patchUrl.c_str())) {
+                    return true;
+                }
+                Serial.println(F("[OTA] Delta update failed, falling back to full image"));
+            }
+            
             // Now we can safely start the download with freed memory
-            return updateFromUrl(downloadUrl.c_str());
+            if (updateFromUrl(downloadUrl.c_str())) {
+                return true;
+            }
+            
+            // Don't re-download a failing image on every report
+            failedVersion = latestVersion;
+            otaEtag = "";
+            return false;
         }
         
         Serial.println(F("[OTA] No updates available"));
         return false;
     }
 
+    void notifyAvailable(const char* version) {
+        if (!version || strcmp(version, FIRMWARE_VERSION) == 0 || failedVersion == version) {
+            return;
+        }
+        
+        if (!updatePending) {
+            Serial.printf("[OTA] Server advertises v%s\n", version);
+        }
+        updatePending = true;
+    }
+
+    bool isUpdatePending() {
+        return updatePending;
+    }
+
     bool updateFromUrl(const char* url) {
         Serial.printf("[OTA] Downloading from %s\n", url);
         
         // Use secure client for HTTPS URLs
-        WiFiClientSecure clientSecure;
+        DnsCachedClient<WiFiClientSecure> clientSecure;
         clientSecure.setInsecure();  // Accept any certificate (for now)
         HTTPClient http;
         
@@ -166,17 +516,32 @@ namespace OTAHandler {
         
         Serial.printf("[OTA] Firmware size: %d bytes\n", contentLength);
         
-        // Check if enough space is available
         size_t contentSize = (size_t)contentLength;
-        if (contentSize > (ESP.getFreeSketchSpace() - 0x1000)) {
+        size_t imageSize = contentSize;
+        
+        #ifdef OTA_SIGNING_ENABLED
+        // The signature block follows the image and is never written to flash
+        if (contentSize <= OTA_IMAGE_TRAILER_SIZE) {
+            Serial.println(F("[OTA] Image is not signed"));
+            http.end();
+            return false;
+        }
+        imageSize = contentSize - OTA_IMAGE_TRAILER_SIZE;
+        uint8_t trailer[OTA_IMAGE_TRAILER_SIZE];
+        BearSSL::HashSHA256 hash;
+        hash.begin();
+        #endif
+        
+        // Check if enough space is available
+        if (imageSize + 1 > (ESP.getFreeSketchSpace() - 0x1000)) {
             Serial.printf("[OTA] Not enough space. Available: %d, Required: %d\n",
-                ESP.getFreeSketchSpace() - 0x1000, contentLength);
+                ESP.getFreeSketchSpace() - 0x1000, imageSize);
             http.end();
             return false;
         }
         
-        // Start update
-        if (!Update.begin(contentSize)) {
+        // Start update (one spare byte, see commitUpdate)
+        if (!Update.begin(imageSize + 1)) {
             Serial.printf("[OTA] Not enough space to begin OTA. Available: %d\n", ESP.getFreeSketchSpace());
             http.end();
             return false;
@@ -193,8 +558,41 @@ namespace OTAHandler {
         while (http.connected() && (written < totalSize)) {
             size_t available = stream->available();
             if (available) {
-                int c = stream->readBytes(buff, ((available > sizeof(buff)) ? sizeof(buff) : available));
-                Update.write(buff, c);
+                // Never past Content-Length: the tail after the image goes
+                // into the fixed-size trailer
+                size_t want = min(min(sizeof(buff), available), totalSize - written);
+                int c = stream->readBytes(buff, want);
+                if (c <= 0) {
+                    delay(1);
+                    continue;
+                }
+                
+                // Gzip images are written as-is; eboot inflates them when
+                // copying to the sketch partition on the next boot
+                if (written == 0 && c >= 2 && buff[0] == 0x1F && buff[1] == 0x8B) {
+                    Serial.println(F("[OTA] Compressed image, will be inflated on install"));
+                }
+                
+                size_t imagePart = (written < imageSize) ? min((size_t)c, imageSize - written) : 0;
+                if (imagePart > 0) {
+                    #ifdef OTA_SIGNING_ENABLED
+                    // Hash in the same pass as the flash write
+                    hash.add(buff, imagePart);
+                    #endif
+                    Update.write(buff, imagePart);
+                }
+                #ifdef OTA_SIGNING_ENABLED
+                if (imagePart < (size_t)c) {
+                    size_t offset = written + imagePart - imageSize;
+                    if (c - imagePart > sizeof(trailer) - offset) {
+                        Serial.println(F("[OTA] Image is longer than announced"));
+                        Update.end(false);
+                        http.end();
+                        return false;
+                    }
+                    memcpy(trailer + offset, buff + imagePart, c - imagePart);
+                }
+                #endif
                 written += c;
                 
                 // Progress indicator
@@ -212,25 +610,93 @@ namespace OTAHandler {
         
         if (written != totalSize) {
             Serial.printf("[OTA] OTA Error: Written %d/%d bytes\n", written, totalSize);
-            // Update will be cleaned up automatically
+            Update.end(false);
+            return false;
+        }
+        
+        #ifdef OTA_SIGNING_ENABLED
+        bool verified = verifySignature(hash, trailer, sizeof(trailer));
+        #else
+        bool verified = true;
+        #endif
+        
+        if (!commitUpdate(verified)) {
+            return false;
+        }
+        
+        Serial.println(F("[OTA] Update successful! Rebooting..."));
+        Log::flush();
+        delay(1000);
+        ESP.restart();
+        
+        return true;
+    }
+
+    bool updateFromPatch(const char* url) {
+        Serial.printf("[OTA] Downloading patch from %s\n", url);
+        
+        DnsCachedClient<WiFiClientSecure> clientSecure;
+        clientSecure.setInsecure();  // Accept any certificate (for now)
+        HTTPClient http;
+        
+        http.begin(clientSecure, url);
+        http.addHeader("Authorization", "Bearer " + Config::deviceToken);
+        
+        int httpCode = http.GET();
+        
+        if (httpCode != HTTP_CODE_OK) {
+            Serial.printf("[OTA] HTTP error: %d - %s\n", httpCode, http.errorToString(httpCode).c_str());
+            http.end();
+            return false;
+        }
+        
+        int contentLength = http.getSize();
+        if (contentLength <= DELTA_PATCH_HEADER_SIZE) {
+            Serial.println(F("[OTA] Invalid patch length"));
+            http.end();
+            return false;
+        }
+        
+        Serial.printf("[OTA] Patch size: %d bytes\n", contentLength);
+        
+        size_t patchSize = (size_t)contentLength;
+        WiFiClient* stream = http.getStreamPtr();
+        
+        #ifdef OTA_SIGNING_ENABLED
+        // Patches carry the signature of the reconstructed image
+        if (patchSize <= DELTA_PATCH_HEADER_SIZE + OTA_PATCH_TRAILER_SIZE) {
+            Serial.println(F("[OTA] Patch is not signed"));
+            http.end();
             return false;
         }
+        patchSize -= OTA_PATCH_TRAILER_SIZE;
+        uint8_t trailer[OTA_PATCH_TRAILER_SIZE];
+        BearSSL::HashSHA256 hash;
+        hash.begin();
+        bool applied = DeltaPatch::apply(*stream, patchSize, &hash) &&
+            stream->readBytes(trailer, sizeof(trailer)) == sizeof(trailer);
+        bool verified = applied && verifySignature(hash, trailer, sizeof(trailer));
+        #else
+        bool applied = DeltaPatch::apply(*stream, patchSize);
+        bool verified = applied;
+        #endif
+        
+        http.end();
         
-        if (!Update.end()) {
-            Serial.printf("[OTA] Update end failed: %s\n", Update.getErrorString().c_str());
+        if (!applied) {
+            Update.end(false);
             return false;
         }
         
-        if (!Update.isFinished()) {
-            Serial.println(F("[OTA] Update not finished"));
+        if (!commitUpdate(verified)) {
             return false;
         }
         
         Serial.println(F("[OTA] Update successful! Rebooting..."));
+        Log::flush();
         delay(1000);
         ESP.restart();
         
         return true;
     }
 }
-
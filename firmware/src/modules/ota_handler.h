@@ -22,17 +22,36 @@ namespace OTAHandler {
     void handle();
     
     /**
-     * Check for updates from server
+     * Check for updates from server (conditional: a 304 costs no body)
      * @return true if update available
      */
     bool checkForUpdate();
     
+    /**
+     * Record a firmware version advertised by the server
+     * (piggybacked on the measurement response)
+     * @param version Advertised version string
+     */
+    void notifyAvailable(const char* version);
+    
+    /**
+     * Check if an advertised update is waiting to be installed
+     */
+    bool isUpdatePending();
+    
     /**
      * Download and install update from URL
      * @param url Full URL to firmware binary
      * @return true if update successful
      */
     bool updateFromUrl(const char* url);
+    
+    /**
+     * Download a delta patch and apply it against the running image
+     * @param url Full URL to the patch
+     * @return true if update successful
+     */
+    bool updateFromPatch(const char* url);
 }
 
 #endif // OTA_HANDLER_H
@@ -0,0 +1,357 @@
+/**
+ * Payload Module Implementation
+ */
+
+#include "payload.h"
+#include "config.h"
+#include "scheduler.h"
+#include "dns_cache.h"
+#include "heap_monitor.h"
+#include "profiler.h"
+#include "logger.h"
+#include "time_sync.h"
+#include "usage_tracker.h"
+#include "forecast.h"
+#include "rollup.h"
+#include "sensor.h"
+
+// Device health piggybacked on uploads; the backend keeps the latest copy
+static void addTelemetry(JsonDocument& doc) {
+    JsonObject telemetry = doc["telemetry"].to<JsonObject>();
+    telemetry["uptime_ms"] = millis();
+    
+    JsonArray tasks = telemetry["tasks"].to<JsonArray>();
+    for (int i = 0; i < Scheduler::getTaskCount(); i++) {
+        const TaskStats& stats = Scheduler::getStats(i);
+        JsonObject task = tasks.add<JsonObject>();
+        task["name"] = stats.name;
+        task["runs"] = stats.runs;
+        task["worst_us"] = stats.worstUs;
+        task["avg_us"] = stats.runs > 0 ? (uint32_t)(stats.totalUs / stats.runs) : 0;
+        task["misses"] = stats.deadlineMisses;
+    }
+    
+    JsonObject dns = telemetry["dns"].to<JsonObject>();
+    dns["hit_ratio"] = DnsCache::getHitRatio();
+    dns["saved_ms"] = DnsCache::getTimeSavedMs();
+    
+    JsonObject log = telemetry["log"].to<JsonObject>();
+    log["errors"] = Log::getCount(LOG_LEVEL_ERROR);
+    log["warnings"] = Log::getCount(LOG_LEVEL_WARN);
+    log["dropped"] = Log::getDropped();
+    
+    HeapMonitor::sample();
+    const HeapStats& heapStats = HeapMonitor::getStats();
+    JsonObject heap = telemetry["heap"].to<JsonObject>();
+    heap["free"] = heapStats.freeHeap;
+    heap["min_free"] = heapStats.minFreeHeap;
+    heap["max_block"] = heapStats.maxBlock;
+    heap["min_max_block"] = heapStats.minMaxBlock;
+    heap["frag"] = heapStats.fragmentation;
+    heap["max_frag"] = heapStats.maxFragmentation;
+    
+    if (HeapMonitor::getSiteCount() > 0) {
+        JsonArray sites = heap["sites"].to<JsonArray>();
+        for (int i = 0; i < HeapMonitor::getSiteCount(); i++) {
+            const HeapSiteStats& site = HeapMonitor::getSite(i);
+            JsonObject entry = sites.add<JsonObject>();
+            entry["name"] = site.name;
+            entry["calls"] = site.calls;
+            entry["peak"] = site.lastPeak;
+            entry["worst_peak"] = site.worstPeak;
+            entry["retained"] = site.lastRetained;
+            entry["over_budget"] = site.overBudget;
+        }
+    }
+    
+#if PROFILING_ENABLED
+    // Per probe: count, avg/max in us, bucket counts (<16 us, then x4)
+    JsonObject hist = telemetry["hist"].to<JsonObject>();
+    for (int i = 0; i < PROBE_COUNT; i++) {
+        const ProfileHistogram& h = Profiler::getHistogram((ProfileProbe)i);
+        JsonObject probe = hist[Profiler::getName((ProfileProbe)i)].to<JsonObject>();
+        probe["n"] = h.count;
+        probe["avg"] = h.count > 0 ? (uint32_t)(h.totalUs / h.count) : 0;
+        probe["max"] = h.maxUs;
+        JsonArray buckets = probe["b"].to<JsonArray>();
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            buckets.add(h.buckets[b]);
+        }
+    }
+#endif
+}
+
+// Usage events and daily counters, so the server needs no nightly scan of
+// raw samples. Returns whether anything was added (acknowledge on success).
+static bool addUsage(JsonDocument& doc, unsigned long now) {
+    RtcUsageEvent events[RTC_USAGE_EVENTS];
+    RtcUsageDay days[2];
+    size_t eventCount = UsageTracker::getEvents(events);
+    size_t dayCount = UsageTracker::getDays(days);
+    if (eventCount == 0 && dayCount == 0) {
+        return false;
+    }
+    
+    JsonObject usage = doc["usage"].to<JsonObject>();
+    
+    JsonArray eventList = usage["events"].to<JsonArray>();
+    for (size_t i = 0; i < eventCount; i++) {
+        JsonObject e = eventList.add<JsonObject>();
+        e["type"] = UsageTracker::getName(events[i].kind);
+        e["age_ms"] = now - events[i].at;
+        if (TimeSync::isValid()) {
+            e["timestamp"] = TimeSync::epochAt(events[i].at);
+        }
+        e["minutes"] = events[i].minutes;
+        e["amount_l"] = events[i].amountL;
+    }
+    
+    JsonArray dayList = usage["days"].to<JsonArray>();
+    for (size_t i = 0; i < dayCount; i++) {
+        char date[11];
+        snprintf(date, sizeof(date), "%04lu-%02lu-%02lu", (unsigned long)(days[i].date / 10000),
+            (unsigned long)(days[i].date / 100 % 100), (unsigned long)(days[i].date % 100));
+        
+        JsonObject d = dayList.add<JsonObject>();
+        d["date"] = date;
+        d["used_l"] = days[i].usedL;
+        d["refilled_l"] = days[i].refilledL;
+        d["refills"] = days[i].refills;
+        d["draws"] = days[i].draws;
+        d["leak"] = days[i].leak != 0;
+    }
+    return true;
+}
+
+// A relay leaf's measurement list in the upload, added on its first frame
+static JsonArray relayMeasurements(JsonArray nodes, const char* deviceId) {
+    for (JsonObject node : nodes) {
+        if (strcmp(node["device_id"] | "", deviceId) == 0) {
+            return node["measurements"];
+        }
+    }
+    
+    JsonObject node = nodes.add<JsonObject>();
+    node["device_id"] = deviceId;
+    return node["measurements"].to<JsonArray>();
+}
+
+// Unix seconds once the clock is synced; until then the clock reading,
+// dated by dateRecord() when the record is sent
+static void addTime(JsonDocument& doc, unsigned long clockMs) {
+    uint32_t timestamp = TimeSync::epochAt(clockMs);
+    if (timestamp != 0) {
+        doc["timestamp"] = timestamp;
+    } else {
+        doc["clock_ms"] = clockMs;
+        doc["clock_id"] = TimeSync::getClockId();
+    }
+}
+
+namespace Payload {
+    bool report(String& body, float levelCm, float volumeL, float tempC, float batteryV, int rssi,
+                const float* channelLevelsCm, unsigned long now) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        doc["firmware_version"] = FIRMWARE_VERSION;
+        if (TimeSync::isValid()) {
+            doc["timestamp"] = TimeSync::epoch();  // Otherwise the server uses arrival time
+        }
+        doc["level_cm"] = levelCm;
+        doc["volume_l"] = volumeL;
+        doc["temperature_c"] = tempC;
+        doc["battery_v"] = batteryV;
+        doc["rssi"] = rssi;
+        addChannels(channelLevelsCm, doc.as<JsonObject>());
+        doc["device_alerts"] = true;  // Alerts arrive via sendAlertEvents()
+        bool usageAdded = addUsage(doc, now);
+        addForecast(doc.as<JsonObject>());
+        addTelemetry(doc);
+        
+        serializeJson(doc, body);
+        return usageAdded;
+    }
+
+    bool batch(String& body, const SystemState* samples, size_t count, unsigned long now,
+               const RtcRollup* rollup) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        doc["firmware_version"] = FIRMWARE_VERSION;
+        
+        JsonArray measurements = doc["measurements"].to<JsonArray>();
+        for (size_t i = 0; i < count; i++) {
+            JsonObject m = measurements.add<JsonObject>();
+            m["age_ms"] = now - samples[i].lastMeasurement;
+            if (TimeSync::isValid()) {
+                m["timestamp"] = TimeSync::epochAt(samples[i].lastMeasurement);
+            }
+            m["level_cm"] = samples[i].waterLevelCm;
+            m["volume_l"] = samples[i].volumeLiters;
+            m["temperature_c"] = samples[i].temperatureC;
+            m["battery_v"] = samples[i].batteryVoltage;
+            m["rssi"] = samples[i].wifiRssi;
+            addChannels(samples[i].channelLevelCm, m);
+        }
+#if ROLLUP_ENABLED
+        if (rollup != nullptr) {
+            unsigned long midpoint = Rollup::getMidpoint(*rollup);
+            JsonObject m = measurements.add<JsonObject>();
+            m["age_ms"] = now - midpoint;
+            if (TimeSync::isValid()) {
+                m["timestamp"] = TimeSync::epochAt(midpoint);
+            }
+            Rollup::toJson(*rollup, m);
+            // Other tanks at their latest reading
+            addChannels(Sensor::getLastLevels(), m);
+        }
+#endif
+        doc["device_alerts"] = true;
+        bool usageAdded = addUsage(doc, now);
+        addForecast(doc.as<JsonObject>());
+        addTelemetry(doc);
+        
+        serializeJson(doc, body);
+        return usageAdded;
+    }
+
+    size_t relay(String& body, const RelayInbox& inbox, size_t count, unsigned long now) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        doc["firmware_version"] = FIRMWARE_VERSION;
+        
+        // Leaf readings are dated from the frame's arrival on this clock
+        JsonArray nodes = doc["nodes"].to<JsonArray>();
+        for (size_t i = 0; i < count; i++) {
+            const RelayEntry& entry = RelayProtocol::peek(inbox, i);
+            JsonArray measurements = relayMeasurements(nodes, entry.frame.deviceId);
+            for (uint8_t j = 0; j < entry.frame.count; j++) {
+                const RelaySample& sample = entry.frame.samples[j];
+                unsigned long takenAt = entry.receivedAt - sample.ageMs;
+                JsonObject m = measurements.add<JsonObject>();
+                m["age_ms"] = now - takenAt;
+                if (TimeSync::isValid()) {
+                    m["timestamp"] = TimeSync::epochAt(takenAt);
+                }
+                m["level_cm"] = sample.levelMm / 10.0f;
+                m["volume_l"] = sample.volumeL;
+                m["temperature_c"] = sample.temperatureCenti / 100.0f;
+                m["battery_v"] = sample.batteryMv / 1000.0f;
+            }
+        }
+        
+        serializeJson(doc, body);
+        return nodes.size();
+    }
+
+    void alertEvents(String& body, const AlertEvent* events, size_t count, unsigned long now) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        
+        JsonArray list = doc["events"].to<JsonArray>();
+        for (size_t i = 0; i < count; i++) {
+            JsonObject e = list.add<JsonObject>();
+            e["type"] = AlertEngine::getName(events[i].type);
+            e["state"] = events[i].kind == ALERT_EVENT_RAISED ? "raised" : "cleared";
+            e["value"] = events[i].value;
+            e["age_ms"] = now - events[i].at;
+        }
+        
+        serializeJson(doc, body);
+    }
+
+    String bufferedMeasurement(const SystemState& state) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        doc["firmware_version"] = FIRMWARE_VERSION;
+        addTime(doc, state.lastMeasurement);
+        
+        doc["level_cm"] = state.waterLevelCm;
+        doc["volume_l"] = state.volumeLiters;
+        doc["temperature_c"] = state.temperatureC;
+        doc["battery_v"] = state.batteryVoltage;
+        doc["rssi"] = state.wifiRssi;
+        addChannels(state.channelLevelCm, doc.as<JsonObject>());
+        doc["buffered"] = true;
+        
+        String json;
+        serializeJson(doc, json);
+        return json;
+    }
+
+#if ROLLUP_ENABLED
+    String bufferedRollup(const RtcRollup& window) {
+        JsonDocument doc;
+        doc["device_id"] = Config::deviceId;
+        doc["firmware_version"] = FIRMWARE_VERSION;
+        addTime(doc, Rollup::getMidpoint(window));
+        Rollup::toJson(window, doc.as<JsonObject>());
+        addChannels(Sensor::getLastLevels(), doc.as<JsonObject>());
+        doc["buffered"] = true;
+        
+        String json;
+        serializeJson(doc, json);
+        return json;
+    }
+#endif
+
+    // Records buffered before the first SNTP sync carry the device clock
+    // reading instead of a timestamp. Date them at upload if that clock has
+    // not restarted since; otherwise the server falls back to arrival time.
+    void dateRecord(String& json) {
+        if (!TimeSync::isValid() || json.indexOf("\"clock_ms\"") < 0) {
+            return;
+        }
+        
+        JsonDocument doc;
+        if (deserializeJson(doc, json) || doc["clock_id"].as<uint32_t>() != TimeSync::getClockId()) {
+            return;
+        }
+        
+        doc["timestamp"] = TimeSync::epochAt(doc["clock_ms"].as<unsigned long>());
+        doc.remove("clock_ms");
+        doc.remove("clock_id");
+        json = "";
+        serializeJson(doc, json);
+    }
+
+    // Parsed straight from the socket; the filter keeps only the fields
+    // the reporter applies
+    DeserializationError parseResponse(Stream& body, JsonDocument& doc) {
+        JsonDocument filter;
+        filter["config"] = true;
+        filter["ota"] = true;
+        
+        return deserializeJson(doc, body, DeserializationOption::Filter(filter));
+    }
+
+    void addChannels(const float* levelsCm, JsonObject record) {
+        if (SENSOR_CHANNELS < 2 || levelsCm == nullptr) {
+            return;
+        }
+        
+        JsonArray channels = record["channels"].to<JsonArray>();
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            JsonObject c = channels.add<JsonObject>();
+            c["level_cm"] = levelsCm[ch];
+            c["volume_l"] = Sensor::calculateVolume(levelsCm[ch], ch);
+            c["percent"] = Sensor::getPercentage(levelsCm[ch], ch);
+        }
+    }
+
+    void addForecast(JsonObject record) {
+        ForecastEstimate estimate;
+        if (!Forecast::getEstimate(estimate)) {
+            return;
+        }
+        
+        JsonObject forecast = record["forecast"].to<JsonObject>();
+        forecast["flow_lpm"] = estimate.flowLpm;
+        if (estimate.minutesToEmpty >= 0) {
+            forecast["time_to_empty_min"] = (uint32_t)estimate.minutesToEmpty;
+            forecast["basis"] = estimate.fromDailyUsage ? "daily" : "flow";
+        }
+        if (estimate.minutesToFull >= 0) {
+            forecast["time_to_full_min"] = (uint32_t)estimate.minutesToFull;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * ============================================================================
+ * Payload Module
+ * ============================================================================
+ * JSON bodies sent to the backend: measurement, batch, relay and alert
+ * uploads, and records buffered in flash for later upload. Kept apart from
+ * the HTTP code so the host can build them too (scripts/heap_budget.cpp
+ * measures their heap use).
+ *
+ * Upload bodies are serialized before returning, so the document is freed
+ * before the request opens and the TLS buffers are allocated.
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "types.h"
+#include "alert_engine.h"
+#include "rtc_store.h"
+#include "relay_protocol.h"
+
+namespace Payload {
+    /**
+     * Measurement upload, with usage, forecast and telemetry
+     * @param body Receives the JSON
+     * @param channelLevelsCm Every channel's level (SENSOR_CHANNELS > 1)
+     * @param now PowerManager::now(), for usage event ages
+     * @return true if usage records were included (acknowledge on success)
+     */
+    bool report(String& body, float levelCm, float volumeL, float tempC, float batteryV, int rssi,
+                const float* channelLevelsCm, unsigned long now);
+    
+    /**
+     * Several measurements in one upload, see DataReporter::sendBatch()
+     * @return true if usage records were included
+     */
+    bool batch(String& body, const SystemState* samples, size_t count, unsigned long now,
+               const RtcRollup* rollup);
+    
+    /**
+     * Relay leaves' frames, grouped by leaf
+     * @return Number of leaves
+     */
+    size_t relay(String& body, const RelayInbox& inbox, size_t count, unsigned long now);
+    
+    /**
+     * Alert transitions
+     */
+    void alertEvents(String& body, const AlertEvent* events, size_t count, unsigned long now);
+    
+    /**
+     * A measurement in the buffered upload format
+     */
+    String bufferedMeasurement(const SystemState& state);
+    
+    /**
+     * A closed rollup window in the buffered upload format (ROLLUP_ENABLED)
+     */
+    String bufferedRollup(const RtcRollup& window);
+    
+    /**
+     * Date a buffered record that carries a clock reading, once the clock
+     * is synced and has not restarted since
+     */
+    void dateRecord(String& json);
+    
+    /**
+     * Parse an upload response, keeping only "config" and "ota"
+     */
+    DeserializationError parseResponse(Stream& body, JsonDocument& doc);
+    
+    /**
+     * Write every channel's level, volume and percentage into a record as
+     * "channels". Does nothing with a single channel, or no levels.
+     */
+    void addChannels(const float* levelsCm, JsonObject record);
+    
+    /**
+     * Add the forecast to a record as a "forecast" object (nothing until a
+     * fit has settled)
+     */
+    void addForecast(JsonObject record);
+}
+
+#endif // PAYLOAD_H
@@ -0,0 +1,113 @@
+/**
+ * Power Manager Module Implementation
+ */
+
+#include "power_manager.h"
+#include "rtc_store.h"
+#include "logger.h"
+
+static const char* const phaseNames[AWAKE_PHASE_COUNT] = {
+    "boot", "sensor", "wifi", "report"
+};
+
+static unsigned long phaseMs[AWAKE_PHASE_COUNT];
+static unsigned long lastMark = 0;
+static bool resumed = false;
+
+static void enterDeepSleep(unsigned long ms, bool radioNext) {
+    RtcPowerState& power = RtcStore::data().power;
+    
+    power.clockMs += millis() + ms;
+    power.cycles++;
+    power.radioOn = radioNext ? 1 : 0;
+    RtcStore::save();
+    
+    Log::flush();
+    ESP.deepSleep((uint64_t)ms * 1000ULL, radioNext ? RF_DEFAULT : RF_DISABLED);
+    
+    // deepSleep() does not return; wait here while it takes effect
+    while (true) {
+        yield();
+    }
+}
+
+namespace PowerManager {
+    void init(bool rtcValid) {
+        resumed = rtcValid && ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE;
+        
+        if (!resumed) {
+            // Cold boot or reset: the radio is on and the clock starts over,
+            // and alert timing, the wall-clock anchor, usage tracking, the
+            // forecast fit and the rollup window with it. Daily usage
+            // counters survive a reset. Deferred measurements are dropped:
+            // they were timed on the old clock, and nothing is left to
+            // convert their times with.
+            RtcData& rtc = RtcStore::data();
+            if (rtcValid && rtc.power.pendingCount > 0) {
+                LOG_WARN("[Power] Reset: dropping %d deferred measurements", rtc.power.pendingCount);
+            }
+            RtcUsageDay usageDays[2];
+            memcpy(usageDays, rtc.usage.days, sizeof(usageDays));
+            memset(&rtc.power, 0, sizeof(rtc.power));
+            memset(rtc.alerts, 0, sizeof(rtc.alerts));
+            memset(&rtc.time, 0, sizeof(rtc.time));
+            memset(&rtc.usage, 0, sizeof(rtc.usage));
+            memset(&rtc.forecast, 0, sizeof(rtc.forecast));
+#if ROLLUP_ENABLED
+            memset(&rtc.rollup, 0, sizeof(rtc.rollup));
+#endif
+            rtc.power.radioOn = 1;
+            memcpy(rtc.usage.days, usageDays, sizeof(usageDays));
+        }
+        
+        memset(phaseMs, 0, sizeof(phaseMs));
+        lastMark = 0;
+    }
+
+    bool resumedFromSleep() {
+        return resumed;
+    }
+
+    bool radioAvailable() {
+        return RtcStore::data().power.radioOn != 0;
+    }
+
+    unsigned long now() {
+        return RtcStore::data().power.clockMs + millis();
+    }
+
+    void mark(AwakePhase phase) {
+        unsigned long t = millis();
+        phaseMs[phase] += t - lastMark;
+        lastMark = t;
+    }
+
+    void sleep(unsigned long ms, bool radioNext) {
+        RtcPowerState& power = RtcStore::data().power;
+        unsigned long awakeMs = millis();
+        
+        // Bounded by the RTC counter range (~3.5 h)
+        unsigned long maxMs = (unsigned long)(ESP.deepSleepMax() / 1000ULL);
+        if (ms > maxMs) {
+            ms = maxMs;
+        }
+        
+        power.lastAwakeMs = awakeMs;
+        power.avgAwakeMs = power.cycles == 0 ? awakeMs : (power.avgAwakeMs * 7 + awakeMs) / 8;
+        
+        Serial.printf("[Power] Awake %lu ms (", awakeMs);
+        for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+            Serial.printf("%s%s %lu", i ? ", " : "", phaseNames[i], phaseMs[i]);
+        }
+        Serial.printf("), avg %lu ms, sleeping %lu ms, duty %.2f%%, radio %s next\n",
+            power.avgAwakeMs, ms, 100.0f * awakeMs / (awakeMs + ms),
+            radioNext ? "on" : "off");
+        
+        enterDeepSleep(ms, radioNext);
+    }
+
+    void restartWithRadio() {
+        Serial.println(F("[Power] Radio needed, restarting with RF enabled"));
+        enterDeepSleep(1, true);
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * ============================================================================
+ * Power Manager Module
+ * ============================================================================
+ * Deep-sleep duty cycling: keeps a clock running across sleeps, decides
+ * whether the next wake needs the radio, and reports how each cycle's
+ * awake time was spent.
+ *
+ * Deep sleep needs D0 (GPIO16) wired to RST so the RTC can wake the chip.
+ */
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+/**
+ * Awake-time budget categories
+ */
+enum AwakePhase {
+    AWAKE_BOOT,         // Reset to modules initialized
+    AWAKE_SENSOR,       // Measurement and alerts
+    AWAKE_WIFI,         // Association and DHCP
+    AWAKE_REPORT,       // Upload, config and OTA
+    AWAKE_PHASE_COUNT
+};
+
+namespace PowerManager {
+    /**
+     * Restore duty-cycle state. Call right after RtcStore::init().
+     * @param rtcValid Result of RtcStore::init()
+     */
+    void init(bool rtcValid);
+    
+    /**
+     * Check if this boot is a wake from deep sleep with RTC state intact
+     */
+    bool resumedFromSleep();
+    
+    /**
+     * Check if this wake started with the radio enabled
+     */
+    bool radioAvailable();
+    
+    /**
+     * Milliseconds since cold boot, including time spent in deep sleep
+     */
+    unsigned long now();
+    
+    /**
+     * Charge the time since the previous mark to a budget phase
+     */
+    void mark(AwakePhase phase);
+    
+    /**
+     * Print the awake-time budget, save RTC state and deep sleep.
+     * Does not return.
+     * @param ms Sleep duration
+     * @param radioNext Wake with RF enabled (skipped RF calibration otherwise)
+     */
+    void sleep(unsigned long ms, bool radioNext);
+    
+    /**
+     * Reboot immediately with RF enabled, for a wake that started with the
+     * radio off but needs it. Does not return.
+     */
+    void restartWithRadio();
+}
+
+#endif // POWER_MANAGER_H
@@ -0,0 +1,74 @@
+/**
+ * Profiler Module Implementation
+ */
+
+#include "profiler.h"
+#include "logger.h"
+
+#if PROFILING_ENABLED
+
+// The cycle counter wraps after ~26 s at 160 MHz; longer spans use millis()
+#define CYCLE_SPAN_LIMIT_MS     20000
+
+static ProfileHistogram histograms[PROBE_COUNT];
+
+static const char* const probeNames[PROBE_COUNT] = {
+    "sensor_read",
+    "report_send",
+    "connect",
+    "storage_write",
+    "loop"
+};
+
+namespace Profiler {
+    void record(ProfileProbe probe, uint32_t us) {
+        ProfileHistogram& h = histograms[probe];
+        h.count++;
+        h.totalUs += us;
+        if (us > h.maxUs) {
+            h.maxUs = us;
+        }
+        
+        int bucket = 0;
+        uint32_t limit = PROFILE_FIRST_BUCKET_US;
+        while (bucket < PROFILE_BUCKETS - 1 && us >= limit) {
+            bucket++;
+            limit <<= 2;
+        }
+        h.buckets[bucket]++;
+    }
+
+    const ProfileHistogram& getHistogram(ProfileProbe probe) {
+        return histograms[probe];
+    }
+
+    const char* getName(ProfileProbe probe) {
+        return probeNames[probe];
+    }
+
+    void printSummary() {
+        LOG_INFO("[Prof] probe           count     avg_us     max_us  buckets (<16us x4 ...)");
+        for (int i = 0; i < PROBE_COUNT; i++) {
+            const ProfileHistogram& h = histograms[i];
+            const uint32_t* b = h.buckets;
+            static_assert(PROFILE_BUCKETS == 10, "update the bucket columns");
+            LOG_INFO("[Prof] %-13s %7u %10u %10u  %u %u %u %u %u %u %u %u %u %u",
+                probeNames[i], h.count,
+                h.count > 0 ? (uint32_t)(h.totalUs / h.count) : 0, h.maxUs,
+                b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9]);
+        }
+    }
+
+    ScopedTimer::~ScopedTimer() {
+        unsigned long elapsedMs = millis() - startMs;
+        uint32_t us;
+        if (elapsedMs < CYCLE_SPAN_LIMIT_MS) {
+            us = (ESP.getCycleCount() - startCycles) / ESP.getCpuFreqMHz();
+        } else {
+            us = elapsedMs * 1000;
+        }
+        record(probe, us);
+    }
+}
+
+#endif // PROFILING_ENABLED
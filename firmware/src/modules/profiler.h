@@ -0,0 +1,92 @@
+/**
+ * ============================================================================
+ * Profiler Module
+ * ============================================================================
+ * Hot-path instrumentation. PROFILE_SCOPE(probe) times the rest of the
+ * enclosing block with the CPU cycle counter and adds the result to the
+ * probe's fixed-bucket latency histogram. With PROFILING_ENABLED false
+ * the macro expands to nothing and the module compiles empty.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Instrumented code paths
+ */
+enum ProfileProbe {
+    PROBE_SENSOR_READ,      // Sensor::readWaterLevel
+    PROBE_REPORT_SEND,      // DataReporter::send
+    PROBE_CONNECT,          // TCP connect + TLS handshake to the server
+    PROBE_STORAGE_WRITE,    // LittleFS writes
+    PROBE_LOOP,             // loop() passes that ran a task (idle excluded)
+    PROBE_COUNT
+};
+
+// Bucket i counts durations below 16 us * 4^i; the last bucket is open
+#define PROFILE_BUCKETS         10
+#define PROFILE_FIRST_BUCKET_US 16
+
+/**
+ * Latency histogram for one probe
+ */
+struct ProfileHistogram {
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t buckets[PROFILE_BUCKETS];
+};
+
+#if PROFILING_ENABLED
+
+namespace Profiler {
+    /**
+     * Add one duration to a probe's histogram
+     */
+    void record(ProfileProbe probe, uint32_t us);
+    
+    /**
+     * Histogram for a probe
+     */
+    const ProfileHistogram& getHistogram(ProfileProbe probe);
+    
+    /**
+     * Short name of a probe (telemetry key)
+     */
+    const char* getName(ProfileProbe probe);
+    
+    /**
+     * Print count, average, max and buckets of every probe
+     */
+    void printSummary();
+    
+    /**
+     * Times its own lifetime; use through PROFILE_SCOPE
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(ProfileProbe probe)
+            : probe(probe), startCycles(ESP.getCycleCount()), startMs(millis()) {}
+        ~ScopedTimer();
+        
+    private:
+        ProfileProbe probe;
+        uint32_t startCycles;
+        unsigned long startMs;
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(probe) Profiler::ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(probe)
+
+#else
+
+#define PROFILE_SCOPE(probe) do {} while (0)
+
+#endif // PROFILING_ENABLED
+
+#endif // PROFILER_H
@@ -0,0 +1,212 @@
+/**
+ * Relay Module Implementation
+ */
+
+#include "relay.h"
+#include "relay_protocol.h"
+#include "config.h"
+#include "logger.h"
+
+#if RELAY_ROLE != RELAY_ROLE_NONE
+static constexpr uint8_t relayKey[RELAY_KEY_LEN] = RELAY_KEY;
+
+static constexpr bool keySet(size_t i = 0) {
+    return i < RELAY_KEY_LEN && (relayKey[i] != 0 || keySet(i + 1));
+}
+
+static_assert(keySet(), "Set RELAY_KEY in config.h, the same on the gateway and its leaves");
+#endif
+
+#if RELAY_ROLE == RELAY_ROLE_LEAF
+
+#include "rtc_store.h"
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+
+static_assert(RELAY_MAX_SAMPLES > RTC_PENDING_SAMPLES, "A frame must hold the RTC backlog and the current reading");
+
+static uint8_t gatewayMac[6] = RELAY_GATEWAY_MAC;
+
+// -1 until the SDK reports the frame's link-layer ack (0) or its absence
+static volatile int8_t sendStatus = -1;
+
+// The frame being sent, and the gateway's answer to it
+static const RelayFrame* sending = nullptr;
+static volatile RelayStatus replyStatus = RELAY_NO_REPLY;
+
+static void onSent(uint8_t* mac, uint8_t status) {
+    sendStatus = status;
+}
+
+static void onReceive(uint8_t* mac, uint8_t* data, uint8_t len) {
+    if (sending != nullptr && memcmp(mac, gatewayMac, sizeof(gatewayMac)) == 0) {
+        RelayStatus status = RelayProtocol::parseAck(data, len, relayKey, *sending);
+        if (status != RELAY_NO_REPLY) {
+            replyStatus = status;
+        }
+    }
+}
+
+static RelayStatus transmit(uint8_t channel, const uint8_t* data, size_t len) {
+    wifi_set_channel(channel);
+    esp_now_set_peer_channel(gatewayMac, channel);
+
+    sendStatus = -1;
+    replyStatus = RELAY_NO_REPLY;
+    sending = (const RelayFrame*)data;
+    if (esp_now_send(gatewayMac, (uint8_t*)data, len) != 0) {
+        sending = nullptr;
+        return RELAY_NO_REPLY;
+    }
+
+    // Done early if the frame itself got no link-layer ack
+    unsigned long start = millis();
+    while (replyStatus == RELAY_NO_REPLY && sendStatus <= 0 && millis() - start < RELAY_ACK_TIMEOUT_MS) {
+        delay(1);
+    }
+    sending = nullptr;
+    return replyStatus;
+}
+
+static RelaySample toSample(const SystemState& state, unsigned long now) {
+    RelaySample sample;
+    sample.ageMs = now - state.lastMeasurement;
+    sample.volumeL = state.volumeLiters;
+    sample.levelMm = (int16_t)constrain(lroundf(state.waterLevelCm * 10.0f), -32768L, 32767L);
+    sample.temperatureCenti = (int16_t)constrain(lroundf(state.temperatureC * 100.0f), -32768L, 32767L);
+    sample.batteryMv = (uint16_t)(state.batteryVoltage * 1000.0f + 0.5f);
+    return sample;
+}
+
+namespace Relay {
+    void init() {
+        RtcRelayState& relay = RtcStore::data().relay;
+
+        // RTC memory was lost and reading numbers start over: a new boot
+        // id tells the gateway they are not repeats of old ones
+        if (relay.boot == 0) {
+            relay.boot = (uint8_t)(RANDOM_REG32 % 255 + 1);
+        }
+
+        WiFi.persistent(false);
+        WiFi.mode(WIFI_STA);
+        WiFi.disconnect();
+
+        if (esp_now_init() != 0) {
+            LOG_ERROR("[Relay] ESP-NOW init failed");
+            return;
+        }
+        esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+        esp_now_register_send_cb(onSent);
+        esp_now_register_recv_cb(onReceive);
+        esp_now_add_peer(gatewayMac, ESP_NOW_ROLE_COMBO, relay.channel, nullptr, 0);
+    }
+
+    bool send(const SystemState* samples, size_t count, unsigned long now) {
+        RtcRelayState& relay = RtcStore::data().relay;
+        size_t first = count > RELAY_MAX_SAMPLES ? count - RELAY_MAX_SAMPLES : 0;
+
+        // Held readings were numbered when taken; the new one is next
+        relay.seq++;
+        RelayFrame frame;
+        RelayProtocol::begin(frame, Config::deviceId.c_str(), relay.boot, relay.seq);
+        for (size_t i = first; i < count; i++) {
+            frame.samples[frame.count++] = toSample(samples[i], now);
+        }
+        RelayProtocol::seal(frame, relayKey);
+
+        uint8_t channel = relay.channel;
+        RelayStatus status = RelayProtocol::deliver(frame, channel, transmit);
+        if (channel != relay.channel) {
+            LOG_INFO("[Relay] Gateway found on channel %u", channel);
+            relay.channel = channel;
+        }
+
+        if (status == RELAY_NO_REPLY) {
+            LOG_WARN("[Relay] No answer from the gateway on any channel");
+            return false;
+        }
+        if (status == RELAY_BUSY) {
+            LOG_WARN("[Relay] Gateway queue is full, keeping the readings");
+            return false;
+        }
+        return true;
+    }
+}
+
+#elif RELAY_ROLE == RELAY_ROLE_GATEWAY
+
+#include "data_reporter.h"
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+
+static RelayInbox inbox;
+
+// Leaves answered so far. The SDK only sends to known peers and holds at
+// most 20, so the oldest gives way.
+static uint8_t replyPeers[RELAY_MAX_LEAVES][6];
+static uint8_t replyPeerCount = 0;
+static uint8_t nextReplyPeer = 0;
+
+static void addReplyPeer(const uint8_t* mac) {
+    if (esp_now_is_peer_exist((uint8_t*)mac) > 0) {
+        return;
+    }
+    if (replyPeerCount == RELAY_MAX_LEAVES) {
+        esp_now_del_peer(replyPeers[nextReplyPeer]);
+    } else {
+        replyPeerCount++;
+    }
+    memcpy(replyPeers[nextReplyPeer], mac, 6);
+    nextReplyPeer = (nextReplyPeer + 1) % RELAY_MAX_LEAVES;
+    esp_now_add_peer((uint8_t*)mac, ESP_NOW_ROLE_COMBO, wifi_get_channel(), nullptr, 0);
+}
+
+// Runs in the SDK's context: queue and answer only. The leaf waits
+// RELAY_ACK_TIMEOUT_MS for the answer, too short to defer it to loop().
+static void onReceive(uint8_t* mac, uint8_t* data, uint8_t len) {
+    RelayAck reply;
+    if (RelayProtocol::accept(inbox, data, len, millis(), reply) != RELAY_NO_REPLY) {
+        addReplyPeer(mac);
+        esp_now_send(mac, (uint8_t*)&reply, sizeof(reply));
+    }
+}
+
+namespace Relay {
+    void init() {
+        // Frames sent while the modem sleeps between beacons are lost
+        WiFi.setSleepMode(WIFI_NONE_SLEEP);
+        memcpy(inbox.key, relayKey, RELAY_KEY_LEN);
+
+        if (esp_now_init() != 0) {
+            LOG_ERROR("[Relay] ESP-NOW init failed");
+            return;
+        }
+        esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+        esp_now_register_recv_cb(onReceive);
+        LOG_INFO("[Relay] Gateway listening, MAC %s", WiFi.macAddress().c_str());
+    }
+
+    size_t getPendingCount() {
+        return inbox.count;
+    }
+
+    bool upload() {
+        // Frames arriving during the upload are left for the next one
+        size_t count = inbox.count;
+        if (count == 0) {
+            return true;
+        }
+
+        if (!DataReporter::sendRelay(inbox, count, millis())) {
+            return false;
+        }
+        RelayProtocol::drop(inbox, count);
+
+        LOG_INFO("[Relay] Uploaded %u frames (%lu repeated readings dropped, %lu frames turned away by a full queue so far)",
+            count, inbox.stats.resent + inbox.stats.duplicates, inbox.stats.overflows);
+        return true;
+    }
+}
+
+#endif // RELAY_ROLE
@@ -0,0 +1,49 @@
+/**
+ * ============================================================================
+ * Relay Module
+ * ============================================================================
+ * ESP-NOW relay between leaf nodes and a gateway (RELAY_ROLE). A leaf sends
+ * its readings as one frame (see relay_protocol.h) and goes back to sleep
+ * without associating or opening a connection. The gateway collects frames
+ * from all its leaves and uploads them in one request.
+ */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <Arduino.h>
+#include "types.h"
+#include "relay_protocol.h"
+
+namespace Relay {
+    /**
+     * Leaf: bring up ESP-NOW without associating.
+     * Gateway: start listening for leaves, once WiFi has been started.
+     */
+    void init();
+
+    /**
+     * Leaf: send readings to the gateway in one frame. Newest ones win if
+     * there are more than a frame holds.
+     * @param samples The readings held since the last acknowledged frame
+     *                and the new one, oldest first, timed by lastMeasurement
+     * @param count Number of readings
+     * @param now PowerManager::now()
+     * @return true once the gateway acknowledged the frame
+     */
+    bool send(const SystemState* samples, size_t count, unsigned long now);
+
+    /**
+     * Gateway: frames waiting for upload
+     */
+    size_t getPendingCount();
+
+    /**
+     * Gateway: upload every waiting frame in one request. Frames stay
+     * queued if it fails.
+     * @return true unless the request failed
+     */
+    bool upload();
+}
+
+#endif // RELAY_H
@@ -0,0 +1,246 @@
+/**
+ * Relay Protocol Module Implementation
+ */
+
+#include "relay_protocol.h"
+#include <stddef.h>
+#include <string.h>
+
+static const size_t HEADER_SIZE = sizeof(RelayFrame) - sizeof(RelaySample) * RELAY_MAX_SAMPLES;
+
+static_assert(sizeof(RelayFrame) <= 250, "ESP-NOW frames carry at most 250 bytes");
+
+static uint64_t readLe64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static void sipRound(uint64_t v[4]) {
+    v[0] += v[1]; v[1] = rotl(v[1], 13); v[1] ^= v[0]; v[0] = rotl(v[0], 32);
+    v[2] += v[3]; v[3] = rotl(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = rotl(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = rotl(v[1], 17); v[1] ^= v[2]; v[2] = rotl(v[2], 32);
+}
+
+// SipHash-2-4: a keyed hash made for short messages, cheap enough to run
+// per frame without BearSSL, so the host simulation can run it too
+static uint64_t sipHash(const uint8_t* key, const uint8_t* data, size_t len) {
+    uint64_t k0 = readLe64(key);
+    uint64_t k1 = readLe64(key + 8);
+    uint64_t v[4] = { k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL,
+                      k0 ^ 0x6c7967656e657261ULL, k1 ^ 0x7465646279746573ULL };
+
+    size_t end = len - len % 8;
+    for (size_t i = 0; i < end; i += 8) {
+        uint64_t m = readLe64(data + i);
+        v[3] ^= m;
+        sipRound(v);
+        sipRound(v);
+        v[0] ^= m;
+    }
+
+    uint64_t last = (uint64_t)len << 56;
+    for (size_t i = end; i < len; i++) {
+        last |= (uint64_t)data[i] << (8 * (i - end));
+    }
+    v[3] ^= last;
+    sipRound(v);
+    sipRound(v);
+    v[0] ^= last;
+
+    v[2] ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        sipRound(v);
+    }
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// Tag of a frame or answer as sent, its own tag field taken as zero
+static void makeTag(const uint8_t* key, const uint8_t* data, size_t len, size_t tagAt, uint8_t* tag) {
+    uint8_t copy[sizeof(RelayFrame)];
+    memcpy(copy, data, len);
+    memset(copy + tagAt, 0, RELAY_TAG_LEN);
+    uint64_t hash = sipHash(key, copy, len);
+    for (int i = 0; i < RELAY_TAG_LEN; i++) {
+        tag[i] = (uint8_t)(hash >> (8 * i));
+    }
+}
+
+// Compares every byte, so the time taken says nothing about the tag
+static bool tagValid(const uint8_t* key, const uint8_t* data, size_t len, size_t tagAt) {
+    uint8_t tag[RELAY_TAG_LEN];
+    makeTag(key, data, len, tagAt, tag);
+    uint8_t diff = 0;
+    for (int i = 0; i < RELAY_TAG_LEN; i++) {
+        diff |= tag[i] ^ data[tagAt + i];
+    }
+    return diff == 0;
+}
+
+// Slot for a leaf, taking over the oldest one when all are in use (that
+// leaf's next repeat would then get through once). A slot is the leaf's
+// from its first frame on, even one turned away before anything was kept.
+static RelayPeer& findPeer(RelayInbox& inbox, const char* deviceId) {
+    for (int i = 0; i < RELAY_MAX_LEAVES; i++) {
+        RelayPeer& peer = inbox.peers[i];
+        if (strcmp(peer.deviceId, deviceId) == 0) {
+            return peer;
+        }
+    }
+
+    RelayPeer& peer = inbox.peers[inbox.nextPeer];
+    inbox.nextPeer = (inbox.nextPeer + 1) % RELAY_MAX_LEAVES;
+    memcpy(peer.deviceId, deviceId, sizeof(peer.deviceId));
+    peer.used = false;
+    return peer;
+}
+
+static RelayStatus answer(const RelayInbox& inbox, RelayAck& reply, const RelayFrame& frame, RelayStatus status) {
+    reply.magic = RELAY_ACK_MAGIC;
+    reply.version = RELAY_VERSION;
+    reply.boot = frame.boot;
+    reply.status = (uint8_t)status;
+    reply.seq = frame.seq;
+    makeTag(inbox.key, (const uint8_t*)&reply, sizeof(reply), offsetof(RelayAck, tag), reply.tag);
+    return status;
+}
+
+namespace RelayProtocol {
+    size_t frameSize(uint8_t count) {
+        return HEADER_SIZE + count * sizeof(RelaySample);
+    }
+
+    void begin(RelayFrame& frame, const char* deviceId, uint8_t boot, uint16_t seq) {
+        memset(&frame, 0, sizeof(frame));
+        frame.magic = RELAY_MAGIC;
+        frame.version = RELAY_VERSION;
+        frame.boot = boot;
+        frame.seq = seq;
+        strncpy(frame.deviceId, deviceId, RELAY_DEVICE_ID_LEN - 1);
+    }
+
+    void seal(RelayFrame& frame, const uint8_t* key) {
+        makeTag(key, (const uint8_t*)&frame, frameSize(frame.count), offsetof(RelayFrame, tag), frame.tag);
+    }
+
+    bool parse(const uint8_t* data, size_t len, const uint8_t* key, RelayFrame& frame) {
+        if (len < HEADER_SIZE || data[0] != RELAY_MAGIC || data[1] != RELAY_VERSION) {
+            return false;
+        }
+
+        memset(&frame, 0, sizeof(frame));
+        memcpy(&frame, data, HEADER_SIZE);
+        if (frame.count == 0 || frame.count > RELAY_MAX_SAMPLES || len != frameSize(frame.count) ||
+            !tagValid(key, data, len, offsetof(RelayFrame, tag))) {
+            return false;
+        }
+        memcpy(frame.samples, data + HEADER_SIZE, frame.count * sizeof(RelaySample));
+        frame.deviceId[RELAY_DEVICE_ID_LEN - 1] = '\0';
+        return frame.deviceId[0] != '\0';
+    }
+
+    RelayStatus parseAck(const uint8_t* data, size_t len, const uint8_t* key, const RelayFrame& frame) {
+        RelayAck reply;
+        if (len != sizeof(reply) || !tagValid(key, data, len, offsetof(RelayAck, tag))) {
+            return RELAY_NO_REPLY;
+        }
+        memcpy(&reply, data, sizeof(reply));
+        if (reply.magic != RELAY_ACK_MAGIC || reply.version != RELAY_VERSION ||
+            reply.boot != frame.boot || reply.seq != frame.seq ||
+            reply.status < RELAY_ACCEPTED || reply.status > RELAY_BUSY) {
+            return RELAY_NO_REPLY;
+        }
+        return (RelayStatus)reply.status;
+    }
+
+    RelayStatus deliver(const RelayFrame& frame, uint8_t& channel, RelayTransmit transmit) {
+        const uint8_t* data = (const uint8_t*)&frame;
+        size_t len = frameSize(frame.count);
+
+        if (channel != 0) {
+            for (int i = 0; i < RELAY_RETRIES; i++) {
+                RelayStatus status = transmit(channel, data, len);
+                if (status != RELAY_NO_REPLY) {
+                    return status;
+                }
+            }
+        }
+
+        // Gateway moved (its access point changed channel) or never found
+        for (uint8_t c = 1; c <= RELAY_WIFI_CHANNELS; c++) {
+            if (c == channel) {
+                continue;
+            }
+            RelayStatus status = transmit(c, data, len);
+            if (status != RELAY_NO_REPLY) {
+                channel = c;
+                return status;
+            }
+        }
+        return RELAY_NO_REPLY;
+    }
+
+    RelayStatus accept(RelayInbox& inbox, const uint8_t* data, size_t len, uint32_t receivedAt, RelayAck& reply) {
+        RelayFrame frame;
+        if (!parse(data, len, inbox.key, frame)) {
+            inbox.stats.invalid++;
+            return RELAY_NO_REPLY;
+        }
+
+        // Readings up to peer.seq arrived before (the leaf missed an ack)
+        RelayPeer& peer = findPeer(inbox, frame.deviceId);
+        uint8_t fresh = frame.count;
+        if (peer.used && peer.boot == frame.boot) {
+            int16_t ahead = (int16_t)(frame.seq - peer.seq);
+            if (ahead <= 0) {
+                inbox.stats.duplicates++;
+                return answer(inbox, reply, frame, RELAY_DUPLICATE);
+            }
+            if (ahead < fresh) {
+                fresh = (uint8_t)ahead;
+            }
+        }
+
+        // Full: the newest frame is turned away, so an upload in progress
+        // still owns the oldest ones. The leaf keeps its readings.
+        if (inbox.count >= RELAY_INBOX_FRAMES) {
+            inbox.stats.overflows++;
+            return answer(inbox, reply, frame, RELAY_BUSY);
+        }
+
+        if (fresh < frame.count) {
+            inbox.stats.resent += frame.count - fresh;
+            memmove(frame.samples, frame.samples + frame.count - fresh, fresh * sizeof(RelaySample));
+            frame.count = fresh;
+        }
+        peer.boot = frame.boot;
+        peer.seq = frame.seq;
+        peer.used = true;
+
+        RelayEntry& entry = inbox.entries[(inbox.head + inbox.count) % RELAY_INBOX_FRAMES];
+        entry.frame = frame;
+        entry.receivedAt = receivedAt;
+        inbox.count++;
+        inbox.stats.accepted++;
+        return answer(inbox, reply, frame, RELAY_ACCEPTED);
+    }
+
+    const RelayEntry& peek(const RelayInbox& inbox, size_t i) {
+        return inbox.entries[(inbox.head + i) % RELAY_INBOX_FRAMES];
+    }
+
+    void drop(RelayInbox& inbox, size_t count) {
+        if (count > inbox.count) {
+            count = inbox.count;
+        }
+        inbox.head = (inbox.head + count) % RELAY_INBOX_FRAMES;
+        inbox.count -= count;
+    }
+}
@@ -0,0 +1,216 @@
+/**
+ * ============================================================================
+ * Relay Protocol Module
+ * ============================================================================
+ * Frame format of the ESP-NOW relay (RELAY_ROLE) and the radio-independent
+ * halves of both ends: a leaf's delivery with retries and channel search,
+ * and the gateway's inbox with duplicate suppression. Plain C++ with no
+ * Arduino dependency, so scripts/relay_sim.cpp runs the same code on the
+ * host (make relay-sim).
+ *
+ * A frame carries one leaf's unsent readings, each with its age at the
+ * time of sending. The gateway stamps frames on arrival, so readings are
+ * dated on the gateway's clock without the leaf ever syncing its own.
+ *
+ * The gateway answers every frame with a RelayAck: taken, already had,
+ * or busy (inbox full). The link-layer ack only says a frame arrived, so
+ * a leaf keeps its readings until the gateway says it has them. A leaf
+ * that missed the answer sends the readings again, in a retry or with its
+ * next report. Readings are numbered per leaf, so the gateway keeps only
+ * the ones newer than what it already has. The numbering restarts with a
+ * new random boot id when the leaf loses RTC memory.
+ *
+ * Frames and answers end their header with a tag: SipHash-2-4 of the
+ * bytes sent (tag zeroed) under a key shared by the gateway and its
+ * leaves. Anything with a wrong tag is dropped, so readings cannot be
+ * injected or altered and answers cannot be faked without the key. The
+ * radio itself is unencrypted: readings can be overheard.
+ */
+
+#ifndef RELAY_PROTOCOL_H
+#define RELAY_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RELAY_MAGIC             0xA7
+#define RELAY_ACK_MAGIC         0xA8
+#define RELAY_VERSION           2
+
+// Readings per frame: a leaf's RTC backlog plus the current one
+#define RELAY_MAX_SAMPLES       8
+#define RELAY_DEVICE_ID_LEN     24      // Including the terminating NUL
+
+// Shared key and the tag made with it
+#define RELAY_KEY_LEN           16
+#define RELAY_TAG_LEN           8
+
+// WiFi channels searched for the gateway
+#define RELAY_WIFI_CHANNELS     13
+
+// Sends on the remembered channel before searching the others
+#define RELAY_RETRIES           3
+
+// Frames held by the gateway between uploads, and leaves whose last
+// sequence number it remembers
+#define RELAY_INBOX_FRAMES      16
+#define RELAY_MAX_LEAVES        16
+
+/**
+ * Gateway's answer to a frame
+ */
+enum RelayStatus {
+    RELAY_NO_REPLY,             // Nothing heard (or the frame was invalid)
+    RELAY_ACCEPTED,             // New readings queued for upload
+    RELAY_DUPLICATE,            // Nothing new; all of them arrived before
+    RELAY_BUSY                  // Inbox full; the leaf keeps its readings
+};
+
+/**
+ * One reading, in the units of RtcSample where it fits
+ */
+struct __attribute__((packed)) RelaySample {
+    uint32_t ageMs;             // Taken this long before the frame was sent
+    float volumeL;
+    int16_t levelMm;
+    int16_t temperatureCenti;   // 0.01 °C
+    uint16_t batteryMv;
+};
+
+/**
+ * Leaf to gateway frame. Only the first `count` samples are sent; they
+ * are consecutive readings, oldest first, the last one numbered seq.
+ */
+struct __attribute__((packed)) RelayFrame {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t boot;               // Leaf's boot id, for seq
+    uint8_t count;
+    uint16_t seq;               // Number of the newest reading
+    char deviceId[RELAY_DEVICE_ID_LEN];
+    uint8_t tag[RELAY_TAG_LEN];
+    RelaySample samples[RELAY_MAX_SAMPLES];
+};
+
+/**
+ * Gateway to leaf answer, for the frame with this boot and seq
+ */
+struct __attribute__((packed)) RelayAck {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t boot;
+    uint8_t status;             // RelayStatus
+    uint16_t seq;
+    uint8_t tag[RELAY_TAG_LEN];
+};
+
+/**
+ * A frame held by the gateway
+ */
+struct RelayEntry {
+    RelayFrame frame;
+    uint32_t receivedAt;        // Gateway clock (ms)
+};
+
+/**
+ * Newest reading received from a leaf. Leaves are told apart by the device
+ * id, which the tag covers, not by the radio's MAC address, which is not.
+ */
+struct RelayPeer {
+    char deviceId[RELAY_DEVICE_ID_LEN];
+    uint8_t boot;
+    uint16_t seq;
+    bool used;
+};
+
+struct RelayStats {
+    uint32_t accepted;
+    uint32_t duplicates;        // Frames with nothing new
+    uint32_t resent;            // Readings already received, dropped from frames
+    uint32_t invalid;           // Bad magic, version, length or tag
+    uint32_t overflows;         // Answered busy because the inbox was full
+};
+
+/**
+ * Gateway inbox: frames in arrival order, oldest at head
+ */
+struct RelayInbox {
+    uint8_t key[RELAY_KEY_LEN]; // Checks frames and signs answers
+    RelayEntry entries[RELAY_INBOX_FRAMES];
+    uint8_t head;
+    uint8_t count;
+    RelayPeer peers[RELAY_MAX_LEAVES];
+    uint8_t nextPeer;           // Slot reused next once all are taken
+    RelayStats stats;
+};
+
+/**
+ * Send one frame on a channel and wait for the answer
+ * @return The gateway's answer, RELAY_NO_REPLY if none came
+ */
+typedef RelayStatus (*RelayTransmit)(uint8_t channel, const uint8_t* data, size_t len);
+
+namespace RelayProtocol {
+    /**
+     * Bytes on air for a frame of count samples
+     */
+    size_t frameSize(uint8_t count);
+
+    /**
+     * Fill in a frame's header
+     * @param deviceId Leaf's device id, truncated to fit
+     * @param boot Leaf's boot id
+     * @param seq Number of the newest reading the frame will carry
+     */
+    void begin(RelayFrame& frame, const char* deviceId, uint8_t boot, uint16_t seq);
+
+    /**
+     * Leaf: tag a frame once its samples are filled in
+     */
+    void seal(RelayFrame& frame, const uint8_t* key);
+
+    /**
+     * Check a received frame and copy it out
+     * @return false if it is not a valid frame of this version and key
+     */
+    bool parse(const uint8_t* data, size_t len, const uint8_t* key, RelayFrame& frame);
+
+    /**
+     * Leaf: check a received answer
+     * @param frame The frame it should answer
+     * @return Its status, RELAY_NO_REPLY if it is not a valid answer to frame
+     */
+    RelayStatus parseAck(const uint8_t* data, size_t len, const uint8_t* key, const RelayFrame& frame);
+
+    /**
+     * Leaf: send a frame, first up to RELAY_RETRIES times on the channel
+     * the gateway was last found on, then once on each other channel.
+     * Stops at the first answer; a busy gateway is not retried.
+     * @param channel In: last known channel, 0 if none. Out: the channel
+     *                the gateway answered on, unchanged if it never did.
+     * @return The answer, RELAY_NO_REPLY if none came on any channel
+     */
+    RelayStatus deliver(const RelayFrame& frame, uint8_t& channel, RelayTransmit transmit);
+
+    /**
+     * Gateway: take the new readings of a received frame into the inbox.
+     * Nothing is added if the frame is invalid (inbox.key checks its tag),
+     * has no reading newer than the sender's last, or the inbox is full.
+     * @param receivedAt Gateway clock (ms)
+     * @param reply Filled in with the answer to send back, unless invalid
+     * @return The answer's status, RELAY_NO_REPLY for an invalid frame
+     */
+    RelayStatus accept(RelayInbox& inbox, const uint8_t* data, size_t len, uint32_t receivedAt, RelayAck& reply);
+
+    /**
+     * Gateway: the i-th oldest frame in the inbox (i < inbox.count)
+     */
+    const RelayEntry& peek(const RelayInbox& inbox, size_t i);
+
+    /**
+     * Gateway: remove the count oldest frames once uploaded
+     */
+    void drop(RelayInbox& inbox, size_t count);
+}
+
+#endif // RELAY_PROTOCOL_H
@@ -0,0 +1,117 @@
+/**
+ * Rollup Module Implementation
+ */
+
+#include "rollup.h"
+#include "config.h"
+#include "sensor.h"
+#include "logger.h"
+
+#if ROLLUP_ENABLED
+
+// Fixed-point units per unit of each quantity
+#define LEVEL_SCALE         10.0f       // mm
+#define TEMPERATURE_SCALE   100.0f      // 0.01 °C
+#define BATTERY_SCALE       1000.0f     // mV
+
+static int16_t toFixed(float value, float scale) {
+    return (int16_t)constrain(lroundf(value * scale), -32768L, 32767L);
+}
+
+static void addStat(RtcRollupStat& stat, int16_t value, bool first) {
+    if (first) {
+        stat.min = stat.max = stat.first = value;
+        stat.sum = 0;
+    }
+    stat.min = min(stat.min, value);
+    stat.max = max(stat.max, value);
+    stat.last = value;
+    stat.sum += value;
+}
+
+static float mean(const RtcRollupStat& stat, uint16_t count, float scale) {
+    return stat.sum / (float)count / scale;
+}
+
+static void writeStat(JsonObject rollup, const char* name, const RtcRollupStat& stat, float scale) {
+    JsonObject s = rollup[name].to<JsonObject>();
+    s["min"] = stat.min / scale;
+    s["max"] = stat.max / scale;
+    s["first"] = stat.first / scale;
+    s["last"] = stat.last / scale;
+}
+
+namespace Rollup {
+    bool add(const SystemState& state) {
+        if (state.waterLevelCm < 0) {
+            return false;
+        }
+        
+        RtcRollup& w = RtcStore::data().rollup;
+        int16_t level = toFixed(state.waterLevelCm, LEVEL_SCALE);
+        bool first = w.count == 0;
+        
+        // reset() leaves the last reading in place, so a jump across two
+        // windows counts too; firstAt is only 0 before the first reading
+        bool step = w.firstAt != 0 && abs(level - w.level.last) >= (int)(ROLLUP_STEP_CM * LEVEL_SCALE);
+        if (step) {
+            LOG_INFO("[Rollup] Level jumped %.1f cm, keeping the raw reading",
+                (level - w.level.last) / LEVEL_SCALE);
+        }
+        
+        if (first) {
+            w.firstAt = state.lastMeasurement;
+        }
+        addStat(w.level, level, first);
+        addStat(w.temperature, toFixed(state.temperatureC, TEMPERATURE_SCALE), first);
+        addStat(w.battery, toFixed(state.batteryVoltage, BATTERY_SCALE), first);
+        w.count++;
+        w.spanS = (uint16_t)min((state.lastMeasurement - w.firstAt) / 1000UL, 65535UL);
+        
+        return step;
+    }
+    
+    const RtcRollup* getWindow() {
+        const RtcRollup& w = RtcStore::data().rollup;
+        return w.count > 0 ? &w : nullptr;
+    }
+    
+    void reset() {
+        RtcRollup& w = RtcStore::data().rollup;
+        LOG_DEBUG("[Rollup] Window of %u readings over %u s done", w.count, w.spanS);
+        w.count = 0;
+    }
+    
+    unsigned long getMidpoint(const RtcRollup& window) {
+        return window.firstAt + window.spanS * 500UL;
+    }
+    
+    void toJson(const RtcRollup& window, JsonObject record) {
+        float levelCm = mean(window.level, window.count, LEVEL_SCALE);
+        record["level_cm"] = levelCm;
+        record["volume_l"] = Sensor::calculateVolume(levelCm);
+        record["temperature_c"] = mean(window.temperature, window.count, TEMPERATURE_SCALE);
+        record["battery_v"] = mean(window.battery, window.count, BATTERY_SCALE);
+        
+        JsonObject rollup = record["rollup"].to<JsonObject>();
+        rollup["samples"] = window.count;
+        rollup["span_s"] = window.spanS;
+        writeStat(rollup, "level_cm", window.level, LEVEL_SCALE);
+        writeStat(rollup, "temperature_c", window.temperature, TEMPERATURE_SCALE);
+        writeStat(rollup, "battery_v", window.battery, BATTERY_SCALE);
+    }
+}
+
+#else
+
+// Rollups off: no window is ever open
+namespace Rollup {
+    const RtcRollup* getWindow() {
+        return nullptr;
+    }
+    
+    void reset() {
+    }
+}
+
+#endif // ROLLUP_ENABLED
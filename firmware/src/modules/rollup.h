@@ -0,0 +1,56 @@
+/**
+ * ============================================================================
+ * Rollup Module
+ * ============================================================================
+ * Streaming aggregate of the readings between two reports (ROLLUP_ENABLED).
+ * Each reading updates a running min, max, sum, first and last of level,
+ * temperature and battery voltage, in fixed point so the window fits in
+ * RTC memory and carries across deep sleep. A report sends the window as
+ * one record and starts a new one once it is delivered; readings that
+ * jump by ROLLUP_STEP_CM are flagged so the caller can send them raw as
+ * well.
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "types.h"
+#include "rtc_store.h"
+
+namespace Rollup {
+    /**
+     * Fold a reading into the current window. Readings without a level
+     * (sensor missing) are skipped.
+     * @param state Measurement, timed by lastMeasurement
+     * @return true if the level jumped by ROLLUP_STEP_CM or more since the
+     *         previous reading
+     */
+    bool add(const SystemState& state);
+    
+    /**
+     * The current window
+     * @return nullptr if it has no readings, or rollups are disabled
+     */
+    const RtcRollup* getWindow();
+    
+    /**
+     * Start a new window, once the current one was sent or buffered
+     */
+    void reset();
+    
+    /**
+     * Time halfway through a window (same clock as lastMeasurement), which
+     * its record is stamped with
+     */
+    unsigned long getMidpoint(const RtcRollup& window);
+    
+    /**
+     * Write a window's means (level_cm, volume_l, temperature_c, battery_v)
+     * and its "rollup" statistics into an upload record
+     */
+    void toJson(const RtcRollup& window, JsonObject record);
+}
+
+#endif // ROLLUP_H
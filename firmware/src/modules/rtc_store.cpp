@@ -0,0 +1,51 @@
+/**
+ * RTC Store Module Implementation
+ */
+
+#include "rtc_store.h"
+#include <coredecls.h>
+
+// Bump when RtcData changes layout so stale contents are dropped
+#define RTC_STORE_MAGIC     0x57545209  // "WTR" + version
+
+struct RtcBlock {
+    uint32_t magic;
+    uint32_t crc;
+    RtcData data;
+};
+
+static_assert(sizeof(RtcBlock) % 4 == 0, "RTC block must be a multiple of 4 bytes");
+static_assert(sizeof(RtcBlock) <= RTC_STORE_MAX_BYTES, "RTC block exceeds RTC user memory");
+
+static RtcBlock block;
+
+namespace RtcStore {
+    bool init() {
+        ESP.rtcUserMemoryRead(RTC_STORE_OFFSET_BLOCKS, (uint32_t*)&block, sizeof(block));
+        
+        if (block.magic == RTC_STORE_MAGIC &&
+            block.crc == crc32(&block.data, sizeof(block.data))) {
+            return true;
+        }
+        
+        // Cold boot, or contents from another layout
+        memset(&block, 0, sizeof(block));
+        block.magic = RTC_STORE_MAGIC;
+        return false;
+    }
+
+    RtcData& data() {
+        return block.data;
+    }
+
+    void save() {
+        block.magic = RTC_STORE_MAGIC;
+        block.crc = crc32(&block.data, sizeof(block.data));
+        ESP.rtcUserMemoryWrite(RTC_STORE_OFFSET_BLOCKS, (uint32_t*)&block, sizeof(block));
+    }
+
+    void clear() {
+        memset(&block.data, 0, sizeof(block.data));
+        save();
+    }
+}
@@ -0,0 +1,255 @@
+/**
+ * ============================================================================
+ * RTC Store Module
+ * ============================================================================
+ * Small state block kept in RTC user memory. It survives reset and deep
+ * sleep (but not power loss) and costs no flash writes. The block is
+ * guarded by a magic number and CRC32; anything that fails the check is
+ * discarded and zeroed.
+ */
+
+#ifndef RTC_STORE_H
+#define RTC_STORE_H
+
+#include <Arduino.h>
+#include "types.h"
+#include "config.h"
+#include "alert_engine.h"
+
+// RTC user memory is addressed in 4-byte blocks. The first 128 bytes are
+// overwritten by eboot during OTA, so the store starts after them.
+#define RTC_STORE_OFFSET_BLOCKS     32
+#define RTC_STORE_MAX_BYTES         (512 - RTC_STORE_OFFSET_BLOCKS * 4)
+
+// Unsent measurements held in RTC memory before spilling to flash. With
+// rollups only the raw readings that stood out are held, and the rollup
+// takes the rest of the space.
+#if ROLLUP_ENABLED
+#define RTC_PENDING_SAMPLES         2
+#else
+#define RTC_PENDING_SAMPLES         4
+#endif
+
+/**
+ * Last good WiFi association, used to skip scan and DHCP on reconnect
+ */
+struct RtcWifiCache {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t valid;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns1;
+    uint32_t dns2;
+};
+
+// Hostnames remembered by DnsCache
+#define RTC_DNS_ENTRIES             2
+
+/**
+ * Resolved server address, kept as a fallback when DNS fails
+ */
+struct RtcDnsEntry {
+    uint32_t hostHash;          // CRC32 of the hostname
+    uint32_t ip;
+    uint32_t resolvedAt;        // PowerManager::now() at resolution
+};
+
+/**
+ * DNS cache entries and hit statistics
+ */
+struct RtcDnsCache {
+    RtcDnsEntry entries[RTC_DNS_ENTRIES];
+    uint32_t hits;
+    uint32_t lookups;           // Queries actually sent
+    uint32_t lookupMs;          // Total time spent in those queries
+    uint32_t fallbacks;         // Failed queries answered from the cache
+    uint32_t failures;          // Failed queries with nothing cached
+};
+
+/**
+ * Unsent measurement, packed to fit several in RTC memory
+ */
+struct RtcSample {
+    float waterLevelCm;
+    float volumeLiters;
+    float temperatureC;
+    uint32_t takenAt;           // PowerManager::now()
+    uint16_t batteryMv;
+    int16_t wifiRssi;
+};
+
+/**
+ * Running statistics of one quantity, in fixed point
+ */
+struct RtcRollupStat {
+    int16_t min;
+    int16_t max;
+    int16_t first;
+    int16_t last;
+    int32_t sum;
+};
+
+/**
+ * Readings folded into the current rollup window
+ */
+struct RtcRollup {
+    uint32_t firstAt;           // PowerManager::now() of the first reading
+    uint16_t count;             // Readings (0 = window empty)
+    uint16_t spanS;             // First to last reading
+    RtcRollupStat level;        // mm
+    RtcRollupStat temperature;  // 0.01 °C
+    RtcRollupStat battery;      // mV
+};
+
+/**
+ * Duty-cycle bookkeeping carried across deep sleep
+ */
+struct RtcPowerState {
+    uint32_t clockMs;           // Time elapsed across sleeps (millis() restarts on wake)
+    uint32_t cycles;            // Wake cycles since cold boot
+    uint32_t lastAwakeMs;       // Awake time of the previous cycle
+    uint32_t avgAwakeMs;        // Moving average of awake time
+    uint32_t lastMeasurement;   // SystemState timing; readings are retaken every wake
+    uint32_t lastReport;
+    uint32_t lastOtaCheck;
+    int16_t wifiRssi;           // Last RSSI, for wakes that don't connect
+    uint8_t radioOn;            // This wake started with RF enabled
+    uint8_t pendingCount;       // Valid entries in RtcData::pending
+};
+
+/**
+ * Per-condition alert engine state, so debounce and cooldown timing
+ * carry across deep sleep
+ */
+struct RtcAlertState {
+    uint32_t pendingSince;      // Condition first seen (debounce start)
+    uint32_t notifiedAt;        // Last audible/server-notified raise
+    uint32_t eventAt;           // Time of the unsent transition
+    float eventValue;           // Reading at the unsent transition
+    uint8_t active;             // Condition raised
+    uint8_t pending;            // Condition seen, waiting out the debounce
+    uint8_t notified;           // This raise was notified (clear gets an event too)
+    uint8_t event;              // Unsent AlertEventKind
+};
+
+/**
+ * Wall-clock anchor: SNTP time at a PowerManager::now() reading
+ */
+struct RtcTimeState {
+    uint32_t epoch;             // Unix seconds at clockMs (0 = never synced)
+    uint32_t clockMs;           // PowerManager::now() at that second
+    uint32_t clockId;           // Random tag of the PowerManager::now() time base
+};
+
+// Completed usage events held until the next upload
+#define RTC_USAGE_EVENTS            2
+
+/**
+ * Draw, refill or leak found by UsageTracker
+ */
+struct RtcUsageEvent {
+    uint32_t at;                // PowerManager::now() when it started
+    float amountL;              // Volume drawn, added or lost
+    uint16_t minutes;           // Duration
+    uint8_t kind;               // UsageEventKind
+    uint8_t reserved;
+};
+
+/**
+ * Usage counters for one local calendar day
+ */
+struct RtcUsageDay {
+    uint32_t date;              // YYYYMMDD (0 = clock not set yet)
+    float usedL;
+    float refilledL;
+    uint8_t refills;
+    uint8_t draws;
+    uint8_t leak;               // Leak suspected during the day
+    uint8_t sent;               // Final counters acknowledged by the server
+};
+
+/**
+ * UsageTracker state machine. days[0] is today, days[1] the day before.
+ */
+struct RtcUsageState {
+    float raw[2];               // Previous two readings (median-of-3 filter)
+    float filtered;             // Last filtered volume
+    float anchorVolume;         // Volume at the start of the episode or idle stretch
+    float idleLow;              // Lowest volume of the idle stretch so far
+    uint32_t lastAt;            // Time of the last reading
+    uint32_t anchorAt;          // Start of the episode or idle stretch
+    uint8_t phase;              // UsagePhase
+    uint8_t settle;             // Readings without flow since the episode slowed
+    uint8_t leakFlagged;        // Leak reported for this idle stretch
+    uint8_t eventCount;
+    RtcUsageEvent events[RTC_USAGE_EVENTS];
+    RtcUsageDay days[2];
+};
+
+/**
+ * Forecast fit: volume and flow at the last reading, with the covariance
+ * of the two (symmetric, upper triangle)
+ */
+struct RtcForecastState {
+    float volumeL;
+    float flowLpm;              // Negative while draining
+    float p[3];                 // var(volume), cov, var(flow)
+    uint32_t lastAt;            // Time of the last reading (0 = no fit yet)
+};
+
+/**
+ * Relay leaf state (RELAY_ROLE_LEAF)
+ */
+struct RtcRelayState {
+    uint16_t seq;               // Number of the last reading taken
+    uint8_t channel;            // WiFi channel the gateway was found on (0 = unknown)
+    uint8_t boot;               // Random per power-up (0 = not yet chosen)
+};
+
+/**
+ * Everything kept in RTC memory. Must stay a multiple of 4 bytes.
+ */
+struct RtcData {
+    uint32_t restartCount;      // Quick restarts, for the config portal trigger
+    RtcWifiCache wifi;
+    RtcDnsCache dns;
+    RtcPowerState power;
+    RtcSample pending[RTC_PENDING_SAMPLES];
+    RtcAlertState alerts[ALERT_TYPE_COUNT];
+    RtcTimeState time;
+    RtcUsageState usage;
+    RtcForecastState forecast;
+#if ROLLUP_ENABLED
+    RtcRollup rollup;
+#endif
+#if RELAY_ROLE == RELAY_ROLE_LEAF
+    RtcRelayState relay;
+#endif
+};
+
+namespace RtcStore {
+    /**
+     * Load and validate the store from RTC memory
+     * @return true if valid contents survived the reset
+     */
+    bool init();
+    
+    /**
+     * Access the in-RAM copy; call save() after changing it
+     */
+    RtcData& data();
+    
+    /**
+     * Write the in-RAM copy back to RTC memory
+     */
+    void save();
+    
+    /**
+     * Zero the store in RAM and RTC memory
+     */
+    void clear();
+}
+
+#endif // RTC_STORE_H
@@ -0,0 +1,164 @@
+/**
+ * Scheduler Module Implementation
+ */
+
+#include "scheduler.h"
+#include "profiler.h"
+#include "logger.h"
+
+struct Task {
+    TaskStats stats;
+    TaskCallback callback;
+    unsigned long intervalMs;       // 0 for one-shot tasks
+    unsigned long deadlineMs;
+    unsigned long nextDue;
+    TaskPriority priority;
+    bool armed;
+};
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+static int taskCount = 0;
+static IdleHook idleHook = nullptr;
+
+static int addTask(const char* name, TaskCallback callback, unsigned long intervalMs,
+                   TaskPriority priority, unsigned long deadlineMs, bool armed) {
+    if (taskCount >= SCHEDULER_MAX_TASKS) {
+        LOG_ERROR("[Sched] Task table full, dropping %s", name);
+        return -1;
+    }
+    
+    Task& task = tasks[taskCount];
+    memset(&task, 0, sizeof(task));
+    task.stats.name = name;
+    task.callback = callback;
+    task.intervalMs = intervalMs;
+    task.deadlineMs = deadlineMs;
+    task.priority = priority;
+    task.nextDue = millis() + intervalMs;
+    task.armed = armed;
+    
+    return taskCount++;
+}
+
+// True if a is more urgent than b (both due)
+static bool moreUrgent(const Task& a, const Task& b) {
+    if (a.priority != b.priority) {
+        return a.priority < b.priority;
+    }
+    return (long)(a.nextDue - b.nextDue) < 0;
+}
+
+namespace Scheduler {
+    int addPeriodic(const char* name, TaskCallback callback, unsigned long intervalMs,
+                    TaskPriority priority, unsigned long deadlineMs) {
+        return addTask(name, callback, intervalMs, priority,
+                       deadlineMs > 0 ? deadlineMs : intervalMs, true);
+    }
+
+    int addOneShot(const char* name, TaskCallback callback,
+                   TaskPriority priority, unsigned long deadlineMs) {
+        return addTask(name, callback, 0, priority, deadlineMs, false);
+    }
+
+    void trigger(int id, unsigned long delayMs) {
+        if (id < 0 || id >= taskCount) {
+            return;
+        }
+        tasks[id].nextDue = millis() + delayMs;
+        tasks[id].armed = true;
+    }
+
+    void setInterval(int id, unsigned long intervalMs) {
+        if (id < 0 || id >= taskCount || tasks[id].intervalMs == intervalMs || intervalMs == 0) {
+            return;
+        }
+        Task& task = tasks[id];
+        if (task.deadlineMs == task.intervalMs) {
+            task.deadlineMs = intervalMs;
+        }
+        task.intervalMs = intervalMs;
+        task.nextDue = millis() + intervalMs;
+    }
+
+    void setIdleHook(IdleHook hook) {
+        idleHook = hook;
+    }
+
+    void run() {
+        unsigned long now = millis();
+        Task* next = nullptr;
+        unsigned long idleMs = ULONG_MAX;
+        
+        for (int i = 0; i < taskCount; i++) {
+            Task& task = tasks[i];
+            if (!task.armed) {
+                continue;
+            }
+            long wait = (long)(task.nextDue - now);
+            if (wait <= 0) {
+                if (!next || moreUrgent(task, *next)) {
+                    next = &task;
+                }
+            } else if ((unsigned long)wait < idleMs) {
+                idleMs = wait;
+            }
+        }
+        
+        if (!next) {
+            if (idleHook) {
+                idleHook(idleMs);
+            } else {
+                yield();
+            }
+            return;
+        }
+        
+        // Reschedule before running so the task can re-trigger itself.
+        // An overrun periodic task skips the slots it missed.
+        unsigned long due = next->nextDue;
+        if (next->intervalMs > 0) {
+            next->nextDue = due + next->intervalMs;
+            if ((long)(next->nextDue - now) <= 0) {
+                next->nextDue = now + next->intervalMs;
+            }
+        } else {
+            next->armed = false;
+        }
+        
+        uint32_t start = micros();
+        next->callback();
+        uint32_t elapsedUs = micros() - start;
+#if PROFILING_ENABLED
+        Profiler::record(PROBE_LOOP, elapsedUs);
+#endif
+        
+        TaskStats& stats = next->stats;
+        stats.runs++;
+        stats.totalUs += elapsedUs;
+        if (elapsedUs > stats.worstUs) {
+            stats.worstUs = elapsedUs;
+        }
+        if (next->deadlineMs > 0 && millis() - due > next->deadlineMs) {
+            stats.deadlineMisses++;
+        }
+    }
+
+    int getTaskCount() {
+        return taskCount;
+    }
+
+    const TaskStats& getStats(int id) {
+        return tasks[id].stats;
+    }
+
+    void printStats() {
+        LOG_INFO("[Sched] task          runs   worst_us     avg_us  misses");
+        for (int i = 0; i < taskCount; i++) {
+            const TaskStats& stats = tasks[i].stats;
+            LOG_INFO("[Sched] %-12s %6u %10u %10u %7u",
+                stats.name, stats.runs, stats.worstUs,
+                stats.runs > 0 ? (uint32_t)(stats.totalUs / stats.runs) : 0,
+                stats.deadlineMisses);
+        }
+    }
+}
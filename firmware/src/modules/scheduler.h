@@ -0,0 +1,102 @@
+/**
+ * ============================================================================
+ * Scheduler Module
+ * ============================================================================
+ * Small cooperative scheduler driving loop(). Tasks are periodic or
+ * one-shot (armed with trigger()); each run() call executes the most
+ * urgent due task, or hands the time until the next one to an idle hook.
+ *
+ * Every task records run count, worst-case and total runtime, and
+ * deadline misses (finishing later than deadlineMs after it was due).
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS     12
+
+/**
+ * Among due tasks, lower value runs first
+ */
+enum TaskPriority {
+    TASK_PRIORITY_HIGH = 0,
+    TASK_PRIORITY_NORMAL = 1,
+    TASK_PRIORITY_LOW = 2
+};
+
+typedef void (*TaskCallback)();
+
+/**
+ * Called when nothing is due
+ * @param idleMs Time until the next task is due
+ */
+typedef void (*IdleHook)(unsigned long idleMs);
+
+/**
+ * Per-task timing statistics
+ */
+struct TaskStats {
+    const char* name;
+    uint32_t runs;
+    uint32_t worstUs;
+    uint64_t totalUs;
+    uint32_t deadlineMisses;
+};
+
+namespace Scheduler {
+    /**
+     * Add a task that runs every intervalMs (first run one interval from now)
+     * @param deadlineMs Allowed lateness + runtime; 0 means one interval
+     * @return Task id, or -1 if the table is full
+     */
+    int addPeriodic(const char* name, TaskCallback callback, unsigned long intervalMs,
+                    TaskPriority priority = TASK_PRIORITY_NORMAL, unsigned long deadlineMs = 0);
+    
+    /**
+     * Add a task that only runs when triggered
+     * @param deadlineMs Allowed lateness + runtime; 0 means none
+     * @return Task id, or -1 if the table is full
+     */
+    int addOneShot(const char* name, TaskCallback callback,
+                   TaskPriority priority = TASK_PRIORITY_NORMAL, unsigned long deadlineMs = 0);
+    
+    /**
+     * Make a task due after delayMs. A periodic task keeps its interval
+     * from then on.
+     */
+    void trigger(int id, unsigned long delayMs = 0);
+    
+    /**
+     * Change a periodic task's interval (no-op if unchanged)
+     */
+    void setInterval(int id, unsigned long intervalMs);
+    
+    /**
+     * Set the hook called when no task is due
+     */
+    void setIdleHook(IdleHook hook);
+    
+    /**
+     * Run the most urgent due task, or the idle hook. Call from loop().
+     */
+    void run();
+    
+    /**
+     * Number of registered tasks
+     */
+    int getTaskCount();
+    
+    /**
+     * Statistics for a task
+     */
+    const TaskStats& getStats(int id);
+    
+    /**
+     * Print the per-task statistics table
+     */
+    void printStats();
+}
+
+#endif // SCHEDULER_H
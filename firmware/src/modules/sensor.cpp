@@ -4,12 +4,19 @@
 
 #include "sensor.h"
 #include "config.h"
+#include "profiler.h"
 #include <NewPing.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
 
-// Ultrasonic sensor
-static NewPing* sonar = nullptr;
+// Ultrasonic sensors, one per channel
+static NewPing* sonar[SENSOR_CHANNELS] = {};
+static float lastLevels[SENSOR_CHANNELS];
+static bool haveLevels = false;
+
+// End of the last ping, per channel and on any channel
+static unsigned long channelPingAt[SENSOR_CHANNELS] = {};
+static unsigned long lastPingAt = 0;
 
 // Temperature sensor
 static OneWire* oneWire = nullptr;
@@ -19,6 +26,10 @@ static DallasTemperature* tempSensor = nullptr;
 #define NUM_SAMPLES         5
 #define SAMPLE_DELAY_MS     50
 
+// Quiet time between pings of different channels, for the previous echo
+// to die down
+#define PING_GAP_MS         30
+
 // Max distance for ultrasonic (cm)
 #define MAX_DISTANCE_CM     400
 
@@ -27,12 +38,53 @@ static DallasTemperature* tempSensor = nullptr;
 // If using direct: ratio = 1.0 (ESP8266 ADC max is 1V!)
 #define BATTERY_DIVIDER_RATIO   2.0
 
+static void waitSince(unsigned long since, unsigned long gapMs) {
+    unsigned long elapsed = millis() - since;
+    if (elapsed < gapMs) {
+        delay(gapMs - elapsed);
+    }
+}
+
+// One ping, once the sensor last used has gone quiet and this one has
+// rested SAMPLE_DELAY_MS
+static float ping(uint8_t channel) {
+    waitSince(lastPingAt, PING_GAP_MS);
+    waitSince(channelPingAt[channel], SAMPLE_DELAY_MS);
+    
+    unsigned int uS = sonar[channel]->ping();
+    lastPingAt = channelPingAt[channel] = millis();
+    
+    // If reading is 0, sensor didn't get echo
+    float cm = sonar[channel]->convert_cm(uS);
+    return cm == 0 ? MAX_DISTANCE_CM : cm;
+}
+
+static float median(float* readings) {
+    // Simple bubble sort for median
+    for (int i = 0; i < NUM_SAMPLES - 1; i++) {
+        for (int j = i + 1; j < NUM_SAMPLES; j++) {
+            if (readings[j] < readings[i]) {
+                float temp = readings[i];
+                readings[i] = readings[j];
+                readings[j] = temp;
+            }
+        }
+    }
+    return readings[NUM_SAMPLES / 2];
+}
+
 namespace Sensor {
     void init() {
         Serial.println(F("[Sensor] Initializing..."));
         
-        // Initialize ultrasonic sensor
-        sonar = new NewPing(PIN_ULTRASONIC_TRIG, PIN_ULTRASONIC_ECHO, MAX_DISTANCE_CM);
+        // Initialize ultrasonic sensors
+        static const uint8_t trigPins[] = SENSOR_TRIG_PINS;
+        static const uint8_t echoPins[] = SENSOR_ECHO_PINS;
+        static_assert(sizeof(trigPins) >= SENSOR_CHANNELS && sizeof(echoPins) >= SENSOR_CHANNELS,
+            "SENSOR_TRIG_PINS and SENSOR_ECHO_PINS need a pin per channel");
+        for (int i = 0; i < SENSOR_CHANNELS; i++) {
+            sonar[i] = new NewPing(trigPins[i], echoPins[i], MAX_DISTANCE_CM);
+        }
         
         // Initialize temperature sensor
         oneWire = new OneWire(PIN_TEMPERATURE);
@@ -45,59 +97,65 @@ namespace Sensor {
         Serial.println(F("[Sensor] Initialized"));
     }
 
-    float readWaterLevel() {
-        if (!sonar) return -1;
+    float readWaterLevel(uint8_t channel) {
+        if (channel >= SENSOR_CHANNELS || !sonar[channel]) return -1;
+        
+        PROFILE_SCOPE(PROBE_SENSOR_READ);
         
         // Take multiple readings and use median
         float readings[NUM_SAMPLES];
-        
         for (int i = 0; i < NUM_SAMPLES; i++) {
-            unsigned int uS = sonar->ping();
-            readings[i] = sonar->convert_cm(uS);
-            
-            // If reading is 0, sensor didn't get echo
-            if (readings[i] == 0) {
-                readings[i] = MAX_DISTANCE_CM;
+            readings[i] = ping(channel);
+        }
+        return median(readings);
+    }
+
+    void readWaterLevels(float* levelsCm) {
+        if (!sonar[0]) {
+            for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+                levelsCm[ch] = -1;
             }
-            
-            delay(SAMPLE_DELAY_MS);
+            return;
         }
         
-        // Simple bubble sort for median
-        for (int i = 0; i < NUM_SAMPLES - 1; i++) {
-            for (int j = i + 1; j < NUM_SAMPLES; j++) {
-                if (readings[j] < readings[i]) {
-                    float temp = readings[i];
-                    readings[i] = readings[j];
-                    readings[j] = temp;
-                }
+        PROFILE_SCOPE(PROBE_SENSOR_READ);
+        
+        // One ping per channel per round: every channel's readings are
+        // spread over the whole read, and a channel rests while the others
+        // ping instead of in a delay
+        float readings[SENSOR_CHANNELS][NUM_SAMPLES];
+        for (int i = 0; i < NUM_SAMPLES; i++) {
+            for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+                readings[ch][i] = ping(ch);
             }
         }
         
-        // Return median
-        return readings[NUM_SAMPLES / 2];
+        for (int ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            levelsCm[ch] = lastLevels[ch] = median(readings[ch]);
+        }
+        haveLevels = true;
+    }
+
+    const float* getLastLevels() {
+        return haveLevels ? lastLevels : nullptr;
     }
 
-    float calculateVolume(float levelCm) {
+    float calculateVolume(float levelCm, uint8_t channel) {
+        const ChannelConfig& tank = Config::channels[channel];
+        
         // Calculate water height from distance reading
         // levelCm is distance from sensor to water surface
         // waterHeight = emptyDistance - levelCm
         
-        float waterHeightCm = Config::levelEmptyCm - levelCm;
+        float waterHeightCm = tank.levelEmptyCm - levelCm;
         
         // Clamp to valid range
         if (waterHeightCm < 0) waterHeightCm = 0;
-        float maxHeight = Config::levelEmptyCm - Config::levelFullCm;
+        float maxHeight = tank.levelEmptyCm - tank.levelFullCm;
         if (waterHeightCm > maxHeight) waterHeightCm = maxHeight;
         
-        #ifdef TANK_IS_CYLINDRICAL
-            // Cylindrical tank: V = π * r² * h
-            float radiusCm = TANK_DIAMETER_CM / 2.0;
-            float volumeCm3 = PI * radiusCm * radiusCm * waterHeightCm;
-        #else
-            // Rectangular tank: V = L * W * H
-            float volumeCm3 = TANK_LENGTH_CM * TANK_WIDTH_CM * waterHeightCm;
-        #endif
+        // Cylinder or box: V = cross-section * h
+        float volumeCm3 = tank.areaCm2 * waterHeightCm;
         
         // Convert cm³ to liters (1000 cm³ = 1 L)
         return volumeCm3 / 1000.0;
@@ -131,9 +189,9 @@ namespace Sensor {
         return voltage;
     }
 
-    float getPercentage(float levelCm) {
-        float emptyDist = Config::levelEmptyCm;
-        float fullDist = Config::levelFullCm;
+    float getPercentage(float levelCm, uint8_t channel) {
+        float emptyDist = Config::channels[channel].levelEmptyCm;
+        float fullDist = Config::channels[channel].levelFullCm;
         
         // Clamp level to valid range
         if (levelCm >= emptyDist) return 0;
@@ -145,8 +203,10 @@ namespace Sensor {
         return percentage;
     }
 
-    void calibrate() {
-        Serial.println(F("[Sensor] Calibration mode"));
+    void calibrate(uint8_t channel) {
+        if (channel >= SENSOR_CHANNELS) return;
+        
+        Serial.printf("[Sensor] Calibration mode (channel %u)\n", channel);
         Serial.println(F("  1. Empty the tank completely"));
         Serial.println(F("  2. Press any key when ready..."));
         
@@ -155,7 +215,7 @@ namespace Sensor {
         }
         Serial.read();
         
-        float emptyReading = readWaterLevel();
+        float emptyReading = readWaterLevel(channel);
         Serial.printf("  Empty level: %.1f cm\n", emptyReading);
         
         Serial.println(F("  3. Fill the tank to maximum level"));
@@ -166,12 +226,12 @@ namespace Sensor {
         }
         Serial.read();
         
-        float fullReading = readWaterLevel();
+        float fullReading = readWaterLevel(channel);
         Serial.printf("  Full level: %.1f cm\n", fullReading);
         
         // Update config
-        Config::levelEmptyCm = emptyReading;
-        Config::levelFullCm = fullReading;
+        Config::channels[channel].levelEmptyCm = emptyReading;
+        Config::channels[channel].levelFullCm = fullReading;
         Config::save();
         
         Serial.println(F("[Sensor] Calibration saved!"));
@@ -2,7 +2,9 @@
  * ============================================================================
  * Sensor Module
  * ============================================================================
- * Handles all sensor readings: ultrasonic, temperature, battery
+ * Handles all sensor readings: ultrasonic, temperature, battery.
+ * Level sensing has SENSOR_CHANNELS channels, one ultrasonic sensor and
+ * tank each, with their own geometry and calibration (Config::channels).
  */
 
 #ifndef SENSOR_H
@@ -18,16 +20,31 @@ namespace Sensor {
     
     /**
      * Read water level using ultrasonic sensor
+     * @param channel Sensor channel
      * @return Distance from sensor to water surface in cm
      */
-    float readWaterLevel();
+    float readWaterLevel(uint8_t channel = 0);
+    
+    /**
+     * Read every channel's water level. Pings go round-robin, one sensor
+     * at a time, so no sensor picks up another's echo.
+     * @param levelsCm SENSOR_CHANNELS distances in cm, channel 0 first
+     */
+    void readWaterLevels(float* levelsCm);
+    
+    /**
+     * Levels from the last readWaterLevels() since boot
+     * @return nullptr if there was none
+     */
+    const float* getLastLevels();
     
     /**
      * Calculate water volume from level
      * @param levelCm Distance reading in cm
+     * @param channel Sensor channel the reading is from
      * @return Volume in liters
      */
-    float calculateVolume(float levelCm);
+    float calculateVolume(float levelCm, uint8_t channel = 0);
     
     /**
      * Read temperature
@@ -44,14 +61,16 @@ namespace Sensor {
     /**
      * Get percentage of tank filled
      * @param levelCm Distance reading
+     * @param channel Sensor channel the reading is from
      * @return Percentage 0-100
      */
-    float getPercentage(float levelCm);
+    float getPercentage(float levelCm, uint8_t channel = 0);
     
     /**
      * Perform sensor calibration (reads empty and full points)
+     * @param channel Sensor channel to calibrate
      */
-    void calibrate();
+    void calibrate(uint8_t channel = 0);
 }
 
 #endif // SENSOR_H
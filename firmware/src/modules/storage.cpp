@@ -3,10 +3,13 @@
  */
 
 #include "storage.h"
+#include "payload.h"
 #include "config.h"
+#include "profiler.h"
+#include "heap_monitor.h"
+#include "logger.h"
 #include "data_reporter.h"
 #include <LittleFS.h>
-#include <ArduinoJson.h>
 
 #define BUFFER_DIR      "/buffer"
 #define MAX_BUFFER_FILES 100
@@ -14,15 +17,50 @@
 // Counter for buffer files
 static int bufferCounter = 0;
 
+// Number of the next buffer file. Carried on from the highest one found at
+// mount, so names stay unique across deep-sleep wakes and resets, where
+// millis() starts over.
+static uint32_t nextRecord = 1;
+
+// Save one upload record, dropping the oldest when the buffer is full
+static void writeRecord(const String& json) {
+    if (bufferCounter >= MAX_BUFFER_FILES) {
+        LOG_WARN("[Storage] Buffer full, dropping oldest");
+        // Delete oldest file
+        Dir dir = LittleFS.openDir(BUFFER_DIR);
+        if (dir.next()) {
+            String oldestPath = String(BUFFER_DIR) + "/" + dir.fileName();
+            LittleFS.remove(oldestPath);
+            bufferCounter--;
+        }
+    }
+    
+    // Save to file; zero-padded so that name order is write order and the
+    // oldest file comes first in the directory
+    char name[32];
+    snprintf(name, sizeof(name), BUFFER_DIR "/%010lu.json", (unsigned long)nextRecord++);
+    String filename = name;
+    
+    File file = LittleFS.open(filename, "w");
+    if (file) {
+        file.print(json);
+        file.close();
+        bufferCounter++;
+        LOG_INFO("[Storage] Buffered measurement (%d total)", bufferCounter);
+    } else {
+        LOG_ERROR("[Storage] Failed to buffer measurement");
+    }
+}
+
 namespace Storage {
     void init() {
-        Serial.println(F("[Storage] Initializing LittleFS..."));
+        LOG_INFO("[Storage] Initializing LittleFS...");
         
         if (!LittleFS.begin()) {
-            Serial.println(F("[Storage] Mount failed, formatting..."));
+            LOG_WARN("[Storage] Mount failed, formatting...");
             LittleFS.format();
             if (!LittleFS.begin()) {
-                Serial.println(F("[Storage] Format failed!"));
+                LOG_ERROR("[Storage] Format failed!");
                 return;
             }
         }
@@ -36,68 +74,52 @@ namespace Storage {
         Dir dir = LittleFS.openDir(BUFFER_DIR);
         while (dir.next()) {
             bufferCounter++;
+            uint32_t number = strtoul(dir.fileName().c_str(), nullptr, 10);
+            if (number >= nextRecord) {
+                nextRecord = number + 1;
+            }
         }
         
         size_t total, used;
         getInfo(&total, &used);
-        Serial.printf("[Storage] Ready: %d/%d bytes used, %d buffered measurements\n",
+        LOG_INFO("[Storage] Ready: %d/%d bytes used, %d buffered measurements",
             used, total, bufferCounter);
+        
+        Log::attachFile();
     }
 
     void format() {
-        Serial.println(F("[Storage] Formatting..."));
+        LOG_INFO("[Storage] Formatting...");
         LittleFS.format();
         bufferCounter = 0;
-        Serial.println(F("[Storage] Format complete"));
+        nextRecord = 1;
+        LOG_INFO("[Storage] Format complete");
     }
 
     void bufferMeasurement(const SystemState& state) {
-        if (bufferCounter >= MAX_BUFFER_FILES) {
-            Serial.println(F("[Storage] Buffer full, dropping oldest"));
-            // Delete oldest file
-            Dir dir = LittleFS.openDir(BUFFER_DIR);
-            if (dir.next()) {
-                String oldestPath = String(BUFFER_DIR) + "/" + dir.fileName();
-                LittleFS.remove(oldestPath);
-                bufferCounter--;
-            }
-        }
-        
-        // Create JSON for this measurement
-        JsonDocument doc;
-        doc["device_id"] = Config::deviceId;
-        doc["firmware_version"] = FIRMWARE_VERSION;
-        doc["timestamp"] = millis();
-        doc["level_cm"] = state.waterLevelCm;
-        doc["volume_l"] = state.volumeLiters;
-        doc["temperature_c"] = state.temperatureC;
-        doc["battery_v"] = state.batteryVoltage;
-        doc["rssi"] = state.wifiRssi;
-        doc["buffered"] = true;
+        PROFILE_SCOPE(PROBE_STORAGE_WRITE);
+        HEAP_SITE("storage", HEAP_BUDGET_STORAGE_BYTES);
         
-        String json;
-        serializeJson(doc, json);
-        
-        // Save to file
-        String filename = String(BUFFER_DIR) + "/" + String(millis()) + ".json";
+        writeRecord(Payload::bufferedMeasurement(state));
+    }
+
+#if ROLLUP_ENABLED
+    void bufferRollup(const RtcRollup& window) {
+        PROFILE_SCOPE(PROBE_STORAGE_WRITE);
+        HEAP_SITE("storage", HEAP_BUDGET_STORAGE_BYTES);
         
-        File file = LittleFS.open(filename, "w");
-        if (file) {
-            file.print(json);
-            file.close();
-            bufferCounter++;
-            Serial.printf("[Storage] Buffered measurement (%d total)\n", bufferCounter);
-        } else {
-            Serial.println(F("[Storage] Failed to buffer measurement"));
-        }
+        writeRecord(Payload::bufferedRollup(window));
     }
+#endif
 
     int flushBuffer() {
         if (bufferCounter == 0) {
             return 0;
         }
         
-        Serial.printf("[Storage] Flushing %d buffered measurements...\n", bufferCounter);
+        HEAP_SITE("flush", HEAP_BUDGET_UPLOAD_BYTES);
+        
+        LOG_INFO("[Storage] Flushing %d buffered measurements...", bufferCounter);
         
         int sent = 0;
         Dir dir = LittleFS.openDir(BUFFER_DIR);
@@ -109,6 +131,7 @@ namespace Storage {
             if (file) {
                 String json = file.readString();
                 file.close();
+                Payload::dateRecord(json);
                 
                 if (DataReporter::sendBuffered(json.c_str())) {
                     LittleFS.remove(path);
@@ -116,7 +139,7 @@ namespace Storage {
                     bufferCounter--;
                 } else {
                     // Stop on first failure, try again later
-                    Serial.println(F("[Storage] Send failed, will retry later"));
+                    LOG_WARN("[Storage] Send failed, will retry later");
                     break;
                 }
             }
@@ -125,7 +148,7 @@ namespace Storage {
             delay(100);
         }
         
-        Serial.printf("[Storage] Sent %d buffered measurements\n", sent);
+        LOG_INFO("[Storage] Sent %d buffered measurements", sent);
         return sent;
     }
 
@@ -140,10 +163,12 @@ namespace Storage {
             LittleFS.remove(path);
         }
         bufferCounter = 0;
-        Serial.println(F("[Storage] Buffer cleared"));
+        LOG_INFO("[Storage] Buffer cleared");
     }
 
     bool writeFile(const char* path, const char* data) {
+        PROFILE_SCOPE(PROBE_STORAGE_WRITE);
+        
         File file = LittleFS.open(path, "w");
         if (!file) {
             return false;
@@ -10,6 +10,7 @@
 
 #include <Arduino.h>
 #include "types.h"
+#include "rtc_store.h"
 
 namespace Storage {
     /**
@@ -28,6 +29,12 @@ namespace Storage {
      */
     void bufferMeasurement(const SystemState& state);
     
+    /**
+     * Buffer a closed rollup window for later upload (ROLLUP_ENABLED)
+     * @param window Window from Rollup::close()
+     */
+    void bufferRollup(const RtcRollup& window);
+    
     /**
      * Flush buffered measurements to server
      * @return Number of measurements sent
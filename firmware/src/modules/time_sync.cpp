@@ -0,0 +1,136 @@
+/**
+ * Time Sync Module Implementation
+ */
+
+#include "time_sync.h"
+#include "config.h"
+#include "rtc_store.h"
+#include "power_manager.h"
+#include "logger.h"
+#include <coredecls.h>
+#include <sys/time.h>
+
+// Anything earlier is the SDK's unset clock counting up from 1970
+#define TIME_MIN_VALID_EPOCH    1577836800UL    // 2020-01-01
+
+static bool sntpStarted = false;
+static bool synced = false;             // SNTP answered since boot
+static uint32_t cachedMinute = 0;       // epoch / 60 that cachedTm holds
+static struct tm cachedTm;
+
+// Called by the core whenever the system time is set. SNTP updates move
+// the anchor; our own settimeofday() in init() is ignored.
+static void onTimeSet(bool fromSntp) {
+    if (!fromSntp) {
+        return;
+    }
+    
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if ((uint32_t)tv.tv_sec < TIME_MIN_VALID_EPOCH) {
+        return;
+    }
+    
+    // Anchor on the whole second, so later lookups need no rounding
+    RtcTimeState& t = RtcStore::data().time;
+    unsigned long clockMs = PowerManager::now() - tv.tv_usec / 1000;
+    
+    if (t.epoch != 0) {
+        // How far the old anchor had drifted (deep-sleep timing is rough)
+        int32_t predictedS = (int32_t)(clockMs - t.clockMs) / 1000;
+        LOG_INFO("[Time] Re-synced, drift %ld s", (long)(predictedS - (int32_t)(tv.tv_sec - t.epoch)));
+    } else {
+        LOG_INFO("[Time] Synced, epoch %lu", (unsigned long)tv.tv_sec);
+    }
+    
+    t.epoch = tv.tv_sec;
+    t.clockMs = clockMs;
+    cachedMinute = 0;
+    synced = true;
+}
+
+namespace TimeSync {
+    void init() {
+        RtcTimeState& t = RtcStore::data().time;
+        
+        // Zeroed by PowerManager when the clock starts over
+        if (t.clockId == 0) {
+            t.clockId = RANDOM_REG32 | 1;
+        }
+        
+        settimeofday_cb(onTimeSet);
+        
+        if (t.epoch != 0) {
+            // Deep-sleep wake: the system clock restarted at 1970, the
+            // anchor did not
+            unsigned long elapsedMs = PowerManager::now() - t.clockMs;
+            struct timeval tv;
+            tv.tv_sec = t.epoch + elapsedMs / 1000;
+            tv.tv_usec = (elapsedMs % 1000) * 1000;
+            settimeofday(&tv, nullptr);
+        }
+        
+        if (syncDue()) {
+            // Runs in the background once WiFi is up, and re-syncs hourly
+            // for as long as the device stays awake
+            configTime(TIME_ZONE, NTP_SERVER_1, NTP_SERVER_2);
+            sntpStarted = true;
+        } else {
+            configTZ(TIME_ZONE);
+        }
+    }
+    
+    bool isValid() {
+        return RtcStore::data().time.epoch != 0;
+    }
+    
+    bool syncDue() {
+        const RtcTimeState& t = RtcStore::data().time;
+        return t.epoch == 0 || PowerManager::now() - t.clockMs >= TIME_RESYNC_MS;
+    }
+    
+    bool waitForSync(unsigned long timeoutMs) {
+        unsigned long start = millis();
+        while (sntpStarted && !synced && millis() - start < timeoutMs) {
+            delay(10);
+        }
+        return isValid();
+    }
+    
+    uint32_t epoch() {
+        return epochAt(PowerManager::now());
+    }
+    
+    uint32_t epochAt(unsigned long clockMs) {
+        const RtcTimeState& t = RtcStore::data().time;
+        if (t.epoch == 0) {
+            return 0;
+        }
+        
+        // Readings taken before the sync are behind the anchor; round down
+        int32_t deltaMs = (int32_t)(clockMs - t.clockMs);
+        int32_t deltaS = deltaMs >= 0 ? deltaMs / 1000 : -((999 - deltaMs) / 1000);
+        return t.epoch + deltaS;
+    }
+    
+    const struct tm* localTime() {
+        uint32_t now = epoch();
+        if (now == 0) {
+            return nullptr;
+        }
+        
+        // Timezone rules are only applied when the minute changes
+        uint32_t minute = now / 60;
+        if (minute != cachedMinute) {
+            time_t start = (time_t)minute * 60;
+            localtime_r(&start, &cachedTm);
+            cachedMinute = minute;
+        }
+        cachedTm.tm_sec = now % 60;
+        return &cachedTm;
+    }
+    
+    uint32_t getClockId() {
+        return RtcStore::data().time.clockId;
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * ============================================================================
+ * Time Sync Module
+ * ============================================================================
+ * Wall clock for quiet hours and measurement timestamps. SNTP sets the
+ * clock; the result is kept in RTC memory as an anchor (epoch second at a
+ * PowerManager::now() reading), so the time carries across deep sleep
+ * without a network round trip and is re-synced every TIME_RESYNC_MS.
+ * Lookups are computed from the anchor and cached, with no syscalls or
+ * timezone conversion on the hot path.
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include <time.h>
+
+namespace TimeSync {
+    /**
+     * Set the timezone, restore the clock from RTC memory and start SNTP
+     * if a sync is due. Call after PowerManager::init().
+     */
+    void init();
+    
+    /**
+     * Check if the wall clock is known (synced since the last cold boot)
+     */
+    bool isValid();
+    
+    /**
+     * Check if the clock was never synced or the last sync is stale
+     */
+    bool syncDue();
+    
+    /**
+     * Wait for a pending SNTP sync, for wakes that sleep right after
+     * @param timeoutMs Longest to wait
+     * @return true if the clock is valid
+     */
+    bool waitForSync(unsigned long timeoutMs);
+    
+    /**
+     * Current Unix time in seconds, or 0 if not known
+     */
+    uint32_t epoch();
+    
+    /**
+     * Unix time of an earlier PowerManager::now() reading, or 0 if not known
+     */
+    uint32_t epochAt(unsigned long clockMs);
+    
+    /**
+     * Local time of day (TIME_ZONE), recomputed once a minute
+     * @return nullptr if the clock is not known
+     */
+    const struct tm* localTime();
+    
+    /**
+     * Identifies the PowerManager::now() time base; changes whenever that
+     * clock starts over (cold boot or reset)
+     */
+    uint32_t getClockId();
+}
+
+#endif // TIME_SYNC_H
@@ -9,13 +9,15 @@
 #define TYPES_H
 
 #include <Arduino.h>
+#include "config.h"
 
 /**
  * System state containing all sensor readings and status
  */
 struct SystemState {
-    float waterLevelCm;
+    float waterLevelCm;         // Channel 0, the primary tank
     float volumeLiters;
+    float channelLevelCm[SENSOR_CHANNELS];
     float temperatureC;
     float batteryVoltage;
     int wifiRssi;
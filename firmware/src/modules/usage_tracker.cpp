@@ -0,0 +1,231 @@
+/**
+ * Usage Tracker Module Implementation
+ */
+
+#include "usage_tracker.h"
+#include "config.h"
+#include "time_sync.h"
+#include "logger.h"
+
+enum UsagePhase {
+    USAGE_PHASE_START,          // No reading yet
+    USAGE_PHASE_IDLE,
+    USAGE_PHASE_DRAW,
+    USAGE_PHASE_REFILL
+};
+
+static const char* const eventNames[] = { "draw", "refill", "leak" };
+
+static float median3(float a, float b, float c) {
+    return max(min(a, b), min(max(a, b), c));
+}
+
+// Local calendar day as YYYYMMDD, or 0 before the clock has synced
+static uint32_t today() {
+    const struct tm* t = TimeSync::localTime();
+    if (t == nullptr) {
+        return 0;
+    }
+    return (t->tm_year + 1900) * 10000UL + (t->tm_mon + 1) * 100UL + t->tm_mday;
+}
+
+static void queueEvent(RtcUsageState& u, UsageEventKind kind, unsigned long from, unsigned long to, float amountL) {
+    if (u.eventCount >= RTC_USAGE_EVENTS) {
+        // Uploads keep failing: the daily counters still have it
+        memmove(u.events, u.events + 1, (RTC_USAGE_EVENTS - 1) * sizeof(RtcUsageEvent));
+        u.eventCount--;
+    }
+    
+    RtcUsageEvent& e = u.events[u.eventCount++];
+    e.at = from;
+    e.amountL = amountL;
+    e.minutes = (uint16_t)min((to - from) / 60000UL, 65535UL);
+    e.kind = kind;
+    e.reserved = 0;
+}
+
+// Start a new day's counters at local midnight. The first day's readings
+// before the clock synced are counted towards it.
+static void rollDay(RtcUsageState& u) {
+    uint32_t date = today();
+    if (date == 0 || date == u.days[0].date) {
+        return;
+    }
+    
+    if (u.days[0].date == 0) {
+        u.days[0].date = date;
+        return;
+    }
+    
+    u.days[1] = u.days[0];
+    memset(&u.days[0], 0, sizeof(u.days[0]));
+    u.days[0].date = date;
+}
+
+// Idle decline counts as usage as it happens, through a low-water mark, so
+// noise is counted at most once per stretch
+static void trackIdle(RtcUsageState& u, float volumeL) {
+    if (volumeL < u.idleLow) {
+        u.days[0].usedL += u.idleLow - volumeL;
+        u.idleLow = volumeL;
+    }
+}
+
+static void startIdle(RtcUsageState& u, float volumeL, unsigned long at) {
+    u.phase = USAGE_PHASE_IDLE;
+    u.anchorVolume = volumeL;
+    u.anchorAt = at;
+    u.idleLow = volumeL;
+    u.leakFlagged = 0;
+}
+
+static void checkLeak(RtcUsageState& u, float volumeL, unsigned long now) {
+    unsigned long elapsedMs = now - u.anchorAt;
+    if (u.leakFlagged || elapsedMs < USAGE_LEAK_WINDOW_MS) {
+        return;
+    }
+    
+    float lostL = u.anchorVolume - volumeL;
+    float rateLph = lostL * 3600000.0f / elapsedMs;
+    if (rateLph < USAGE_LEAK_RATE_LPH) {
+        return;
+    }
+    
+    LOG_WARN("[Usage] Possible leak: %.1f L lost in %lu min with no draw", lostL, elapsedMs / 60000);
+    u.leakFlagged = 1;
+    u.days[0].leak = 1;
+    queueEvent(u, USAGE_EVENT_LEAK, u.anchorAt, now, lostL);
+}
+
+// Flow started between the previous reading and this one
+static void startEpisode(RtcUsageState& u, UsagePhase phase) {
+    u.phase = phase;
+    u.anchorVolume = u.filtered;
+    u.anchorAt = u.lastAt;
+    u.settle = 0;
+}
+
+static void endEpisode(RtcUsageState& u, float volumeL, unsigned long at) {
+    RtcUsageDay& day = u.days[0];
+    bool draw = u.phase == USAGE_PHASE_DRAW;
+    float amountL = draw ? u.anchorVolume - volumeL : volumeL - u.anchorVolume;
+    
+    if (draw && amountL > 0) {
+        day.usedL += amountL;
+    }
+    
+    // Smaller ones are noise (refills) or counted as usage only (draws)
+    if (amountL >= USAGE_MIN_EVENT_L) {
+        if (draw) {
+            day.draws++;
+        } else {
+            day.refills++;
+            day.refilledL += amountL;
+        }
+        queueEvent(u, draw ? USAGE_EVENT_DRAW : USAGE_EVENT_REFILL, u.anchorAt, at, amountL);
+        LOG_INFO("[Usage] %s of %.1f L over %lu min", eventNames[draw ? USAGE_EVENT_DRAW : USAGE_EVENT_REFILL],
+            amountL, (at - u.anchorAt) / 60000);
+    }
+    
+    startIdle(u, volumeL, at);
+}
+
+namespace UsageTracker {
+    void update(float volumeL, unsigned long now) {
+        RtcUsageState& u = RtcStore::data().usage;
+        
+        rollDay(u);
+        
+        if (u.phase == USAGE_PHASE_START) {
+            u.raw[0] = u.raw[1] = u.filtered = volumeL;
+            u.lastAt = now;
+            startIdle(u, volumeL, now);
+            return;
+        }
+        
+        float filtered = median3(u.raw[0], u.raw[1], volumeL);
+        u.raw[0] = u.raw[1];
+        u.raw[1] = volumeL;
+        
+        if (now == u.lastAt) {
+            return;
+        }
+        
+        unsigned long intervalMs = now - u.lastAt;
+        float delta = filtered - u.filtered;
+        float rateLpm = delta * 60000.0f / intervalMs;
+        bool rising = rateLpm >= USAGE_FLOW_LPM && delta >= USAGE_NOISE_L;
+        bool falling = rateLpm <= -USAGE_FLOW_LPM && -delta >= USAGE_NOISE_L;
+        
+        if (u.phase == USAGE_PHASE_DRAW || u.phase == USAGE_PHASE_REFILL) {
+            bool flowing = u.phase == USAGE_PHASE_DRAW ? rateLpm <= -USAGE_FLOW_LPM : rateLpm >= USAGE_FLOW_LPM;
+            bool reversed = u.phase == USAGE_PHASE_DRAW ? rising : falling;
+            
+            if (reversed) {
+                // A refill straight after a draw (or the other way round):
+                // the turning point was the previous reading
+                endEpisode(u, u.filtered, u.lastAt);
+            } else if (flowing) {
+                u.settle = 0;
+            } else if (++u.settle >= USAGE_SETTLE_SAMPLES) {
+                // Flow stopped after the last reading that still had it
+                endEpisode(u, filtered, now - u.settle * intervalMs);
+            }
+        }
+        
+        if (u.phase == USAGE_PHASE_IDLE) {
+            if (rising) {
+                startEpisode(u, USAGE_PHASE_REFILL);
+            } else if (falling) {
+                trackIdle(u, u.filtered);
+                startEpisode(u, USAGE_PHASE_DRAW);
+            } else {
+                trackIdle(u, filtered);
+                checkLeak(u, filtered, now);
+            }
+        }
+        
+        u.filtered = filtered;
+        u.lastAt = now;
+    }
+    
+    size_t getEvents(RtcUsageEvent* events) {
+        const RtcUsageState& u = RtcStore::data().usage;
+        memcpy(events, u.events, u.eventCount * sizeof(RtcUsageEvent));
+        return u.eventCount;
+    }
+    
+    size_t getDays(RtcUsageDay* days) {
+        const RtcUsageState& u = RtcStore::data().usage;
+        size_t count = 0;
+        for (int i = 0; i < 2; i++) {
+            if (u.days[i].date != 0 && !u.days[i].sent) {
+                days[count++] = u.days[i];
+            }
+        }
+        return count;
+    }
+    
+    void acknowledge() {
+        RtcUsageState& u = RtcStore::data().usage;
+        u.eventCount = 0;
+        
+        // Today's counters are still growing and go out with every upload
+        if (u.days[1].date != 0) {
+            u.days[1].sent = 1;
+        }
+    }
+    
+    float getFiltered() {
+        return RtcStore::data().usage.filtered;
+    }
+    
+    float getYesterdayUsage() {
+        const RtcUsageDay& day = RtcStore::data().usage.days[1];
+        return day.date != 0 ? day.usedL : 0;
+    }
+    
+    const char* getName(uint8_t kind) {
+        return kind <= USAGE_EVENT_LEAK ? eventNames[kind] : "unknown";
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * ============================================================================
+ * Usage Tracker Module
+ * ============================================================================
+ * Streaming consumption analysis over every measurement. Readings pass a
+ * median-of-3 filter (drops single missed echoes, keeps steps) into a
+ * small state machine:
+ *   - idle: level steady, or falling slower than USAGE_FLOW_LPM
+ *   - draw / refill: level moving at least USAGE_FLOW_LPM; ends after
+ *     USAGE_SETTLE_SAMPLES readings without flow, or when it reverses
+ *   - leak: an idle stretch of USAGE_LEAK_WINDOW_MS that still lost at
+ *     least USAGE_LEAK_RATE_LPH
+ * Completed draws and refills, and suspected leaks, are queued as events;
+ * usage, refill volume and counts add up per local calendar day. Both go
+ * out with the next measurement upload. State lives in RTC memory, so it
+ * carries across deep sleep.
+ */
+
+#ifndef USAGE_TRACKER_H
+#define USAGE_TRACKER_H
+
+#include <Arduino.h>
+#include "rtc_store.h"
+
+enum UsageEventKind {
+    USAGE_EVENT_DRAW,
+    USAGE_EVENT_REFILL,
+    USAGE_EVENT_LEAK
+};
+
+namespace UsageTracker {
+    /**
+     * Feed one measurement
+     * @param volumeL Measured volume
+     * @param now PowerManager::now()
+     */
+    void update(float volumeL, unsigned long now);
+    
+    /**
+     * Copy the events waiting for the next upload
+     * @param events Array of at least RTC_USAGE_EVENTS entries
+     * @return Number of events copied
+     */
+    size_t getEvents(RtcUsageEvent* events);
+    
+    /**
+     * Copy today's counters and, until acknowledged, yesterday's final
+     * ones. Days are only known once the clock has synced.
+     * @param days Array of at least 2 entries
+     * @return Number of days copied
+     */
+    size_t getDays(RtcUsageDay* days);
+    
+    /**
+     * Drop the reported events and mark yesterday's counters as sent,
+     * once an upload carrying them succeeded
+     */
+    void acknowledge();
+    
+    /**
+     * Last filtered volume (median of the last three readings)
+     */
+    float getFiltered();
+    
+    /**
+     * Volume used on the previous day, or 0 if not known
+     */
+    float getYesterdayUsage();
+    
+    /**
+     * Server name of an event kind ("draw", "refill", "leak")
+     */
+    const char* getName(uint8_t kind);
+}
+
+#endif // USAGE_TRACKER_H
@@ -5,15 +5,41 @@
 
 #include "wifi_manager.h"
 #include "config.h"
+#include "rtc_store.h"
+#include "logger.h"
 #include <ESP8266WiFi.h>
 #include <WiFiManager.h>
-#include <ArduinoJson.h>
-#include <LittleFS.h>
 
-// Restart detection file path
-#define RESTART_DETECT_FILE "/restart_detect.json"
+/**
+ * Connection states. Transitions happen in handle(), driven by the WiFi
+ * event callbacks and timeouts; nothing in this module waits in a loop
+ * except the blocking connect() wrapper.
+ */
+enum WifiState {
+    WIFI_STATE_IDLE,            // Not started
+    WIFI_STATE_CONNECTING,      // Association / DHCP in progress
+    WIFI_STATE_CONNECTED,
+    WIFI_STATE_BACKOFF,         // Waiting before the next attempt
+    WIFI_STATE_PORTAL,          // Config portal open
+    WIFI_STATE_OFF              // Radio asleep (see sleep())
+};
+
+static WifiState wifiState = WIFI_STATE_IDLE;
+static unsigned long stateSince = 0;
+static bool portalAllowed = true;
+static bool triedCache = false;
+static bool attemptFromCache = false;
 
-static unsigned long lastReconnectAttempt = 0;
+// Link state, set from the WiFi event callbacks
+static volatile bool linkUp = false;
+static WiFiEventHandler gotIpHandler;
+static WiFiEventHandler disconnectedHandler;
+static WifiManager::StatusCallback statusCallback = nullptr;
+
+// Radio on-time accounting (the radio is on from boot until the first sleep())
+static bool radioAsleep = false;
+static unsigned long radioOnSince = 0;
+static unsigned long radioOnTotal = 0;
 static WiFiManager* wifiManager = nullptr;
 
 // Custom parameters for WiFiManager
@@ -25,227 +51,371 @@ void saveConfigCallback() {
     Serial.println(F("[WiFi] Config will be saved"));
 }
 
-// Restart detection structure
-struct RestartData {
-    uint32_t restartCount;
-    unsigned long lastRestartTime;
-};
+// Remember the association that just succeeded for the next fast connect
+static void rememberConnection() {
+    RtcWifiCache& cache = RtcStore::data().wifi;
+    
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns1 = WiFi.dnsIP(0);
+    cache.dns2 = WiFi.dnsIP(1);
+    cache.valid = 1;
+    
+    RtcStore::save();
+}
+
+// Drop the cached association and go back to DHCP
+static void forgetConnection() {
+    if (RtcStore::data().wifi.valid) {
+        RtcStore::data().wifi.valid = 0;
+        RtcStore::save();
+    }
+    WiFi.config(INADDR_ANY, INADDR_ANY, INADDR_ANY);
+}
+
+// Start association straight to the cached AP with the cached lease,
+// skipping the scan and DHCP exchange
+static bool beginFromCache() {
+    const RtcWifiCache& cache = RtcStore::data().wifi;
+    if (!cache.valid) {
+        return false;
+    }
+    
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet),
+                IPAddress(cache.dns1), IPAddress(cache.dns2));
+    
+    // Don't persist the BSSID lock to the SDK's flash config
+    WiFi.persistent(false);
+    WiFi.begin(Config::wifiSsid.c_str(), Config::wifiPassword.c_str(), cache.channel, cache.bssid);
+    WiFi.persistent(true);
+    return true;
+}
+
+static void enterState(WifiState next) {
+    wifiState = next;
+    stateSince = millis();
+}
+
+// Start an association: the cached AP once per outage, otherwise a full
+// scan + DHCP
+static void startAttempt() {
+    WiFi.hostname(Config::getOtaHostname());
+    
+    attemptFromCache = !triedCache && Config::wifiSsid.length() > 0 && beginFromCache();
+    if (attemptFromCache) {
+        triedCache = true;
+    } else {
+        forgetConnection();
+        WiFi.begin(Config::wifiSsid.c_str(), Config::wifiPassword.c_str());
+    }
+    
+    enterState(WIFI_STATE_CONNECTING);
+}
+
+// Config portal closed with new settings: save them and restart
+static void applyPortalResult() {
+    Serial.println(F("[WiFi] Configuration saved, updating config..."));
+    
+    // Get values from WiFiManager parameters
+    String newDeviceId = String(custom_device_id->getValue());
+    String newDeviceToken = String(custom_device_token->getValue());
+    
+    // Get WiFi credentials from the network that was selected in the portal
+    // WiFiManager automatically saves credentials to EEPROM, and we can read them from WiFi
+    String newWifiSsid = WiFi.SSID();
+    String newWifiPassword = WiFi.psk();
+    
+    // Update config
+    if (newDeviceId.length() > 0) {
+        Config::deviceId = newDeviceId;
+    }
+    if (newDeviceToken.length() > 0) {
+        Config::deviceToken = newDeviceToken;
+    }
+    // Update WiFi credentials from the selected network
+    // WiFiManager has already saved them to EEPROM, but we also save to Config for consistency
+    if (newWifiSsid.length() > 0 && newWifiSsid != AP_SSID) {
+        Config::wifiSsid = newWifiSsid;
+        Serial.printf("[WiFi] Saved SSID: %s\n", newWifiSsid.c_str());
+    }
+    if (newWifiPassword.length() > 0) {
+        Config::wifiPassword = newWifiPassword;
+    }
+    
+    // Save to flash
+    Config::save();
+    
+    Serial.println(F("[WiFi] Config saved! Restarting..."));
+    Serial.println();
+    Log::flush();
+    delay(2000);
+    ESP.restart();
+}
+
+// Restart detection: evaluated once per boot, cleared once the boot is stable
+static bool restartChecked = false;
+static bool restartPortalDue = false;
+static bool bootStable = false;
+
+// Resets a user or a crash loop can cause. Deep-sleep wakes and deliberate
+// ESP.restart() calls (portal save, OTA) don't count.
+static bool countsAsRestart(uint32_t reason) {
+    switch (reason) {
+        case REASON_DEFAULT_RST:
+        case REASON_EXT_SYS_RST:
+        case REASON_WDT_RST:
+        case REASON_EXCEPTION_RST:
+        case REASON_SOFT_WDT_RST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Built when the portal first opens: a normal connect never needs it, and
+// duty-cycle wakes count their awake milliseconds
+static void createPortal() {
+    wifiManager = new WiFiManager();
+    wifiManager->setSaveConfigCallback(saveConfigCallback);
+    wifiManager->setConfigPortalBlocking(false);
+    wifiManager->setConfigPortalTimeout(180); // 3 minutes timeout
+    wifiManager->setAPStaticIPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+    
+    // Custom parameters with the current values (Config::load() has run)
+    char deviceIdBuffer[DEVICE_ID_MAX_LEN];
+    char deviceTokenBuffer[DEVICE_TOKEN_MAX_LEN];
+    
+    Config::deviceId.toCharArray(deviceIdBuffer, sizeof(deviceIdBuffer));
+    Config::deviceToken.toCharArray(deviceTokenBuffer, sizeof(deviceTokenBuffer));
+    
+    custom_device_id = new WiFiManagerParameter("device_id", "Device ID", deviceIdBuffer, DEVICE_ID_MAX_LEN);
+    custom_device_token = new WiFiManagerParameter("device_token", "Device Token", deviceTokenBuffer, DEVICE_TOKEN_MAX_LEN);
+    
+    wifiManager->addParameter(custom_device_id);
+    wifiManager->addParameter(custom_device_token);
+}
 
 namespace WifiManager {
     void init() {
         WiFi.mode(WIFI_STA);
-        WiFi.setAutoReconnect(true);
+        WiFi.setAutoReconnect(false);   // Reconnects are driven by handle()
         WiFi.persistent(true);
         
-        // Initialize WiFiManager
-        if (!wifiManager) {
-            wifiManager = new WiFiManager();
-            wifiManager->setSaveConfigCallback(saveConfigCallback);
-            wifiManager->setConfigPortalTimeout(180); // 3 minutes timeout
-            wifiManager->setAPStaticIPConfig(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1), IPAddress(255, 255, 255, 0));
+        // Event callbacks only record link state; handle() acts on it
+        if (!gotIpHandler) {
+            gotIpHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP&) {
+                linkUp = true;
+            });
+            disconnectedHandler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected&) {
+                linkUp = false;
+            });
         }
         
-        // Load current config values
-        Config::load();
-        
-        // Create custom parameters with current values
-        char deviceIdBuffer[64];
-        char deviceTokenBuffer[128];
-        
-        Config::deviceId.toCharArray(deviceIdBuffer, sizeof(deviceIdBuffer));
-        Config::deviceToken.toCharArray(deviceTokenBuffer, sizeof(deviceTokenBuffer));
-        
-        if (!custom_device_id) {
-            custom_device_id = new WiFiManagerParameter("device_id", "Device ID", deviceIdBuffer, 64);
-            custom_device_token = new WiFiManagerParameter("device_token", "Device Token", deviceTokenBuffer, 128);
-            
-            wifiManager->addParameter(custom_device_id);
-            wifiManager->addParameter(custom_device_token);
-        } else {
-            // Update existing parameters
-            custom_device_id->setValue(deviceIdBuffer, 64);
-            custom_device_token->setValue(deviceTokenBuffer, 128);
-        }
     }
 
     bool shouldEnterConfigPortal() {
-        // Use LittleFS to persist restart data across full resets
-        // Strategy: Write a marker file with timestamp on each boot
-        // If file exists and was written recently (within 5 seconds), increment counter
-        // Since we can't get real time between boots, we use a simpler approach:
-        // - Write marker file on each boot
-        // - If file exists, increment counter (assumes rapid restarts)
-        // - Reset counter after successful connection or config portal
+        // The count lives in RTC memory: it survives reset-button presses and
+        // crashes but not power loss, and costs no flash writes. A boot that
+        // runs for RESTART_WINDOW_MS clears it (see confirmStableBoot()).
+        if (restartChecked) {
+            return restartPortalDue;
+        }
+        restartChecked = true;
         
-        uint32_t restartCount = 0;
-        unsigned long currentTime = millis();
-        bool fileExisted = false;
+        uint32_t& restartCount = RtcStore::data().restartCount;
+        uint32_t reason = ESP.getResetInfoPtr()->reason;
         
-        // Try to read existing restart data
-        if (LittleFS.begin()) {
-            if (LittleFS.exists(RESTART_DETECT_FILE)) {
-                fileExisted = true;
-                File file = LittleFS.open(RESTART_DETECT_FILE, "r");
-                if (file) {
-                    StaticJsonDocument<512> doc;
-                    DeserializationError error = deserializeJson(doc, file);
-                    if (error == DeserializationError::Ok) {
-                        restartCount = doc["restart_count"] | 0;
-                        unsigned long lastTime = doc["last_restart_time"] | 0;
-                        
-                        // Check if last restart was "recent" (within 5 seconds)
-                        // Since millis() resets, we check if the time difference is small
-                        // If currentTime < lastTime, it means we wrapped around or restarted
-                        // In that case, assume it's a recent restart if time is small
-                        unsigned long timeDiff = (currentTime >= lastTime) ? 
-                            (currentTime - lastTime) : (currentTime + (ULONG_MAX - lastTime));
-                        
-                        if (timeDiff <= 5000) {
-                            // Recent restart, increment counter
-                            restartCount++;
-                            Serial.printf("[WiFi] Recent restart detected, count: %d\n", restartCount);
-                        } else {
-                            // Not recent, reset counter
-                            restartCount = 1;
-                            Serial.println(F("[WiFi] Restart after delay, resetting count"));
-                        }
-                    }
-                    file.close();
-                }
-            } else {
-                // First boot or file was deleted
-                restartCount = 1;
-            }
+        if (countsAsRestart(reason)) {
+            restartCount++;
+            Serial.printf("[WiFi] Quick restart count: %d (reason %d)\n", restartCount, reason);
+        } else {
+            restartCount = 0;
         }
         
-        // Save restart data with current timestamp
-        if (LittleFS.begin()) {
-            File file = LittleFS.open(RESTART_DETECT_FILE, "w");
-            if (file) {
-                StaticJsonDocument<512> doc;
-                doc["restart_count"] = restartCount;
-                doc["last_restart_time"] = currentTime;
-                serializeJson(doc, file);
-                file.close();
-            }
+        if (restartCount >= RESTART_PORTAL_COUNT) {
+            Serial.printf("[WiFi] %d restarts within %d ms detected! Entering config portal...\n",
+                restartCount, RESTART_WINDOW_MS);
+            restartCount = 0;
+            restartPortalDue = true;
         }
         
-        // Check if 3 or more restarts within 5 seconds
-        if (restartCount >= 3) {
-            Serial.println(F("[WiFi] 3 restarts within 5 seconds detected! Entering config portal..."));
-            
-            // Reset restart count
-            if (LittleFS.begin()) {
-                File file = LittleFS.open(RESTART_DETECT_FILE, "w");
-                if (file) {
-                    StaticJsonDocument<512> doc;
-                    doc["restart_count"] = 0;
-                    doc["last_restart_time"] = currentTime;
-                    serializeJson(doc, file);
-                    file.close();
-                }
-            }
-            
-            return true;
+        RtcStore::save();
+        return restartPortalDue;
+    }
+
+    void confirmStableBoot() {
+        // A deep-sleep wake means the previous boot got as far as sleeping
+        bool woke = ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE;
+        if (bootStable || (millis() < RESTART_WINDOW_MS && !woke)) {
+            return;
         }
+        bootStable = true;
         
-        return false;
+        if (RtcStore::data().restartCount != 0) {
+            RtcStore::data().restartCount = 0;
+            RtcStore::save();
+        }
     }
 
-    bool connect(bool forceConfigPortal) {
+    void begin(bool forceConfigPortal, bool allowPortal) {
         if (!wifiManager) {
             init();
         }
         
-        // Check if we should force config portal (3 restarts within 5 seconds)
-        if (forceConfigPortal || shouldEnterConfigPortal()) {
-            Serial.println(F("[WiFi] Starting configuration portal..."));
+        portalAllowed = allowPortal;
+        triedCache = false;
+        
+        // Check if we should force config portal (quick restarts)
+        if (forceConfigPortal || (allowPortal && shouldEnterConfigPortal())) {
             startConfigPortal();
-            return false; // Will return after portal closes
+            return;
         }
         
         // Try to connect with saved credentials
         Serial.printf("[WiFi] Connecting to %s...\n", Config::wifiSsid.c_str());
-        
-        // Set hostname before connecting
-        WiFi.hostname(Config::getOtaHostname());
-        
-        bool connected = false;
-        
-        // Try autoConnect - will start portal if connection fails
-        if (Config::wifiSsid.length() > 0 && Config::wifiPassword.length() > 0) {
-            // Pre-fill WiFi credentials
-            WiFi.begin(Config::wifiSsid.c_str(), Config::wifiPassword.c_str());
-            
-            unsigned long startTime = millis();
-            while (WiFi.status() != WL_CONNECTED && (millis() - startTime < WIFI_CONNECT_TIMEOUT_MS)) {
-                delay(500);
-                Serial.print(".");
-            }
-            Serial.println();
-            
-            if (WiFi.status() == WL_CONNECTED) {
-                connected = true;
-            }
-        }
-        
-        if (!connected) {
-            // Connection failed, start config portal
-            Serial.println(F("[WiFi] Connection failed, starting config portal..."));
-            startConfigPortal();
-            return false;
-        }
-        
-        Serial.print(F("[WiFi] Connected! IP: "));
-        Serial.println(WiFi.localIP());
-        
-        // Reset restart count on successful connection
-        if (LittleFS.begin()) {
-            if (LittleFS.exists(RESTART_DETECT_FILE)) {
-                File file = LittleFS.open(RESTART_DETECT_FILE, "w");
-                if (file) {
-                    StaticJsonDocument<512> doc;
-                    doc["restart_count"] = 0;
-                    doc["last_restart_time"] = millis();
-                    serializeJson(doc, file);
-                    file.close();
+        startAttempt();
+    }
+
+    void handle() {
+        unsigned long elapsed = millis() - stateSince;
+        
+        switch (wifiState) {
+            case WIFI_STATE_CONNECTING:
+                if (linkUp) {
+                    if (!attemptFromCache) {
+                        rememberConnection();
+                    }
+                    Serial.printf("[WiFi] Connected in %lu ms! IP: %s\n",
+                        elapsed, WiFi.localIP().toString().c_str());
+                    
+                    // Later outages just retry; the portal is for setup
+                    portalAllowed = false;
+                    triedCache = false;
+                    enterState(WIFI_STATE_CONNECTED);
+                    if (statusCallback) {
+                        statusCallback(true);
+                    }
+                } else if (attemptFromCache && elapsed >= WIFI_FAST_CONNECT_TIMEOUT_MS) {
+                    Serial.println(F("[WiFi] Fast connect failed, scanning..."));
+                    WiFi.disconnect();
+                    startAttempt();
+                } else if (elapsed >= WIFI_CONNECT_TIMEOUT_MS) {
+                    if (portalAllowed) {
+                        // Connection failed, start config portal
+                        Serial.println(F("[WiFi] Connection failed, starting config portal..."));
+                        startConfigPortal();
+                    } else {
+                        Serial.println(F("[WiFi] Connection failed, will retry..."));
+                        WiFi.disconnect();
+                        enterState(WIFI_STATE_BACKOFF);
+                    }
+                }
+                break;
+                
+            case WIFI_STATE_CONNECTED:
+                if (!linkUp) {
+                    Serial.println(F("[WiFi] Connection lost, reconnecting..."));
+                    triedCache = false;
+                    startAttempt();
+                    if (statusCallback) {
+                        statusCallback(false);
+                    }
+                }
+                break;
+                
+            case WIFI_STATE_BACKOFF:
+                // Don't spam reconnect attempts
+                if (elapsed >= WIFI_RECONNECT_INTERVAL_MS) {
+                    Serial.println(F("[WiFi] Attempting reconnect..."));
+                    startAttempt();
+                }
+                break;
+                
+            case WIFI_STATE_PORTAL:
+                if (wifiManager->process()) {
+                    applyPortalResult();
+                } else if (!wifiManager->getConfigPortalActive()) {
+                    Serial.println(F("[WiFi] Config portal timeout"));
+                    portalAllowed = false;
+                    WiFi.mode(WIFI_STA);
+                    startAttempt();
                 }
-            }
+                break;
+                
+            default:
+                break;
+        }
+    }
+
+    bool connect(bool forceConfigPortal, bool allowPortal) {
+        begin(forceConfigPortal, allowPortal);
+        
+        // For callers with nothing else to do until the link is up. The
+        // portal ends by restarting the device or timing out.
+        while (wifiState == WIFI_STATE_CONNECTING || wifiState == WIFI_STATE_PORTAL) {
+            handle();
+            delay(10);
         }
         
-        return true;
+        return isConnected();
     }
 
     bool isConnected() {
-        return WiFi.status() == WL_CONNECTED;
+        return linkUp;
+    }
+
+    bool isPortalActive() {
+        return wifiState == WIFI_STATE_PORTAL;
+    }
+
+    void onStatusChange(StatusCallback callback) {
+        statusCallback = callback;
     }
 
-    void reconnect() {
-        unsigned long now = millis();
+    bool wake() {
+        if (radioAsleep) {
+            WiFi.forceSleepWake();
+            delay(1);
+            
+            // Mode changes are not written to flash
+            WiFi.persistent(false);
+            WiFi.mode(WIFI_STA);
+            WiFi.persistent(true);
+            
+            radioAsleep = false;
+            radioOnSince = millis();
+        }
         
-        // Don't spam reconnect attempts
-        if (now - lastReconnectAttempt < WIFI_RECONNECT_INTERVAL_MS) {
+        return isConnected() || connect(false, false);
+    }
+
+    void sleep() {
+        if (radioAsleep) {
             return;
         }
         
-        lastReconnectAttempt = now;
-        
-        Serial.println(F("[WiFi] Attempting reconnect..."));
-        
-        WiFi.disconnect();
-        delay(100);
-        
-        if (Config::wifiSsid.length() > 0 && Config::wifiPassword.length() > 0) {
-            WiFi.begin(Config::wifiSsid.c_str(), Config::wifiPassword.c_str());
-        }
+        WiFi.persistent(false);
+        WiFi.mode(WIFI_OFF);
+        WiFi.persistent(true);
+        WiFi.forceSleepBegin();
+        delay(1);
         
-        // Non-blocking: just start the connection attempt
-        // Loop will check status later
+        linkUp = false;
+        enterState(WIFI_STATE_OFF);
+        radioAsleep = true;
+        radioOnTotal += millis() - radioOnSince;
+    }
+
+    unsigned long getRadioOnMs() {
+        return radioAsleep ? radioOnTotal : radioOnTotal + (millis() - radioOnSince);
     }
 
     void startConfigPortal() {
         if (!wifiManager) {
-            init();
+            createPortal();
         }
         
         Serial.println(F("[WiFi] Starting configuration portal..."));
@@ -253,51 +423,9 @@ namespace WifiManager {
         Serial.printf("[WiFi] AP Password: %s\n", AP_PASSWORD);
         Serial.println(F("[WiFi] Connect to the AP and configure your device"));
         
-        // Start config portal (blocking)
-        bool portalStarted = wifiManager->startConfigPortal(AP_SSID, AP_PASSWORD);
-        
-        if (!portalStarted) {
-            Serial.println(F("[WiFi] Config portal timeout"));
-            return;
-        }
-        
-        // Config portal closed - save the new values
-        Serial.println(F("[WiFi] Configuration saved, updating config..."));
-        
-        // Get values from WiFiManager parameters
-        String newDeviceId = String(custom_device_id->getValue());
-        String newDeviceToken = String(custom_device_token->getValue());
-        
-        // Get WiFi credentials from the network that was selected in the portal
-        // When startConfigPortal() returns true, it means a network was selected and connected
-        // WiFiManager automatically saves credentials to EEPROM, and we can read them from WiFi
-        String newWifiSsid = WiFi.SSID();
-        String newWifiPassword = WiFi.psk();
-        
-        // Update config
-        if (newDeviceId.length() > 0) {
-            Config::deviceId = newDeviceId;
-        }
-        if (newDeviceToken.length() > 0) {
-            Config::deviceToken = newDeviceToken;
-        }
-        // Update WiFi credentials from the selected network
-        // WiFiManager has already saved them to EEPROM, but we also save to Config for consistency
-        if (newWifiSsid.length() > 0 && newWifiSsid != AP_SSID) {
-            Config::wifiSsid = newWifiSsid;
-            Serial.printf("[WiFi] Saved SSID: %s\n", newWifiSsid.c_str());
-        }
-        if (newWifiPassword.length() > 0) {
-            Config::wifiPassword = newWifiPassword;
-        }
-        
-        // Save to flash
-        Config::save();
-        
-        Serial.println(F("[WiFi] Config saved! Restarting..."));
-        Serial.println();
-        delay(2000);
-        ESP.restart();
+        // Non-blocking: handle() serves the portal from loop()
+        wifiManager->startConfigPortal(AP_SSID, AP_PASSWORD);
+        enterState(WIFI_STATE_PORTAL);
     }
 
     int getRssi() {
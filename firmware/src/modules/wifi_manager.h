@@ -2,7 +2,11 @@
  * ============================================================================
  * WiFi Manager Module
  * ============================================================================
- * Handles WiFi connection, reconnection, and AP fallback using WiFiManager
+ * Handles WiFi connection, reconnection, and AP fallback using WiFiManager.
+ *
+ * Connection management is a non-blocking state machine: begin() starts
+ * it, handle() advances it from loop(), and link state comes from the
+ * ESP8266 WiFi event callbacks rather than polling WiFi.status().
  */
 
 #ifndef WIFI_MANAGER_H
@@ -12,29 +16,70 @@
 
 namespace WifiManager {
     /**
-     * Initialize WiFi
+     * Initialize WiFi. Call after Config::load(): the config portal takes
+     * its device ID and token from Config when it opens.
      */
     void init();
     
     /**
-     * Connect to configured WiFi network or start config portal
-     * @param forceConfigPortal Force start config portal (e.g., after 3 restarts)
+     * Called from handle() when the link comes up or goes down
+     */
+    typedef void (*StatusCallback)(bool connected);
+    
+    /**
+     * Start connecting (or open the config portal) without blocking
+     * @param forceConfigPortal Force start config portal (e.g., after quick restarts)
+     * @param allowPortal Start the portal if the connection fails
+     *                    (off for duty-cycle wakes, which retry next cycle)
+     */
+    void begin(bool forceConfigPortal = false, bool allowPortal = true);
+    
+    /**
+     * Advance the connection / portal state machine. Never blocks; call
+     * from loop(). Reconnects automatically after the link drops.
+     */
+    void handle();
+    
+    /**
+     * Blocking connect: begin() and run handle() until connected, failed,
+     * or the portal has closed. For callers with nothing else to do.
      * @return true if connected successfully
      */
-    bool connect(bool forceConfigPortal = false);
+    bool connect(bool forceConfigPortal = false, bool allowPortal = true);
     
     /**
-     * Check if WiFi is currently connected
+     * Check if WiFi is currently connected (tracked from WiFi events)
      */
     bool isConnected();
     
     /**
-     * Attempt to reconnect if disconnected
+     * Check if the config portal is open
+     */
+    bool isPortalActive();
+    
+    /**
+     * Register a callback for link up / down transitions
      */
-    void reconnect();
+    void onStatusChange(StatusCallback callback);
     
     /**
-     * Start AP mode for configuration
+     * Power the radio up and connect without the config portal
+     * @return true if connected
+     */
+    bool wake();
+    
+    /**
+     * Disconnect and put the radio to sleep until the next wake()
+     */
+    void sleep();
+    
+    /**
+     * Total time the radio has been powered since boot (ms)
+     */
+    unsigned long getRadioOnMs();
+    
+    /**
+     * Start AP mode for configuration (non-blocking; served by handle())
      */
     void startConfigPortal();
     
@@ -54,10 +99,18 @@ namespace WifiManager {
     String getMacAddress();
     
     /**
-     * Check if device should enter config portal (3 restarts within 5 seconds)
+     * Check if device should enter config portal (RESTART_PORTAL_COUNT
+     * resets, each within RESTART_WINDOW_MS of boot). Counts this boot on
+     * the first call; later calls return the same answer.
      * @return true if should enter config portal
      */
     bool shouldEnterConfigPortal();
+    
+    /**
+     * Clear the restart count once this boot has run for RESTART_WINDOW_MS
+     * (or is a deep-sleep wake). Cheap; call from loop().
+     */
+    void confirmStableBoot();
 }
 
 #endif // WIFI_MANAGER_H
@@ -9,6 +9,7 @@
  *   - Ultrasonic water level sensing
  *   - WiFi connectivity with auto-reconnect
  *   - HTTPS/MQTT data reporting
+ *   - LAN HTTP API and dashboard
  *   - OTA firmware updates
  *   - Local audio alerts
  *   - Temperature monitoring
@@ -28,9 +29,23 @@
 #include "wifi_manager.h"
 #include "sensor.h"
 #include "alerts.h"
+#include "alert_engine.h"
+#include "usage_tracker.h"
+#include "forecast.h"
+#include "rollup.h"
 #include "data_reporter.h"
+#include "relay.h"
+#include "local_api.h"
 #include "ota_handler.h"
 #include "storage.h"
+#include "rtc_store.h"
+#include "power_manager.h"
+#include "time_sync.h"
+#include "dns_cache.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "heap_monitor.h"
+#include "logger.h"
 
 // ============================================================================
 // Global State
@@ -38,6 +53,15 @@
 
 SystemState state;
 
+// Scheduler task ids
+int measureTask = -1;
+int alertsTask = -1;
+int reportTask = -1;
+
+// Measurements waiting for the next radio session (RADIO_BATCHING_ENABLED)
+SystemState batch[BATCH_MAX_SAMPLES];
+size_t batchCount = 0;
+
 // ============================================================================
 // Setup
 // ============================================================================
@@ -55,6 +79,16 @@ void setup() {
     Serial.println(F("═══════════════════════════════════════════════════"));
     Serial.println();
 
+    // Restore state kept in RTC memory across resets and deep sleep
+    bool rtcValid = RtcStore::init();
+    PowerManager::init(rtcValid);
+    TimeSync::init();
+    
+#if DEEP_SLEEP_ENABLED
+    // Battery mode: one wake cycle, then back to deep sleep
+    runDutyCycle();
+#endif
+
     // Initialize modules
     Storage::init();
     Config::load();
@@ -62,41 +96,39 @@ void setup() {
     Sensor::init();
     Alerts::init();
     
-    // Initialize state timers
-    state.lastOtaCheck = 0;  // Will check on first loop after WiFi connects
+    // No OTA check at startup: the first measurement response advertises
+    // any pending firmware
+    state.lastOtaCheck = millis();
+    
+    // Initialize data reporter
+    DataReporter::init();
     
-    // Connect to WiFi (will check for 3 restarts and start config portal if needed)
+    // Connect to WiFi (will check for quick restarts and start config portal if needed)
     Serial.println(F("[WiFi] Connecting..."));
     WifiManager::init();
+    WifiManager::onStatusChange(onWifiStatusChange);
     
-    // Connect (will automatically check for 3 restarts and start config portal if needed)
-    if (WifiManager::connect()) {
-        state.wifiConnected = true;
-        state.wifiRssi = WiFi.RSSI();
-        Serial.print(F("[WiFi] Connected! IP: "));
-        Serial.println(WiFi.localIP());
-        
-        // Initialize OTA after WiFi is connected
-        OTAHandler::init();
-        
-        // Initialize data reporter
-        DataReporter::init();
-        
-        // Check for OTA updates immediately after connecting
-        // (will also check periodically in loop)
-        Serial.println(F("[OTA] Checking for updates on startup..."));
-        OTAHandler::checkForUpdate();
-        state.lastOtaCheck = millis();
-    } else {
-        // If connect() returns false, it might have started config portal
-        // Config portal will restart the device when done, so we won't reach here
-        Serial.println(F("[WiFi] Connection failed, will retry..."));
-        state.wifiConnected = false;
-    }
+#if RADIO_BATCHING_ENABLED
+    // Connected once for the portal and restart checks; radio off until
+    // the first batch is due
+    WifiManager::connect();
+    WifiManager::sleep();
+    state.wifiConnected = false;
+#else
+    // Non-blocking: loop() keeps measuring and alerting while WiFi
+    // associates or the config portal is open
+    WifiManager::begin();
+#endif
+    
+#if RELAY_ROLE == RELAY_ROLE_GATEWAY
+    Relay::init();
+#endif
     
     // Play startup sound
     Alerts::playStartupSound();
     
+    setupTasks();
+    
     Serial.println(F("[System] Setup complete!"));
     Serial.println();
 }
@@ -106,53 +138,184 @@ void setup() {
 // ============================================================================
 
 void loop() {
-    unsigned long now = millis();
+    Scheduler::run();
+}
+
+// ============================================================================
+// Tasks
+// ============================================================================
+
+void setupTasks() {
+    Scheduler::addPeriodic("wifi", wifiTask, SCHEDULER_FAST_TASK_MS, TASK_PRIORITY_HIGH);
+#if !RADIO_BATCHING_ENABLED
+    Scheduler::addPeriodic("ota-lan", OTAHandler::handle, SCHEDULER_FAST_TASK_MS, TASK_PRIORITY_HIGH);
+    Scheduler::addPeriodic("ota-check", otaCheckTask, 1000, TASK_PRIORITY_LOW, OTA_CHECK_DEADLINE_MS);
+#endif
+    measureTask = Scheduler::addPeriodic("measure", measurementTask,
+        Config::measurementIntervalMs, TASK_PRIORITY_NORMAL);
+    alertsTask = Scheduler::addOneShot("alerts", alertTask, TASK_PRIORITY_HIGH, ALERT_DEADLINE_MS);
+    reportTask = Scheduler::addPeriodic("report", reportingTask,
+        Config::reportIntervalMs, TASK_PRIORITY_LOW);
+    Scheduler::addPeriodic("heap", HeapMonitor::sample, HEAP_SAMPLE_INTERVAL_MS, TASK_PRIORITY_LOW);
+    Scheduler::addPeriodic("stats", statsTask, SCHEDULER_STATS_INTERVAL_MS, TASK_PRIORITY_LOW);
+#if RELAY_ROLE == RELAY_ROLE_GATEWAY
+    Scheduler::addPeriodic("relay", relayTask, 1000, TASK_PRIORITY_LOW);
+#endif
+#if LOCAL_API_ENABLED
+    Scheduler::addPeriodic("local-api", LocalApi::handle, SCHEDULER_FAST_TASK_MS, TASK_PRIORITY_NORMAL);
+#endif
     
-    // Handle OTA updates
-    OTAHandler::handle();
+    Scheduler::setIdleHook(onIdle);
     
-    // Check WiFi connection
-    if (!WifiManager::isConnected()) {
-        if (state.wifiConnected) {
-            Serial.println(F("[WiFi] Connection lost, reconnecting..."));
-            state.wifiConnected = false;
-        }
-        WifiManager::reconnect();
-    } else if (!state.wifiConnected) {
-        state.wifiConnected = true;
-        state.wifiRssi = WiFi.RSSI();
-        Serial.println(F("[WiFi] Reconnected!"));
+#if IDLE_LIGHT_SLEEP_ENABLED
+    // delay() in the idle hook lets the SDK light-sleep between beacons
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+#endif
+}
+
+void onIdle(unsigned long idleMs) {
+    // Serial output happens here, off the measurement and report paths
+    Log::drain();
+    delay(idleMs < SCHEDULER_IDLE_MAX_MS ? idleMs : SCHEDULER_IDLE_MAX_MS);
+}
+
+void wifiTask() {
+    // Past the restart window: this boot no longer counts as a quick restart
+    WifiManager::confirmStableBoot();
+    
+    // Advance WiFi connection / portal; link changes arrive via onWifiStatusChange()
+    WifiManager::handle();
+}
+
+void measurementTask() {
+    takeMeasurement();
+    state.lastMeasurement = millis();
+#if LOCAL_API_ENABLED
+    LocalApi::record(state);
+#endif
+    trackUsage();
+#if ROLLUP_ENABLED
+    rollupMeasurement();
+#elif RADIO_BATCHING_ENABLED
+    queueMeasurement();
+#endif
+    Scheduler::trigger(alertsTask);
+}
+
+void alertTask() {
+    if (!checkAlerts()) {
+        return;
     }
     
-    // Take measurements at configured interval
-    if (now - state.lastMeasurement >= Config::measurementIntervalMs) {
-        takeMeasurement();
-        state.lastMeasurement = now;
+    // Alert transitions go out right away instead of waiting for the report
+#if RADIO_BATCHING_ENABLED
+    Scheduler::trigger(reportTask);
+#else
+    if (state.wifiConnected) {
+        pushAlertEvents();
+    }
+#endif
+}
+
+void reportingTask() {
+#if RADIO_BATCHING_ENABLED
+    if (batchCount > 0 || Rollup::getWindow() != nullptr || AlertEngine::hasPendingEvents()) {
+        uploadBatch();
     }
+#else
+    if (state.wifiConnected) {
+        reportData();
+#if RELAY_ROLE == RELAY_ROLE_GATEWAY
+        Relay::upload();
+#endif
+    } else {
+        // Store locally for later upload
+        deferMeasurement();
+    }
+#endif
+    state.lastReport = millis();
     
-    // Report data at configured interval
-    if (now - state.lastReport >= Config::reportIntervalMs) {
-        if (state.wifiConnected) {
-            reportData();
-        } else {
-            // Store locally for later upload
-            Storage::bufferMeasurement(state);
-        }
-        state.lastReport = now;
+    // The server may have changed the intervals
+    Scheduler::setInterval(measureTask, Config::measurementIntervalMs);
+    Scheduler::setInterval(reportTask, Config::reportIntervalMs);
+}
+
+#if RELAY_ROLE == RELAY_ROLE_GATEWAY
+// Wait before the next early upload after one failed, doubling up to the
+// report interval; reports still retry on their own schedule
+static unsigned long relayBackoffMs = 0;
+static unsigned long relayFailedAt = 0;
+
+void relayTask() {
+    // Filling up faster than reports drain it: upload the leaves' frames
+    // now instead of turning new ones away
+    if (!state.wifiConnected || Relay::getPendingCount() < RELAY_INBOX_FRAMES / 2) {
+        return;
+    }
+    if (relayBackoffMs != 0 && millis() - relayFailedAt < relayBackoffMs) {
+        return;
     }
     
-    // Check for OTA updates at configured interval
-    if (state.wifiConnected && (now - state.lastOtaCheck >= OTA_CHECK_INTERVAL_MS)) {
-        Serial.println(F("[OTA] Periodic update check..."));
+    if (Relay::upload()) {
+        relayBackoffMs = 0;
+        return;
+    }
+    relayFailedAt = millis();
+    relayBackoffMs = relayBackoffMs == 0 ? RELAY_UPLOAD_BACKOFF_MS
+        : min(relayBackoffMs * 2, (unsigned long)Config::reportIntervalMs);
+    LOG_WARN("[Relay] Upload failed, next early attempt in %lu s", relayBackoffMs / 1000);
+}
+#endif
+
+void statsTask() {
+    Scheduler::printStats();
+    HeapMonitor::printStats();
+#if PROFILING_ENABLED
+    Profiler::printSummary();
+#endif
+}
+
+void otaCheckTask() {
+    // Fetch OTA updates when the server has advertised one, with a slow
+    // fallback poll in case an advertisement was missed
+    if (state.wifiConnected &&
+        (OTAHandler::isUpdatePending() || millis() - state.lastOtaCheck >= OTA_CHECK_INTERVAL_MS)) {
         OTAHandler::checkForUpdate();
-        state.lastOtaCheck = now;
+        state.lastOtaCheck = millis();
+    }
+}
+
+// ============================================================================
+// WiFi Events
+// ============================================================================
+
+void onWifiStatusChange(bool connected) {
+    static bool networkServicesStarted = false;
+    
+    state.wifiConnected = connected;
+    if (!connected) {
+        return;
     }
     
-    // Check alert conditions
-    checkAlerts();
+    state.wifiRssi = WiFi.RSSI();
     
-    // Small delay to prevent tight loop
-    delay(10);
+    // ArduinoOTA and the local API need the network; start them on the
+    // first connection, once the config portal has let go of port 80
+    if (!networkServicesStarted) {
+        OTAHandler::init();
+#if LOCAL_API_ENABLED
+        LocalApi::begin(state);
+#endif
+        networkServicesStarted = true;
+    }
+    
+#if !RADIO_BATCHING_ENABLED && !DEEP_SLEEP_ENABLED
+    // Alert transitions raised while offline go out with the next report;
+    // bring it forward
+    if (AlertEngine::hasPendingEvents()) {
+        Scheduler::trigger(reportTask);
+    }
+#endif
 }
 
 // ============================================================================
@@ -160,10 +323,11 @@ void loop() {
 // ============================================================================
 
 void takeMeasurement() {
-    Serial.println(F("[Sensor] Taking measurement..."));
+    LOG_INFO("[Sensor] Taking measurement...");
     
-    // Read water level
-    state.waterLevelCm = Sensor::readWaterLevel();
+    // Read water level (every tank; channel 0 is the primary one)
+    Sensor::readWaterLevels(state.channelLevelCm);
+    state.waterLevelCm = state.channelLevelCm[0];
     state.volumeLiters = Sensor::calculateVolume(state.waterLevelCm);
     
     // Read temperature
@@ -178,62 +342,371 @@ void takeMeasurement() {
     }
     
     // Log measurement
-    Serial.printf("[Sensor] Level: %.1f cm, Volume: %.1f L, Temp: %.1f°C, Battery: %.2fV\n",
+    LOG_INFO("[Sensor] Level: %.1f cm, Volume: %.1f L, Temp: %.1f°C, Battery: %.2fV",
         state.waterLevelCm,
         state.volumeLiters,
         state.temperatureC,
         state.batteryVoltage
     );
+    for (int ch = 1; ch < SENSOR_CHANNELS; ch++) {
+        LOG_INFO("[Sensor] Tank %d level: %.1f cm, Volume: %.1f L", ch,
+            state.channelLevelCm[ch], Sensor::calculateVolume(state.channelLevelCm[ch], ch));
+    }
 }
 
 void reportData() {
-    Serial.println(F("[Report] Sending data..."));
+    // Alert transitions first; they are the time-critical part
+    pushAlertEvents();
+    
+#if ROLLUP_ENABLED
+    if (Rollup::getWindow() != nullptr) {
+        reportRollup();
+        return;
+    }
+#endif
+    
+    LOG_INFO("[Report] Sending data...");
     
     bool success = DataReporter::send(
         state.waterLevelCm,
         state.volumeLiters,
         state.temperatureC,
         state.batteryVoltage,
-        state.wifiRssi
+        state.wifiRssi,
+        state.channelLevelCm
     );
     
     if (success) {
-        Serial.println(F("[Report] Data sent successfully"));
+        LOG_INFO("[Report] Data sent successfully");
+        DnsCache::printStats();
         // Try to send any buffered data
+        flushPending();
         Storage::flushBuffer();
     } else {
-        Serial.println(F("[Report] Failed to send, buffering locally"));
-        Storage::bufferMeasurement(state);
+        LOG_WARN("[Report] Failed to send, buffering locally");
+        deferMeasurement();
+    }
+}
+
+void deferMeasurement() {
+#if ROLLUP_ENABLED
+    // The window stands in for the readings since the last report
+    const RtcRollup* window = Rollup::getWindow();
+    if (window != nullptr) {
+        Storage::bufferRollup(*window);
+        Rollup::reset();
+        return;
+    }
+#endif
+#if DEEP_SLEEP_ENABLED
+    // Hold unsent measurements in RTC memory; flash only once it fills up
+    if (holdMeasurement()) {
+        return;
+    }
+#endif
+    Storage::bufferMeasurement(state);
+}
+
+// Keep the current measurement in RTC memory until the next report. The
+// slots only have room for the primary tank; other tanks' readings go to
+// flash.
+bool holdMeasurement() {
+    RtcData& rtc = RtcStore::data();
+    if (SENSOR_CHANNELS > 1 || rtc.power.pendingCount >= RTC_PENDING_SAMPLES) {
+        return false;
+    }
+    
+    RtcSample& sample = rtc.pending[rtc.power.pendingCount++];
+    sample.waterLevelCm = state.waterLevelCm;
+    sample.volumeLiters = state.volumeLiters;
+    sample.temperatureC = state.temperatureC;
+    sample.takenAt = state.lastMeasurement;
+    sample.batteryMv = (uint16_t)(state.batteryVoltage * 1000.0f + 0.5f);
+    sample.wifiRssi = state.wifiRssi;
+    LOG_INFO("[Report] Deferred measurement (%d in RTC memory)", rtc.power.pendingCount);
+    return true;
+}
+
+// Unpack the measurements held in RTC memory for upload
+size_t loadPending(SystemState* samples) {
+    RtcData& rtc = RtcStore::data();
+    for (uint8_t i = 0; i < rtc.power.pendingCount; i++) {
+        samples[i] = {};
+        samples[i].waterLevelCm = rtc.pending[i].waterLevelCm;
+        samples[i].volumeLiters = rtc.pending[i].volumeLiters;
+        samples[i].temperatureC = rtc.pending[i].temperatureC;
+        samples[i].batteryVoltage = rtc.pending[i].batteryMv / 1000.0f;
+        samples[i].wifiRssi = rtc.pending[i].wifiRssi;
+        samples[i].lastMeasurement = rtc.pending[i].takenAt;
+    }
+    return rtc.power.pendingCount;
+}
+
+void flushPending() {
+    RtcData& rtc = RtcStore::data();
+    if (rtc.power.pendingCount == 0) {
+        return;
+    }
+    
+    SystemState samples[RTC_PENDING_SAMPLES];
+    loadPending(samples);
+    
+    // One request for all of them
+    if (DataReporter::sendBatch(samples, rtc.power.pendingCount, PowerManager::now())) {
+        LOG_INFO("[Report] Sent %d deferred measurements", rtc.power.pendingCount);
+        rtc.power.pendingCount = 0;
     }
 }
 
-void checkAlerts() {
-    // Check for tank full
-    if (state.volumeLiters >= Config::tankFullThreshold) {
-        if (!state.alertActive) {
-            Serial.println(F("[Alert] Tank is FULL!"));
-            Alerts::triggerTankFull();
-            state.alertActive = true;
+void trackUsage() {
+    // No reading (sensor missing): nothing to learn from
+    if (state.waterLevelCm >= 0) {
+        UsageTracker::update(state.volumeLiters, PowerManager::now());
+        Forecast::update(UsageTracker::getFiltered(), PowerManager::now());
+    }
+}
+
+bool checkAlerts() {
+    bool queued = AlertEngine::evaluate(state, PowerManager::now());
+    state.alertActive = AlertEngine::anyActive();
+    return queued;
+}
+
+void pushAlertEvents() {
+    AlertEvent events[ALERT_TYPE_COUNT];
+    size_t count = AlertEngine::getPendingEvents(events);
+    
+    // Unsent events stay queued (in RTC memory) for the next report
+    if (count > 0 && DataReporter::sendAlertEvents(events, count, PowerManager::now())) {
+        AlertEngine::clearPendingEvents();
+    }
+}
+
+// ============================================================================
+// Radio-off Batching (RADIO_BATCHING_ENABLED)
+// ============================================================================
+
+void queueMeasurement() {
+    if (batchCount >= BATCH_MAX_SAMPLES) {
+        // Uploads keep failing: move the oldest sample to flash
+        Storage::bufferMeasurement(batch[0]);
+        memmove(batch, batch + 1, (BATCH_MAX_SAMPLES - 1) * sizeof(SystemState));
+        batchCount--;
+    }
+    batch[batchCount++] = state;
+}
+
+void uploadBatch() {
+    unsigned long radioBefore = WifiManager::getRadioOnMs();
+    size_t samples = batchCount;
+    
+    // One radio session: alert events, batch, flash backlog, then OTA
+    state.wifiConnected = WifiManager::wake();
+    if (state.wifiConnected) {
+        state.wifiRssi = WiFi.RSSI();
+        pushAlertEvents();
+        
+        // An unsent rollup window stays open and keeps growing
+        if (DataReporter::sendBatch(batch, batchCount, millis(), Rollup::getWindow())) {
+            DnsCache::printStats();
+            batchCount = 0;
+            Rollup::reset();
+            Storage::flushBuffer();
+        }
+        
+        if (OTAHandler::isUpdatePending() || millis() - state.lastOtaCheck >= OTA_CHECK_INTERVAL_MS) {
+            OTAHandler::checkForUpdate();
+            state.lastOtaCheck = millis();
         }
     }
-    // Check for tank low
-    else if (state.volumeLiters <= Config::tankLowThreshold) {
-        if (!state.alertActive) {
-            Serial.println(F("[Alert] Tank is LOW!"));
-            Alerts::triggerTankLow();
-            state.alertActive = true;
+    
+    WifiManager::sleep();
+    state.wifiConnected = false;
+    
+    unsigned long radioMs = WifiManager::getRadioOnMs() - radioBefore;
+    LOG_INFO("[Power] Radio on %lu ms for %d samples (%lu ms/sample), %.1f%% of uptime",
+        radioMs, samples, samples ? radioMs / samples : radioMs, 100.0f * WifiManager::getRadioOnMs() / millis());
+}
+
+// ============================================================================
+// Rollups (ROLLUP_ENABLED)
+// ============================================================================
+
+#if ROLLUP_ENABLED
+void rollupMeasurement() {
+    if (!Rollup::add(state)) {
+        return;
+    }
+    
+    // Stood out from the previous reading: goes out raw as well. If there
+    // is no room, the window's min/max still carry it.
+#if RADIO_BATCHING_ENABLED
+    queueMeasurement();
+#else
+    if (!holdMeasurement()) {
+        LOG_WARN("[Report] No room for the raw reading");
+    }
+#endif
+}
+
+// One record for all readings since the last report, plus the raw ones
+// that stood out
+void reportRollup() {
+    const RtcRollup* window = Rollup::getWindow();
+    SystemState samples[RTC_PENDING_SAMPLES];
+    size_t count = loadPending(samples);
+    
+    LOG_INFO("[Report] Sending rollup of %u readings...", window->count);
+    
+    if (DataReporter::sendBatch(samples, count, PowerManager::now(), window)) {
+        LOG_INFO("[Report] Data sent successfully");
+        DnsCache::printStats();
+        RtcStore::data().power.pendingCount = 0;
+        Rollup::reset();
+        Storage::flushBuffer();
+    } else {
+        LOG_WARN("[Report] Failed to send, buffering locally");
+        deferMeasurement();
+    }
+}
+#endif
+
+// ============================================================================
+// Relay Leaf (RELAY_ROLE_LEAF)
+// ============================================================================
+
+#if RELAY_ROLE == RELAY_ROLE_LEAF
+// The readings held in RTC memory and this one, as one frame to the
+// gateway. A leaf cannot upload a flash backlog, so once RTC memory is
+// full the oldest held reading gives way.
+void relayMeasurement() {
+    RtcData& rtc = RtcStore::data();
+    SystemState samples[RTC_PENDING_SAMPLES + 1];
+    size_t count = loadPending(samples);
+    samples[count++] = state;
+    
+    Relay::init();
+    if (Relay::send(samples, count, PowerManager::now())) {
+        LOG_INFO("[Relay] Sent %d readings to the gateway", count);
+        rtc.power.pendingCount = 0;
+        return;
+    }
+    
+    if (rtc.power.pendingCount >= RTC_PENDING_SAMPLES) {
+        LOG_WARN("[Relay] Dropping the oldest held reading");
+        memmove(rtc.pending, rtc.pending + 1, (RTC_PENDING_SAMPLES - 1) * sizeof(RtcSample));
+        rtc.power.pendingCount--;
+    }
+    holdMeasurement();
+}
+#endif
+
+// ============================================================================
+// Duty Cycle (DEEP_SLEEP_ENABLED)
+// ============================================================================
+
+void runDutyCycle() {
+    bool resumed = PowerManager::resumedFromSleep();
+    RtcData& rtc = RtcStore::data();
+    
+    if (resumed) {
+        // Readings are retaken below; only timing and RSSI carry over
+        state.lastMeasurement = rtc.power.lastMeasurement;
+        state.lastReport = rtc.power.lastReport;
+        state.lastOtaCheck = rtc.power.lastOtaCheck;
+        state.wifiRssi = rtc.power.wifiRssi;
+        WifiManager::confirmStableBoot();
+    }
+    
+    unsigned long now = PowerManager::now();
+    bool reportDue = !resumed || now - state.lastReport >= Config::reportIntervalMs;
+    
+    // Sleep timing drifted and this wake skipped RF calibration: restart
+    // with the radio before doing any work twice
+    if (reportDue && !PowerManager::radioAvailable()) {
+        PowerManager::restartWithRadio();
+    }
+    
+    // Config holds intervals and thresholds; everything else waits
+    Config::load();
+    Sensor::init();
+    Alerts::init();
+    PowerManager::mark(AWAKE_BOOT);
+    
+    takeMeasurement();
+    state.lastMeasurement = now;
+    trackUsage();
+#if ROLLUP_ENABLED
+    rollupMeasurement();
+#endif
+    bool alertQueued = checkAlerts();
+    PowerManager::mark(AWAKE_SENSOR);
+    
+    // Alert transitions are reported right away: on this wake if it has
+    // the radio, otherwise on an immediate RF-enabled wake
+    bool reportNext = false;
+    if (alertQueued && !reportDue) {
+        if (PowerManager::radioAvailable()) {
+            reportDue = true;
+        } else {
+            reportNext = true;
+            state.lastReport = now - Config::reportIntervalMs;
         }
     }
-    // Check for battery low
-    else if (state.batteryVoltage < Config::batteryLowThreshold) {
-        if (!state.alertActive) {
-            Serial.println(F("[Alert] Battery LOW!"));
-            Alerts::triggerBatteryLow();
-            state.alertActive = true;
+    
+    if (reportDue) {
+#if RELAY_ROLE == RELAY_ROLE_LEAF
+        relayMeasurement();
+#else
+        Storage::init();
+        WifiManager::init();
+        state.wifiConnected = WifiManager::connect(false, !resumed);
+        PowerManager::mark(AWAKE_WIFI);
+        
+        if (state.wifiConnected) {
+            state.wifiRssi = WiFi.RSSI();
+            DataReporter::init();
+            reportData();
+            
+            // SNTP answers in the background; give it a moment so the
+            // clock carried through sleep gets corrected
+            if (TimeSync::syncDue()) {
+                TimeSync::waitForSync(TIME_SYNC_WAIT_MS);
+            }
+            
+            if (OTAHandler::isUpdatePending() || now - state.lastOtaCheck >= OTA_CHECK_INTERVAL_MS) {
+                OTAHandler::checkForUpdate();
+                state.lastOtaCheck = now;
+            }
+        } else {
+            deferMeasurement();
         }
+#endif
+        
+        state.lastReport = now;
+        PowerManager::mark(AWAKE_REPORT);
+    }
+    
+    if (!resumed) {
+        Alerts::playStartupSound();
     }
-    else {
-        state.alertActive = false;
+    
+    // Sleep until the next measurement slot; the radio is only calibrated
+    // on wakes that will report
+    unsigned long elapsed = PowerManager::now() - state.lastMeasurement;
+    unsigned long sleepMs = Config::measurementIntervalMs > elapsed + 100 && !reportNext ?
+        Config::measurementIntervalMs - elapsed : 100;
+    bool radioNext = PowerManager::now() + sleepMs - state.lastReport >= Config::reportIntervalMs;
+    
+    // Let an alert pattern finish; deep sleep would cut it off
+    while (Alerts::isPlaying()) {
+        delay(10);
     }
+    
+    state.wifiConnected = false;
+    rtc.power.lastMeasurement = state.lastMeasurement;
+    rtc.power.lastReport = state.lastReport;
+    rtc.power.lastOtaCheck = state.lastOtaCheck;
+    rtc.power.wifiRssi = state.wifiRssi;
+    PowerManager::sleep(sleepMs, radioNext);
 }
-
@@ -0,0 +1,123 @@
+// Dashboard for the device's local API (see src/modules/local_api.h)
+'use strict';
+
+const STATE_INTERVAL_MS = 5000;
+const HISTORY_INTERVAL_MS = 60000;
+
+const $ = (id) => document.getElementById(id);
+
+function fmt(value, digits, unit) {
+  return value === undefined ? '--' : value.toFixed(digits) + ' ' + unit;
+}
+
+function duration(minutes) {
+  if (minutes >= 2880) return Math.round(minutes / 1440) + ' days';
+  if (minutes >= 120) return Math.round(minutes / 60) + ' h';
+  return Math.round(minutes) + ' min';
+}
+
+function showState(s) {
+  $('device').textContent = s.device_id + ' v' + s.firmware_version;
+  const percent = s.percent === undefined ? 0 : Math.max(0, Math.min(100, s.percent));
+  $('fill').style.height = percent + '%';
+  $('percent').textContent = s.percent === undefined ? '--' : Math.round(s.percent) + '%';
+  $('volume').textContent = fmt(s.volume_l, 0, 'L');
+  $('level').textContent = fmt(s.level_cm, 1, 'cm');
+  $('temperature').textContent = fmt(s.temperature_c, 1, '°C');
+  $('battery').textContent = fmt(s.battery_v, 2, 'V');
+
+  const f = s.forecast;
+  $('flow').textContent = f ? fmt(f.flow_lpm, 1, 'L/min') : '--';
+  if (f && f.time_to_full_min !== undefined) {
+    $('forecast').textContent = 'full in ' + duration(f.time_to_full_min);
+  } else if (f && f.time_to_empty_min !== undefined) {
+    $('forecast').textContent = 'empty in ' + duration(f.time_to_empty_min);
+  } else {
+    $('forecast').textContent = '--';
+  }
+
+  $('channels').innerHTML = '';
+  (s.channels || []).slice(1).forEach((c, i) => {
+    const row = document.createElement('div');
+    row.textContent = 'Tank ' + (i + 2) + ': ' + fmt(c.volume_l, 0, 'L') +
+      (c.percent === undefined ? '' : ' (' + Math.round(c.percent) + '%)');
+    $('channels').appendChild(row);
+  });
+
+  $('alerts').innerHTML = '';
+  s.alerts.forEach((name) => {
+    const tag = document.createElement('span');
+    tag.textContent = name.replace(/_/g, ' ');
+    $('alerts').appendChild(tag);
+  });
+
+  const age = s.age_ms === undefined ? 'no reading yet' : 'reading ' + Math.round(s.age_ms / 1000) + ' s old';
+  $('status').textContent = age + ', WiFi ' + s.rssi + ' dBm' +
+    (s.buffered ? ', ' + s.buffered + ' unsent' : '');
+}
+
+// Binary layout in local_api.h: 12-byte header, then 14-byte records
+function parseHistory(buffer) {
+  const view = new DataView(buffer);
+  if (view.getUint8(0) !== 0x57 || view.getUint8(1) !== 0x48 || view.getUint8(2) !== 1) {
+    throw new Error('unknown history format');
+  }
+  const size = view.getUint8(3);
+  const count = view.getUint16(4, true);
+  const points = [];
+  for (let i = 0, at = 12; i < count; i++, at += size) {
+    points.push({ ageMs: view.getUint32(at, true), volumeL: view.getFloat32(at + 4, true) });
+  }
+  return points;
+}
+
+function drawHistory(points) {
+  const canvas = $('history');
+  const ctx = canvas.getContext('2d');
+  ctx.clearRect(0, 0, canvas.width, canvas.height);
+  if (points.length < 2) return;
+
+  const span = points[0].ageMs || 1;
+  let low = Infinity, high = -Infinity;
+  points.forEach((p) => { low = Math.min(low, p.volumeL); high = Math.max(high, p.volumeL); });
+  if (high - low < 1) { high += 0.5; low -= 0.5; }
+
+  const pad = 20;
+  const x = (p) => pad + (1 - p.ageMs / span) * (canvas.width - 2 * pad);
+  const y = (p) => canvas.height - pad - (p.volumeL - low) / (high - low) * (canvas.height - 2 * pad);
+
+  ctx.strokeStyle = '#3a8ee6';
+  ctx.lineWidth = 2;
+  ctx.beginPath();
+  points.forEach((p, i) => (i ? ctx.lineTo(x(p), y(p)) : ctx.moveTo(x(p), y(p))));
+  ctx.stroke();
+
+  ctx.fillStyle = '#6b7785';
+  ctx.font = '12px system-ui, sans-serif';
+  ctx.fillText(Math.round(high) + ' L', 2, pad - 6);
+  ctx.fillText(Math.round(low) + ' L', 2, canvas.height - 4);
+  ctx.fillText('-' + duration(span / 60000), pad, canvas.height - 4);
+}
+
+async function pollState() {
+  try {
+    const res = await fetch('/api/state');
+    showState(await res.json());
+  } catch (e) {
+    $('status').textContent = 'Device not reachable';
+  }
+  setTimeout(pollState, STATE_INTERVAL_MS);
+}
+
+async function pollHistory() {
+  try {
+    const res = await fetch('/api/history');
+    drawHistory(parseHistory(await res.arrayBuffer()));
+  } catch (e) {
+    // Keep the last chart
+  }
+  setTimeout(pollHistory, HISTORY_INTERVAL_MS);
+}
+
+pollState();
+pollHistory();